@@ -0,0 +1,114 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares exporting documents as JSON with boson::json_writer to calling bsoncxx::to_json on
+// each document and concatenating the results.
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <bsoncxx/json.hpp>
+
+#include <boson/json_writer.hpp>
+#include <boson/mapping_functions.hpp>
+
+class Address {
+   public:
+    std::string street;
+    std::string city;
+    std::int32_t zip;
+
+    template <class Archive>
+    void serialize(Archive& ar) {
+        ar(CEREAL_NVP(street), CEREAL_NVP(city), CEREAL_NVP(zip));
+    }
+};
+
+class Customer {
+   public:
+    std::int64_t id;
+    std::string name;
+    double balance;
+    bool active;
+    std::chrono::system_clock::time_point joined;
+    Address address;
+    std::vector<std::int32_t> orders;
+
+    template <class Archive>
+    void serialize(Archive& ar) {
+        ar(CEREAL_NVP(id), CEREAL_NVP(name), CEREAL_NVP(balance), CEREAL_NVP(active),
+           CEREAL_NVP(joined), CEREAL_NVP(address), CEREAL_NVP(orders));
+    }
+};
+
+template <typename F>
+double time_ms(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main() {
+    const int k_documents = 20000;
+    const int k_rounds = 5;
+
+    std::vector<bsoncxx::document::value> docs;
+    docs.reserve(k_documents);
+    for (int i = 0; i < k_documents; ++i) {
+        Customer c{i,
+                   "Customer \"" + std::to_string(i) + "\"",
+                   i * 1.25,
+                   i % 3 != 0,
+                   std::chrono::system_clock::time_point(std::chrono::hours(24 * (i % 10000))),
+                   {std::to_string(i) + " Main Street", "Springfield", 10000 + i % 90000},
+                   {i, i + 1, i + 2}};
+        docs.push_back(boson::to_document(c));
+    }
+
+    std::size_t to_json_bytes = 0;
+    double to_json_time = time_ms([&]() {
+        for (int round = 0; round < k_rounds; ++round) {
+            std::string out;
+            for (const auto& doc : docs) {
+                out += bsoncxx::to_json(doc.view());
+                out += '\n';
+            }
+            to_json_bytes += out.size();
+        }
+    });
+
+    std::size_t writer_bytes = 0;
+    double writer_time = time_ms([&]() {
+        for (int round = 0; round < k_rounds; ++round) {
+            std::string out;
+            boson::json_writer writer(out);
+            for (const auto& doc : docs) {
+                writer.write(doc.view());
+            }
+            writer.finish();
+            writer_bytes += out.size();
+        }
+    });
+
+    std::cout << k_rounds << " x " << k_documents << " documents" << std::endl;
+    std::cout << "bsoncxx::to_json per document: " << to_json_time << " ms, "
+              << to_json_bytes / k_rounds << " bytes" << std::endl;
+    std::cout << "boson::json_writer:            " << writer_time << " ms, "
+              << writer_bytes / k_rounds << " bytes" << std::endl;
+    std::cout << "speedup: " << to_json_time / writer_time << "x" << std::endl;
+}
@@ -0,0 +1,208 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <boson/config/prelude.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+namespace boson {
+BOSON_INLINE_NAMESPACE_BEGIN
+
+/**
+ * Whether the archivers count the work they do. This is set with the BOSON_ENABLE_ARCHIVE_COUNTERS
+ * CMake option, and every translation unit that includes boson must be built with the same value.
+ * When it is off, the counters are compiled out of the archivers entirely.
+ */
+#if defined(BOSON_ENABLE_ARCHIVE_COUNTERS)
+constexpr bool k_archive_counters_enabled = true;
+#else
+constexpr bool k_archive_counters_enabled = false;
+#endif
+
+/**
+ * The work done by the BSON archivers while serializing or deserializing objects.
+ */
+struct archive_counters {
+    // Pushes on the node stacks of either archive.
+    std::uint64_t stack_pushes = 0;
+
+    // BSONInputArchive: calls to search(), keys compared while looking up fields by name, searches
+    // answered from the result cached by willSearchYieldValue(), and the documents read and bytes
+    // copied by readNextDoc().
+    std::uint64_t searches = 0;
+    std::uint64_t key_comparisons = 0;
+    std::uint64_t cached_search_hits = 0;
+    std::uint64_t documents_read = 0;
+    std::uint64_t bytes_read = 0;
+
+    // BSONOutputArchive: the documents and bytes written by writeDoc(), and the number of times
+    // the builder had to grow its buffer for them.
+    std::uint64_t documents_written = 0;
+    std::uint64_t bytes_written = 0;
+    std::uint64_t builder_reallocations = 0;
+
+    archive_counters& operator+=(const archive_counters& other) {
+        stack_pushes += other.stack_pushes;
+        searches += other.searches;
+        key_comparisons += other.key_comparisons;
+        cached_search_hits += other.cached_search_hits;
+        documents_read += other.documents_read;
+        bytes_read += other.bytes_read;
+        documents_written += other.documents_written;
+        bytes_written += other.bytes_written;
+        builder_reallocations += other.builder_reallocations;
+        return *this;
+    }
+};
+
+namespace details {
+
+/**
+ * The counters held by an archive. The disabled specialization is empty and its methods do
+ * nothing, so that counting costs nothing when BOSON_ENABLE_ARCHIVE_COUNTERS is off.
+ */
+template <bool Enabled>
+class archive_counter_storage {
+   public:
+    void add(std::uint64_t archive_counters::*counter, std::uint64_t n = 1) {
+        _counters.*counter += n;
+    }
+
+    const archive_counters& get() const {
+        return _counters;
+    }
+
+   private:
+    archive_counters _counters;
+};
+
+template <>
+class archive_counter_storage<false> {
+   public:
+    void add(std::uint64_t archive_counters::*, std::uint64_t = 1) {
+    }
+
+    archive_counters get() const {
+        return {};
+    }
+};
+
+/**
+ * Estimates the number of times a bson_t grew its buffer to hold a document of the given length.
+ * libbson keeps documents of up to 120 bytes inline, then allocates a buffer of the next power of
+ * two of at least 128 bytes, and doubles it whenever it runs out of space.
+ */
+inline std::uint64_t estimated_builder_reallocations(std::size_t length) {
+    if (length <= 120) {
+        return 0;
+    }
+    std::uint64_t reallocations = 1;
+    for (std::size_t capacity = 128; capacity < length; capacity *= 2) {
+        ++reallocations;
+    }
+    return reallocations;
+}
+
+/**
+ * The counters of the archives that serialized or deserialized each type, as recorded by the
+ * mapping functions.
+ */
+class archive_counter_registry {
+   public:
+    static archive_counter_registry& instance() {
+        static archive_counter_registry registry;
+        return registry;
+    }
+
+    void record(const std::type_info& type, const archive_counters& counters) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _counters[std::type_index(type)] += counters;
+    }
+
+    archive_counters get(const std::type_info& type) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _counters.find(std::type_index(type));
+        return it == _counters.end() ? archive_counters{} : it->second;
+    }
+
+    std::vector<std::pair<std::string, archive_counters>> all() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<std::pair<std::string, archive_counters>> result;
+        for (const auto& entry : _counters) {
+            result.emplace_back(entry.first.name(), entry.second);
+        }
+        return result;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _counters.clear();
+    }
+
+   private:
+    mutable std::mutex _mutex;
+    std::map<std::type_index, archive_counters> _counters;
+};
+
+}  // namespace details
+
+/**
+ * Adds the counters of an archive to the totals of the type it serialized or deserialized. This
+ * does nothing if the archive counters are disabled.
+ * @tparam T    The type of the root object of the archive.
+ */
+template <class T>
+void record_archive_counters(const archive_counters& counters) {
+    if (k_archive_counters_enabled) {
+        details::archive_counter_registry::instance().record(typeid(T), counters);
+    }
+}
+
+/**
+ * Returns the totals of the counters recorded for a type.
+ */
+template <class T>
+archive_counters archive_counters_for() {
+    return details::archive_counter_registry::instance().get(typeid(T));
+}
+
+/**
+ * Returns the totals of the counters recorded for each type, keyed by the implementation-defined
+ * name of the type, as returned by std::type_info::name().
+ */
+inline std::vector<std::pair<std::string, archive_counters>> archive_counters_by_type() {
+    return details::archive_counter_registry::instance().all();
+}
+
+/**
+ * Discards the counters recorded for all types.
+ */
+inline void reset_archive_counters() {
+    details::archive_counter_registry::instance().reset();
+}
+
+BOSON_INLINE_NAMESPACE_END
+}  // namespace boson
+
+#include <boson/config/postlude.hpp>
@@ -56,6 +56,7 @@
 #include <bsoncxx/types.hpp>
 #include <bsoncxx/types/value.hpp>
 
+#include <boson/archive_counters.hpp>
 #include <boson/stdx/optional.hpp>
 
 // Includes for officially supported STL containers
@@ -195,12 +196,26 @@ class BSONOutputArchive : public cereal::OutputArchive<BSONOutputArchive> {
      * output stream.
      */
     void writeDoc() {
-        _writeStream.write(reinterpret_cast<const char*>(_bsonBuilder.view_document().data()),
-                           _bsonBuilder.view_document().length());
+        auto doc = _bsonBuilder.view_document();
+        _writeStream.write(reinterpret_cast<const char*>(doc.data()), doc.length());
+        if (k_archive_counters_enabled) {
+            _counters.add(&archive_counters::documents_written);
+            _counters.add(&archive_counters::bytes_written, doc.length());
+            _counters.add(&archive_counters::builder_reallocations,
+                          details::estimated_builder_reallocations(doc.length()));
+        }
         _bsonBuilder.clear();
     }
 
    public:
+    /**
+     * Returns the work done by this archive so far. The counters are all zero unless
+     * BOSON_ENABLE_ARCHIVE_COUNTERS is set.
+     */
+    archive_counters counters() const {
+        return _counters.get();
+    }
+
     /**
      * Checks if the most recent object written was in the root of the document.
      * If so, that document is written to the archive.
@@ -222,6 +237,7 @@ class BSONOutputArchive : public cereal::OutputArchive<BSONOutputArchive> {
         writeName(true);
         _nodeTypeStack.push(OutputNodeType::StartObject);
         _curNodeInheritsUnderlyingBSONDataBase.push(inheritsUnderlyingBSONDataBase);
+        _counters.add(&archive_counters::stack_pushes, 2);
     }
 
     /**
@@ -330,6 +346,23 @@ class BSONOutputArchive : public cereal::OutputArchive<BSONOutputArchive> {
         _bsonBuilder.append(std::forward<T>(t));
     }
 
+    /**
+     * Saves binary data to the current node. Unlike saving a b_binary, this does not require the
+     * data to be owned by a class that inherits UnderlyingBSONDataBase, since it is copied into
+     * the document immediately.
+     *
+     * @param subType
+     *    The BSON binary subtype of the data.
+     * @param data
+     *    The data, which needs to remain valid only for the duration of the call.
+     * @param size
+     *    The size of the data in bytes.
+     */
+    void saveBinary(bsoncxx::binary_sub_type subType, const std::uint8_t* data, std::size_t size) {
+        _bsonBuilder.append(
+            bsoncxx::types::b_binary{subType, static_cast<std::uint32_t>(size), data});
+    }
+
     /**
      * Specialization of saveValue for std::chrono::system_clock::time_point,
      * which can't be directly passed to a BSON builder without it first
@@ -464,6 +497,9 @@ class BSONOutputArchive : public cereal::OutputArchive<BSONOutputArchive> {
     // equal to 0, we are not in an array and can write keys in dot notation.
     uint8_t _arrayNestingLevel;
 
+    // The work done by this archive, if BOSON_ENABLE_ARCHIVE_COUNTERS is set.
+    details::archive_counter_storage<k_archive_counters_enabled> _counters;
+
 };  // BSONOutputArchive
 
 class BSONInputArchive : public cereal::InputArchive<BSONInputArchive> {
@@ -518,6 +554,8 @@ class BSONInputArchive : public cereal::InputArchive<BSONInputArchive> {
         // Store the BSON data of the document in a view that we can access.
         _curBsonDoc = bsoncxx::document::view{_curBsonData.get(), static_cast<size_t>(docsize)};
         _curBsonDataSize = docsize;
+        _counters.add(&archive_counters::documents_read);
+        _counters.add(&archive_counters::bytes_read, static_cast<std::uint64_t>(docsize));
 
         // Specify that we've read a document.
         _readFirstDoc = true;
@@ -530,8 +568,11 @@ class BSONInputArchive : public cereal::InputArchive<BSONInputArchive> {
      *         element in that array.
      */
     inline bsoncxx::types::value search() {
+        _counters.add(&archive_counters::searches);
+
         // If our search result is cached, return the cached result instead of repeating the search.
         if (_cachedSearchResult) {
+            _counters.add(&archive_counters::cached_search_hits);
             auto val = *_cachedSearchResult;
             _cachedSearchResult = stdx::nullopt;
             return val;
@@ -556,14 +597,14 @@ class BSONInputArchive : public cereal::InputArchive<BSONInputArchive> {
                 _nodeTypeStack.top() == InputNodeType::InRootElement) {
                 // If we're in an object in the Root (InObject),
                 // look for the key in the current BSON view.
-                const auto& elemFromDoc = _curBsonDoc[nextName];
+                const auto& elemFromDoc = find(_curBsonDoc, nextName);
                 if (elemFromDoc) {
                     return elemFromDoc.get_value();
                 }
             } else if (_nodeTypeStack.top() == InputNodeType::InEmbeddedObject) {
                 // If we're in an embedded object, look for the key in the object
                 // at the top of the embedded object stack.
-                const auto& elemFromDoc = _embeddedBsonDocStack.top()[nextName];
+                const auto& elemFromDoc = find(_embeddedBsonDocStack.top(), nextName);
                 if (elemFromDoc) {
                     return elemFromDoc.get_value();
                 }
@@ -594,6 +635,42 @@ class BSONInputArchive : public cereal::InputArchive<BSONInputArchive> {
         throw boson::Exception("Missing name for element search.");
     }
 
+    /**
+     * Looks up a key in a document. This is what document::view::operator[] does, except that
+     * the keys compared are counted if BOSON_ENABLE_ARCHIVE_COUNTERS is set.
+     */
+    bsoncxx::document::element find(const bsoncxx::document::view& doc, const char* name) {
+        if (!k_archive_counters_enabled) {
+            return doc[name];
+        }
+        bsoncxx::stdx::string_view key{name};
+        for (auto&& elem : doc) {
+            _counters.add(&archive_counters::key_comparisons);
+            if (elem.key() == key) {
+                return elem;
+            }
+        }
+        return {};
+    }
+
+    /**
+     * Pushes a value on one of the node stacks.
+     */
+    template <class Stack, class Value>
+    void push(Stack& stack, Value&& value) {
+        _counters.add(&archive_counters::stack_pushes);
+        stack.push(std::forward<Value>(value));
+    }
+
+   public:
+    /**
+     * Returns the work done by this archive so far. The counters are all zero unless
+     * BOSON_ENABLE_ARCHIVE_COUNTERS is set.
+     */
+    archive_counters counters() const {
+        return _counters.get();
+    }
+
    public:
     /**
      * Checks if the next invocation of search() will yield a value. Used to check if a particular
@@ -629,10 +706,10 @@ class BSONInputArchive : public cereal::InputArchive<BSONInputArchive> {
 
             if (_nodeTypeStack.top() == InputNodeType::InObject ||
                 _nodeTypeStack.top() == InputNodeType::InRootElement) {
-                val = _curBsonDoc[nextName];
+                val = find(_curBsonDoc, nextName);
 
             } else {
-                val = _embeddedBsonDocStack.top()[nextName];
+                val = find(_embeddedBsonDocStack.top(), nextName);
             }
 
             if (val) {
@@ -653,7 +730,7 @@ class BSONInputArchive : public cereal::InputArchive<BSONInputArchive> {
     bool startRootElementIfRoot() {
         if (_nodeTypeStack.empty()) {
             readNextDoc();
-            _nodeTypeStack.push(InputNodeType::InRootElement);
+            push(_nodeTypeStack, InputNodeType::InRootElement);
             return true;
         }
         return false;
@@ -682,21 +759,21 @@ class BSONInputArchive : public cereal::InputArchive<BSONInputArchive> {
             // If there is a name, the new node is loading a BSON document or array as a root
             // element.
             if (_nextName) {
-                _nodeTypeStack.push(InputNodeType::InRootElement);
+                push(_nodeTypeStack, InputNodeType::InRootElement);
                 auto newNode = search();
 
                 if (newNode.type() == bsoncxx::type::k_array) {
-                    _embeddedBsonArrayStack.push(newNode.get_array().value);
-                    _embeddedBsonArrayIteratorStack.push(_embeddedBsonArrayStack.top().begin());
-                    _nodeTypeStack.push(InputNodeType::InEmbeddedArray);
+                    push(_embeddedBsonArrayStack, newNode.get_array().value);
+                    push(_embeddedBsonArrayIteratorStack, _embeddedBsonArrayStack.top().begin());
+                    push(_nodeTypeStack, InputNodeType::InEmbeddedArray);
                 } else if (newNode.type() == bsoncxx::type::k_document) {
-                    _embeddedBsonDocStack.push(newNode.get_document().value);
-                    _nodeTypeStack.push(InputNodeType::InEmbeddedObject);
+                    push(_embeddedBsonDocStack, newNode.get_document().value);
+                    push(_nodeTypeStack, InputNodeType::InEmbeddedObject);
                 } else {
                     throw boson::Exception("Node requested is neither document nor array.");
                 }
             } else {
-                _nodeTypeStack.push(InputNodeType::InObject);
+                push(_nodeTypeStack, InputNodeType::InObject);
             }
         } else {
             // If we're not in the root node, match the next key to an embedded document
@@ -706,12 +783,12 @@ class BSONInputArchive : public cereal::InputArchive<BSONInputArchive> {
             auto newNode = search();
 
             if (newNode.type() == bsoncxx::type::k_document) {
-                _embeddedBsonDocStack.push(newNode.get_document().value);
-                _nodeTypeStack.push(InputNodeType::InEmbeddedObject);
+                push(_embeddedBsonDocStack, newNode.get_document().value);
+                push(_nodeTypeStack, InputNodeType::InEmbeddedObject);
             } else if (newNode.type() == bsoncxx::type::k_array) {
-                _embeddedBsonArrayStack.push(newNode.get_array().value);
-                _embeddedBsonArrayIteratorStack.push(_embeddedBsonArrayStack.top().begin());
-                _nodeTypeStack.push(InputNodeType::InEmbeddedArray);
+                push(_embeddedBsonArrayStack, newNode.get_array().value);
+                push(_embeddedBsonArrayIteratorStack, _embeddedBsonArrayStack.top().begin());
+                push(_nodeTypeStack, InputNodeType::InEmbeddedArray);
             } else {
                 throw boson::Exception("Node requested is neither document nor array.");
             }
@@ -834,6 +911,17 @@ class BSONInputArchive : public cereal::InputArchive<BSONInputArchive> {
             std::chrono::milliseconds{bsonVal.get_date().value});
     }
 
+    /**
+     * Loads the BSON value of the current node as is, for types that accept values of more than
+     * one BSON type. The value is a view into the current document, so it must be copied if it
+     * needs to outlive the next document read by the archive.
+     *
+     * @return The BSON value of the current node.
+     */
+    bsoncxx::types::value loadRawValue() {
+        return search();
+    }
+
     /**
      * Loads a BSON UTF-8 value from the current node and puts it into a std::string.
      *
@@ -923,6 +1011,9 @@ class BSONInputArchive : public cereal::InputArchive<BSONInputArchive> {
     // A stack maintaining the state of the node currently being worked on.
     std::stack<InputNodeType> _nodeTypeStack;
 
+    // The work done by this archive, if BOSON_ENABLE_ARCHIVE_COUNTERS is set.
+    details::archive_counter_storage<k_archive_counters_enabled> _counters;
+
 };  // BSONInputArchive
 
 // ######################################################################
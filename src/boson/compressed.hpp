@@ -0,0 +1,409 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <boson/config/prelude.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <bsoncxx/types.hpp>
+#include <bsoncxx/types/value.hpp>
+
+#include <boson/bson_archiver.hpp>
+#include <boson/stdx/optional.hpp>
+
+namespace boson {
+BOSON_INLINE_NAMESPACE_BEGIN
+
+// The size, in bytes, from which compressed fields are compressed by default.
+constexpr std::size_t k_default_compression_threshold = 1024;
+
+namespace details {
+
+// Compressed fields are stored as BSON binary data of the user-defined subtype, made of a codec
+// byte, the uncompressed size as a little-endian 32-bit integer, and the compressed data.
+constexpr std::uint8_t k_lz_codec = 1;
+constexpr std::size_t k_compressed_header_size = 5;
+
+// Parameters of the LZ4 block format, which the codec below produces: matches are at least 4
+// bytes long and at most 65535 bytes back, the last 5 bytes of the input are always literals, and
+// the last match starts at least 12 bytes before the end of the input.
+constexpr std::size_t k_lz_min_match = 4;
+constexpr std::size_t k_lz_max_offset = 65535;
+constexpr std::size_t k_lz_last_literals = 5;
+constexpr std::size_t k_lz_match_limit = 12;
+constexpr unsigned k_lz_hash_bits = 12;
+
+inline std::uint32_t lz_read32(const std::uint8_t* p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void lz_write_length(std::vector<std::uint8_t>& out, std::size_t length) {
+    while (length >= 255) {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(static_cast<std::uint8_t>(length));
+}
+
+inline void lz_write_sequence(std::vector<std::uint8_t>& out, const std::uint8_t* literals,
+                              std::size_t literal_length, std::size_t offset,
+                              std::size_t match_length) {
+    std::size_t match_code = match_length ? match_length - k_lz_min_match : 0;
+    out.push_back(static_cast<std::uint8_t>((std::min<std::size_t>(literal_length, 15) << 4) |
+                                            std::min<std::size_t>(match_code, 15)));
+    if (literal_length >= 15) {
+        lz_write_length(out, literal_length - 15);
+    }
+    out.insert(out.end(), literals, literals + literal_length);
+    if (match_length == 0) {
+        return;
+    }
+    out.push_back(static_cast<std::uint8_t>(offset & 0xff));
+    out.push_back(static_cast<std::uint8_t>(offset >> 8));
+    if (match_code >= 15) {
+        lz_write_length(out, match_code - 15);
+    }
+}
+
+/**
+ * Compresses data into an LZ4 block, with a greedy search for matches over a hash table of the
+ * last position of each 4-byte sequence. This favours speed over compression ratio, which suits
+ * text fields that are compressed on every save.
+ */
+inline std::vector<std::uint8_t> lz_compress(const std::uint8_t* src, std::size_t size) {
+    std::vector<std::uint8_t> out;
+    out.reserve(size / 2 + 16);
+    std::vector<std::uint32_t> table(std::size_t{1} << k_lz_hash_bits, 0);
+
+    std::size_t anchor = 0;
+    std::size_t i = 0;
+    std::size_t limit = size > k_lz_match_limit ? size - k_lz_match_limit : 0;
+    while (i < limit) {
+        std::uint32_t sequence = lz_read32(src + i);
+        std::uint32_t hash = (sequence * 2654435761u) >> (32 - k_lz_hash_bits);
+        std::size_t candidate = table[hash];
+        table[hash] = static_cast<std::uint32_t>(i);
+
+        if (candidate < i && i - candidate <= k_lz_max_offset &&
+            lz_read32(src + candidate) == sequence) {
+            std::size_t length = k_lz_min_match;
+            while (i + length < size - k_lz_last_literals &&
+                   src[candidate + length] == src[i + length]) {
+                ++length;
+            }
+            lz_write_sequence(out, src + anchor, i - anchor, i - candidate, length);
+            i += length;
+            anchor = i;
+        } else {
+            ++i;
+        }
+    }
+    lz_write_sequence(out, src + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+inline std::size_t lz_read_length(const std::uint8_t* src, std::size_t size, std::size_t& pos) {
+    std::size_t length = 0;
+    std::uint8_t byte;
+    do {
+        if (pos >= size) {
+            throw boson::Exception("Compressed field is truncated.");
+        }
+        byte = src[pos++];
+        length += byte;
+    } while (byte == 255);
+    return length;
+}
+
+/**
+ * Decompresses an LZ4 block into a buffer of the given size. Corrupt input is detected before it
+ * is read or written out of bounds, and throws a boson::Exception.
+ */
+inline void lz_decompress(const std::uint8_t* src, std::size_t size, std::uint8_t* dst,
+                          std::size_t dst_size) {
+    std::size_t ip = 0;
+    std::size_t op = 0;
+    while (ip < size) {
+        std::uint8_t token = src[ip++];
+
+        std::size_t literal_length = token >> 4;
+        if (literal_length == 15) {
+            literal_length += lz_read_length(src, size, ip);
+        }
+        if (literal_length > size - ip || literal_length > dst_size - op) {
+            throw boson::Exception("Compressed field is corrupt.");
+        }
+        std::memcpy(dst + op, src + ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+        if (ip == size) {
+            break;
+        }
+
+        if (size - ip < 2) {
+            throw boson::Exception("Compressed field is truncated.");
+        }
+        std::size_t offset = src[ip] | (static_cast<std::size_t>(src[ip + 1]) << 8);
+        ip += 2;
+        std::size_t match_length = token & 15;
+        if (match_length == 15) {
+            match_length += lz_read_length(src, size, ip);
+        }
+        match_length += k_lz_min_match;
+        if (offset == 0 || offset > op || match_length > dst_size - op) {
+            throw boson::Exception("Compressed field is corrupt.");
+        }
+        // Matches may overlap the bytes they produce, so they are copied byte by byte.
+        for (std::size_t j = 0; j < match_length; ++j, ++op) {
+            dst[op] = dst[op - offset];
+        }
+    }
+    if (op != dst_size) {
+        throw boson::Exception("Compressed field is truncated.");
+    }
+}
+
+/**
+ * Compresses data and prepends the header of a compressed field.
+ * @return The stored form of the data, or an empty vector if compression does not make it
+ *         smaller.
+ */
+inline std::vector<std::uint8_t> compress_field(const std::uint8_t* data, std::size_t size) {
+    if (size > std::numeric_limits<std::uint32_t>::max()) {
+        return {};
+    }
+    auto payload = lz_compress(data, size);
+    if (payload.size() + k_compressed_header_size >= size) {
+        return {};
+    }
+    std::vector<std::uint8_t> stored;
+    stored.reserve(payload.size() + k_compressed_header_size);
+    stored.push_back(k_lz_codec);
+    for (int shift = 0; shift < 32; shift += 8) {
+        stored.push_back(static_cast<std::uint8_t>(size >> shift));
+    }
+    stored.insert(stored.end(), payload.begin(), payload.end());
+    return stored;
+}
+
+/**
+ * Decompresses the stored form of a compressed field into a string or a vector of bytes.
+ */
+template <class T>
+T decompress_field(const std::vector<std::uint8_t>& stored) {
+    if (stored.size() < k_compressed_header_size || stored[0] != k_lz_codec) {
+        throw boson::Exception("Compressed field has an unknown format.");
+    }
+    std::size_t size = 0;
+    for (int i = 0; i < 4; ++i) {
+        size |= static_cast<std::size_t>(stored[1 + i]) << (8 * i);
+    }
+    // A byte of an LZ4 block expands to at most 255 bytes, so a larger size means corrupt data
+    // and must not be allocated.
+    std::size_t payload_size = stored.size() - k_compressed_header_size;
+    if (size / 255 > payload_size) {
+        throw boson::Exception("Compressed field is corrupt.");
+    }
+    T value(size, 0);
+    lz_decompress(stored.data() + k_compressed_header_size, payload_size,
+                  size ? reinterpret_cast<std::uint8_t*>(&value[0]) : nullptr, size);
+    return value;
+}
+
+// Uncompressed values are stored as the BSON type that they would have without compression.
+inline void save_uncompressed(BSONOutputArchive& ar, const std::string& value) {
+    ar.saveValue(value);
+}
+
+inline void save_uncompressed(BSONOutputArchive& ar, const std::vector<std::uint8_t>& value) {
+    ar.saveBinary(bsoncxx::binary_sub_type::k_binary, value.data(), value.size());
+}
+
+inline void load_uncompressed(const bsoncxx::types::value& v, std::string& value) {
+    if (v.type() != bsoncxx::type::k_utf8) {
+        throw boson::Exception("Compressed string field holds neither a string nor binary data.");
+    }
+    value = v.get_utf8().value.to_string();
+}
+
+inline void load_uncompressed(const bsoncxx::types::value& v, std::vector<std::uint8_t>& value) {
+    if (v.type() != bsoncxx::type::k_binary) {
+        throw boson::Exception("Compressed binary field does not hold binary data.");
+    }
+    value.assign(v.get_binary().bytes, v.get_binary().bytes + v.get_binary().size);
+}
+
+}  // namespace details
+
+/**
+ * A string or binary field that is compressed when it is serialized, if it is at least
+ * Threshold bytes long and compression makes it smaller. Compressed values are stored as BSON
+ * binary data of the user-defined subtype, and other values as a string or binary data, so that
+ * existing documents can be read as compressed fields.
+ *
+ * A deserialized value is only decompressed when it is first accessed, and it is saved again
+ * without being recompressed if it was not modified. The first access is not thread-safe, even
+ * through a const reference. Saving never modifies the field, so a field may be saved by several
+ * threads at once.
+ *
+ * @tparam T            std::string or std::vector<std::uint8_t>.
+ * @tparam Threshold    The size, in bytes, from which the value is compressed.
+ */
+template <class T, std::size_t Threshold = k_default_compression_threshold>
+class compressed {
+    static_assert(std::is_same<T, std::string>::value ||
+                      std::is_same<T, std::vector<std::uint8_t>>::value,
+                  "compressed fields must be std::string or std::vector<std::uint8_t>");
+
+   public:
+    using value_type = T;
+
+    compressed() : _value(T{}) {
+    }
+
+    compressed(T value) : _value(std::move(value)) {
+    }
+
+    compressed& operator=(T value) {
+        _value = std::move(value);
+        _stored.clear();
+        return *this;
+    }
+
+    /**
+     * Returns the value, decompressing it if this is its first access.
+     */
+    const T& get() const {
+        if (!_value) {
+            _value = details::decompress_field<T>(_stored);
+        }
+        return *_value;
+    }
+
+    /**
+     * Returns the value for modification. The value will be compressed again when it is saved.
+     */
+    T& get() {
+        static_cast<const compressed&>(*this).get();
+        _stored.clear();
+        return *_value;
+    }
+
+    const T& operator*() const {
+        return get();
+    }
+
+    T& operator*() {
+        return get();
+    }
+
+    const T* operator->() const {
+        return &get();
+    }
+
+    T* operator->() {
+        return &get();
+    }
+
+    /**
+     * Returns whether the value is held uncompressed, i.e. whether it was set, accessed, or was
+     * not compressed when it was loaded.
+     */
+    bool is_decompressed() const {
+        return static_cast<bool>(_value);
+    }
+
+    /**
+     * Returns whether the value is held compressed, i.e. whether it was loaded compressed and
+     * has not been modified since.
+     */
+    bool is_compressed() const {
+        return !_stored.empty();
+    }
+
+    friend void prologue(BSONOutputArchive& ar, const compressed&) {
+        ar.writeName();
+    }
+
+    friend void epilogue(BSONOutputArchive& ar, const compressed&) {
+        ar.writeDocIfRoot();
+    }
+
+    friend void prologue(BSONInputArchive& ar, const compressed&) {
+        ar.startRootElementIfRoot();
+    }
+
+    friend void epilogue(BSONInputArchive& ar, const compressed&) {
+        ar.finishRootElementIfRootElement();
+    }
+
+    friend void CEREAL_SAVE_FUNCTION_NAME(BSONOutputArchive& ar, const compressed& field) {
+        if (!field._stored.empty()) {
+            ar.saveBinary(bsoncxx::binary_sub_type::k_user, field._stored.data(),
+                          field._stored.size());
+            return;
+        }
+
+        // The compressed value is not kept, since this may be called on several threads at once.
+        std::vector<std::uint8_t> stored;
+        if (field._value->size() >= Threshold) {
+            stored = details::compress_field(
+                reinterpret_cast<const std::uint8_t*>(field._value->data()), field._value->size());
+        }
+        if (stored.empty()) {
+            details::save_uncompressed(ar, *field._value);
+        } else {
+            ar.saveBinary(bsoncxx::binary_sub_type::k_user, stored.data(), stored.size());
+        }
+    }
+
+    friend void CEREAL_LOAD_FUNCTION_NAME(BSONInputArchive& ar, compressed& field) {
+        auto v = ar.loadRawValue();
+        if (v.type() == bsoncxx::type::k_binary &&
+            v.get_binary().sub_type == bsoncxx::binary_sub_type::k_user) {
+            const auto& binary = v.get_binary();
+            field._stored.assign(binary.bytes, binary.bytes + binary.size);
+            field._value = stdx::nullopt;
+        } else {
+            T value;
+            details::load_uncompressed(v, value);
+            field._value = std::move(value);
+            field._stored.clear();
+        }
+    }
+
+   private:
+    // The uncompressed value, unless it was loaded compressed and has not been accessed yet.
+    mutable stdx::optional<T> _value;
+
+    // The stored form of the value, if it was loaded compressed and has not been modified since.
+    std::vector<std::uint8_t> _stored;
+};
+
+BOSON_INLINE_NAMESPACE_END
+}  // namespace boson
+
+#include <boson/config/postlude.hpp>
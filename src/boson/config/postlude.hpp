@@ -34,6 +34,8 @@
 #pragma pop_macro("BOSON_POLY_USE_SYSTEM_MNMLSTC")
 #undef BOSON_POLY_USE_BOOST
 #pragma pop_macro("BOSON_POLY_USE_BOOST")
+#undef BOSON_ENABLE_ARCHIVE_COUNTERS
+#pragma pop_macro("BOSON_ENABLE_ARCHIVE_COUNTERS")
 
 // src/boson/config/version.hpp.in
 #undef BOSON_VERSION_EXTRA
@@ -31,6 +31,8 @@
 #undef BOSON_POLY_USE_SYSTEM_MNMLSTC
 #pragma push_macro("BOSON_POLY_USE_BOOST")
 #undef BOSON_POLY_USE_BOOST
+#pragma push_macro("BOSON_ENABLE_ARCHIVE_COUNTERS")
+#undef BOSON_ENABLE_ARCHIVE_COUNTERS
 
 // src/boson/config/version.hpp.in
 #pragma push_macro("BOSON_VERSION_EXTRA")
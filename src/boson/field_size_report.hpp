@@ -0,0 +1,202 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <boson/config/prelude.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <bsoncxx/array/view.hpp>
+#include <bsoncxx/document/element.hpp>
+#include <bsoncxx/document/view.hpp>
+#include <bsoncxx/types.hpp>
+
+#include <boson/mapping_functions.hpp>
+
+namespace boson {
+BOSON_INLINE_NAMESPACE_BEGIN
+
+/**
+ * The encoded size of one field path over a sample of documents. The size of a field is the size
+ * of its whole BSON element, i.e. its type byte, its key and its value, so the size of an
+ * embedded document or array includes the sizes of its children.
+ */
+struct field_size {
+    // The dotted path of the field. The elements of an array are reported together, under the
+    // path of the array followed by "[]", e.g. "tags[]" or "tags[].name".
+    std::string path;
+
+    // The number of documents of the sample in which the field appears.
+    std::size_t documents = 0;
+
+    // The total size of the field over the sample, and its mean and 99th percentile per document.
+    // Documents in which the field does not appear count as 0 bytes.
+    std::uint64_t total_bytes = 0;
+    double mean_bytes = 0;
+    std::uint64_t p99_bytes = 0;
+
+    // The fraction of the total size of the sampled documents taken by the field.
+    double share = 0;
+};
+
+/**
+ * The encoded sizes of the fields of a sample of documents, as returned by field_size_report().
+ */
+struct field_size_summary {
+    // The number of sampled documents, and their total, mean and 99th percentile size.
+    std::size_t documents = 0;
+    std::uint64_t total_bytes = 0;
+    double mean_bytes = 0;
+    std::uint64_t p99_bytes = 0;
+
+    // The fields of the documents, ordered by path, so that a field follows its parent.
+    std::vector<field_size> fields;
+
+    /**
+     * Writes the report as a table, with the fields indented under their parents.
+     */
+    void write(std::ostream& os) const {
+        os << "documents: " << documents << ", mean size: " << std::fixed << std::setprecision(1)
+           << mean_bytes << " bytes, p99 size: " << p99_bytes << " bytes\n";
+        os << std::left << std::setw(40) << "field" << std::right << std::setw(12) << "mean"
+           << std::setw(12) << "p99" << std::setw(10) << "share" << std::setw(12) << "present"
+           << "\n";
+        for (const auto& field : fields) {
+            auto depth = std::count(field.path.begin(), field.path.end(), '.') +
+                         std::count(field.path.begin(), field.path.end(), '[');
+            auto name = std::string(2 * depth, ' ') + field.path;
+            os << std::left << std::setw(40) << name << std::right << std::setw(12)
+               << field.mean_bytes << std::setw(12) << field.p99_bytes << std::setw(9)
+               << field.share * 100 << "%" << std::setw(12) << field.documents << "\n";
+        }
+    }
+};
+
+namespace details {
+
+/**
+ * Returns the value at the 99th percentile of some values, with the nearest-rank method.
+ */
+inline std::uint64_t p99(std::vector<std::uint64_t> values) {
+    if (values.empty()) {
+        return 0;
+    }
+    auto rank = static_cast<std::size_t>(std::ceil(0.99 * values.size()));
+    auto nth = values.begin() + (std::max<std::size_t>(rank, 1) - 1);
+    std::nth_element(values.begin(), nth, values.end());
+    return *nth;
+}
+
+/**
+ * Adds the size of each element of a document or array, and of their children, to the total of
+ * its path. The size of an element is the distance from its offset to the offset of the next
+ * element, or to the terminating null byte of the enclosing document.
+ */
+template <class View>
+void add_field_sizes(View view, const std::string& prefix, bool in_array,
+                     std::map<std::string, std::uint64_t>& sizes) {
+    auto end = view.end();
+    for (auto it = view.begin(); it != end;) {
+        bsoncxx::document::element elem = *it;
+        ++it;
+        auto next = it == end ? static_cast<std::uint32_t>(view.length() - 1) : it->offset();
+
+        std::string path;
+        if (in_array) {
+            path = prefix + "[]";
+        } else if (prefix.empty()) {
+            path = elem.key().to_string();
+        } else {
+            path = prefix + "." + elem.key().to_string();
+        }
+        sizes[path] += next - elem.offset();
+
+        if (elem.type() == bsoncxx::type::k_document) {
+            add_field_sizes(elem.get_document().value, path, false, sizes);
+        } else if (elem.type() == bsoncxx::type::k_array) {
+            add_field_sizes(elem.get_array().value, path, true, sizes);
+        }
+    }
+}
+
+}  // namespace details
+
+/**
+ * Serializes a sample of objects and reports the encoded size of each of their fields, in order
+ * to find the fields that make documents large.
+ *
+ * @tparam T        A type that is serializable to BSON using a BSONArchiver.
+ * @param  sample   A range of objects of type T.
+ * @return The sizes of the documents and of each of their fields.
+ */
+template <class T, class Range>
+field_size_summary field_size_report(const Range& sample) {
+    field_size_summary summary;
+    std::vector<std::uint64_t> document_sizes;
+    // The size of each path in each document, indexed by the position of the document.
+    std::map<std::string, std::vector<std::uint64_t>> path_sizes;
+
+    for (const T& obj : sample) {
+        auto doc = to_document(obj);
+        std::map<std::string, std::uint64_t> sizes;
+        details::add_field_sizes(doc.view(), "", false, sizes);
+        for (const auto& entry : sizes) {
+            auto& values = path_sizes[entry.first];
+            values.resize(document_sizes.size() + 1);
+            values.back() = entry.second;
+        }
+        document_sizes.push_back(doc.view().length());
+    }
+
+    summary.documents = document_sizes.size();
+    if (summary.documents == 0) {
+        return summary;
+    }
+    for (auto size : document_sizes) {
+        summary.total_bytes += size;
+    }
+    summary.mean_bytes = static_cast<double>(summary.total_bytes) / summary.documents;
+    summary.p99_bytes = details::p99(document_sizes);
+
+    for (auto& entry : path_sizes) {
+        auto& values = entry.second;
+        values.resize(summary.documents);
+
+        field_size field;
+        field.path = entry.first;
+        for (auto size : values) {
+            field.documents += size > 0;
+            field.total_bytes += size;
+        }
+        field.mean_bytes = static_cast<double>(field.total_bytes) / summary.documents;
+        field.p99_bytes = details::p99(std::move(values));
+        field.share = static_cast<double>(field.total_bytes) / summary.total_bytes;
+        summary.fields.push_back(std::move(field));
+    }
+    return summary;
+}
+
+BOSON_INLINE_NAMESPACE_END
+}  // namespace boson
+
+#include <boson/config/postlude.hpp>
@@ -0,0 +1,214 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <boson/config/prelude.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+#include <bsoncxx/stdx/string_view.hpp>
+#include <bsoncxx/types.hpp>
+#include <bsoncxx/types/value.hpp>
+
+#include <boson/bson_archiver.hpp>
+
+namespace boson {
+BOSON_INLINE_NAMESPACE_BEGIN
+
+/**
+ * A set of strings that are stored once, and never freed, so that equal strings can share a
+ * single copy. It is split into shards with a lock each, so that threads decoding documents
+ * concurrently rarely wait on each other.
+ */
+class intern_table {
+   public:
+    /**
+     * Returns the table used by interned_string.
+     */
+    static intern_table& global() {
+        static intern_table table;
+        return table;
+    }
+
+    /**
+     * Returns the copy of a string held by the table, adding it if needed. Looking up a string
+     * that is already in the table does not allocate.
+     */
+    const std::string* intern(bsoncxx::stdx::string_view str) {
+        auto hash = hash_string(str);
+        auto& shard = _shards[hash % k_shard_count];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.strings.find(str);
+        if (it != shard.strings.end()) {
+            return it->second.get();
+        }
+        std::unique_ptr<std::string> copy(new std::string(str.data(), str.size()));
+        const std::string* result = copy.get();
+        // The key views the copy, which does not move when the map rehashes.
+        shard.strings.emplace(bsoncxx::stdx::string_view(*result), std::move(copy));
+        return result;
+    }
+
+    /**
+     * Returns the number of distinct strings in the table.
+     */
+    std::size_t size() const {
+        std::size_t size = 0;
+        for (const auto& shard : _shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            size += shard.strings.size();
+        }
+        return size;
+    }
+
+   private:
+    static constexpr std::size_t k_shard_count = 16;
+
+    // FNV-1a, since std::hash is not available for every string_view that bsoncxx may use.
+    static std::size_t hash_string(bsoncxx::stdx::string_view str) {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (char c : str) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+        return static_cast<std::size_t>(hash ^ (hash >> 32));
+    }
+
+    struct hasher {
+        std::size_t operator()(bsoncxx::stdx::string_view str) const {
+            return hash_string(str);
+        }
+    };
+
+    struct shard {
+        mutable std::mutex mutex;
+        std::unordered_map<bsoncxx::stdx::string_view, std::unique_ptr<std::string>, hasher>
+            strings;
+    };
+
+    std::array<shard, k_shard_count> _shards;
+};
+
+/**
+ * A string field whose value is shared with all other interned_strings of the same value, through
+ * intern_table::global(). This is meant for fields with few distinct values, such as statuses or
+ * country codes, so that large result sets do not hold a copy of the same string per object.
+ *
+ * An interned_string is the size of a pointer, is serialized as a BSON string, and compares equal
+ * to another one in constant time. Since interned strings are never freed, it should not be used
+ * for fields that can take arbitrarily many values.
+ */
+class interned_string {
+   public:
+    interned_string() : interned_string(bsoncxx::stdx::string_view{}) {
+    }
+
+    interned_string(bsoncxx::stdx::string_view str) : _str(intern_table::global().intern(str)) {
+    }
+
+    interned_string(const std::string& str)
+        : interned_string(bsoncxx::stdx::string_view{str.data(), str.size()}) {
+    }
+
+    interned_string(const char* str) : interned_string(bsoncxx::stdx::string_view{str}) {
+    }
+
+    const std::string& get() const {
+        return *_str;
+    }
+
+    const std::string& operator*() const {
+        return *_str;
+    }
+
+    const std::string* operator->() const {
+        return _str;
+    }
+
+    operator const std::string&() const {
+        return *_str;
+    }
+
+    friend bool operator==(const interned_string& a, const interned_string& b) {
+        return a._str == b._str;
+    }
+
+    friend bool operator!=(const interned_string& a, const interned_string& b) {
+        return a._str != b._str;
+    }
+
+    friend bool operator<(const interned_string& a, const interned_string& b) {
+        return *a._str < *b._str;
+    }
+
+    friend bool operator>(const interned_string& a, const interned_string& b) {
+        return b < a;
+    }
+
+    friend bool operator<=(const interned_string& a, const interned_string& b) {
+        return !(b < a);
+    }
+
+    friend bool operator>=(const interned_string& a, const interned_string& b) {
+        return !(a < b);
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const interned_string& str) {
+        return os << *str._str;
+    }
+
+    friend void prologue(BSONOutputArchive& ar, const interned_string&) {
+        ar.writeName();
+    }
+
+    friend void epilogue(BSONOutputArchive& ar, const interned_string&) {
+        ar.writeDocIfRoot();
+    }
+
+    friend void prologue(BSONInputArchive& ar, const interned_string&) {
+        ar.startRootElementIfRoot();
+    }
+
+    friend void epilogue(BSONInputArchive& ar, const interned_string&) {
+        ar.finishRootElementIfRootElement();
+    }
+
+    friend void CEREAL_SAVE_FUNCTION_NAME(BSONOutputArchive& ar, const interned_string& str) {
+        ar.saveValue(*str._str);
+    }
+
+    // The string is interned straight from the document, without an intermediate copy.
+    friend void CEREAL_LOAD_FUNCTION_NAME(BSONInputArchive& ar, interned_string& str) {
+        auto v = ar.loadRawValue();
+        if (v.type() != bsoncxx::type::k_utf8) {
+            throw boson::Exception("Interned string field does not hold a string.");
+        }
+        str._str = intern_table::global().intern(v.get_utf8().value);
+    }
+
+   private:
+    const std::string* _str;
+};
+
+BOSON_INLINE_NAMESPACE_END
+}  // namespace boson
+
+#include <boson/config/postlude.hpp>
@@ -0,0 +1,660 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <boson/config/prelude.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <bsoncxx/array/view.hpp>
+#include <bsoncxx/decimal128.hpp>
+#include <bsoncxx/document/element.hpp>
+#include <bsoncxx/document/view.hpp>
+#include <bsoncxx/oid.hpp>
+#include <bsoncxx/stdx/string_view.hpp>
+#include <bsoncxx/types.hpp>
+
+#include <boson/bson_archiver.hpp>
+
+namespace boson {
+BOSON_INLINE_NAMESPACE_BEGIN
+
+/**
+ * The flavor of MongoDB Extended JSON written by a json_writer. Relaxed mode writes numbers and
+ * recent dates as plain JSON, while canonical mode preserves the exact BSON type of every value.
+ *
+ * @see https://github.com/mongodb/specifications/blob/master/source/extended-json.rst
+ */
+enum class json_mode { k_relaxed, k_canonical };
+
+/**
+ * How a json_writer separates the documents it writes: one document per line (JSON Lines), or as
+ * the elements of a single JSON array.
+ */
+enum class json_framing { k_lines, k_array };
+
+/**
+ * Writes BSON documents as Extended JSON, e.g. to export the results of a query. Rather than
+ * creating a string per document, the writer walks the elements of each document and appends
+ * them to one buffer, which is either a string given by the caller or a buffer that is flushed to
+ * an output stream whenever it grows past k_flush_size.
+ *
+ * The output is compact, i.e. it has no whitespace between tokens. Strings are assumed to be
+ * valid UTF-8, and are written as is except for the characters that JSON requires to be escaped.
+ */
+class json_writer {
+   public:
+    // The size past which a writer that outputs to a stream flushes its buffer.
+    static constexpr std::size_t k_flush_size = 1 << 16;
+
+    /**
+     * Creates a writer that writes to an output stream. The output is only complete once
+     * finish() is called, or once the writer is destroyed.
+     */
+    explicit json_writer(std::ostream& os, json_mode mode = json_mode::k_relaxed,
+                         json_framing framing = json_framing::k_lines)
+        : _os(&os), _out(&_buffer), _mode(mode), _framing(framing) {
+        _buffer.reserve(k_flush_size + k_flush_size / 4);
+    }
+
+    /**
+     * Creates a writer that appends to a string.
+     */
+    explicit json_writer(std::string& out, json_mode mode = json_mode::k_relaxed,
+                         json_framing framing = json_framing::k_lines)
+        : _out(&out), _mode(mode), _framing(framing) {
+    }
+
+    json_writer(const json_writer&) = delete;
+    json_writer& operator=(const json_writer&) = delete;
+
+    ~json_writer() {
+        try {
+            finish();
+        } catch (...) {
+        }
+    }
+
+    /**
+     * Restricts the output to the given field, in dot notation. Once a field is included, the
+     * fields that are not included are left out of every document. As in a MongoDB projection,
+     * including "a.b" writes the "b" field of "a" if "a" is an embedded document, and of each
+     * embedded document in "a" if it is an array.
+     *
+     * @return This writer, so that calls can be chained.
+     */
+    json_writer& include(const std::string& path) {
+        _filter.add(path);
+        return *this;
+    }
+
+    /**
+     * Writes a document.
+     */
+    void write(bsoncxx::document::view doc) {
+        if (_finished) {
+            throw boson::Exception("Cannot write to a json_writer after finishing it.");
+        }
+        if (_framing == json_framing::k_array) {
+            _out->push_back(_documents == 0 ? '[' : ',');
+        }
+        write_document(doc, _filter.empty() ? nullptr : &_filter);
+        if (_framing == json_framing::k_lines) {
+            _out->push_back('\n');
+        }
+        ++_documents;
+        if (_os && _buffer.size() >= k_flush_size) {
+            flush();
+        }
+    }
+
+    /**
+     * Writes every document of a range, such as a mongocxx::cursor.
+     *
+     * @return The number of documents written.
+     */
+    template <class Range>
+    std::size_t write_all(Range&& docs) {
+        std::size_t count = 0;
+        for (auto&& doc : docs) {
+            write(doc);
+            ++count;
+        }
+        return count;
+    }
+
+    /**
+     * Completes the output, by closing the array when using array framing, and flushes it to the
+     * output stream. No documents can be written afterwards.
+     */
+    void finish() {
+        if (_finished) {
+            return;
+        }
+        _finished = true;
+        if (_framing == json_framing::k_array) {
+            if (_documents == 0) {
+                _out->push_back('[');
+            }
+            _out->push_back(']');
+        }
+        flush();
+    }
+
+    /**
+     * Returns the number of documents written so far.
+     */
+    std::size_t documents() const {
+        return _documents;
+    }
+
+   private:
+    /**
+     * A tree of the fields to write. A node without children stands for a whole field.
+     */
+    struct field_filter {
+        std::string name;
+        std::vector<field_filter> children;
+
+        bool empty() const {
+            return children.empty();
+        }
+
+        void add(const std::string& path) {
+            field_filter* node = this;
+            std::size_t start = 0;
+            while (true) {
+                auto dot = path.find('.', start);
+                auto name = path.substr(start, dot == std::string::npos ? dot : dot - start);
+                auto child = node->find(name);
+                if (child && child->empty()) {
+                    // The whole parent field is already included.
+                    return;
+                }
+                if (!child) {
+                    node->children.push_back(field_filter{name, {}});
+                    child = &node->children.back();
+                }
+                node = child;
+                if (dot == std::string::npos) {
+                    node->children.clear();
+                    return;
+                }
+                start = dot + 1;
+            }
+        }
+
+        const field_filter* find(bsoncxx::stdx::string_view key) const {
+            for (const auto& child : children) {
+                if (child.name.size() == key.size() &&
+                    std::memcmp(child.name.data(), key.data(), key.size()) == 0) {
+                    return &child;
+                }
+            }
+            return nullptr;
+        }
+
+        field_filter* find(const std::string& key) {
+            for (auto& child : children) {
+                if (child.name == key) {
+                    return &child;
+                }
+            }
+            return nullptr;
+        }
+    };
+
+    void flush() {
+        if (_os && !_buffer.empty()) {
+            _os->write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+            _buffer.clear();
+        }
+    }
+
+    void append(const char* str) {
+        _out->append(str);
+    }
+
+    /**
+     * Returns whether an element is written under a filter. Fields that are filtered by their
+     * children are only written if they can have children.
+     */
+    static bool passes(const bsoncxx::document::element& elem, const field_filter* filter) {
+        return !filter || elem.type() == bsoncxx::type::k_document ||
+               elem.type() == bsoncxx::type::k_array;
+    }
+
+    void write_document(bsoncxx::document::view doc, const field_filter* filter) {
+        _out->push_back('{');
+        bool first = true;
+        for (auto&& elem : doc) {
+            const field_filter* child = nullptr;
+            if (filter) {
+                child = filter->find(elem.key());
+                if (!child) {
+                    continue;
+                }
+                if (child->empty()) {
+                    child = nullptr;
+                } else if (!passes(elem, child)) {
+                    continue;
+                }
+            }
+            if (!first) {
+                _out->push_back(',');
+            }
+            first = false;
+            write_string(elem.key());
+            _out->push_back(':');
+            write_value(elem, child);
+        }
+        _out->push_back('}');
+    }
+
+    void write_array(bsoncxx::array::view arr, const field_filter* filter) {
+        _out->push_back('[');
+        bool first = true;
+        for (auto&& elem : arr) {
+            if (!passes(elem, filter)) {
+                continue;
+            }
+            if (!first) {
+                _out->push_back(',');
+            }
+            first = false;
+            write_value(elem, filter);
+        }
+        _out->push_back(']');
+    }
+
+    void write_value(const bsoncxx::document::element& elem, const field_filter* filter) {
+        bool canonical = _mode == json_mode::k_canonical;
+        switch (elem.type()) {
+            case bsoncxx::type::k_double:
+                write_double(elem.get_double().value);
+                break;
+            case bsoncxx::type::k_utf8:
+                write_string(elem.get_utf8().value);
+                break;
+            case bsoncxx::type::k_document:
+                write_document(elem.get_document().value, filter);
+                break;
+            case bsoncxx::type::k_array:
+                write_array(elem.get_array().value, filter);
+                break;
+            case bsoncxx::type::k_binary: {
+                auto bin = elem.get_binary();
+                append("{\"$binary\":{\"base64\":\"");
+                write_base64(bin.bytes, bin.size);
+                append("\",\"subType\":\"");
+                write_hex(reinterpret_cast<const std::uint8_t*>(&bin.sub_type), 1);
+                append("\"}}");
+                break;
+            }
+            case bsoncxx::type::k_undefined:
+                append("{\"$undefined\":true}");
+                break;
+            case bsoncxx::type::k_oid:
+                write_oid(elem.get_oid().value);
+                break;
+            case bsoncxx::type::k_bool:
+                append(elem.get_bool().value ? "true" : "false");
+                break;
+            case bsoncxx::type::k_date:
+                write_date(std::chrono::milliseconds{elem.get_date().value}.count());
+                break;
+            case bsoncxx::type::k_null:
+                append("null");
+                break;
+            case bsoncxx::type::k_regex: {
+                auto regex = elem.get_regex();
+                append("{\"$regularExpression\":{\"pattern\":");
+                write_string(regex.regex);
+                append(",\"options\":");
+                write_string(regex.options);
+                append("}}");
+                break;
+            }
+            case bsoncxx::type::k_dbpointer: {
+                auto pointer = elem.get_dbpointer();
+                append("{\"$dbPointer\":{\"$ref\":");
+                write_string(pointer.collection);
+                append(",\"$id\":");
+                write_oid(pointer.value);
+                append("}}");
+                break;
+            }
+            case bsoncxx::type::k_code:
+                append("{\"$code\":");
+                write_string(elem.get_code().code);
+                _out->push_back('}');
+                break;
+            case bsoncxx::type::k_symbol:
+                append("{\"$symbol\":");
+                write_string(elem.get_symbol().symbol);
+                _out->push_back('}');
+                break;
+            case bsoncxx::type::k_codewscope: {
+                auto code = elem.get_codewscope();
+                append("{\"$code\":");
+                write_string(code.code);
+                append(",\"$scope\":");
+                write_document(code.scope, nullptr);
+                _out->push_back('}');
+                break;
+            }
+            case bsoncxx::type::k_int32:
+                write_integer(elem.get_int32().value, canonical ? "{\"$numberInt\":\"" : nullptr);
+                break;
+            case bsoncxx::type::k_timestamp: {
+                auto ts = elem.get_timestamp();
+                append("{\"$timestamp\":{\"t\":");
+                write_integer(ts.timestamp, nullptr);
+                append(",\"i\":");
+                write_integer(ts.increment, nullptr);
+                append("}}");
+                break;
+            }
+            case bsoncxx::type::k_int64:
+                write_integer(elem.get_int64().value, canonical ? "{\"$numberLong\":\"" : nullptr);
+                break;
+            case bsoncxx::type::k_decimal128:
+                append("{\"$numberDecimal\":\"");
+                append(elem.get_decimal128().value.to_string().c_str());
+                append("\"}");
+                break;
+            case bsoncxx::type::k_maxkey:
+                append("{\"$maxKey\":1}");
+                break;
+            case bsoncxx::type::k_minkey:
+                append("{\"$minKey\":1}");
+                break;
+            default:
+                throw boson::Exception("Cannot write a BSON value of unknown type as JSON.");
+        }
+    }
+
+    /**
+     * Writes a JSON string, escaping quotes, backslashes and control characters. Runs of
+     * characters that need no escaping are appended at once.
+     */
+    void write_string(bsoncxx::stdx::string_view str) {
+        static const char k_hex[] = "0123456789abcdef";
+        _out->push_back('"');
+        const char* run = str.data();
+        const char* end = str.data() + str.size();
+        for (const char* p = run; p != end; ++p) {
+            auto c = static_cast<unsigned char>(*p);
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+            _out->append(run, p - run);
+            run = p + 1;
+            _out->push_back('\\');
+            switch (c) {
+                case '"':
+                case '\\':
+                    _out->push_back(static_cast<char>(c));
+                    break;
+                case '\b':
+                    _out->push_back('b');
+                    break;
+                case '\f':
+                    _out->push_back('f');
+                    break;
+                case '\n':
+                    _out->push_back('n');
+                    break;
+                case '\r':
+                    _out->push_back('r');
+                    break;
+                case '\t':
+                    _out->push_back('t');
+                    break;
+                default:
+                    append("u00");
+                    _out->push_back(k_hex[c >> 4]);
+                    _out->push_back(k_hex[c & 0xF]);
+            }
+        }
+        _out->append(run, end - run);
+        _out->push_back('"');
+    }
+
+    /**
+     * Writes an integer, either as a JSON number or, given the opening of a wrapper such as
+     * {"$numberLong":", as a string wrapped in a document.
+     */
+    void write_integer(std::int64_t value, const char* wrapper) {
+        char digits[24];
+        char* end = digits + sizeof(digits);
+        char* p = end;
+        // Negate as unsigned, so that the smallest int64 does not overflow.
+        auto magnitude = value < 0 ? 0 - static_cast<std::uint64_t>(value)
+                                   : static_cast<std::uint64_t>(value);
+        do {
+            *--p = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude);
+        if (value < 0) {
+            *--p = '-';
+        }
+        if (wrapper) {
+            append(wrapper);
+        }
+        _out->append(p, end - p);
+        if (wrapper) {
+            append("\"}");
+        }
+    }
+
+    /**
+     * Writes a double with the fewest significant digits that read back as the same value. In
+     * relaxed mode, finite values are written as JSON numbers, with a ".0" suffix for integral
+     * values so that they read back as doubles.
+     */
+    void write_double(double value) {
+        char digits[32];
+        if (std::isnan(value)) {
+            std::strcpy(digits, "NaN");
+        } else if (std::isinf(value)) {
+            std::strcpy(digits, value > 0 ? "Infinity" : "-Infinity");
+        } else {
+            format_double(value, digits);
+            if (_mode == json_mode::k_relaxed) {
+                append(digits);
+                return;
+            }
+        }
+        append("{\"$numberDouble\":\"");
+        append(digits);
+        append("\"}");
+    }
+
+    /**
+     * Formats a finite double into a buffer of at least 32 characters.
+     *
+     * Most doubles hold a decimal with few digits, such as a price. For these, this looks for the
+     * fewest decimals k such that value * 10^k rounds to an integer n < 2^53 with n / 10^k ==
+     * value. Since n and 10^k are exact doubles and division is correctly rounded, the decimal
+     * n / 10^k then reads back as value, and can be written without formatting functions, which
+     * are several times slower. Other values are formatted with snprintf.
+     */
+    static void format_double(double value, char* digits) {
+        static constexpr double k_max_exact = 9007199254740992.0;
+        double magnitude = std::fabs(value);
+        if (magnitude >= 1e-4 && magnitude < 1e15) {
+            double scale = 1;
+            for (int k = 0; k <= 15 && magnitude * scale < k_max_exact; ++k, scale *= 10) {
+                double n = std::nearbyint(magnitude * scale);
+                if (n / scale != magnitude) {
+                    continue;
+                }
+                // Writes the digits of n, then inserts the decimal point k digits from the end.
+                char reversed[24];
+                auto integer = static_cast<std::uint64_t>(n);
+                int len = 0;
+                do {
+                    reversed[len++] = static_cast<char>('0' + integer % 10);
+                    integer /= 10;
+                } while (integer || len <= k);
+                char* p = digits;
+                if (value < 0) {
+                    *p++ = '-';
+                }
+                while (len > k) {
+                    *p++ = reversed[--len];
+                }
+                *p++ = '.';
+                if (k == 0) {
+                    *p++ = '0';
+                }
+                while (len > 0) {
+                    *p++ = reversed[--len];
+                }
+                *p = '\0';
+                return;
+            }
+        }
+
+        for (int precision = 15; precision <= 17; ++precision) {
+            std::snprintf(digits, 32, "%.*g", precision, value);
+            if (std::strtod(digits, nullptr) == value) {
+                break;
+            }
+        }
+        if (!std::strpbrk(digits, ".eE")) {
+            std::strcat(digits, ".0");
+        }
+    }
+
+    /**
+     * Writes a datetime, given in milliseconds since the epoch. In relaxed mode, dates between
+     * the years 1970 and 9999 are written as ISO-8601 strings in UTC.
+     */
+    void write_date(std::int64_t millis) {
+        // The first millisecond of the year 10000.
+        static constexpr std::int64_t k_max_iso_millis = 253402300800000;
+        if (_mode == json_mode::k_canonical || millis < 0 || millis >= k_max_iso_millis) {
+            append("{\"$date\":");
+            write_integer(millis, "{\"$numberLong\":\"");
+            _out->push_back('}');
+            return;
+        }
+
+        // Converts days since the epoch to a civil date, after H. Hinnant's civil_from_days.
+        auto days = millis / 86400000;
+        auto ms_of_day = millis % 86400000;
+        auto z = days + 719468;
+        auto era = z / 146097;
+        auto doe = z - era * 146097;
+        auto yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        auto doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        auto mp = (5 * doy + 2) / 153;
+        auto day = doy - (153 * mp + 2) / 5 + 1;
+        auto month = mp < 10 ? mp + 3 : mp - 9;
+        auto year = yoe + era * 400 + (month <= 2);
+
+        append("{\"$date\":\"");
+        write_padded(year, 4);
+        _out->push_back('-');
+        write_padded(month, 2);
+        _out->push_back('-');
+        write_padded(day, 2);
+        _out->push_back('T');
+        write_padded(ms_of_day / 3600000, 2);
+        _out->push_back(':');
+        write_padded(ms_of_day / 60000 % 60, 2);
+        _out->push_back(':');
+        write_padded(ms_of_day / 1000 % 60, 2);
+        if (ms_of_day % 1000) {
+            _out->push_back('.');
+            write_padded(ms_of_day % 1000, 3);
+        }
+        append("Z\"}");
+    }
+
+    // Writes a non-negative number with leading zeros, e.g. the fields of a date.
+    void write_padded(std::int64_t value, int width) {
+        char digits[4];
+        for (int i = width - 1; i >= 0; --i) {
+            digits[i] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+        _out->append(digits, width);
+    }
+
+    void write_oid(const bsoncxx::oid& oid) {
+        append("{\"$oid\":\"");
+        write_hex(reinterpret_cast<const std::uint8_t*>(oid.bytes()), oid.size());
+        append("\"}");
+    }
+
+    void write_hex(const std::uint8_t* data, std::size_t size) {
+        static const char k_hex[] = "0123456789abcdef";
+        for (std::size_t i = 0; i < size; ++i) {
+            _out->push_back(k_hex[data[i] >> 4]);
+            _out->push_back(k_hex[data[i] & 0xF]);
+        }
+    }
+
+    void write_base64(const std::uint8_t* data, std::size_t size) {
+        static const char k_alphabet[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::size_t i = 0;
+        for (; i + 3 <= size; i += 3) {
+            std::uint32_t n = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+            _out->push_back(k_alphabet[n >> 18]);
+            _out->push_back(k_alphabet[(n >> 12) & 0x3F]);
+            _out->push_back(k_alphabet[(n >> 6) & 0x3F]);
+            _out->push_back(k_alphabet[n & 0x3F]);
+        }
+        if (i < size) {
+            std::uint32_t n = data[i] << 16;
+            if (i + 1 < size) {
+                n |= data[i + 1] << 8;
+            }
+            _out->push_back(k_alphabet[n >> 18]);
+            _out->push_back(k_alphabet[(n >> 12) & 0x3F]);
+            _out->push_back(i + 1 < size ? k_alphabet[(n >> 6) & 0x3F] : '=');
+            _out->push_back('=');
+        }
+    }
+
+    std::ostream* _os = nullptr;
+    // The buffer of a writer that outputs to a stream.
+    std::string _buffer;
+    // The string that is appended to, which is _buffer when writing to a stream.
+    std::string* _out;
+    json_mode _mode;
+    json_framing _framing;
+    field_filter _filter;
+    std::size_t _documents = 0;
+    bool _finished = false;
+};
+
+BOSON_INLINE_NAMESPACE_END
+}  // namespace boson
+
+#include <boson/config/postlude.hpp>
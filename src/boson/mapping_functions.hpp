@@ -21,6 +21,7 @@
 #include <bsoncxx/builder/basic/document.hpp>
 #include <bsoncxx/stdx/optional.hpp>
 
+#include <boson/archive_counters.hpp>
 #include <boson/bson_archiver.hpp>
 #include <boson/bson_streambuf.hpp>
 
@@ -41,6 +42,7 @@ bsoncxx::document::value to_document(const T& obj) {
     bson_ostream bos([&doc](bsoncxx::document::value v) { doc = std::move(v); });
     BSONOutputArchive archive(bos);
     archive(obj);
+    record_archive_counters<T>(archive.counters());
     return doc.value();
 }
 
@@ -58,6 +60,7 @@ bsoncxx::document::value to_dotted_notation_document(const T& obj) {
     bson_ostream bos([&doc](bsoncxx::document::value v) { doc = std::move(v); });
     BSONOutputArchive archive(bos, true);
     archive(obj);
+    record_archive_counters<T>(archive.counters());
     return doc.value();
 }
 
@@ -79,6 +82,7 @@ T to_obj(bsoncxx::document::view v) {
     boson::BSONInputArchive archive(bis);
     T obj;
     archive(obj);
+    record_archive_counters<T>(archive.counters());
     return obj;
 }
 
@@ -97,6 +101,7 @@ void to_obj(bsoncxx::document::view v, T& obj) {
     boson::bson_istream bis(v);
     boson::BSONInputArchive archive(bis);
     archive(obj);
+    record_archive_counters<T>(archive.counters());
 }
 
 /*
@@ -0,0 +1,93 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+
+#include <vector>
+
+#include <bsoncxx/json.hpp>
+
+#include <boson/archive_counters.hpp>
+#include <boson/mapping_functions.hpp>
+
+using namespace boson;
+
+struct Counted {
+    int a, b, c;
+    std::vector<int> d;
+
+    template <class Archive>
+    void serialize(Archive& ar) {
+        ar(CEREAL_NVP(a), CEREAL_NVP(b), CEREAL_NVP(c), CEREAL_NVP(d));
+    }
+};
+
+struct Uncounted {};
+
+TEST_CASE("estimated_builder_reallocations follows the growth of a bson_t.",
+          "[boson::archive_counters]") {
+    REQUIRE(details::estimated_builder_reallocations(5) == 0);
+    REQUIRE(details::estimated_builder_reallocations(120) == 0);
+    REQUIRE(details::estimated_builder_reallocations(121) == 1);
+    REQUIRE(details::estimated_builder_reallocations(128) == 1);
+    REQUIRE(details::estimated_builder_reallocations(129) == 2);
+    REQUIRE(details::estimated_builder_reallocations(1024 * 1024) == 14);
+}
+
+TEST_CASE("archive counters are aggregated per type.", "[boson::archive_counters]") {
+    reset_archive_counters();
+
+    archive_counters counters;
+    counters.searches = 3;
+    counters.bytes_read = 40;
+    details::archive_counter_registry::instance().record(typeid(Counted), counters);
+    details::archive_counter_registry::instance().record(typeid(Counted), counters);
+
+    REQUIRE(archive_counters_for<Counted>().searches == 6);
+    REQUIRE(archive_counters_for<Counted>().bytes_read == 80);
+    REQUIRE(archive_counters_for<Uncounted>().searches == 0);
+    REQUIRE(archive_counters_by_type().size() == 1);
+
+    reset_archive_counters();
+    REQUIRE(archive_counters_by_type().empty());
+}
+
+TEST_CASE("the archivers count their work only when the counters are enabled.",
+          "[boson::archive_counters]") {
+    reset_archive_counters();
+
+    auto doc = bsoncxx::from_json(R"({"a": 1, "b": 2, "c": 3, "d": [4, 5]})");
+    auto obj = to_obj<Counted>(doc.view());
+    auto round_trip = to_document(obj);
+    REQUIRE(round_trip.view() == doc.view());
+
+    auto counters = archive_counters_for<Counted>();
+    if (!k_archive_counters_enabled) {
+        REQUIRE(counters.searches == 0);
+        REQUIRE(archive_counters_by_type().empty());
+        return;
+    }
+
+    // Each of a, b, c and d is searched for by name, after comparing it to the keys before it,
+    // and the two elements of d are searched for in the array.
+    REQUIRE(counters.searches == 6);
+    REQUIRE(counters.key_comparisons == 1 + 2 + 3 + 4);
+    REQUIRE(counters.cached_search_hits == 0);
+    REQUIRE(counters.documents_read == 1);
+    REQUIRE(counters.bytes_read == doc.view().length());
+    REQUIRE(counters.documents_written == 1);
+    REQUIRE(counters.bytes_written == doc.view().length());
+    REQUIRE(counters.builder_reallocations == 0);
+    REQUIRE(counters.stack_pushes > 0);
+}
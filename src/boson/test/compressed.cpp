@@ -0,0 +1,168 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boson/compressed.hpp>
+#include <boson/mapping_functions.hpp>
+
+using namespace boson;
+
+struct Article {
+    std::string title;
+    compressed<std::string, 64> body;
+    compressed<std::vector<std::uint8_t>, 64> attachment;
+
+    template <class Archive>
+    void serialize(Archive& ar) {
+        ar(CEREAL_NVP(title), CEREAL_NVP(body), CEREAL_NVP(attachment));
+    }
+};
+
+struct PlainArticle {
+    std::string title;
+    std::string body;
+
+    template <class Archive>
+    void serialize(Archive& ar) {
+        ar(CEREAL_NVP(title), CEREAL_NVP(body));
+    }
+};
+
+static std::string round_trip(const std::string& data) {
+    auto src = reinterpret_cast<const std::uint8_t*>(data.data());
+    auto packed = details::lz_compress(src, data.size());
+    std::string unpacked(data.size(), 0);
+    details::lz_decompress(packed.data(), packed.size(),
+                           reinterpret_cast<std::uint8_t*>(&unpacked[0]), unpacked.size());
+    return unpacked;
+}
+
+TEST_CASE("The compressed field codec round-trips data.", "[boson::compressed]") {
+    SECTION("Short and incompressible data.") {
+        REQUIRE(round_trip("a") == "a");
+        REQUIRE(round_trip("abcdefghijklm") == "abcdefghijklm");
+
+        std::mt19937 gen(42);
+        std::string noise(5000, 0);
+        for (auto& c : noise) {
+            c = static_cast<char>(gen());
+        }
+        REQUIRE(round_trip(noise) == noise);
+        auto src = reinterpret_cast<const std::uint8_t*>(noise.data());
+        REQUIRE(details::compress_field(src, noise.size()).empty());
+    }
+
+    SECTION("Repetitive data, with long literals and overlapping matches.") {
+        std::string text;
+        for (int i = 0; i < 200; ++i) {
+            text += R"({"status": "active", "country": "US", "id": )" + std::to_string(i) + "}";
+        }
+        text += std::string(1000, 'x');
+        REQUIRE(round_trip(text) == text);
+
+        auto src = reinterpret_cast<const std::uint8_t*>(text.data());
+        auto stored = details::compress_field(src, text.size());
+        REQUIRE(!stored.empty());
+        auto ratio = text.size() / stored.size();
+        REQUIRE(ratio >= 4);
+        REQUIRE(details::decompress_field<std::string>(stored) == text);
+    }
+
+    SECTION("Corrupt data is rejected.") {
+        std::string text(1000, 'y');
+        auto src = reinterpret_cast<const std::uint8_t*>(text.data());
+        auto stored = details::compress_field(src, text.size());
+
+        auto truncated = stored;
+        truncated.resize(truncated.size() - 3);
+        REQUIRE_THROWS_AS(details::decompress_field<std::string>(truncated), boson::Exception);
+
+        auto bad_codec = stored;
+        bad_codec[0] = 0x7f;
+        REQUIRE_THROWS_AS(details::decompress_field<std::string>(bad_codec), boson::Exception);
+
+        auto bad_size = stored;
+        bad_size[1] += 1;
+        REQUIRE_THROWS_AS(details::decompress_field<std::string>(bad_size), boson::Exception);
+
+        // A size that the data could not decompress to is rejected before it is allocated.
+        auto huge_size = stored;
+        huge_size[4] = 0x7f;
+        REQUIRE_THROWS_AS(details::decompress_field<std::string>(huge_size), boson::Exception);
+    }
+}
+
+TEST_CASE("Compressed fields are stored compressed past their threshold and decompressed lazily.",
+          "[boson::compressed]") {
+    Article article;
+    article.title = "t";
+    article.body = std::string(500, 'b');
+    article.attachment = std::vector<std::uint8_t>(10, 7);
+
+    auto doc = to_document(article);
+    auto body = doc.view()["body"];
+    REQUIRE(body.type() == bsoncxx::type::k_binary);
+    REQUIRE(body.get_binary().sub_type == bsoncxx::binary_sub_type::k_user);
+    REQUIRE(body.get_binary().size < 100);
+
+    // The attachment is under the threshold, and is stored uncompressed.
+    auto attachment = doc.view()["attachment"];
+    REQUIRE(attachment.type() == bsoncxx::type::k_binary);
+    REQUIRE(attachment.get_binary().sub_type == bsoncxx::binary_sub_type::k_binary);
+    REQUIRE(attachment.get_binary().size == 10);
+
+    auto loaded = to_obj<Article>(doc.view());
+    REQUIRE(!loaded.body.is_decompressed());
+    REQUIRE(loaded.attachment.is_decompressed());
+    REQUIRE(loaded.body->size() == 500);
+    REQUIRE(*loaded.body == std::string(500, 'b'));
+    REQUIRE(loaded.body.is_decompressed());
+    REQUIRE(*loaded.attachment == std::vector<std::uint8_t>(10, 7));
+
+    SECTION("An unmodified field is saved without being recompressed.") {
+        REQUIRE(loaded.body.is_compressed());
+        REQUIRE(to_document(loaded).view() == doc.view());
+    }
+
+    SECTION("A modified field is compressed again when it is saved.") {
+        loaded.body->append("c");
+        REQUIRE(!loaded.body.is_compressed());
+        auto saved = to_document(loaded);
+        auto reloaded = to_obj<Article>(saved.view());
+        REQUIRE(*reloaded.body == std::string(500, 'b') + "c");
+
+        // Saving does not modify the field, so that concurrent saves do not race.
+        REQUIRE(!loaded.body.is_compressed());
+        REQUIRE(to_document(loaded).view() == saved.view());
+    }
+}
+
+TEST_CASE("Compressed string fields read and write plain strings under their threshold.",
+          "[boson::compressed]") {
+    PlainArticle plain{"t", "short body"};
+    auto article = to_obj<Article>(to_document(plain).view());
+    REQUIRE(article.body.get() == "short body");
+
+    article.body = "still short";
+    article.attachment = std::vector<std::uint8_t>{};
+    auto doc = to_document(article);
+    REQUIRE(doc.view()["body"].type() == bsoncxx::type::k_utf8);
+    REQUIRE(to_obj<PlainArticle>(doc.view()).body == "still short");
+}
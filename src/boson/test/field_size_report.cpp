@@ -0,0 +1,103 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boson/field_size_report.hpp>
+
+using namespace boson;
+
+struct Inner {
+    int x;
+
+    template <class Archive>
+    void serialize(Archive& ar) {
+        ar(CEREAL_NVP(x));
+    }
+};
+
+struct Outer {
+    int a;
+    std::string s;
+    std::vector<int> v;
+    Inner in;
+
+    template <class Archive>
+    void serialize(Archive& ar) {
+        ar(CEREAL_NVP(a), CEREAL_NVP(s), CEREAL_NVP(v), CEREAL_NVP(in));
+    }
+};
+
+TEST_CASE("field_size_report attributes the encoded size of documents to their fields.",
+          "[boson::field_size_report]") {
+    std::vector<Outer> sample{{1, "hi", {1, 2}, {3}}, {4, "", {}, {5}}};
+    auto summary = field_size_report<Outer>(sample);
+
+    // {a: int32, s: "hi", v: [int32, int32], in: {x: int32}} is 60 bytes, and the second document,
+    // with an empty string and an empty array, is 44 bytes.
+    REQUIRE(summary.documents == 2);
+    REQUIRE(summary.total_bytes == 104);
+    REQUIRE(summary.mean_bytes == Approx(52));
+    REQUIRE(summary.p99_bytes == 60);
+
+    std::vector<std::string> paths;
+    for (const auto& field : summary.fields) {
+        paths.push_back(field.path);
+    }
+    REQUIRE(paths == (std::vector<std::string>{"a", "in", "in.x", "s", "v", "v[]"}));
+
+    SECTION("A field's size is its whole element, including its key and its children.") {
+        const auto& a = summary.fields[0];
+        REQUIRE(a.documents == 2);
+        REQUIRE(a.total_bytes == 14);
+        REQUIRE(a.mean_bytes == Approx(7));
+        REQUIRE(a.share == Approx(14.0 / 104));
+
+        const auto& in = summary.fields[1];
+        REQUIRE(in.total_bytes == 32);
+        REQUIRE(summary.fields[2].total_bytes == 14);
+
+        const auto& s = summary.fields[3];
+        REQUIRE(s.total_bytes == 18);
+        REQUIRE(s.p99_bytes == 10);
+    }
+
+    SECTION("The elements of an array are reported together.") {
+        const auto& v = summary.fields[4];
+        REQUIRE(v.total_bytes == 30);
+
+        const auto& elements = summary.fields[5];
+        REQUIRE(elements.documents == 1);
+        REQUIRE(elements.total_bytes == 14);
+        REQUIRE(elements.mean_bytes == Approx(7));
+        REQUIRE(elements.p99_bytes == 14);
+    }
+
+    SECTION("The report can be written as a table.") {
+        std::ostringstream os;
+        summary.write(os);
+        REQUIRE(os.str().find("documents: 2") == 0);
+        REQUIRE(os.str().find("\n  in.x") != std::string::npos);
+    }
+}
+
+TEST_CASE("field_size_report of an empty sample is empty.", "[boson::field_size_report]") {
+    auto summary = field_size_report<Outer>(std::vector<Outer>{});
+    REQUIRE(summary.documents == 0);
+    REQUIRE(summary.fields.empty());
+}
@@ -0,0 +1,95 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <bsoncxx/json.hpp>
+
+#include <boson/interned_string.hpp>
+#include <boson/mapping_functions.hpp>
+
+using namespace boson;
+
+struct Order {
+    int id;
+    interned_string status;
+
+    template <class Archive>
+    void serialize(Archive& ar) {
+        ar(CEREAL_NVP(id), CEREAL_NVP(status));
+    }
+};
+
+TEST_CASE("intern_table stores each distinct string once.", "[boson::interned_string]") {
+    intern_table table;
+    auto a = table.intern("active");
+    auto b = table.intern(std::string("act") + "ive");
+    auto c = table.intern("closed");
+    REQUIRE(a == b);
+    REQUIRE(a != c);
+    REQUIRE(*a == "active");
+    REQUIRE(table.size() == 2);
+
+    // Threads interning the same strings get the same copies.
+    std::vector<const std::string*> results(8);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        threads.emplace_back([&, i]() {
+            for (int j = 0; j < 1000; ++j) {
+                table.intern("s" + std::to_string(j));
+            }
+            results[i] = table.intern("s500");
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (auto result : results) {
+        REQUIRE(result == results.front());
+    }
+    REQUIRE(table.size() == 1002);
+}
+
+TEST_CASE("interned_string compares and converts like the string it holds.",
+          "[boson::interned_string]") {
+    interned_string a("active");
+    interned_string b(std::string("active"));
+    interned_string c;
+    REQUIRE(a == b);
+    REQUIRE(&a.get() == &b.get());
+    REQUIRE(a != c);
+    REQUIRE(c.get().empty());
+    REQUIRE(c < a);
+    REQUIRE(a->size() == 6);
+    const std::string& str = a;
+    REQUIRE(str == "active");
+    REQUIRE(sizeof(interned_string) == sizeof(const std::string*));
+}
+
+TEST_CASE("interned_string fields are serialized as strings and interned on load.",
+          "[boson::interned_string]") {
+    auto doc = bsoncxx::from_json(R"({"id": 1, "status": "shipped"})");
+    auto first = to_obj<Order>(doc.view());
+    auto second = to_obj<Order>(doc.view());
+    REQUIRE(first.status.get() == "shipped");
+    REQUIRE(&first.status.get() == &second.status.get());
+    REQUIRE(to_document(first).view() == doc.view());
+
+    auto not_a_string = bsoncxx::from_json(R"({"id": 1, "status": 2})");
+    REQUIRE_THROWS_AS(to_obj<Order>(not_a_string.view()), boson::Exception);
+}
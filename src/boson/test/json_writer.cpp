@@ -0,0 +1,128 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <bsoncxx/json.hpp>
+
+#include <boson/json_writer.hpp>
+
+using namespace boson;
+
+namespace {
+
+std::string write_json(bsoncxx::document::view doc, json_mode mode) {
+    std::string out;
+    json_writer writer(out, mode);
+    writer.write(doc);
+    return out;
+}
+
+}  // namespace
+
+TEST_CASE("json_writer writes relaxed Extended JSON.", "[boson::json_writer]") {
+    auto doc = bsoncxx::from_json(R"({
+        "i": 42, "l": {"$numberLong": "-7"}, "d": 1.0, "f": 0.1,
+        "inf": {"$numberDouble": "-Infinity"}, "s": "a\"b\\c\n\u0001", "t": true, "n": null,
+        "date": {"$date": {"$numberLong": "1356351330501"}},
+        "epoch": {"$date": {"$numberLong": "0"}},
+        "old": {"$date": {"$numberLong": "-1"}},
+        "oid": {"$oid": "57e193d7a9cc81b4027498b5"},
+        "bin": {"$binary": {"base64": "Zm9vYg==", "subType": "80"}},
+        "ts": {"$timestamp": {"t": 7, "i": 2}},
+        "re": {"$regularExpression": {"pattern": "^a", "options": "i"}},
+        "min": {"$minKey": 1}, "sub": {"x": [1, {"y": 2}]}
+    })");
+
+    REQUIRE(write_json(doc.view(), json_mode::k_relaxed) ==
+            R"({"i":42,"l":-7,"d":1.0,"f":0.1,"inf":{"$numberDouble":"-Infinity"},)"
+            R"("s":"a\"b\\c\n\u0001","t":true,"n":null,)"
+            R"("date":{"$date":"2012-12-24T12:15:30.501Z"},)"
+            R"("epoch":{"$date":"1970-01-01T00:00:00Z"},)"
+            R"("old":{"$date":{"$numberLong":"-1"}},)"
+            R"("oid":{"$oid":"57e193d7a9cc81b4027498b5"},)"
+            R"("bin":{"$binary":{"base64":"Zm9vYg==","subType":"80"}},)"
+            R"("ts":{"$timestamp":{"t":7,"i":2}},)"
+            R"("re":{"$regularExpression":{"pattern":"^a","options":"i"}},)"
+            R"("min":{"$minKey":1},"sub":{"x":[1,{"y":2}]}})"
+            "\n");
+}
+
+TEST_CASE("json_writer writes canonical Extended JSON.", "[boson::json_writer]") {
+    auto doc = bsoncxx::from_json(R"({
+        "i": 42, "l": {"$numberLong": "-7"}, "d": 1.0,
+        "date": {"$date": {"$numberLong": "1356351330501"}}
+    })");
+
+    REQUIRE(write_json(doc.view(), json_mode::k_canonical) ==
+            R"({"i":{"$numberInt":"42"},"l":{"$numberLong":"-7"},"d":{"$numberDouble":"1.0"},)"
+            R"("date":{"$date":{"$numberLong":"1356351330501"}}})"
+            "\n");
+}
+
+TEST_CASE("json_writer frames documents as lines or as an array.", "[boson::json_writer]") {
+    std::vector<bsoncxx::document::value> docs;
+    docs.push_back(bsoncxx::from_json(R"({"a": 1})"));
+    docs.push_back(bsoncxx::from_json(R"({"a": 2})"));
+    std::vector<bsoncxx::document::view> views{docs[0].view(), docs[1].view()};
+
+    SECTION("JSON Lines") {
+        std::ostringstream os;
+        json_writer writer(os);
+        REQUIRE(writer.write_all(views) == 2);
+        writer.finish();
+        REQUIRE(os.str() == "{\"a\":1}\n{\"a\":2}\n");
+        REQUIRE_THROWS_AS(writer.write(views[0]), boson::Exception);
+    }
+
+    SECTION("Array") {
+        std::ostringstream os;
+        {
+            json_writer writer(os, json_mode::k_relaxed, json_framing::k_array);
+            writer.write_all(views);
+        }
+        REQUIRE(os.str() == R"([{"a":1},{"a":2}])");
+    }
+
+    SECTION("Empty array") {
+        std::ostringstream os;
+        json_writer(os, json_mode::k_relaxed, json_framing::k_array).finish();
+        REQUIRE(os.str() == "[]");
+    }
+}
+
+TEST_CASE("json_writer writes only the included fields.", "[boson::json_writer]") {
+    auto doc = bsoncxx::from_json(R"({
+        "_id": 1, "a": {"x": 1, "y": 2}, "b": [{"x": 3, "y": 4}, 5], "c": 6
+    })");
+
+    std::string out;
+    json_writer writer(out);
+
+    SECTION("Subfields are written from embedded documents and arrays of documents.") {
+        writer.include("a.y").include("b.x").include("c");
+        writer.write(doc.view());
+        REQUIRE(out == R"({"a":{"y":2},"b":[{"x":3}],"c":6})" "\n");
+    }
+
+    SECTION("Including a field includes all of its subfields.") {
+        writer.include("a.y").include("a");
+        writer.write(doc.view());
+        REQUIRE(out == R"({"a":{"x":1,"y":2}})" "\n");
+    }
+}
@@ -0,0 +1,657 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <mangrove/config/prelude.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <bsoncxx/builder/core.hpp>
+#include <bsoncxx/document/value.hpp>
+#include <mongocxx/pipeline.hpp>
+#include <mongocxx/stdx.hpp>
+
+#include <boson/mapping_functions.hpp>
+#include <mangrove/expression_syntax.hpp>
+#include <mangrove/nvp.hpp>
+#include <mangrove/query_builder.hpp>
+#include <mangrove/util.hpp>
+
+namespace mangrove {
+MANGROVE_INLINE_NAMESPACE_BEGIN
+
+namespace details {
+
+/**
+ * The class at the root of a name-value pair, i.e. the type of the documents in which it names a
+ * field. For MANGROVE_KEY(Order::customer)->*MANGROVE_CHILD(Customer, name), this is Order.
+ */
+template <typename NvpT>
+struct nvp_root {};
+
+template <typename Base, typename T>
+struct nvp_root<nvp<Base, T>> {
+    using type = Base;
+};
+
+template <typename Base, typename T, typename Parent>
+struct nvp_root<nvp_child<Base, T, Parent>> : public nvp_root<Parent> {};
+
+template <typename NvpT>
+struct nvp_root<array_element_nvp<NvpT>> : public nvp_root<NvpT> {};
+
+template <typename NvpT>
+using nvp_root_t = typename nvp_root<NvpT>::type;
+
+/**
+ * Whether a name-value pair names a field of Doc. Free name-value pairs are not tied to a class,
+ * so they may name a field of any document.
+ */
+template <typename Doc, typename NvpT>
+struct is_field_of : public std::is_base_of<nvp_root_t<NvpT>, Doc> {};
+
+template <typename Doc, typename T>
+struct is_field_of<Doc, free_nvp<T>> : public std::true_type {};
+
+/**
+ * Whether all the fields that a query or sort expression refers to are fields of Doc. The
+ * subquery of an $elemMatch refers to the elements of its array, so only the array is checked.
+ */
+template <typename Doc, typename Expr>
+struct expression_fields_of : public std::true_type {};
+
+template <typename Doc, typename NvpT>
+struct expression_fields_of<Doc, sort_expr<NvpT>> : public is_field_of<Doc, NvpT> {};
+
+template <typename Doc, typename NvpT, typename U>
+struct expression_fields_of<Doc, comparison_expr<NvpT, U>> : public is_field_of<Doc, NvpT> {};
+
+template <typename Doc, typename NvpT, typename U>
+struct expression_fields_of<Doc, comparison_value_expr<NvpT, U>>
+    : public is_field_of<Doc, NvpT> {};
+
+template <typename Doc, typename Expr>
+struct expression_fields_of<Doc, not_expr<Expr>> : public expression_fields_of<Doc, Expr> {};
+
+template <typename Doc, typename Expr1, typename Expr2>
+struct expression_fields_of<Doc, boolean_expr<Expr1, Expr2>>
+    : public std::integral_constant<bool, expression_fields_of<Doc, Expr1>::value &&
+                                              expression_fields_of<Doc, Expr2>::value> {};
+
+template <typename Doc, typename List>
+struct expression_fields_of<Doc, boolean_list_expr<List>>
+    : public expression_fields_of<Doc, List> {};
+
+template <typename Doc, expression_category list_type, typename... Args>
+struct expression_fields_of<Doc, expression_list<list_type, Args...>>
+    : public all_true<expression_fields_of<Doc, Args>::value...> {};
+
+/**
+ * Appends a field path as an aggregation expression, i.e. "$name".
+ */
+template <typename NvpT>
+void append_field_reference(bsoncxx::builder::core &builder, const NvpT &nvp) {
+    std::string s(1, '$');
+    builder.append(nvp.append_name(s));
+}
+
+constexpr bool names_equal(const char *a, const char *b) {
+    while (*a != '\0' && *a == *b) {
+        ++a;
+        ++b;
+    }
+    return *a == *b;
+}
+
+/**
+ * Returns the index of the mapped field of T with the given name, or the number of mapped fields
+ * if there is none.
+ */
+template <typename T, std::size_t... I>
+constexpr std::size_t mapped_field_index(const char *name, std::index_sequence<I...>) {
+    const bool matches[] = {names_equal(std::get<I>(T::mangrove_mapped_fields()).name, name)...,
+                            true};
+    std::size_t i = 0;
+    while (!matches[i]) {
+        ++i;
+    }
+    return i;
+}
+
+template <typename T>
+constexpr std::size_t mapped_field_index(const char *name) {
+    return mapped_field_index<T>(
+        name,
+        std::make_index_sequence<std::tuple_size<decltype(T::mangrove_mapped_fields())>::value>{});
+}
+
+template <typename T>
+constexpr bool has_mapped_id() {
+    return mapped_field_index<T>("_id") <
+           std::tuple_size<decltype(T::mangrove_mapped_fields())>::value;
+}
+
+// The type of the _id field that T maps. T must have one.
+template <typename T>
+using mapped_id_t =
+    typename std::tuple_element_t<mapped_field_index<T>("_id"),
+                                  decltype(T::mangrove_mapped_fields())>::no_opt_type;
+
+/**
+ * The accumulators of the $group stage. Each has the name of its operator, and a type trait that
+ * determines whether it can produce an output field of type Out from input values of type In.
+ */
+struct sum_op {
+    static constexpr const char *name() {
+        return "$sum";
+    }
+    template <typename Out, typename In>
+    using accepts = std::integral_constant<bool, std::is_arithmetic<Out>::value &&
+                                                     std::is_arithmetic<In>::value>;
+};
+
+struct avg_op {
+    static constexpr const char *name() {
+        return "$avg";
+    }
+    template <typename Out, typename In>
+    using accepts = std::integral_constant<bool, std::is_floating_point<Out>::value &&
+                                                     std::is_arithmetic<In>::value>;
+};
+
+// $min, $max, $first and $last produce one of their input values.
+struct selection_op {
+    template <typename Out, typename In>
+    using accepts = std::is_same<Out, In>;
+};
+
+struct min_op : public selection_op {
+    static constexpr const char *name() {
+        return "$min";
+    }
+};
+
+struct max_op : public selection_op {
+    static constexpr const char *name() {
+        return "$max";
+    }
+};
+
+struct first_op : public selection_op {
+    static constexpr const char *name() {
+        return "$first";
+    }
+};
+
+struct last_op : public selection_op {
+    static constexpr const char *name() {
+        return "$last";
+    }
+};
+
+// $push and $addToSet produce an array of their input values.
+struct array_op {
+    template <typename Out, typename In>
+    using accepts =
+        std::integral_constant<bool, is_iterable_v<Out> &&
+                                         std::is_same<iterable_value_t<Out>, In>::value>;
+};
+
+struct push_op : public array_op {
+    static constexpr const char *name() {
+        return "$push";
+    }
+};
+
+struct add_to_set_op : public array_op {
+    static constexpr const char *name() {
+        return "$addToSet";
+    }
+};
+
+// The input type of a source that is either a name-value pair or a constant.
+template <typename Source, typename = void>
+struct source_value {
+    using type = Source;
+    using root = void;
+};
+
+template <typename Source>
+struct source_value<Source, std::enable_if_t<is_nvp_v<Source>>> {
+    using type = typename Source::no_opt_type;
+    using root = nvp_root_t<Source>;
+};
+
+template <typename Source>
+std::enable_if_t<is_nvp_v<Source>> append_source(bsoncxx::builder::core &builder,
+                                                 const Source &source) {
+    append_field_reference(builder, source);
+}
+
+template <typename Source>
+std::enable_if_t<!is_nvp_v<Source>> append_source(bsoncxx::builder::core &builder,
+                                                  const Source &source) {
+    append_value_to_bson(source, builder);
+}
+
+}  // namespace details
+
+/**
+ * A field of the documents produced by a $group or $project stage, and the value it is given.
+ * These are created with .as() on an accumulator or a value_of() expression.
+ * @tparam OutNvpT  The name-value pair of the output field, in the result class.
+ * @tparam Value    The accumulator or field_value that computes the field.
+ */
+template <typename OutNvpT, typename Value>
+class aggregation_output {
+   public:
+    using result_type = details::nvp_root_t<OutNvpT>;
+    using value_type = Value;
+
+    constexpr aggregation_output(const OutNvpT &out, const Value &value)
+        : _out(out), _value(value) {
+    }
+
+    bsoncxx::stdx::string_view key() const {
+        return _out.key();
+    }
+
+    void append_to_bson(bsoncxx::builder::core &builder) const {
+        builder.key_view(_out.key());
+        _value.append_value(builder);
+    }
+
+   private:
+    const OutNvpT _out;
+    const Value _value;
+};
+
+/**
+ * An accumulator of a $group stage, such as {$sum: "$total"}.
+ * @tparam Op       The accumulator operator, one of the details::*_op structs.
+ * @tparam Source   The name-value pair that is accumulated, or a constant.
+ */
+template <typename Op, typename Source>
+class accumulator {
+   public:
+    using source_root = typename details::source_value<Source>::root;
+    using source_type = typename details::source_value<Source>::type;
+
+    constexpr accumulator(const Source &source) : _source(source) {
+    }
+
+    /**
+     * Stores the result of this accumulator in a field of the result class.
+     * @param out   A name-value pair of a field of the result class, from MANGROVE_KEY.
+     */
+    template <typename Base, typename T>
+    constexpr aggregation_output<nvp<Base, T>, accumulator> as(const nvp<Base, T> &out) const {
+        static_assert(
+            Op::template accepts<remove_optional_t<T>, source_type>::value,
+            "The type of this field cannot hold the result of the accumulator on its input.");
+        return {out, *this};
+    }
+
+    void append_value(bsoncxx::builder::core &builder) const {
+        builder.open_document();
+        builder.key_view(Op::name());
+        details::append_source(builder, _source);
+        builder.close_document();
+    }
+
+   private:
+    const Source _source;
+};
+
+/**
+ * The value of a field of the input documents, as used in a $project stage.
+ */
+template <typename NvpT>
+class field_value {
+   public:
+    using source_root = details::nvp_root_t<NvpT>;
+    using source_type = typename NvpT::no_opt_type;
+
+    constexpr field_value(const NvpT &nvp) : _nvp(nvp) {
+    }
+
+    /**
+     * Stores this value in a field of the result class.
+     * @param out   A name-value pair of a field of the result class, from MANGROVE_KEY.
+     */
+    template <typename Base, typename T>
+    constexpr aggregation_output<nvp<Base, T>, field_value> as(const nvp<Base, T> &out) const {
+        static_assert(std::is_same<remove_optional_t<T>, source_type>::value,
+                      "A projected field must have the same type as its value.");
+        return {out, *this};
+    }
+
+    void append_value(bsoncxx::builder::core &builder) const {
+        details::append_field_reference(builder, _nvp);
+    }
+
+   private:
+    const NvpT _nvp;
+};
+
+template <typename NvpT>
+constexpr field_value<NvpT> value_of(const NvpT &nvp) {
+    static_assert(is_nvp_v<NvpT>, "value_of requires a name-value pair.");
+    return {nvp};
+}
+
+/**
+ * Accumulators for the $group stage of a typed_pipeline. Each takes a name-value pair of the
+ * input documents, and is given an output field with .as(), e.g.
+ * sum(MANGROVE_KEY(Order::total)).as(MANGROVE_KEY(Revenue::total)). sum() also takes a constant,
+ * so that sum(1) counts the documents in each group.
+ */
+template <typename Source>
+constexpr accumulator<details::sum_op, Source> sum(const Source &source) {
+    return {source};
+}
+
+template <typename NvpT>
+constexpr accumulator<details::avg_op, NvpT> avg(const NvpT &nvp) {
+    static_assert(is_nvp_v<NvpT>, "avg requires a name-value pair.");
+    return {nvp};
+}
+
+template <typename NvpT>
+constexpr accumulator<details::min_op, NvpT> min(const NvpT &nvp) {
+    static_assert(is_nvp_v<NvpT>, "min requires a name-value pair.");
+    return {nvp};
+}
+
+template <typename NvpT>
+constexpr accumulator<details::max_op, NvpT> max(const NvpT &nvp) {
+    static_assert(is_nvp_v<NvpT>, "max requires a name-value pair.");
+    return {nvp};
+}
+
+template <typename NvpT>
+constexpr accumulator<details::first_op, NvpT> first(const NvpT &nvp) {
+    static_assert(is_nvp_v<NvpT>, "first requires a name-value pair.");
+    return {nvp};
+}
+
+template <typename NvpT>
+constexpr accumulator<details::last_op, NvpT> last(const NvpT &nvp) {
+    static_assert(is_nvp_v<NvpT>, "last requires a name-value pair.");
+    return {nvp};
+}
+
+template <typename NvpT>
+constexpr accumulator<details::push_op, NvpT> push(const NvpT &nvp) {
+    static_assert(is_nvp_v<NvpT>, "push requires a name-value pair.");
+    return {nvp};
+}
+
+template <typename NvpT>
+constexpr accumulator<details::add_to_set_op, NvpT> add_to_set(const NvpT &nvp) {
+    static_assert(is_nvp_v<NvpT>, "add_to_set requires a name-value pair.");
+    return {nvp};
+}
+
+namespace details {
+
+// Checks, at compile time, that an output of a stage reads from Doc and writes to Result.
+template <typename Doc, typename Result, typename Output>
+struct output_matches
+    : public std::integral_constant<
+          bool,
+          std::is_base_of<typename Output::result_type, Result>::value &&
+              (std::is_void<typename Output::value_type::source_root>::value ||
+               std::is_base_of<typename Output::value_type::source_root, Doc>::value)> {};
+
+enum class stage_type { match, project, group, sort, limit, skip, unwind };
+
+struct pipeline_stage {
+    stage_type type;
+    mongocxx::stdx::optional<bsoncxx::document::value> document;
+    std::int32_t n;
+    std::string path;
+};
+
+}  // namespace details
+
+/**
+ * An aggregation pipeline over a collection of T, whose stages are built from name-value pairs
+ * and query builder expressions, so that field names and types are checked at compile time.
+ * Stages that reshape the documents, i.e. group() and project(), produce a pipeline whose
+ * documents are of a new result class, and check that every output field belongs to it.
+ *
+ * For example:
+ *     auto revenue = typed_pipeline<Order>{}
+ *                        .match(MANGROVE_KEY(Order::paid) == true)
+ *                        .group<Revenue>(MANGROVE_KEY(Order::customer),
+ *                                        sum(MANGROVE_KEY(Order::total))
+ *                                            .as(MANGROVE_KEY(Revenue::total)))
+ *                        .sort(MANGROVE_KEY(Revenue::total).sort(false))
+ *                        .limit(10);
+ *     for (Revenue r : collection_wrapper<Order>(coll).aggregate(revenue)) { ... }
+ *
+ * @tparam T    The type of the documents in the collection that the pipeline runs on.
+ * @tparam Doc  The type of the documents produced by the pipeline so far.
+ */
+template <typename T, typename Doc = T>
+class typed_pipeline {
+   public:
+    using collection_type = T;
+    using document_type = Doc;
+
+    typed_pipeline() = default;
+
+    /**
+     * Appends a $match stage.
+     * @param filter    A query expression on the current documents.
+     */
+    template <typename Query>
+    typed_pipeline &match(const Query &filter) {
+        static_assert(details::is_query_expression_v<Query>,
+                      "The $match stage requires a query expression.");
+        static_assert(details::expression_fields_of<Doc, Query>::value,
+                      "$match requires a query on fields of the current documents.");
+        return append(details::stage_type::match, filter);
+    }
+
+    /**
+     * Appends a $sort stage.
+     * @param order A sort expression, or a list of them, on the current documents.
+     */
+    template <typename Sort>
+    typed_pipeline &sort(const Sort &order) {
+        static_assert(details::is_sort_expression_v<Sort>,
+                      "The $sort stage requires a sort expression.");
+        static_assert(details::expression_fields_of<Doc, Sort>::value,
+                      "$sort requires a sort order on fields of the current documents.");
+        return append(details::stage_type::sort, order);
+    }
+
+    /**
+     * Appends a $limit stage.
+     */
+    typed_pipeline &limit(std::int32_t n) {
+        _stages.push_back({details::stage_type::limit, {}, n, {}});
+        return *this;
+    }
+
+    /**
+     * Appends a $skip stage.
+     */
+    typed_pipeline &skip(std::int32_t n) {
+        _stages.push_back({details::stage_type::skip, {}, n, {}});
+        return *this;
+    }
+
+    /**
+     * Appends an $unwind stage, which produces a document for each element of an array field.
+     * The documents keep their type, so this is typically followed by group() or project().
+     * @param field A name-value pair of an array field of the current documents.
+     */
+    template <typename NvpT>
+    typed_pipeline &unwind(const NvpT &field) {
+        static_assert(std::is_base_of<details::nvp_root_t<NvpT>, Doc>::value,
+                      "$unwind requires a field of the current documents.");
+        static_assert(is_iterable_v<typename NvpT::no_opt_type>,
+                      "$unwind requires an array field.");
+        std::string path(1, '$');
+        field.append_name(path);
+        _stages.push_back({details::stage_type::unwind, {}, 0, std::move(path)});
+        return *this;
+    }
+
+    /**
+     * Appends a $group stage that groups the current documents by a field, which becomes the _id
+     * of the results, and computes the other fields of the results with accumulators.
+     * @tparam Result   The class of the grouped documents. It must map an _id field of the same
+     *                  type as the key.
+     * @param key       A name-value pair of the current documents to group by.
+     * @param outputs   Accumulators, each given a field of Result with .as().
+     */
+    template <typename Result, typename Key, typename... Outputs>
+    std::enable_if_t<is_nvp_v<Key>, typed_pipeline<T, Result>> group(
+        const Key &key, const Outputs &... outputs) const {
+        static_assert(std::is_base_of<details::nvp_root_t<Key>, Doc>::value,
+                      "The $group key must be a field of the current documents.");
+        static_assert(details::has_mapped_id<Result>(),
+                      "The result of a $group stage must map an _id field.");
+        // After an $unwind, an array field holds single elements, so its elements may be the key.
+        using key_type = typename Key::no_opt_type;
+        static_assert(std::is_same<details::mapped_id_t<Result>, key_type>::value ||
+                          std::is_same<details::mapped_id_t<Result>,
+                                       iterable_value_t<key_type>>::value,
+                      "The _id of the result must have the same type as the $group key.");
+        return group_impl<Result>([&key](bsoncxx::builder::core &builder) {
+            details::append_field_reference(builder, key);
+        }, outputs...);
+    }
+
+    /**
+     * Appends a $group stage that puts all of the current documents into a single group.
+     * @tparam Result   The class of the grouped document.
+     * @param outputs   Accumulators, each given a field of Result with .as().
+     */
+    template <typename Result, typename... Outputs>
+    typed_pipeline<T, Result> group(std::nullptr_t, const Outputs &... outputs) const {
+        return group_impl<Result>(
+            [](bsoncxx::builder::core &builder) { builder.append(bsoncxx::types::b_null{}); },
+            outputs...);
+    }
+
+    /**
+     * Appends a $project stage that reshapes the current documents into objects of Result.
+     * The _id field is only kept if it is one of the outputs.
+     * @tparam Result   The class of the projected documents.
+     * @param outputs   Fields of the current documents, as value_of(field).as(result_field).
+     */
+    template <typename Result, typename... Outputs>
+    typed_pipeline<T, Result> project(const Outputs &... outputs) const {
+        static_assert(all_true<details::output_matches<Doc, Result, Outputs>::value...>::value,
+                      "Each output of $project must take a field of the current documents with "
+                      "value_of(), and give it to a field of the result with .as().");
+        auto builder = bsoncxx::builder::core(false);
+        bool has_id = false;
+        auto id = bsoncxx::stdx::string_view("_id");
+        (void)std::initializer_list<int>{(has_id = has_id || outputs.key() == id, 0)...};
+        if (!has_id) {
+            builder.key_view("_id").append(0);
+        }
+        (void)std::initializer_list<int>{(outputs.append_to_bson(builder), 0)...};
+        return next<Result>(details::stage_type::project, builder.extract_document());
+    }
+
+    /**
+     * Builds the driver pipeline to pass to mongocxx::collection::aggregate().
+     */
+    mongocxx::pipeline pipeline() const {
+        mongocxx::pipeline result;
+        for (const auto &stage : _stages) {
+            switch (stage.type) {
+                case details::stage_type::match:
+                    result.match(stage.document->view());
+                    break;
+                case details::stage_type::project:
+                    result.project(stage.document->view());
+                    break;
+                case details::stage_type::group:
+                    result.group(stage.document->view());
+                    break;
+                case details::stage_type::sort:
+                    result.sort(stage.document->view());
+                    break;
+                case details::stage_type::limit:
+                    result.limit(stage.n);
+                    break;
+                case details::stage_type::skip:
+                    result.skip(stage.n);
+                    break;
+                case details::stage_type::unwind:
+                    result.unwind(stage.path);
+                    break;
+            }
+        }
+        return result;
+    }
+
+   private:
+    template <typename, typename>
+    friend class typed_pipeline;
+
+    typed_pipeline(std::vector<details::pipeline_stage> stages) : _stages(std::move(stages)) {
+    }
+
+    template <typename Expr>
+    typed_pipeline &append(details::stage_type type, const Expr &expr) {
+        auto builder = bsoncxx::builder::core(false);
+        expr.append_to_bson(builder);
+        _stages.push_back({type, builder.extract_document(), 0, {}});
+        return *this;
+    }
+
+    template <typename Result>
+    typed_pipeline<T, Result> next(details::stage_type type,
+                                   bsoncxx::document::value document) const {
+        auto stages = _stages;
+        stages.push_back({type, std::move(document), 0, {}});
+        return typed_pipeline<T, Result>(std::move(stages));
+    }
+
+    template <typename Result, typename AppendId, typename... Outputs>
+    typed_pipeline<T, Result> group_impl(AppendId &&append_id, const Outputs &... outputs) const {
+        static_assert(all_true<details::output_matches<Doc, Result, Outputs>::value...>::value,
+                      "Each output of $group must accumulate a field of the current documents, "
+                      "and give it to a field of the result with .as().");
+        auto builder = bsoncxx::builder::core(false);
+        builder.key_view("_id");
+        append_id(builder);
+        (void)std::initializer_list<int>{(outputs.append_to_bson(builder), 0)...};
+        return next<Result>(details::stage_type::group, builder.extract_document());
+    }
+
+    std::vector<details::pipeline_stage> _stages;
+};
+
+MANGROVE_INLINE_NAMESPACE_END
+}  // namespace mangrove
+
+#include <mangrove/config/postlude.hpp>
@@ -0,0 +1,332 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <mangrove/config/prelude.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+#include <bsoncxx/stdx/optional.hpp>
+
+namespace mangrove {
+MANGROVE_INLINE_NAMESPACE_BEGIN
+
+/**
+ * Options for adaptive cursor batch sizing. A target of zero means that the corresponding budget
+ * is not enforced.
+ */
+class batch_size_options {
+   public:
+    /**
+     * Sets the number of bytes that a batch should hold, measured as the size of the BSON
+     * documents it is decoded from. This bounds the memory used by batches of large documents.
+     */
+    batch_size_options& target_bytes(std::size_t target_bytes) {
+        _target_bytes = target_bytes;
+        return *this;
+    }
+
+    std::size_t target_bytes() const {
+        return _target_bytes;
+    }
+
+    /**
+     * Sets the amount of time that the consumer of a cursor should spend on the objects of a
+     * batch, i.e. the time between two getMore round-trips. Fast consumers get large batches, so
+     * that they do not wait on round-trips, and slow ones get small batches.
+     */
+    batch_size_options& target_latency(std::chrono::milliseconds target_latency) {
+        _target_latency = target_latency;
+        return *this;
+    }
+
+    std::chrono::milliseconds target_latency() const {
+        return _target_latency;
+    }
+
+    /**
+     * Sets the bounds of the batch size, and the batch size used before anything was observed.
+     */
+    batch_size_options& min_batch_size(std::size_t min_batch_size) {
+        _min_batch_size = min_batch_size;
+        return *this;
+    }
+
+    std::size_t min_batch_size() const {
+        return _min_batch_size;
+    }
+
+    batch_size_options& max_batch_size(std::size_t max_batch_size) {
+        _max_batch_size = max_batch_size;
+        return *this;
+    }
+
+    std::size_t max_batch_size() const {
+        return _max_batch_size;
+    }
+
+    batch_size_options& initial_batch_size(std::size_t initial_batch_size) {
+        _initial_batch_size = initial_batch_size;
+        return *this;
+    }
+
+    std::size_t initial_batch_size() const {
+        return _initial_batch_size;
+    }
+
+   private:
+    std::size_t _target_bytes = 4 * 1024 * 1024;
+    std::chrono::milliseconds _target_latency{100};
+    std::size_t _min_batch_size = 16;
+    std::size_t _max_batch_size = 10000;
+    // The size of the first batch returned by the server by default.
+    std::size_t _initial_batch_size = 101;
+};
+
+/**
+ * What a batch_size_tuner has observed, and the batch size it currently picks.
+ */
+struct batch_size_stats {
+    // The number of queries whose batch size was chosen by the tuner.
+    std::uint64_t queries = 0;
+    // The number of documents, and their total BSON size, observed by tuned cursors.
+    std::uint64_t documents = 0;
+    std::uint64_t bytes = 0;
+    // Moving averages of the BSON size of a document, and of the time the consumer spends on an
+    // object before asking for the next one.
+    double average_document_bytes = 0;
+    std::chrono::nanoseconds average_processing_time{0};
+    // The batch size that the next query will use.
+    std::size_t batch_size = 0;
+};
+
+/**
+ * Chooses the batch size of queries from the size of the documents and the processing rate of
+ * the consumers observed by previous cursors, so that a batch meets a memory and a latency
+ * budget. This is thread-safe, so that cursors on different threads can share a tuner.
+ *
+ * The batch size of a cursor is fixed when its query is sent, so the observations of a cursor
+ * are applied to the queries that follow it.
+ */
+class batch_size_tuner {
+   public:
+    /**
+     * Enables the tuner with the given options, or disables it if the options are empty. The
+     * observations made so far are discarded.
+     */
+    void configure(const bsoncxx::stdx::optional<batch_size_options>& options) {
+        if (options && (options->min_batch_size() == 0 ||
+                        options->min_batch_size() > options->max_batch_size())) {
+            throw std::logic_error("mangrove: invalid bounds for the adaptive batch size.");
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        _options = options;
+        _stats = batch_size_stats{};
+        _stats.batch_size = _options ? _pick() : 0;
+    }
+
+    /**
+     * Returns whether the tuner is currently enabled.
+     */
+    bool enabled() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return static_cast<bool>(_options);
+    }
+
+    /**
+     * Returns the batch size to use for a new query, and counts the query.
+     * @return The batch size, or 0 if the tuner is disabled.
+     */
+    std::size_t next_batch_size() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_options) {
+            return 0;
+        }
+        ++_stats.queries;
+        return _stats.batch_size;
+    }
+
+    /**
+     * Records what a cursor observed over a number of documents.
+     *
+     * @param documents     The number of documents.
+     * @param bytes         Their total BSON size.
+     * @param processing    The total time the consumer spent on the objects decoded from them.
+     */
+    void record(std::size_t documents, std::size_t bytes, std::chrono::nanoseconds processing) {
+        if (documents == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_options) {
+            return;
+        }
+
+        double document_bytes = static_cast<double>(bytes) / documents;
+        double processing_ns = static_cast<double>(processing.count()) / documents;
+        if (_stats.documents == 0) {
+            _average_processing_ns = processing_ns;
+            _stats.average_document_bytes = document_bytes;
+        } else {
+            _average_processing_ns += k_smoothing * (processing_ns - _average_processing_ns);
+            _stats.average_document_bytes +=
+                k_smoothing * (document_bytes - _stats.average_document_bytes);
+        }
+        _stats.documents += documents;
+        _stats.bytes += bytes;
+        _stats.average_processing_time =
+            std::chrono::nanoseconds(static_cast<std::int64_t>(_average_processing_ns));
+        _stats.batch_size = _pick();
+    }
+
+    /**
+     * Returns a snapshot of the tuner's counters and estimates.
+     */
+    batch_size_stats stats() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _stats;
+    }
+
+   private:
+    // The weight of a new observation in the moving averages.
+    static constexpr double k_smoothing = 0.25;
+
+    std::size_t _pick() const {
+        if (_stats.documents == 0) {
+            return std::min(std::max(_options->initial_batch_size(), _options->min_batch_size()),
+                            _options->max_batch_size());
+        }
+
+        double size = static_cast<double>(_options->max_batch_size());
+        if (_options->target_bytes() && _stats.average_document_bytes > 0) {
+            size = std::min(size, _options->target_bytes() / _stats.average_document_bytes);
+        }
+        auto target_ns = std::chrono::nanoseconds(_options->target_latency()).count();
+        if (target_ns && _average_processing_ns > 0) {
+            size = std::min(size, target_ns / _average_processing_ns);
+        }
+        return std::max(static_cast<std::size_t>(size), _options->min_batch_size());
+    }
+
+    mutable std::mutex _mutex;
+    bsoncxx::stdx::optional<batch_size_options> _options;
+    batch_size_stats _stats;
+    double _average_processing_ns = 0;
+};
+
+namespace details {
+
+/**
+ * Accumulates what a deserializing_cursor observes for a batch_size_tuner, and reports it once
+ * per batch and when the cursor is destroyed, so that the tuner's lock is not taken for every
+ * document.
+ */
+class batch_size_sampler {
+    using clock = std::chrono::steady_clock;
+
+   public:
+    batch_size_sampler() = default;
+
+    batch_size_sampler(batch_size_tuner* tuner, std::size_t batch_size)
+        : _tuner(tuner), _batch_size(batch_size) {
+    }
+
+    batch_size_sampler(batch_size_sampler&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    batch_size_sampler& operator=(batch_size_sampler&& other) noexcept {
+        if (this != &other) {
+            flush();
+            _tuner = other._tuner;
+            _batch_size = other._batch_size;
+            _documents = other._documents;
+            _bytes = other._bytes;
+            _processing = other._processing;
+            _yielded_at = other._yielded_at;
+            _waiting = other._waiting;
+            other._tuner = nullptr;
+        }
+        return *this;
+    }
+
+    ~batch_size_sampler() {
+        flush();
+    }
+
+    bool active() const {
+        return _tuner != nullptr;
+    }
+
+    /**
+     * Counts a document read from the cursor.
+     */
+    void document(std::size_t bytes) {
+        ++_documents;
+        _bytes += bytes;
+        if (_documents >= _batch_size) {
+            flush();
+        }
+    }
+
+    /**
+     * Marks that an object was handed to the consumer.
+     */
+    void yielded() {
+        _yielded_at = clock::now();
+        _waiting = true;
+    }
+
+    /**
+     * Marks that the consumer asked for the next object.
+     */
+    void advanced() {
+        if (_waiting) {
+            _processing += clock::now() - _yielded_at;
+            _waiting = false;
+        }
+    }
+
+   private:
+    void flush() {
+        if (_tuner && _documents) {
+            _tuner->record(_documents, _bytes, _processing);
+        }
+        _documents = 0;
+        _bytes = 0;
+        _processing = std::chrono::nanoseconds{0};
+    }
+
+    batch_size_tuner* _tuner = nullptr;
+    std::size_t _batch_size = 0;
+    std::size_t _documents = 0;
+    std::size_t _bytes = 0;
+    std::chrono::nanoseconds _processing{0};
+    clock::time_point _yielded_at;
+    bool _waiting = false;
+};
+
+}  // namespace details
+
+MANGROVE_INLINE_NAMESPACE_END
+}  // namespace mangrove
+
+#include <mangrove/config/postlude.hpp>
@@ -16,18 +16,141 @@
 
 #include <mangrove/config/prelude.hpp>
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
 #include <iostream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <cereal/cereal.hpp>
 
 #include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/core.hpp>
 #include <bsoncxx/stdx/optional.hpp>
 #include <mongocxx/collection.hpp>
+#include <mongocxx/stdx.hpp>
 
+#include <boson/json_writer.hpp>
 #include <boson/mapping_functions.hpp>
+#include <mangrove/aggregation.hpp>
 #include <mangrove/deserializing_cursor.hpp>
+#include <mangrove/expression_syntax.hpp>
+#include <mangrove/metrics.hpp>
+#include <mangrove/scratch_builder.hpp>
 
 namespace mangrove {
 MANGROVE_INLINE_NAMESPACE_BEGIN
 
+namespace details {
+
+template <typename T, size_t... I>
+bsoncxx::document::value mapped_fields_projection_impl(std::index_sequence<I...>) {
+    auto builder = bsoncxx::builder::core(false);
+    (void)std::initializer_list<int>{
+        (builder.key_view(std::get<I>(T::mangrove_mapped_fields()).name).append(std::int32_t{1}),
+         0)...};
+    return builder.extract_document();
+}
+
+// Builds the projection of an export: the projection given in its options, if any, with an
+// inclusion of each exported field. _id is excluded unless it is mentioned by either.
+template <typename... NvpT>
+bsoncxx::document::value export_projection(
+    const mongocxx::stdx::optional<bsoncxx::document::view_or_value>& base,
+    const NvpT&... fields) {
+    std::vector<std::string> names;
+    (void)std::initializer_list<int>{
+        (names.emplace_back(), fields.append_name(names.back()), 0)...};
+    auto exported = [&names](const std::string& name) {
+        return std::find(names.begin(), names.end(), name) != names.end();
+    };
+
+    auto projection = bsoncxx::builder::core(false);
+    bool has_id = exported("_id");
+    if (base) {
+        for (auto&& element : base->view()) {
+            auto key = element.key().to_string();
+            if (!exported(key)) {
+                has_id = has_id || key == "_id";
+                projection.key_owned(key).append(element.get_value());
+            }
+        }
+    }
+    for (const auto& name : names) {
+        projection.key_view(name).append(std::int32_t{1});
+    }
+    if (!has_id) {
+        projection.key_view("_id").append(std::int32_t{0});
+    }
+    return projection.extract_document();
+}
+
+// The reply of the distinct command, of the form {values: [...]}.
+template <typename U>
+struct distinct_values {
+    std::vector<U> values;
+
+    template <class Archive>
+    void serialize(Archive& ar) {
+        ar(cereal::make_nvp("values", values));
+    }
+};
+
+// Like boson::serializing_iterator, but counts the serialization of each object as encoding in
+// an operation_timer.
+template <typename Iter>
+class encoding_iterator : public std::iterator<std::input_iterator_tag, bsoncxx::document::value> {
+   public:
+    encoding_iterator(Iter it, operation_timer* timer) : _it(it), _timer(timer) {
+    }
+
+    encoding_iterator& operator++() {
+        ++_it;
+        return *this;
+    }
+
+    void operator++(int) {
+        operator++();
+    }
+
+    bool operator==(const encoding_iterator& rhs) {
+        return _it == rhs._it;
+    }
+
+    bool operator!=(const encoding_iterator& rhs) {
+        return _it != rhs._it;
+    }
+
+    bsoncxx::document::value operator*() {
+        return _timer->encode([this]() { return boson::to_document(*_it); });
+    }
+
+   private:
+    Iter _it;
+    operation_timer* _timer;
+};
+
+}  // namespace details
+
+/**
+ * Returns a projection that includes exactly the fields that a class registers with
+ * MANGROVE_MAKE_KEYS, under the names they are stored with.
+ * @tparam T    A class with mapped fields.
+ * @return      A document of the form {field1: 1, field2: 1, ...}.
+ */
+template <typename T>
+bsoncxx::document::value mapped_fields_projection() {
+    static_assert(details::has_mapped_fields_v<T>,
+                  "mapped_fields_projection requires a class that uses MANGROVE_MAKE_KEYS.");
+    return details::mapped_fields_projection_impl<T>(
+        std::make_index_sequence<std::tuple_size<decltype(T::mangrove_mapped_fields())>::value>{});
+}
+
 template <class T>
 class collection_wrapper {
    public:
@@ -51,6 +174,15 @@ class collection_wrapper {
         return _coll;
     }
 
+    /**
+     * Sets the metrics that the operations of this wrapper are recorded in. The metrics must
+     * outlive this wrapper.
+     * @param metrics   The metrics to record in, or null to stop recording.
+     */
+    void set_metrics(model_metrics* metrics) {
+        _metrics = metrics;
+    }
+
     ///
     /// Runs an aggregation framework pipeline against this collection, and returns the results
     /// as de-serialized objects.
@@ -74,7 +206,36 @@ class collection_wrapper {
     deserializing_cursor<Result> aggregate(
         const mongocxx::pipeline& pipeline,
         const mongocxx::options::aggregate& options = mongocxx::options::aggregate()) {
-        return deserializing_cursor<Result>(_coll.aggregate(pipeline, options));
+        auto timer = start(operation::aggregate);
+        deserializing_cursor<Result> cursor(_coll.aggregate(pipeline, options));
+        cursor.instrument(std::move(timer));
+        return cursor;
+    }
+
+    ///
+    /// Runs a typed aggregation pipeline against this collection, and returns the results as
+    /// de-serialized objects of the type produced by the pipeline's last reshaping stage.
+    ///
+    /// @param pipeline
+    ///   The typed pipeline to run, which must start from documents of type T.
+    /// @param options
+    ///   Optional arguments, see mongocxx::mongocxx::options::aggregate.
+    ///
+    /// @return A deserializing_cursor<Result> with the results.
+    /// @throws
+    ///   If the operation failed, the returned cursor will throw an mongocxx::exception::query
+    ///   when it is iterated.
+    ///
+    /// @see typed_pipeline
+    ///
+    template <class Result>
+    deserializing_cursor<Result> aggregate(
+        const typed_pipeline<T, Result>& pipeline,
+        const mongocxx::options::aggregate& options = mongocxx::options::aggregate()) {
+        auto timer = start(operation::aggregate);
+        deserializing_cursor<Result> cursor(_coll.aggregate(pipeline.pipeline(), options));
+        cursor.instrument(std::move(timer));
+        return cursor;
     }
 
     ///
@@ -95,7 +256,93 @@ class collection_wrapper {
     deserializing_cursor<T> find(
         bsoncxx::document::view_or_value filter,
         const mongocxx::options::find& options = mongocxx::options::find()) {
-        return deserializing_cursor<T>(_coll.find(filter, options));
+        auto timer = start(operation::find);
+        deserializing_cursor<T> cursor(_coll.find(filter, options));
+        cursor.instrument(std::move(timer));
+        return cursor;
+    }
+
+    ///
+    /// Writes the documents in this collection which match the provided filter as Extended JSON,
+    /// straight from the BSON returned by the server, without deserializing them.
+    ///
+    /// @param filter
+    ///   Document view representing a document that should match the query.
+    /// @param options
+    ///   Optional arguments, see mongocxx::options::find. If fields are given, they are added
+    ///   to the projection, which must then be an inclusion projection.
+    /// @param writer
+    ///   The writer to which the documents are written. It is not finished, so that the results
+    ///   of several queries can be written to the same output.
+    /// @param fields
+    ///   The name-value pairs of the fields to export, from MANGROVE_KEY or MANGROVE_CHILD. Only
+    ///   these fields, and those in the projection, are returned by the server and written. By
+    ///   default, all fields are.
+    ///
+    /// @return The number of documents written.
+    /// @throws mongocxx::exception::query if the find failed.
+    ///
+    template <typename... NvpT>
+    std::size_t export_json(bsoncxx::document::view_or_value filter,
+                            mongocxx::options::find options, boson::json_writer& writer,
+                            const NvpT&... fields) {
+        auto timer = start(operation::find);
+        if (sizeof...(NvpT) > 0) {
+            options.projection(details::export_projection(options.projection(), fields...));
+        }
+
+        std::size_t count = 0;
+        for (auto&& doc : _coll.find(filter, options)) {
+            // Writing the documents is not decoding them. Like the processing of the objects of a
+            // cursor, it is left out of the operation's time.
+            timer.pause();
+            writer.write(doc);
+            timer.resume();
+            ++count;
+        }
+        return count;
+    }
+
+    template <typename... NvpT>
+    std::size_t export_json(bsoncxx::document::view_or_value filter, boson::json_writer& writer,
+                            const NvpT&... fields) {
+        return export_json(std::move(filter), mongocxx::options::find(), writer, fields...);
+    }
+
+    ///
+    /// Finds the distinct values of a field among the documents that match a filter, using the
+    /// distinct command so that only the values are sent by the server.
+    ///
+    /// @param field
+    ///   The name-value pair of the field, from MANGROVE_KEY or MANGROVE_CHILD.
+    /// @param filter
+    ///   Document view representing the documents to consider. By default, all of them.
+    /// @param options
+    ///   Optional arguments, see mongocxx::options::distinct.
+    ///
+    /// @return The distinct values. If the field is an array, these are its distinct elements.
+    /// @throws mongocxx::exception::query if the operation fails.
+    ///
+    /// @see https://docs.mongodb.com/manual/reference/command/distinct/
+    ///
+    template <typename NvpT>
+    std::vector<iterable_value_t<typename NvpT::no_opt_type>> distinct(
+        const NvpT& field,
+        bsoncxx::document::view_or_value filter = bsoncxx::document::view_or_value{},
+        const mongocxx::options::distinct& options = mongocxx::options::distinct()) {
+        static_assert(std::is_base_of<details::nvp_root_t<NvpT>, T>::value,
+                      "distinct requires a field of the collection's documents.");
+        using value_type = iterable_value_t<typename NvpT::no_opt_type>;
+
+        auto timer = start(operation::distinct);
+        std::string name;
+        field.append_name(name);
+        for (auto&& reply : _coll.distinct(name, filter, options)) {
+            return timer.decode(reply.length(), [&reply]() {
+                return boson::to_obj<details::distinct_values<value_type>>(reply).values;
+            });
+        }
+        return {};
     }
 
     ///
@@ -114,7 +361,8 @@ class collection_wrapper {
     mongocxx::stdx::optional<T> find_one(
         bsoncxx::document::view_or_value filter,
         const mongocxx::options::find& options = mongocxx::options::find()) {
-        return boson::to_optional_obj<T>(_coll.find_one(filter, options));
+        auto timer = start(operation::find_one);
+        return decode_optional(timer, _coll.find_one(filter, options));
     }
 
     ///
@@ -133,7 +381,8 @@ class collection_wrapper {
         bsoncxx::document::view_or_value filter,
         const mongocxx::options::find_one_and_delete& options =
             mongocxx::options::find_one_and_delete()) {
-        return boson::to_optional_obj<T>(_coll.find_one_and_delete(filter, options));
+        auto timer = start(operation::find_and_modify);
+        return decode_optional(timer, _coll.find_one_and_delete(filter, options));
     }
 
     ///
@@ -159,8 +408,69 @@ class collection_wrapper {
         bsoncxx::document::view_or_value filter, const T& replacement,
         const mongocxx::options::find_one_and_replace& options =
             mongocxx::options::find_one_and_replace()) {
-        return boson::to_optional_obj<T>(
-            _coll.find_one_and_replace(filter, boson::to_document(replacement), options));
+        auto timer = start(operation::find_and_modify);
+        auto doc = timer.encode([&replacement]() { return boson::to_document(replacement); });
+        return decode_optional(timer, _coll.find_one_and_replace(filter, doc.view(), options));
+    }
+
+    ///
+    /// Finds a single document matching the filter, updates it, and returns either the original
+    /// or the updated document as a deserialized object.
+    ///
+    /// If T registers its fields with MANGROVE_MAKE_KEYS and the options do not set a projection,
+    /// only the mapped fields are returned by the server.
+    ///
+    /// @param filter
+    ///   Document view representing a document that should be updated.
+    /// @param update
+    ///   Document view representing the update to apply to a matching document.
+    /// @param options
+    ///   Optional arguments, see mongocxx::options::find_one_and_update.
+    ///
+    /// @return The original or updated object.
+    /// @throws mongocxx::exception::write if the operation fails.
+    ///
+    /// @note
+    ///   In order to pass a write concern to this, you must use the collection
+    ///   level set write concern - collection::write_concern(wc).
+    ///
+    mongocxx::stdx::optional<T> find_one_and_update(
+        bsoncxx::document::view_or_value filter, bsoncxx::document::view_or_value update,
+        mongocxx::options::find_one_and_update options =
+            mongocxx::options::find_one_and_update()) {
+        if (!options.projection()) {
+            limit_projection(options);
+        }
+        auto timer = start(operation::find_and_modify);
+        return decode_optional(timer, _coll.find_one_and_update(filter, update, options));
+    }
+
+    ///
+    /// Finds a single document matching a query expression, applies an update expression to it,
+    /// and returns either the original or the updated document as a deserialized object.
+    ///
+    /// The expressions are serialized into this thread's scratch builders, so this does not
+    /// allocate documents for them.
+    ///
+    /// @param filter
+    ///   A query expression, built with MANGROVE_KEY.
+    /// @param update
+    ///   An update expression, or a list of them, built with MANGROVE_KEY.
+    /// @param options
+    ///   Optional arguments, see mongocxx::options::find_one_and_update.
+    ///
+    /// @return The original or updated object.
+    /// @throws mongocxx::exception::write if the operation fails.
+    ///
+    template <typename Query, typename Update,
+              typename = std::enable_if_t<details::is_query_expression_v<Query> &&
+                                          details::is_update_expression_v<Update>>>
+    mongocxx::stdx::optional<T> find_one_and_update(
+        const Query& filter, const Update& update,
+        mongocxx::options::find_one_and_update options =
+            mongocxx::options::find_one_and_update()) {
+        return find_one_and_update(serialize_filter(filter), serialize_update(update),
+                                   std::move(options));
     }
 
     ///
@@ -179,7 +489,9 @@ class collection_wrapper {
     ///
     mongocxx::stdx::optional<mongocxx::result::insert_one> insert_one(
         T obj, const mongocxx::options::insert& options = mongocxx::options::insert()) {
-        return _coll.insert_one(boson::to_document(obj), options);
+        auto timer = start(operation::insert);
+        auto doc = timer.encode([&obj]() { return boson::to_document(obj); });
+        return _coll.insert_one(doc.view(), options);
     }
 
     ///
@@ -242,8 +554,10 @@ class collection_wrapper {
     mongocxx::stdx::optional<mongocxx::result::insert_many> insert_many(
         object_iterator_type begin, object_iterator_type end,
         const mongocxx::options::insert& options = mongocxx::options::insert()) {
-        return _coll.insert_many(boson::serializing_iterator<object_iterator_type>(begin),
-                                 boson::serializing_iterator<object_iterator_type>(end), options);
+        auto timer = start(operation::insert);
+        return _coll.insert_many(details::encoding_iterator<object_iterator_type>(begin, &timer),
+                                 details::encoding_iterator<object_iterator_type>(end, &timer),
+                                 options);
     }
 
     ///
@@ -264,11 +578,40 @@ class collection_wrapper {
     mongocxx::stdx::optional<mongocxx::result::replace_one> replace_one(
         bsoncxx::document::view_or_value filter, const T& replacement,
         const mongocxx::options::update& options = mongocxx::options::update()) {
-        return _coll.replace_one(filter, boson::to_document(replacement), options);
+        auto timer = start(operation::replace);
+        auto doc = timer.encode([&replacement]() { return boson::to_document(replacement); });
+        return _coll.replace_one(filter, doc.view(), options);
     }
 
    private:
+    template <typename U = T>
+    static std::enable_if_t<details::has_mapped_fields_v<U>> limit_projection(
+        mongocxx::options::find_one_and_update& options) {
+        static const auto projection = mapped_fields_projection<U>();
+        options.projection(projection.view());
+    }
+
+    template <typename U = T>
+    static std::enable_if_t<!details::has_mapped_fields_v<U>> limit_projection(
+        mongocxx::options::find_one_and_update&) {
+    }
+
+    details::operation_timer start(operation op) {
+        return details::operation_timer(_metrics, op);
+    }
+
+    static mongocxx::stdx::optional<T> decode_optional(
+        details::operation_timer& timer,
+        const mongocxx::stdx::optional<bsoncxx::document::value>& doc) {
+        if (!doc) {
+            return {};
+        }
+        auto view = doc->view();
+        return timer.decode(view.length(), [&view]() { return boson::to_obj<T>(view); });
+    }
+
     mongocxx::collection _coll;
+    model_metrics* _metrics = nullptr;
 };
 
 MANGROVE_INLINE_NAMESPACE_END
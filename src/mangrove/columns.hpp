@@ -0,0 +1,223 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <mangrove/config/prelude.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <bsoncxx/document/element.hpp>
+#include <bsoncxx/document/view.hpp>
+#include <bsoncxx/oid.hpp>
+#include <bsoncxx/types.hpp>
+
+#include <boson/bson_archiver.hpp>
+#include <boson/bson_streambuf.hpp>
+#include <mangrove/nvp.hpp>
+#include <mangrove/util.hpp>
+
+namespace mangrove {
+MANGROVE_INLINE_NAMESPACE_BEGIN
+
+namespace details {
+
+/**
+ * The type in which a column stores the values of a field of type T. Bools are stored as bytes,
+ * since std::vector<bool> packs them into bits that are only reachable through proxy objects,
+ * which loops over the column cannot process in place.
+ */
+template <typename T>
+struct column_storage {
+    using type = T;
+};
+
+template <>
+struct column_storage<bool> {
+    using type = std::uint8_t;
+};
+
+template <typename T>
+using column_storage_t = typename column_storage<T>::type;
+
+}  // namespace details
+
+/**
+ * The values of one field over a set of documents, stored contiguously, as returned by
+ * deserializing_cursor::collect_columns().
+ *
+ * @tparam T The type of the field, without its optional wrapper if it has one. The values of
+ *           bool fields are stored as std::uint8_t.
+ */
+template <typename T>
+struct column {
+    // The value of the field in each row. Rows in which the field is null hold a
+    // default-constructed value.
+    std::vector<details::column_storage_t<T>> values;
+
+    // Whether the field may be null, because it or one of its parents is optional. If so, nulls
+    // holds a byte per row that is 1 when the field is missing or null in that row. Otherwise,
+    // nulls is empty.
+    bool nullable = false;
+    std::vector<std::uint8_t> nulls;
+
+    std::size_t size() const {
+        return values.size();
+    }
+
+    bool is_null(std::size_t row) const {
+        return nullable && nulls[row] != 0;
+    }
+};
+
+namespace details {
+
+/**
+ * Converts the value of a BSON element to a field of type T. This uses a BSONInputArchive on the
+ * document that contains the element, so that any type that boson can deserialize can be read
+ * into a column.
+ */
+template <typename T>
+struct column_value {
+    static void load(bsoncxx::document::view parent, const std::string& key,
+                     const bsoncxx::document::element&, T& out) {
+        boson::bson_istream bis(parent);
+        boson::BSONInputArchive archive(bis);
+        archive(cereal::make_nvp(key, out));
+    }
+};
+
+/**
+ * Converts BSON values to the scalar types that boson deserializes directly, without an archive.
+ * These accept the same BSON types as BSONInputArchive::loadValue().
+ */
+#define MANGROVE_COLUMN_VALUE(cxxtype, btype, expr)                                          \
+    template <>                                                                              \
+    struct column_value<cxxtype> {                                                           \
+        static void load(bsoncxx::document::view, const std::string&,                        \
+                         const bsoncxx::document::element& elem, cxxtype& out) {             \
+            if (elem.type() != bsoncxx::type::k_##btype) {                                   \
+                throw boson::Exception("Type mismatch when loading values.");                \
+            }                                                                                \
+            out = expr;                                                                      \
+        }                                                                                    \
+    };
+
+MANGROVE_COLUMN_VALUE(bool, bool, elem.get_bool().value)
+MANGROVE_COLUMN_VALUE(std::int32_t, int32, elem.get_int32().value)
+MANGROVE_COLUMN_VALUE(std::int64_t, int64, elem.get_int64().value)
+MANGROVE_COLUMN_VALUE(double, double, elem.get_double().value)
+MANGROVE_COLUMN_VALUE(std::string, utf8, elem.get_utf8().value.to_string())
+MANGROVE_COLUMN_VALUE(bsoncxx::oid, oid, elem.get_oid().value)
+MANGROVE_COLUMN_VALUE(std::chrono::system_clock::time_point, date,
+                      std::chrono::system_clock::time_point(
+                          std::chrono::milliseconds{elem.get_date().value}))
+
+#undef MANGROVE_COLUMN_VALUE
+
+/**
+ * Reads one field, given by its path in dot notation, out of documents and appends it to a
+ * column. Only the elements along the path are looked at, so the rest of each document is never
+ * decoded.
+ */
+template <typename NvpT>
+class column_reader {
+   public:
+    using value_type = typename NvpT::no_opt_type;
+    static constexpr bool nullable = may_be_null<NvpT>::value;
+
+    explicit column_reader(const NvpT& field) {
+        auto name = field.get_name();
+        std::size_t start = 0;
+        for (auto dot = name.find('.'); dot != std::string::npos; dot = name.find('.', start)) {
+            _parents.push_back(name.substr(start, dot - start));
+            start = dot + 1;
+        }
+        _key = name.substr(start);
+    }
+
+    column<value_type> make_column() const {
+        column<value_type> col;
+        col.nullable = nullable;
+        return col;
+    }
+
+    /**
+     * Appends the field of a document to a column. If a required field is missing or cannot be
+     * converted, this throws a boson::Exception and leaves the column unchanged.
+     */
+    void read(bsoncxx::document::view doc, column<value_type>& col) const {
+        bsoncxx::document::element elem;
+        bool found = true;
+        for (const auto& parent : _parents) {
+            auto sub = doc[parent];
+            if (!sub || sub.type() != bsoncxx::type::k_document) {
+                found = false;
+                break;
+            }
+            doc = sub.get_document().value;
+        }
+        if (found) {
+            elem = doc[_key];
+        }
+
+        if (!elem || elem.type() == bsoncxx::type::k_null) {
+            if (!nullable) {
+                throw boson::Exception(elem ? "Type mismatch when loading values."
+                                            : "No element found with the key " + _key + ".");
+            }
+            col.values.emplace_back();
+            col.nulls.push_back(1);
+            return;
+        }
+
+        value_type value{};
+        column_value<value_type>::load(doc, _key, elem, value);
+        col.values.push_back(std::move(value));
+        if (nullable) {
+            col.nulls.push_back(0);
+        }
+    }
+
+    /**
+     * Removes the rows of a column past the given count, to undo reading a document whose other
+     * fields could not be read.
+     */
+    static void truncate(column<value_type>& col, std::size_t rows) {
+        col.values.erase(col.values.begin() + rows, col.values.end());
+        if (nullable) {
+            col.nulls.resize(rows);
+        }
+    }
+
+   private:
+    std::vector<std::string> _parents;
+    std::string _key;
+};
+
+template <typename NvpT>
+constexpr bool column_reader<NvpT>::nullable;
+
+}  // namespace details
+
+MANGROVE_INLINE_NAMESPACE_END
+}  // namespace mangrove
+
+#include <mangrove/config/postlude.hpp>
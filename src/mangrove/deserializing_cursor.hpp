@@ -16,13 +16,29 @@
 
 #include <mangrove/config/prelude.hpp>
 
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <initializer_list>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <bsoncxx/builder/basic/document.hpp>
 #include <bsoncxx/stdx/optional.hpp>
 #include <mongocxx/cursor.hpp>
 
 #include <boson/mapping_functions.hpp>
+#include <mangrove/batch_size_tuner.hpp>
+#include <mangrove/columns.hpp>
+#include <mangrove/metrics.hpp>
+#include <mangrove/nvp.hpp>
+#include <mangrove/ref.hpp>
 
 namespace mangrove {
 MANGROVE_INLINE_NAMESPACE_BEGIN
@@ -42,33 +58,236 @@ class deserializing_cursor {
     class iterator;
 
     iterator begin() {
-        return iterator(_c.begin(), _c.end());
+        details::operation_timer::section section(_timer);
+        return iterator(_c.begin(), _c.end(), this);
     }
 
     iterator end() {
         return iterator(_c.end(), _c.end());
     }
 
+    /**
+     * Resolves a reference field of the results in batches. Rather than yielding each object as
+     * soon as it is read, the cursor reads up to prefetch_batch_size() objects ahead, collects
+     * the _ids they refer to through the given field, and looks them all up with a single $in
+     * query using U::find_map_by_ids(). Accessing the field of a yielded object then does not
+     * query the database.
+     *
+     * This must be called before iteration begins, and may be called for several fields.
+     * When called on a temporary cursor, e.g. the result of T::find(), the cursor is moved into
+     * the returned value, so that the call can be chained in a range-based for loop.
+     *
+     * @param field A reference field of T, as returned by MANGROVE_KEY(T::field).
+     * @return      This cursor, so that calls can be chained.
+     */
+    template <typename Base, typename U, typename IdType>
+    deserializing_cursor& prefetch(const nvp<Base, ref<U, IdType>>& field) & {
+        static_assert(std::is_base_of<Base, T>::value,
+                      "prefetch requires a field of the cursor's result type.");
+        auto member = field.t;
+        _prefetchers.push_back([member](std::vector<T>& objs) {
+            std::vector<IdType> ids;
+            ids.reserve(objs.size());
+            for (const T& obj : objs) {
+                ids.push_back((obj.*member).id());
+            }
+
+            std::map<IdType, std::shared_ptr<const U>> targets;
+            for (auto&& found : U::find_map_by_ids(ids)) {
+                targets.emplace(found.first, std::make_shared<const U>(std::move(found.second)));
+            }
+
+            for (const T& obj : objs) {
+                auto it = targets.find((obj.*member).id());
+                (obj.*member).resolve(it == targets.end() ? nullptr : it->second);
+            }
+        });
+        return *this;
+    }
+
+    template <typename Base, typename U, typename IdType>
+    deserializing_cursor prefetch(const nvp<Base, ref<U, IdType>>& field) && {
+        prefetch(field);
+        return std::move(*this);
+    }
+
+    /**
+     * Sets the number of objects that are read ahead and resolved together by prefetch().
+     * This is best set to the batch size of the underlying query.
+     */
+    deserializing_cursor& prefetch_batch_size(std::size_t batch_size) & {
+        if (batch_size == 0) {
+            throw std::logic_error("mangrove: the prefetch batch size must be positive.");
+        }
+        _prefetch_batch_size = batch_size;
+        return *this;
+    }
+
+    deserializing_cursor prefetch_batch_size(std::size_t batch_size) && {
+        prefetch_batch_size(batch_size);
+        return std::move(*this);
+    }
+
+    std::size_t prefetch_batch_size() const {
+        return _prefetch_batch_size;
+    }
+
+    /**
+     * Reports the size of the documents read by this cursor, and the time its consumer spends on
+     * each object, to a batch_size_tuner. This must be called before iteration begins, and the
+     * tuner must outlive the cursor.
+     *
+     * @param tuner         The tuner that chose the batch size of the query.
+     * @param batch_size    The batch size of the query, which is also used for prefetch().
+     * @return              This cursor, so that calls can be chained.
+     */
+    deserializing_cursor& adapt_batch_size(batch_size_tuner& tuner, std::size_t batch_size) {
+        prefetch_batch_size(batch_size);
+        _sampler = details::batch_size_sampler(&tuner, batch_size);
+        return *this;
+    }
+
+    /**
+     * Adds the time spent advancing this cursor, and the documents it decodes and skips, to the
+     * operation measured by the given timer. The timer is paused while the caller holds an
+     * object, and reports the operation when this cursor is destroyed.
+     */
+    deserializing_cursor& instrument(details::operation_timer timer) {
+        _timer = std::move(timer);
+        _timer.pause();
+        return *this;
+    }
+
+    /**
+     * Reads the remaining results into columns, one per given field, rather than into objects
+     * of type T. Each column holds the values of its field contiguously, in the order of the
+     * results, so that the data can be processed by loops that only touch the fields they need.
+     *
+     * Only the given fields are decoded. Optional fields are read without their optional
+     * wrapper, and their column records which rows are null, i.e. do not have the field or have
+     * it set to null. Like iteration, this skips documents that miss a required field or that
+     * cannot be converted to the type of a field, so that the columns always have the same
+     * number of rows.
+     *
+     * This consumes the cursor, and cannot be combined with iteration or with prefetch().
+     *
+     * @param fields    Fields of T, as returned by MANGROVE_KEY(T::field) or
+     *                  MANGROVE_CHILD(T, field, subfield).
+     * @return          A tuple with a column<F> for each field, where F is the type of the field.
+     */
+    template <typename... NvpT>
+    std::tuple<column<typename NvpT::no_opt_type>...> collect_columns(const NvpT&... fields) {
+        static_assert(sizeof...(NvpT) > 0, "collect_columns requires at least one field.");
+        if (prefetching()) {
+            throw std::logic_error("mangrove: collect_columns cannot be used with prefetch().");
+        }
+        details::operation_timer::section section(_timer);
+        std::tuple<details::column_reader<NvpT>...> readers{
+            details::column_reader<NvpT>(fields)...};
+        return collect_columns(readers, std::index_sequence_for<NvpT...>{});
+    }
+
    private:
+    template <typename... NvpT, std::size_t... I>
+    std::tuple<column<typename NvpT::no_opt_type>...> collect_columns(
+        const std::tuple<details::column_reader<NvpT>...>& readers, std::index_sequence<I...>) {
+        std::tuple<column<typename NvpT::no_opt_type>...> columns{
+            std::get<I>(readers).make_column()...};
+        std::size_t rows = 0;
+
+        for (auto&& doc : _c) {
+            if (_sampler.active()) {
+                _sampler.document(doc.length());
+            }
+            try {
+                _timer.decode(doc.length(), [&]() {
+                    (void)std::initializer_list<int>{
+                        (std::get<I>(readers).read(doc, std::get<I>(columns)), 0)...};
+                    return true;
+                });
+                ++rows;
+                if (_sampler.active()) {
+                    _sampler.yielded();
+                }
+            } catch (boson::Exception& e) {
+                // Remove the fields that were read before the one that failed.
+                (void)std::initializer_list<int>{
+                    (details::column_reader<NvpT>::truncate(std::get<I>(columns), rows), 0)...};
+                _timer.skipped();
+            }
+        }
+        return columns;
+    }
+
+    // The number of documents in the first batch returned by the server by default.
+    static constexpr std::size_t k_default_prefetch_batch_size = 101;
+
+    bool prefetching() const {
+        return !_prefetchers.empty();
+    }
+
+    T decode(const bsoncxx::document::view& doc) {
+        return _timer.decode(doc.length(), [&doc]() { return boson::to_obj<T>(doc); });
+    }
+
+    /**
+     * Reads the next batch of objects from the underlying cursor, skipping documents that cannot
+     * be deserialized, runs the prefetchers over it, and adds it to the buffer of objects that
+     * are ready to be yielded.
+     */
+    void fill_buffer(mongocxx::cursor::iterator& ci, const mongocxx::cursor::iterator& ci_end) {
+        std::vector<T> batch;
+        while (ci != ci_end && batch.size() < _prefetch_batch_size) {
+            if (_sampler.active()) {
+                _sampler.document((*ci).length());
+            }
+            try {
+                batch.push_back(decode(*ci));
+            } catch (boson::Exception& e) {
+                _timer.skipped();
+            }
+            ++ci;
+        }
+
+        for (auto& prefetcher : _prefetchers) {
+            prefetcher(batch);
+        }
+        for (auto& obj : batch) {
+            _buffer.push_back(std::move(obj));
+        }
+    }
+
     mongocxx::cursor _c;
+    std::vector<std::function<void(std::vector<T>&)>> _prefetchers;
+    std::size_t _prefetch_batch_size = k_default_prefetch_batch_size;
+    // Objects that have been read ahead of the iterator when prefetching.
+    std::deque<T> _buffer;
+    details::batch_size_sampler _sampler;
+    details::operation_timer _timer;
 };
 
 template <class T>
 class deserializing_cursor<T>::iterator : public std::iterator<std::input_iterator_tag, T> {
    public:
-    iterator(mongocxx::cursor::iterator ci, mongocxx::cursor::iterator ci_end)
-        : _ci(ci), _ci_end(ci_end) {
+    iterator(mongocxx::cursor::iterator ci, mongocxx::cursor::iterator ci_end,
+             deserializing_cursor* owner = nullptr)
+        : _ci(ci), _ci_end(ci_end), _owner(owner) {
         skip_invalid_documents();
     }
 
-    iterator(const deserializing_cursor::iterator& dsi) : _ci(dsi._ci), _ci_end(dsi._ci_end) {
+    iterator(const deserializing_cursor::iterator& dsi)
+        : _ci(dsi._ci), _ci_end(dsi._ci_end), _opt(dsi._opt), _owner(dsi._owner) {
         skip_invalid_documents();
     }
 
     iterator& operator++() {
-        ++_ci;
-        _opt = mongocxx::stdx::nullopt;
-        skip_invalid_documents();
+        if (!_owner) {
+            advance();
+            return *this;
+        }
+        details::operation_timer::section section(_owner->_timer);
+        _owner->_sampler.advanced();
+        advance();
         return *this;
     }
 
@@ -76,12 +295,14 @@ class deserializing_cursor<T>::iterator : public std::iterator<std::input_iterat
         operator++();
     }
 
+    // When prefetching, the underlying cursor runs ahead of the objects that are yielded, so an
+    // iterator is only at the end once it also has no current object.
     bool operator==(const iterator& rhs) {
-        return _ci == rhs._ci;
+        return _ci == rhs._ci && bool(_opt) == bool(rhs._opt);
     }
 
     bool operator!=(const iterator& rhs) {
-        return _ci != rhs._ci;
+        return !(*this == rhs);
     }
 
     /**
@@ -99,6 +320,29 @@ class deserializing_cursor<T>::iterator : public std::iterator<std::input_iterat
     // Cached object value. When this is non-empty, this always contains the current object pointed
     // to by the cursor.
     mongocxx::stdx::optional<T> _opt;
+    // The cursor that this iterates, which holds the objects read ahead when prefetching. This is
+    // null for end iterators.
+    deserializing_cursor* _owner;
+
+    bool prefetching() const {
+        return _owner && _owner->prefetching();
+    }
+
+    bool sampling() const {
+        return _owner && _owner->_sampler.active();
+    }
+
+    void advance() {
+        if (!prefetching()) {
+            ++_ci;
+        }
+        _opt = mongocxx::stdx::nullopt;
+        skip_invalid_documents();
+    }
+
+    T decode(const bsoncxx::document::view& doc) {
+        return _owner ? _owner->decode(doc) : boson::to_obj<T>(doc);
+    }
 
     /**
      * Iterates over documents, and skips documents that cannot be properly deserialized into an
@@ -109,18 +353,51 @@ class deserializing_cursor<T>::iterator : public std::iterator<std::input_iterat
      * dereferencing.
      */
     void skip_invalid_documents() {
+        if (prefetching()) {
+            next_prefetched();
+            return;
+        }
         while (_ci != _ci_end) {
             try {
                 if (!_opt) {
-                    _opt = boson::to_obj<T>(*_ci);
+                    if (sampling()) {
+                        _owner->_sampler.document((*_ci).length());
+                    }
+                    _opt = decode(*_ci);
+                    if (sampling()) {
+                        _owner->_sampler.yielded();
+                    }
                 }
                 return;
             } catch (boson::Exception& e) {
+                if (_owner) {
+                    _owner->_timer.skipped();
+                }
                 ++_ci;
                 _opt = mongocxx::stdx::nullopt;
             }
         }
     }
+
+    /**
+     * Takes the next object from the cursor's buffer, reading the next batch when it is empty.
+     */
+    void next_prefetched() {
+        if (_opt) {
+            return;
+        }
+        auto& buffer = _owner->_buffer;
+        while (buffer.empty() && _ci != _ci_end) {
+            _owner->fill_buffer(_ci, _ci_end);
+        }
+        if (!buffer.empty()) {
+            _opt = std::move(buffer.front());
+            buffer.pop_front();
+            if (sampling()) {
+                _owner->_sampler.yielded();
+            }
+        }
+    }
 };
 
 MANGROVE_INLINE_NAMESPACE_END
@@ -0,0 +1,262 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <mangrove/config/prelude.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+
+#include <bsoncxx/stdx/optional.hpp>
+
+namespace mangrove {
+MANGROVE_INLINE_NAMESPACE_BEGIN
+
+/**
+ * Options for the read-through identity cache that backs model<T>::find_by_id().
+ * A limit of zero means that the corresponding budget is not enforced.
+ */
+class id_cache_options {
+   public:
+    /**
+     * Sets the maximum number of objects kept in the cache. When the cache grows past this
+     * number, the least recently used objects are evicted.
+     */
+    id_cache_options& max_entries(std::size_t max_entries) {
+        _max_entries = max_entries;
+        return *this;
+    }
+
+    std::size_t max_entries() const {
+        return _max_entries;
+    }
+
+    /**
+     * Sets the maximum number of bytes kept in the cache, measured as the size of the BSON
+     * documents that the cached objects were decoded from.
+     */
+    id_cache_options& max_bytes(std::size_t max_bytes) {
+        _max_bytes = max_bytes;
+        return *this;
+    }
+
+    std::size_t max_bytes() const {
+        return _max_bytes;
+    }
+
+    /**
+     * Sets the amount of time after which a cached object is considered stale and is fetched
+     * from the database again. This bounds how long changes that were not made through the model
+     * (e.g. by another process) can go unnoticed.
+     */
+    id_cache_options& ttl(std::chrono::milliseconds ttl) {
+        _ttl = ttl;
+        return *this;
+    }
+
+    std::chrono::milliseconds ttl() const {
+        return _ttl;
+    }
+
+   private:
+    std::size_t _max_entries = 1024;
+    std::size_t _max_bytes = 0;
+    std::chrono::milliseconds _ttl{0};
+};
+
+/**
+ * A thread-safe LRU cache of deserialized objects, keyed by their _id.
+ *
+ * The cache is disabled until configure() is called with a set of options, and all lookups miss
+ * while it is disabled. Every invalidation bumps a generation counter; an object fetched from the
+ * database is only inserted if no invalidation happened since the fetch started, so that a
+ * concurrent write can never be shadowed by a stale read.
+ *
+ * @tparam IdType   The type of the _id field. Must be copyable and less-than comparable.
+ * @tparam T        The type of the cached objects.
+ */
+template <typename IdType, typename T>
+class id_cache {
+    using clock = std::chrono::steady_clock;
+
+    struct entry {
+        IdType id;
+        T obj;
+        std::size_t bytes;
+        clock::time_point expires;
+    };
+
+    using lru_list = std::list<entry>;
+
+   public:
+    /**
+     * Enables the cache with the given options, or disables and empties it if the options are
+     * empty.
+     */
+    void configure(const bsoncxx::stdx::optional<id_cache_options>& options) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _options = options;
+        ++_generation;
+        _clear();
+    }
+
+    /**
+     * Returns whether the cache is currently enabled.
+     */
+    bool enabled() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return static_cast<bool>(_options);
+    }
+
+    /**
+     * Looks up an object by its _id. A hit marks the object as most recently used.
+     * @return A copy of the cached object, or an empty optional if it is absent or expired.
+     */
+    bsoncxx::stdx::optional<T> get(const IdType& id) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _index.find(id);
+        if (it == _index.end()) {
+            return {};
+        }
+
+        if (_expired(*it->second)) {
+            _erase(it);
+            return {};
+        }
+
+        _lru.splice(_lru.begin(), _lru, it->second);
+        return it->second->obj;
+    }
+
+    /**
+     * Returns the current generation. This must be read before fetching an object from the
+     * database, and passed along to put() afterwards.
+     */
+    std::uint64_t generation() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _generation;
+    }
+
+    /**
+     * Inserts an object into the cache, evicting the least recently used objects as needed.
+     * The object is dropped if the cache is disabled, if the cache was invalidated since
+     * `generation` was read, or if the object alone exceeds the byte budget.
+     *
+     * @param id            The _id of the object.
+     * @param obj           The object to cache.
+     * @param bytes         The size of the BSON document the object was decoded from.
+     * @param generation    The value of generation() read before the object was fetched.
+     */
+    void put(const IdType& id, const T& obj, std::size_t bytes, std::uint64_t generation) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_options || generation != _generation ||
+            (_options->max_bytes() && bytes > _options->max_bytes())) {
+            return;
+        }
+
+        auto it = _index.find(id);
+        if (it != _index.end()) {
+            _erase(it);
+        }
+
+        auto expires = _options->ttl().count() ? clock::now() + _options->ttl()
+                                                : clock::time_point::max();
+        _lru.push_front(entry{id, obj, bytes, expires});
+        _index.emplace(id, _lru.begin());
+        _bytes += bytes;
+        _evict();
+    }
+
+    /**
+     * Removes the object with the given _id, if present.
+     */
+    void erase(const IdType& id) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_generation;
+        auto it = _index.find(id);
+        if (it != _index.end()) {
+            _erase(it);
+        }
+    }
+
+    /**
+     * Removes every object from the cache. This is used after writes whose effect on individual
+     * _id's is not known, such as update_many() or delete_many().
+     */
+    void clear() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_generation;
+        _clear();
+    }
+
+    /**
+     * Returns the number of objects currently in the cache.
+     */
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _index.size();
+    }
+
+    /**
+     * Returns the total BSON size of the objects currently in the cache.
+     */
+    std::size_t bytes() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _bytes;
+    }
+
+   private:
+    bool _expired(const entry& e) const {
+        return clock::now() >= e.expires;
+    }
+
+    void _erase(typename std::map<IdType, typename lru_list::iterator>::iterator it) {
+        _bytes -= it->second->bytes;
+        _lru.erase(it->second);
+        _index.erase(it);
+    }
+
+    void _clear() {
+        _lru.clear();
+        _index.clear();
+        _bytes = 0;
+    }
+
+    // Evicts least recently used objects until the cache fits within its budgets.
+    void _evict() {
+        while (!_lru.empty() &&
+               ((_options->max_entries() && _lru.size() > _options->max_entries()) ||
+                (_options->max_bytes() && _bytes > _options->max_bytes()))) {
+            _erase(_index.find(_lru.back().id));
+        }
+    }
+
+    mutable std::mutex _mutex;
+    bsoncxx::stdx::optional<id_cache_options> _options;
+    // Most recently used objects are at the front.
+    lru_list _lru;
+    std::map<IdType, typename lru_list::iterator> _index;
+    std::size_t _bytes = 0;
+    std::uint64_t _generation = 0;
+};
+
+MANGROVE_INLINE_NAMESPACE_END
+}  // namespace mangrove
+
+#include <mangrove/config/postlude.hpp>
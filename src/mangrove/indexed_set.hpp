@@ -0,0 +1,553 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <mangrove/config/prelude.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <bsoncxx/stdx/optional.hpp>
+#include <mongocxx/stdx.hpp>
+
+#include <boson/mapping_functions.hpp>
+#include <mangrove/query_builder.hpp>
+
+namespace mangrove {
+MANGROVE_INLINE_NAMESPACE_BEGIN
+
+/**
+ * Describes how indexed_set<T> answers a query, as returned by indexed_set<T>::explain().
+ */
+struct index_explanation {
+    // "IXSCAN" if the query is answered from an index, or "COLLSCAN" if every object is scanned.
+    std::string stage;
+    // The field of the chosen index, if any.
+    std::string index_field;
+    // The type of the chosen index, "hash" or "ordered", if any.
+    std::string index_type;
+    // The number of objects that the query is evaluated against.
+    std::size_t examined;
+};
+
+namespace details {
+
+/**
+ * The key type of an index on a field. Array fields are indexed by their elements, and optional
+ * fields by their underlying values.
+ */
+template <typename Field>
+using index_key_t = iterable_value_t<remove_optional_t<Field>>;
+
+template <typename V, typename F>
+std::enable_if_t<!is_iterable_v<V>> for_each_key(const V &v, F &&f) {
+    f(v);
+}
+
+template <typename V, typename F>
+std::enable_if_t<is_iterable_v<V>> for_each_key(const V &v, F &&f) {
+    for (const auto &elem : v) {
+        f(elem);
+    }
+}
+
+template <typename V, typename F>
+void for_each_key(const bsoncxx::stdx::optional<V> &v, F &&f) {
+    if (v) {
+        for_each_key(*v, f);
+    }
+}
+
+/**
+ * The interface of a secondary index over the objects in an indexed_set. Objects are identified
+ * by the position of their slot in the set.
+ */
+template <typename T>
+class index_base {
+   public:
+    virtual ~index_base() = default;
+
+    virtual const std::string &field_name() const = 0;
+    virtual const char *type() const = 0;
+
+    virtual void insert(const T &obj, std::size_t slot) = 0;
+    virtual void erase(const T &obj, std::size_t slot) = 0;
+};
+
+/**
+ * An index with a specific key type. Query planning looks up indexes by their field name, and
+ * then casts them to this type according to the type of the query operand.
+ */
+template <typename T, typename Key>
+class key_index : public index_base<T> {
+   public:
+    // Appends the slots of the objects that have a key equal to `key`.
+    virtual void find_equal(const Key &key, std::vector<std::size_t> &slots) const = 0;
+
+    /**
+     * Appends the slots of the objects that have a key in the given range, and returns true.
+     * Returns false if this index does not support range lookups.
+     */
+    virtual bool find_range(const Key *lower, bool lower_inclusive, const Key *upper,
+                            bool upper_inclusive, std::vector<std::size_t> &slots) const = 0;
+};
+
+template <typename T, typename Field, typename Map>
+class field_index : public key_index<T, index_key_t<Field>> {
+   public:
+    using key_type = index_key_t<Field>;
+
+    field_index(const nvp<T, Field> &field, const char *type)
+        : _field(field), _name(field.get_name()), _type(type) {
+    }
+
+    const std::string &field_name() const override {
+        return _name;
+    }
+
+    const char *type() const override {
+        return _type;
+    }
+
+    void insert(const T &obj, std::size_t slot) override {
+        for_each_key(obj.*_field.t, [&](const key_type &key) { _entries.emplace(key, slot); });
+    }
+
+    void erase(const T &obj, std::size_t slot) override {
+        for_each_key(obj.*_field.t, [&](const key_type &key) {
+            auto range = _entries.equal_range(key);
+            for (auto it = range.first; it != range.second;) {
+                it = it->second == slot ? _entries.erase(it) : std::next(it);
+            }
+        });
+    }
+
+    void find_equal(const key_type &key, std::vector<std::size_t> &slots) const override {
+        auto range = _entries.equal_range(key);
+        for (auto it = range.first; it != range.second; ++it) {
+            slots.push_back(it->second);
+        }
+    }
+
+   protected:
+    const nvp<T, Field> _field;
+    const std::string _name;
+    const char *_type;
+    Map _entries;
+};
+
+template <typename T, typename Field>
+class hash_index
+    : public field_index<T, Field, std::unordered_multimap<index_key_t<Field>, std::size_t>> {
+   public:
+    hash_index(const nvp<T, Field> &field)
+        : field_index<T, Field, std::unordered_multimap<index_key_t<Field>, std::size_t>>(field,
+                                                                                          "hash") {
+    }
+
+    bool find_range(const index_key_t<Field> *, bool, const index_key_t<Field> *, bool,
+                    std::vector<std::size_t> &) const override {
+        return false;
+    }
+};
+
+template <typename T, typename Field>
+class ordered_index
+    : public field_index<T, Field, std::multimap<index_key_t<Field>, std::size_t>> {
+   public:
+    ordered_index(const nvp<T, Field> &field)
+        : field_index<T, Field, std::multimap<index_key_t<Field>, std::size_t>>(field,
+                                                                                "ordered") {
+    }
+
+    bool find_range(const index_key_t<Field> *lower, bool lower_inclusive,
+                    const index_key_t<Field> *upper, bool upper_inclusive,
+                    std::vector<std::size_t> &slots) const override {
+        const auto &entries = this->_entries;
+        // An empty range, in which case the bounds below could cross.
+        if (lower && upper && !(*lower < *upper) && !(lower_inclusive && upper_inclusive)) {
+            return true;
+        }
+
+        auto first = !lower ? entries.begin() : lower_inclusive ? entries.lower_bound(*lower)
+                                                                : entries.upper_bound(*lower);
+        auto last = !upper ? entries.end() : upper_inclusive ? entries.upper_bound(*upper)
+                                                             : entries.lower_bound(*upper);
+        for (auto it = first; it != last; ++it) {
+            slots.push_back(it->second);
+        }
+        return true;
+    }
+};
+
+}  // namespace details
+
+/**
+ * An in-process set of objects with secondary indexes on their fields.
+ *
+ * Indexes are declared with add_hash_index() and add_ordered_index(), given the name-value pair
+ * of a top-level field, e.g. add_ordered_index(MANGROVE_KEY(User::age)). Hash indexes answer
+ * equality and $in queries, and ordered indexes also answer range queries. Array fields are
+ * indexed by their elements, and objects in which an optional field is empty are not indexed on
+ * that field.
+ *
+ * Queries are query builder expressions. When a query, or one of the clauses of a conjunction,
+ * compares an indexed field, the set looks up candidates in the index that yields the fewest of
+ * them, and evaluates the whole query against those candidates only. Otherwise, it scans every
+ * object. explain() reports which index a query would use.
+ *
+ * Indexes are kept up to date when objects are inserted, updated or erased. Reads may run
+ * concurrently with each other, but not with writes.
+ *
+ * @tparam T The type of the stored objects. It must be copyable.
+ */
+template <typename T>
+class indexed_set {
+   public:
+    indexed_set() = default;
+
+    /**
+     * Adds a hash index on the given field, and indexes the objects already in the set.
+     * Adding an index that already exists has no effect.
+     * @param field The name-value pair of a top-level field of T, whose values must be hashable.
+     */
+    template <typename Field>
+    void add_hash_index(const nvp<T, Field> &field) {
+        add_index(std::make_unique<details::hash_index<T, Field>>(field));
+    }
+
+    /**
+     * Adds an ordered index on the given field, and indexes the objects already in the set.
+     * Adding an index that already exists has no effect.
+     * @param field The name-value pair of a top-level field of T, whose values must be less-than
+     *              comparable.
+     */
+    template <typename Field>
+    void add_ordered_index(const nvp<T, Field> &field) {
+        add_index(std::make_unique<details::ordered_index<T, Field>>(field));
+    }
+
+    /**
+     * Inserts a copy of an object into the set.
+     */
+    void insert(T obj) {
+        std::lock_guard<std::shared_timed_mutex> lock(_mutex);
+        std::size_t slot;
+        if (_free.empty()) {
+            slot = _slots.size();
+            _slots.emplace_back(std::move(obj));
+        } else {
+            slot = _free.back();
+            _free.pop_back();
+            _slots[slot] = std::move(obj);
+        }
+
+        for (const auto &index : _indexes) {
+            index->insert(*_slots[slot], slot);
+        }
+    }
+
+    /**
+     * Returns copies of the objects that match the given query.
+     * The order of the results is unspecified.
+     */
+    template <typename Query, typename = std::enable_if_t<details::is_query_expression_v<Query>>>
+    std::vector<T> find(const Query &filter) const {
+        std::shared_lock<std::shared_timed_mutex> lock(_mutex);
+        std::vector<T> results;
+        for_each_match(filter, [&](std::size_t slot) { results.push_back(*_slots[slot]); });
+        return results;
+    }
+
+    /**
+     * Returns a copy of an object that matches the given query, if there is one.
+     */
+    template <typename Query, typename = std::enable_if_t<details::is_query_expression_v<Query>>>
+    bsoncxx::stdx::optional<T> find_one(const Query &filter) const {
+        std::shared_lock<std::shared_timed_mutex> lock(_mutex);
+        for (auto slot : candidates(filter, nullptr)) {
+            if (filter.matches(*_slots[slot])) {
+                return *_slots[slot];
+            }
+        }
+        return {};
+    }
+
+    /**
+     * Returns the number of objects that match the given query.
+     */
+    template <typename Query, typename = std::enable_if_t<details::is_query_expression_v<Query>>>
+    std::size_t count(const Query &filter) const {
+        std::shared_lock<std::shared_timed_mutex> lock(_mutex);
+        std::size_t n = 0;
+        for_each_match(filter, [&](std::size_t) { ++n; });
+        return n;
+    }
+
+    /**
+     * Applies an update to every object that matches the given query, and updates the indexes.
+     * @return The number of updated objects.
+     * @throws std::logic_error if the update cannot be applied to C++ objects.
+     */
+    template <typename Query, typename Update,
+              typename = std::enable_if_t<details::is_query_expression_v<Query>>,
+              typename = std::enable_if_t<details::is_update_expression_v<Update>>>
+    std::size_t update(const Query &filter, const Update &update) {
+        std::lock_guard<std::shared_timed_mutex> lock(_mutex);
+        // Update copies of all the matches before storing any of them, so that neither the
+        // objects nor the indexes change if the update throws for one of them.
+        std::vector<std::pair<std::size_t, T>> updates;
+        for_each_match(filter, [&](std::size_t slot) {
+            updates.emplace_back(slot, *_slots[slot]);
+            update.apply(updates.back().second);
+        });
+        for (auto &entry : updates) {
+            auto slot = entry.first;
+            for (const auto &index : _indexes) {
+                index->erase(*_slots[slot], slot);
+            }
+            _slots[slot] = std::move(entry.second);
+            for (const auto &index : _indexes) {
+                index->insert(*_slots[slot], slot);
+            }
+        }
+        return updates.size();
+    }
+
+    /**
+     * Removes every object that matches the given query.
+     * @return The number of removed objects.
+     */
+    template <typename Query, typename = std::enable_if_t<details::is_query_expression_v<Query>>>
+    std::size_t erase(const Query &filter) {
+        std::lock_guard<std::shared_timed_mutex> lock(_mutex);
+        std::size_t n = 0;
+        for_each_match(filter, [&](std::size_t slot) {
+            for (const auto &index : _indexes) {
+                index->erase(*_slots[slot], slot);
+            }
+            _slots[slot] = bsoncxx::stdx::nullopt;
+            _free.push_back(slot);
+            ++n;
+        });
+        return n;
+    }
+
+    /**
+     * Reports how the given query would be answered, without running it.
+     */
+    template <typename Query, typename = std::enable_if_t<details::is_query_expression_v<Query>>>
+    index_explanation explain(const Query &filter) const {
+        std::shared_lock<std::shared_timed_mutex> lock(_mutex);
+        const details::index_base<T> *index = nullptr;
+        auto examined = candidates(filter, &index).size();
+        if (!index) {
+            return {"COLLSCAN", "", "", examined};
+        }
+        return {"IXSCAN", index->field_name(), index->type(), examined};
+    }
+
+    /**
+     * Returns the number of objects in the set.
+     */
+    std::size_t size() const {
+        std::shared_lock<std::shared_timed_mutex> lock(_mutex);
+        return _slots.size() - _free.size();
+    }
+
+    /**
+     * Removes every object from the set, keeping its indexes.
+     */
+    void clear() {
+        std::lock_guard<std::shared_timed_mutex> lock(_mutex);
+        for (std::size_t slot = 0; slot < _slots.size(); ++slot) {
+            if (_slots[slot]) {
+                for (const auto &index : _indexes) {
+                    index->erase(*_slots[slot], slot);
+                }
+            }
+        }
+        _slots.clear();
+        _free.clear();
+    }
+
+   private:
+    void add_index(std::unique_ptr<details::index_base<T>> index) {
+        std::lock_guard<std::shared_timed_mutex> lock(_mutex);
+        for (const auto &existing : _indexes) {
+            if (existing->field_name() == index->field_name() &&
+                std::string(existing->type()) == index->type()) {
+                return;
+            }
+        }
+
+        for (std::size_t slot = 0; slot < _slots.size(); ++slot) {
+            if (_slots[slot]) {
+                index->insert(*_slots[slot], slot);
+            }
+        }
+        _indexes.push_back(std::move(index));
+    }
+
+    // Calls `f` with the slot of each object that matches the filter. `f` may modify the object,
+    // or erase it, since the candidates are collected before the first call.
+    template <typename Query, typename F>
+    void for_each_match(const Query &filter, F &&f) const {
+        for (auto slot : candidates(filter, nullptr)) {
+            if (filter.matches(*_slots[slot])) {
+                f(slot);
+            }
+        }
+    }
+
+    /**
+     * Returns the slots of the objects that may match the given query, in increasing order.
+     * @param index If not null, set to the chosen index, or to nullptr if all objects are scanned.
+     */
+    template <typename Query>
+    std::vector<std::size_t> candidates(const Query &filter,
+                                        const details::index_base<T> **index) const {
+        bsoncxx::stdx::optional<std::vector<std::size_t>> slots;
+        const details::index_base<T> *chosen = nullptr;
+        plan(filter, slots, chosen);
+        if (index) {
+            *index = chosen;
+        }
+
+        if (!slots) {
+            slots.emplace();
+            for (std::size_t slot = 0; slot < _slots.size(); ++slot) {
+                if (_slots[slot]) {
+                    slots->push_back(slot);
+                }
+            }
+            return *slots;
+        }
+
+        // Multikey indexes may yield the same object more than once.
+        std::sort(slots->begin(), slots->end());
+        slots->erase(std::unique(slots->begin(), slots->end()), slots->end());
+        return *slots;
+    }
+
+    /**
+     * Looks up the candidates for a query in the indexes, and keeps them if they are fewer than
+     * the current candidates in `slots`. Expressions that cannot be answered from an index leave
+     * `slots` unchanged.
+     */
+    template <typename Query>
+    void plan(const Query &, bsoncxx::stdx::optional<std::vector<std::size_t>> &,
+              const details::index_base<T> *&) const {
+    }
+
+    template <typename NvpT, typename U>
+    void plan(const comparison_expr<NvpT, U> &expr,
+              bsoncxx::stdx::optional<std::vector<std::size_t>> &slots,
+              const details::index_base<T> *&chosen) const {
+        using details::query_operator;
+        using key_type = std::conditional_t<is_iterable_v<U>, iterable_value_t<U>, U>;
+
+        auto name = expr.field().get_name();
+        for (const auto &index : _indexes) {
+            auto typed = dynamic_cast<const details::key_index<T, key_type> *>(index.get());
+            if (!typed || index->field_name() != name) {
+                continue;
+            }
+
+            std::vector<std::size_t> found;
+            if (!lookup(*typed, expr.op_code(), expr.operand(), found)) {
+                continue;
+            }
+            if (!slots || found.size() < slots->size()) {
+                slots = std::move(found);
+                chosen = index.get();
+            }
+        }
+    }
+
+    template <typename... Args>
+    void plan(const expression_list<expression_category::query, Args...> &list,
+              bsoncxx::stdx::optional<std::vector<std::size_t>> &slots,
+              const details::index_base<T> *&chosen) const {
+        tuple_for_each(list.storage, [&](const auto &expr) { plan(expr, slots, chosen); });
+    }
+
+    template <typename Expr1, typename Expr2>
+    void plan(const boolean_expr<Expr1, Expr2> &expr,
+              bsoncxx::stdx::optional<std::vector<std::size_t>> &slots,
+              const details::index_base<T> *&chosen) const {
+        // Only a conjunction can be answered from the index of one of its clauses.
+        if (details::to_query_operator(expr._op) == details::query_operator::logical_and) {
+            plan(expr._lhs, slots, chosen);
+            plan(expr._rhs, slots, chosen);
+        }
+    }
+
+    template <typename Key, typename U>
+    static std::enable_if_t<!is_iterable_v<U>, bool> lookup(
+        const details::key_index<T, Key> &index, details::query_operator op, const U &operand,
+        std::vector<std::size_t> &found) {
+        using details::query_operator;
+        switch (op) {
+            case query_operator::eq:
+                index.find_equal(operand, found);
+                return true;
+            case query_operator::gt:
+                return index.find_range(&operand, false, nullptr, false, found);
+            case query_operator::gte:
+                return index.find_range(&operand, true, nullptr, false, found);
+            case query_operator::lt:
+                return index.find_range(nullptr, false, &operand, false, found);
+            case query_operator::lte:
+                return index.find_range(nullptr, false, &operand, true, found);
+            default:
+                return false;
+        }
+    }
+
+    template <typename Key, typename Iterable>
+    static std::enable_if_t<is_iterable_v<Iterable>, bool> lookup(
+        const details::key_index<T, Key> &index, details::query_operator op,
+        const Iterable &operand, std::vector<std::size_t> &found) {
+        if (op != details::query_operator::in) {
+            return false;
+        }
+        for (const auto &key : operand) {
+            index.find_equal(key, found);
+        }
+        return true;
+    }
+
+    mutable std::shared_timed_mutex _mutex;
+    // Erased objects leave an empty slot behind, which is reused by the next insertion, so that
+    // the slots of the other objects stay valid in the indexes.
+    std::vector<bsoncxx::stdx::optional<T>> _slots;
+    std::vector<std::size_t> _free;
+    std::vector<std::unique_ptr<details::index_base<T>>> _indexes;
+};
+
+MANGROVE_INLINE_NAMESPACE_END
+}  // namespace mangrove
+
+#include <mangrove/config/postlude.hpp>
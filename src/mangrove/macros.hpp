@@ -55,6 +55,32 @@
 // If using the mangrove::model, then also register _id as a field.
 #define MANGROVE_MAKE_KEYS_MODEL(Base, ...) MANGROVE_MAKE_KEYS(Base, MANGROVE_NVP(_id), __VA_ARGS__)
 
+// Register members under compact stored names, assigned in declaration order: the first field is
+// stored as "a", the second as "b", and so on. Serialization and every expression built from the
+// members use the stored names. Since moving or removing a field renames the fields after it, new
+// fields should only be appended.
+#define MANGROVE_MAKE_SHORT_KEYS(Base, ...)                                     \
+    using mangrove_wrap_base = Base;                                            \
+    constexpr static auto mangrove_declared_fields() {                          \
+        return std::make_tuple(__VA_ARGS__);                                    \
+    }                                                                           \
+    constexpr static auto mangrove_mapped_fields() {                            \
+        return mangrove::details::with_short_names(mangrove_declared_fields()); \
+    }                                                                           \
+    MANGROVE_SERIALIZE_KEYS
+
+// If using the mangrove::model, _id keeps its name and the other fields get short names.
+#define MANGROVE_MAKE_SHORT_KEYS_MODEL(Base, ...)                                                 \
+    using mangrove_wrap_base = Base;                                                              \
+    constexpr static auto mangrove_declared_fields() {                                            \
+        return std::make_tuple(MANGROVE_NVP(_id), __VA_ARGS__);                                   \
+    }                                                                                             \
+    constexpr static auto mangrove_mapped_fields() {                                              \
+        return std::tuple_cat(std::make_tuple(MANGROVE_NVP(_id)),                                 \
+                              mangrove::details::with_short_names(std::make_tuple(__VA_ARGS__))); \
+    }                                                                                             \
+    MANGROVE_SERIALIZE_KEYS
+
 #define MANGROVE_KEY(value) mangrove::hasCallIfFieldIsPresent<decltype(&value), &value>::call()
 // convenience macro for accessing scalar elements of array fields in query builder.
 #define MANGROVE_ELEM(value) MANGROVE_KEY(value).element()
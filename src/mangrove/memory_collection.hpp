@@ -0,0 +1,597 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <mangrove/config/prelude.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <bsoncxx/document/view_or_value.hpp>
+#include <bsoncxx/stdx/optional.hpp>
+#include <mongocxx/options/find.hpp>
+#include <mongocxx/options/find_one_and_delete.hpp>
+#include <mongocxx/options/find_one_and_replace.hpp>
+#include <mongocxx/options/find_one_and_update.hpp>
+#include <mongocxx/options/insert.hpp>
+#include <mongocxx/options/update.hpp>
+
+#include <mangrove/aggregation.hpp>
+#include <mangrove/expression_syntax.hpp>
+
+namespace mangrove {
+MANGROVE_INLINE_NAMESPACE_BEGIN
+
+/**
+ * The result of a write to a memory_collection. This mirrors the accessors of the mongocxx
+ * result classes, so that code written against a collection_wrapper can check the results of
+ * writes to either kind of collection in the same way.
+ */
+class memory_write_result {
+   public:
+    memory_write_result(std::int32_t inserted, std::int32_t matched, std::int32_t modified,
+                        std::int32_t deleted)
+        : _inserted(inserted), _matched(matched), _modified(modified), _deleted(deleted) {
+    }
+
+    std::int32_t inserted_count() const {
+        return _inserted;
+    }
+
+    std::int32_t matched_count() const {
+        return _matched;
+    }
+
+    std::int32_t modified_count() const {
+        return _modified;
+    }
+
+    std::int32_t deleted_count() const {
+        return _deleted;
+    }
+
+   private:
+    std::int32_t _inserted;
+    std::int32_t _matched;
+    std::int32_t _modified;
+    std::int32_t _deleted;
+};
+
+namespace details {
+
+template <typename T, typename = void>
+struct is_equality_comparable : public std::false_type {};
+
+template <typename T>
+struct is_equality_comparable<
+    T, decltype(void(std::declval<const T &>() == std::declval<const T &>()))>
+    : public std::true_type {};
+
+/**
+ * Applies an update to a copy of an object, and returns whether the copy now differs from the
+ * original. Updating a copy leaves the original untouched if the update throws. Objects that
+ * cannot be compared are assumed to change whenever they are updated.
+ */
+template <typename T, typename Update>
+std::enable_if_t<is_equality_comparable<T>::value, bool> apply_and_compare(const T &original,
+                                                                           const Update &update,
+                                                                           T &copy) {
+    update.apply(copy);
+    return !(copy == original);
+}
+
+template <typename T, typename Update>
+std::enable_if_t<!is_equality_comparable<T>::value, bool> apply_and_compare(const T &,
+                                                                            const Update &update,
+                                                                            T &copy) {
+    update.apply(copy);
+    return true;
+}
+
+}  // namespace details
+
+/**
+ * The result of memory_collection::find(). Like the deserializing_cursor returned by
+ * collection_wrapper::find(), it is a range of objects that is read with begin() and end().
+ * It holds copies of the matching objects, taken when find() was called, so writes to the
+ * collection do not change the results of a cursor that was already returned.
+ */
+template <class T>
+class memory_cursor {
+   public:
+    using iterator = typename std::vector<T>::iterator;
+
+    explicit memory_cursor(std::vector<T> objects) : _objects(std::move(objects)) {
+    }
+
+    iterator begin() {
+        return _objects.begin();
+    }
+
+    iterator end() {
+        return _objects.end();
+    }
+
+   private:
+    std::vector<T> _objects;
+};
+
+/**
+ * An in-process collection of objects with the same interface as collection_wrapper<T>.
+ *
+ * Objects are stored by value in contiguous storage, in insertion order, and queries and updates
+ * built with the query builder are evaluated directly against them with matches() and apply().
+ * This makes a memory_collection usable as a cache of hot data that is queried with the same code
+ * as the database, or as a stand-in for a collection in tests.
+ *
+ * Since there is no server to evaluate them, filters and updates must be query builder
+ * expressions rather than BSON documents, and results are ordered by sort expressions rather than
+ * by the sort option. The options of each operation are those of collection_wrapper; the ones
+ * that only concern the server, such as write concerns and time limits, are ignored, and
+ * projections are ignored since objects are always returned whole. If T maps an _id, inserting
+ * an object with the _id of a stored one throws, as it does on the server. Reads may run
+ * concurrently with each other, but not with writes.
+ *
+ * @tparam T The type of the stored objects. It must be copyable.
+ */
+template <class T>
+class memory_collection {
+    template <typename Query>
+    using enable_if_query_t = std::enable_if_t<details::is_query_expression_v<Query>>;
+
+    template <typename Update>
+    using enable_if_update_t = std::enable_if_t<details::is_update_expression_v<Update>>;
+
+    using return_document = mongocxx::options::return_document;
+
+   public:
+    memory_collection() = default;
+
+    /**
+     * Creates a collection that contains copies of the given objects.
+     */
+    template <typename Iterable>
+    explicit memory_collection(const Iterable &objects)
+        : _objects(std::begin(objects), std::end(objects)) {
+    }
+
+    /**
+     * Returns copies of all the objects in the collection, in insertion order. Since it takes no
+     * filter, this is also what find({}) calls.
+     * @param options   Optional arguments, see mongocxx::options::find. Only skip and limit apply.
+     * @throws std::logic_error if the options have a sort.
+     */
+    memory_cursor<T> find(
+        const mongocxx::options::find &options = mongocxx::options::find()) const {
+        check_no_sort(options.sort());
+        auto results = copy_matches([](const T &) { return true; });
+        return memory_cursor<T>{skip_and_limit(std::move(results), options)};
+    }
+
+    /**
+     * Returns copies of the objects that match the given query, in insertion order.
+     * @param filter    A query expression.
+     * @param options   Optional arguments, see mongocxx::options::find. Only skip and limit apply.
+     * @throws std::logic_error if the options have a sort.
+     */
+    template <typename Query, typename = enable_if_query_t<Query>>
+    memory_cursor<T> find(
+        const Query &filter,
+        const mongocxx::options::find &options = mongocxx::options::find()) const {
+        check_no_sort(options.sort());
+        auto results = copy_matches([&](const T &obj) { return filter.matches(obj); });
+        return memory_cursor<T>{skip_and_limit(std::move(results), options)};
+    }
+
+    /**
+     * Returns copies of the objects that match the given query, in the given sort order.
+     * @param filter    A query expression.
+     * @param sort      A sort expression, such as MANGROVE_KEY(T::x).sort(true).
+     * @param options   Optional arguments, see mongocxx::options::find. Only skip and limit apply.
+     * @throws std::logic_error if the options also have a sort.
+     */
+    template <typename Query, typename NvpT, typename = enable_if_query_t<Query>>
+    memory_cursor<T> find(
+        const Query &filter, const sort_expr<NvpT> &sort,
+        const mongocxx::options::find &options = mongocxx::options::find()) const {
+        check_no_sort(options.sort());
+        auto results = copy_matches([&](const T &obj) { return filter.matches(obj); });
+        std::stable_sort(results.begin(), results.end(),
+                         [&](const T &a, const T &b) { return sort.less(a, b); });
+        return memory_cursor<T>{skip_and_limit(std::move(results), options)};
+    }
+
+    /**
+     * Returns a copy of the first object that matches the given query.
+     * @param filter    A query expression.
+     * @param options   Optional arguments, see mongocxx::options::find. Only skip applies.
+     * @return An optional object that matched the filter.
+     * @throws std::logic_error if the options have a sort.
+     */
+    template <typename Query, typename = enable_if_query_t<Query>>
+    bsoncxx::stdx::optional<T> find_one(
+        const Query &filter,
+        const mongocxx::options::find &options = mongocxx::options::find()) const {
+        check_no_sort(options.sort());
+        std::shared_lock<std::shared_timed_mutex> lock(_mutex);
+        auto skip = options.skip() ? static_cast<std::size_t>(*options.skip()) : 0;
+        for (const T &obj : _objects) {
+            if (filter.matches(obj) && skip-- == 0) {
+                return obj;
+            }
+        }
+        return {};
+    }
+
+    /**
+     * Returns the number of objects in the collection.
+     */
+    std::int64_t count() const {
+        std::shared_lock<std::shared_timed_mutex> lock(_mutex);
+        return static_cast<std::int64_t>(_objects.size());
+    }
+
+    /**
+     * Returns the number of objects that match the given query.
+     * @param filter    A query expression.
+     */
+    template <typename Query, typename = enable_if_query_t<Query>>
+    std::int64_t count(const Query &filter) const {
+        std::shared_lock<std::shared_timed_mutex> lock(_mutex);
+        return std::count_if(_objects.begin(), _objects.end(),
+                             [&](const T &obj) { return filter.matches(obj); });
+    }
+
+    /**
+     * Finds the first object that matches the given query, removes it, and returns it.
+     * @param filter    A query expression.
+     * @param options   Optional arguments, see mongocxx::options::find_one_and_delete.
+     * @return The removed object, if any object matched.
+     * @throws std::logic_error if the options have a sort.
+     */
+    template <typename Query, typename = enable_if_query_t<Query>>
+    bsoncxx::stdx::optional<T> find_one_and_delete(
+        const Query &filter, const mongocxx::options::find_one_and_delete &options =
+                                 mongocxx::options::find_one_and_delete()) {
+        check_no_sort(options.sort());
+        std::lock_guard<std::shared_timed_mutex> lock(_mutex);
+        auto it = find_first(filter);
+        if (it == _objects.end()) {
+            return {};
+        }
+        T obj = std::move(*it);
+        _objects.erase(it);
+        return obj;
+    }
+
+    /**
+     * Finds the first object that matches the given query and replaces it.
+     * @param filter        A query expression.
+     * @param replacement   The object to replace the matching object with.
+     * @param options       Optional arguments, see mongocxx::options::find_one_and_replace.
+     *                      return_document selects the object that is returned, and upsert
+     *                      inserts the replacement if no object matches.
+     * @return The original or replacement object, if any object matched or was inserted.
+     * @throws std::logic_error if the options have a sort, or if the replacement is upserted and
+     *         an object with its _id is stored.
+     */
+    template <typename Query, typename = enable_if_query_t<Query>>
+    bsoncxx::stdx::optional<T> find_one_and_replace(
+        const Query &filter, const T &replacement,
+        const mongocxx::options::find_one_and_replace &options =
+            mongocxx::options::find_one_and_replace()) {
+        check_no_sort(options.sort());
+        bool return_new = options.return_document() == return_document::k_after;
+        std::lock_guard<std::shared_timed_mutex> lock(_mutex);
+        auto it = find_first(filter);
+        if (it == _objects.end()) {
+            if (!options.upsert().value_or(false)) {
+                return {};
+            }
+            check_unique_id(replacement, _objects.end());
+            _objects.push_back(replacement);
+            if (!return_new) {
+                return {};
+            }
+            return replacement;
+        }
+        T original = std::move(*it);
+        *it = replacement;
+        if (return_new) {
+            return replacement;
+        }
+        return original;
+    }
+
+    /**
+     * Finds the first object that matches the given query and applies an update to it.
+     * @param filter    A query expression.
+     * @param update    An update expression.
+     * @param options   Optional arguments, see mongocxx::options::find_one_and_update.
+     *                  return_document selects the object that is returned.
+     * @return The original or updated object, if any object matched.
+     * @throws std::logic_error if the options have a sort or request an upsert, which would
+     *         need the server to build a new object from the filter, or if the update cannot be
+     *         applied to C++ objects.
+     */
+    template <typename Query, typename Update, typename = enable_if_query_t<Query>,
+              typename = enable_if_update_t<Update>>
+    bsoncxx::stdx::optional<T> find_one_and_update(
+        const Query &filter, const Update &update,
+        const mongocxx::options::find_one_and_update &options =
+            mongocxx::options::find_one_and_update()) {
+        check_no_sort(options.sort());
+        if (options.upsert().value_or(false)) {
+            throw std::logic_error("mangrove: a memory_collection cannot upsert with an update.");
+        }
+        std::lock_guard<std::shared_timed_mutex> lock(_mutex);
+        auto it = find_first(filter);
+        if (it == _objects.end()) {
+            return {};
+        }
+        // Update a copy first, so that the stored object is unchanged if the update throws.
+        T updated = *it;
+        update.apply(updated);
+        std::swap(*it, updated);
+        if (options.return_document() == return_document::k_after) {
+            return *it;
+        }
+        return updated;
+    }
+
+    /**
+     * Inserts a copy of an object at the end of the collection.
+     * @param obj       The object to insert.
+     * @param options   Optional arguments, see mongocxx::options::insert. None of them apply.
+     * @throws std::logic_error if an object with the same _id is stored.
+     */
+    bsoncxx::stdx::optional<memory_write_result> insert_one(
+        T obj, const mongocxx::options::insert & = mongocxx::options::insert()) {
+        std::lock_guard<std::shared_timed_mutex> lock(_mutex);
+        check_unique_id(obj, _objects.end());
+        _objects.push_back(std::move(obj));
+        return memory_write_result{1, 0, 0, 0};
+    }
+
+    /**
+     * Inserts copies of the objects in a container at the end of the collection.
+     * @param container The objects to insert.
+     * @param options   Optional arguments, see mongocxx::options::insert. None of them apply.
+     * @throws std::logic_error if two objects would have the same _id. No object is inserted.
+     */
+    template <typename container_type>
+    bsoncxx::stdx::optional<memory_write_result> insert_many(
+        const container_type &container,
+        const mongocxx::options::insert &options = mongocxx::options::insert()) {
+        return insert_many(std::begin(container), std::end(container), options);
+    }
+
+    /**
+     * Inserts copies of the objects in the range [begin, end) at the end of the collection.
+     * @param begin     The first object to insert.
+     * @param end       The end of the objects to insert.
+     * @param options   Optional arguments, see mongocxx::options::insert. None of them apply.
+     * @throws std::logic_error if two objects would have the same _id. No object is inserted.
+     */
+    template <typename object_iterator_type>
+    bsoncxx::stdx::optional<memory_write_result> insert_many(
+        object_iterator_type begin, object_iterator_type end,
+        const mongocxx::options::insert & = mongocxx::options::insert()) {
+        std::lock_guard<std::shared_timed_mutex> lock(_mutex);
+        auto size = _objects.size();
+        _objects.insert(_objects.end(), begin, end);
+        // Check each new object against the ones before it, including the new ones.
+        try {
+            for (auto it = _objects.begin() + size; it != _objects.end(); ++it) {
+                check_unique_id(*it, it);
+            }
+        } catch (...) {
+            _objects.erase(_objects.begin() + size, _objects.end());
+            throw;
+        }
+        return memory_write_result{static_cast<std::int32_t>(_objects.size() - size), 0, 0, 0};
+    }
+
+    /**
+     * Replaces the first object that matches the given query.
+     * @param filter        A query expression.
+     * @param replacement   The object to replace the matching object with.
+     * @param options       Optional arguments, see mongocxx::options::update. upsert inserts the
+     *                      replacement if no object matches.
+     * @throws std::logic_error if the replacement is upserted and an object with its _id is
+     *         stored.
+     */
+    template <typename Query, typename = enable_if_query_t<Query>>
+    bsoncxx::stdx::optional<memory_write_result> replace_one(
+        const Query &filter, const T &replacement,
+        const mongocxx::options::update &options = mongocxx::options::update()) {
+        std::lock_guard<std::shared_timed_mutex> lock(_mutex);
+        auto it = find_first(filter);
+        if (it == _objects.end()) {
+            if (!options.upsert().value_or(false)) {
+                return memory_write_result{0, 0, 0, 0};
+            }
+            check_unique_id(replacement, _objects.end());
+            _objects.push_back(replacement);
+            return memory_write_result{1, 0, 0, 0};
+        }
+        *it = replacement;
+        return memory_write_result{0, 1, 1, 0};
+    }
+
+    /**
+     * Applies an update to the first object that matches the given query.
+     * @param filter    A query expression.
+     * @param update    An update expression.
+     * @throws std::logic_error if the update cannot be applied to C++ objects.
+     */
+    template <typename Query, typename Update, typename = enable_if_query_t<Query>,
+              typename = enable_if_update_t<Update>>
+    bsoncxx::stdx::optional<memory_write_result> update_one(const Query &filter,
+                                                            const Update &update) {
+        std::lock_guard<std::shared_timed_mutex> lock(_mutex);
+        auto it = find_first(filter);
+        if (it == _objects.end()) {
+            return memory_write_result{0, 0, 0, 0};
+        }
+        T updated = *it;
+        bool modified = details::apply_and_compare(*it, update, updated);
+        *it = std::move(updated);
+        return memory_write_result{0, 1, modified ? 1 : 0, 0};
+    }
+
+    /**
+     * Applies an update to every object that matches the given query.
+     * @param filter    A query expression.
+     * @param update    An update expression.
+     * @throws std::logic_error if the update cannot be applied to C++ objects.
+     */
+    template <typename Query, typename Update, typename = enable_if_query_t<Query>,
+              typename = enable_if_update_t<Update>>
+    bsoncxx::stdx::optional<memory_write_result> update_many(const Query &filter,
+                                                             const Update &update) {
+        std::lock_guard<std::shared_timed_mutex> lock(_mutex);
+        // Update copies of all the matches before storing any of them, so that no object is
+        // changed if the update throws for one of them.
+        std::vector<std::pair<std::size_t, T>> updates;
+        std::int32_t modified = 0;
+        for (std::size_t i = 0; i < _objects.size(); ++i) {
+            if (filter.matches(_objects[i])) {
+                updates.emplace_back(i, _objects[i]);
+                modified += details::apply_and_compare(_objects[i], update, updates.back().second)
+                                ? 1
+                                : 0;
+            }
+        }
+        for (auto &entry : updates) {
+            _objects[entry.first] = std::move(entry.second);
+        }
+        return memory_write_result{0, static_cast<std::int32_t>(updates.size()), modified, 0};
+    }
+
+    /**
+     * Removes the first object that matches the given query.
+     * @param filter    A query expression.
+     */
+    template <typename Query, typename = enable_if_query_t<Query>>
+    bsoncxx::stdx::optional<memory_write_result> delete_one(const Query &filter) {
+        std::lock_guard<std::shared_timed_mutex> lock(_mutex);
+        auto it = find_first(filter);
+        if (it == _objects.end()) {
+            return memory_write_result{0, 0, 0, 0};
+        }
+        _objects.erase(it);
+        return memory_write_result{0, 0, 0, 1};
+    }
+
+    /**
+     * Removes every object that matches the given query.
+     * @param filter    A query expression.
+     */
+    template <typename Query, typename = enable_if_query_t<Query>>
+    bsoncxx::stdx::optional<memory_write_result> delete_many(const Query &filter) {
+        std::lock_guard<std::shared_timed_mutex> lock(_mutex);
+        auto size = _objects.size();
+        _objects.erase(std::remove_if(_objects.begin(), _objects.end(),
+                                      [&](const T &obj) { return filter.matches(obj); }),
+                       _objects.end());
+        return memory_write_result{0, 0, 0, static_cast<std::int32_t>(size - _objects.size())};
+    }
+
+    /**
+     * Removes every object from the collection.
+     */
+    void drop() {
+        std::lock_guard<std::shared_timed_mutex> lock(_mutex);
+        _objects.clear();
+    }
+
+   private:
+    template <typename Predicate>
+    std::vector<T> copy_matches(Predicate predicate) const {
+        std::shared_lock<std::shared_timed_mutex> lock(_mutex);
+        std::vector<T> results;
+        std::copy_if(_objects.begin(), _objects.end(), std::back_inserter(results), predicate);
+        return results;
+    }
+
+    static void check_no_sort(
+        const bsoncxx::stdx::optional<bsoncxx::document::view_or_value> &sort) {
+        if (sort) {
+            throw std::logic_error(
+                "mangrove: a memory_collection is ordered by sort expressions, not documents.");
+        }
+    }
+
+    static std::vector<T> skip_and_limit(std::vector<T> results,
+                                         const mongocxx::options::find &options) {
+        // As on the server, a negative limit is the same as a positive one.
+        std::size_t skip = options.skip() ? static_cast<std::size_t>(*options.skip()) : 0;
+        std::size_t limit =
+            options.limit() ? static_cast<std::size_t>(std::abs(*options.limit())) : 0;
+        auto first = std::min(skip, results.size());
+        auto last = limit ? std::min(first + limit, results.size()) : results.size();
+        results.erase(results.begin() + last, results.end());
+        results.erase(results.begin(), results.begin() + first);
+        return results;
+    }
+
+    // Throws if one of the objects before last has the _id of obj, since the server rejects an
+    // insert with a duplicate _id. Classes that do not map an _id can always be inserted.
+    template <typename U = T>
+    std::enable_if_t<details::has_mapped_id<U>()> check_unique_id(
+        const T &obj, typename std::vector<T>::const_iterator last) const {
+        auto id = std::get<details::mapped_field_index<U>("_id")>(U::mangrove_mapped_fields()).t;
+        if (std::any_of(_objects.cbegin(), last,
+                        [&](const T &other) { return other.*id == obj.*id; })) {
+            throw std::logic_error("mangrove: an object with the same _id is already stored.");
+        }
+    }
+
+    template <typename U = T>
+    std::enable_if_t<!details::has_mapped_id<U>()> check_unique_id(
+        const T &, typename std::vector<T>::const_iterator) const {
+    }
+
+    template <typename Query>
+    typename std::vector<T>::iterator find_first(const Query &filter) {
+        return std::find_if(_objects.begin(), _objects.end(),
+                            [&](const T &obj) { return filter.matches(obj); });
+    }
+
+    template <typename Query>
+    typename std::vector<T>::const_iterator find_first(const Query &filter) const {
+        return std::find_if(_objects.begin(), _objects.end(),
+                            [&](const T &obj) { return filter.matches(obj); });
+    }
+
+    mutable std::shared_timed_mutex _mutex;
+    std::vector<T> _objects;
+};
+
+MANGROVE_INLINE_NAMESPACE_END
+}  // namespace mangrove
+
+#include <mangrove/config/postlude.hpp>
@@ -0,0 +1,619 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <mangrove/config/prelude.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mangrove {
+MANGROVE_INLINE_NAMESPACE_BEGIN
+
+/**
+ * The kinds of operations that are measured by model_metrics.
+ */
+enum class operation : std::size_t {
+    find,
+    find_one,
+    find_and_modify,
+    insert,
+    update,
+    replace,
+    remove,
+    aggregate,
+    count,
+    distinct
+};
+
+constexpr std::size_t k_operation_count = 10;
+
+/**
+ * Returns the name of an operation, as used in metric labels.
+ */
+inline const char* operation_name(operation op) {
+    static const char* const names[k_operation_count] = {
+        "find",   "find_one", "find_and_modify", "insert", "update",
+        "replace", "delete",  "aggregate",       "count",  "distinct"};
+    return names[static_cast<std::size_t>(op)];
+}
+
+/**
+ * A snapshot of a latency_histogram.
+ */
+struct histogram_snapshot {
+    std::vector<std::uint64_t> counts;
+    std::uint64_t count = 0;
+    std::chrono::nanoseconds sum{0};
+
+    /**
+     * Returns the upper bound of the bucket that holds the given quantile, e.g. 0.99 for the
+     * 99th percentile, or zero if nothing was recorded.
+     */
+    std::chrono::nanoseconds percentile(double quantile) const;
+
+    std::chrono::nanoseconds mean() const {
+        return count ? sum / static_cast<std::int64_t>(count) : std::chrono::nanoseconds{0};
+    }
+};
+
+/**
+ * A histogram of durations with logarithmic buckets, in the manner of HdrHistogram: each power of
+ * two is split into 8 linear sub-buckets, so that any duration up to centuries is recorded with
+ * a relative error below 12.5% in a fixed amount of memory. Recording is lock-free.
+ */
+class latency_histogram {
+   public:
+    static constexpr std::size_t k_sub_buckets = 8;
+    static constexpr std::size_t k_bucket_count = 62 * k_sub_buckets;
+
+    latency_histogram() {
+        reset();
+    }
+
+    latency_histogram(const latency_histogram&) = delete;
+    latency_histogram& operator=(const latency_histogram&) = delete;
+
+    /**
+     * Returns the bucket of a duration in nanoseconds. Durations below 8ns have a bucket each,
+     * and each following power of two [2^e, 2^(e+1)) has 8 buckets.
+     */
+    static std::size_t bucket_index(std::uint64_t ns) {
+        if (ns < k_sub_buckets) {
+            return static_cast<std::size_t>(ns);
+        }
+        std::size_t exponent = 3;
+        while (exponent < 63 && (ns >> (exponent + 1))) {
+            ++exponent;
+        }
+        return (exponent - 2) * k_sub_buckets + ((ns >> (exponent - 3)) & (k_sub_buckets - 1));
+    }
+
+    /**
+     * Returns the smallest duration in nanoseconds that falls in a bucket.
+     */
+    static std::uint64_t bucket_lower_bound(std::size_t index) {
+        if (index < k_sub_buckets) {
+            return index;
+        }
+        std::size_t exponent = index / k_sub_buckets + 2;
+        return (k_sub_buckets + index % k_sub_buckets) << (exponent - 3);
+    }
+
+    /**
+     * Returns the smallest duration in nanoseconds that falls past a bucket.
+     */
+    static std::uint64_t bucket_upper_bound(std::size_t index) {
+        return index + 1 < k_bucket_count ? bucket_lower_bound(index + 1)
+                                          : std::numeric_limits<std::uint64_t>::max();
+    }
+
+    void record(std::chrono::nanoseconds duration) {
+        auto ns = static_cast<std::uint64_t>(std::max<std::int64_t>(duration.count(), 0));
+        _counts[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+        _sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    histogram_snapshot snapshot() const {
+        histogram_snapshot result;
+        result.counts.reserve(k_bucket_count);
+        for (const auto& count : _counts) {
+            result.counts.push_back(count.load(std::memory_order_relaxed));
+            result.count += result.counts.back();
+        }
+        result.sum = std::chrono::nanoseconds(_sum_ns.load(std::memory_order_relaxed));
+        return result;
+    }
+
+    void reset() {
+        for (auto& count : _counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        _sum_ns.store(0, std::memory_order_relaxed);
+    }
+
+   private:
+    std::array<std::atomic<std::uint64_t>, k_bucket_count> _counts;
+    std::atomic<std::uint64_t> _sum_ns;
+};
+
+inline std::chrono::nanoseconds histogram_snapshot::percentile(double quantile) const {
+    if (count == 0) {
+        return std::chrono::nanoseconds{0};
+    }
+    auto rank = static_cast<std::uint64_t>(quantile * count);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen > rank || seen == count) {
+            // The upper bound is exclusive, so the largest duration in the bucket is one less.
+            return std::chrono::nanoseconds(latency_histogram::bucket_upper_bound(i) - 1);
+        }
+    }
+    return std::chrono::nanoseconds{0};
+}
+
+/**
+ * What model_metrics recorded for one kind of operation.
+ */
+struct operation_snapshot {
+    // The number of operations, including those that failed.
+    std::uint64_t calls = 0;
+    // The latency of each operation. For cursors, this is the time spent in the call and in
+    // advancing the cursor, which excludes the time the caller spends on each object.
+    histogram_snapshot latency;
+    std::chrono::nanoseconds total_time{0};
+    // The time spent converting objects to and from BSON with boson.
+    std::chrono::nanoseconds encode_time{0};
+    std::chrono::nanoseconds decode_time{0};
+    std::uint64_t bytes_encoded = 0;
+    std::uint64_t bytes_decoded = 0;
+    std::uint64_t documents_decoded = 0;
+    // The documents that a cursor skipped because they could not be deserialized.
+    std::uint64_t documents_skipped = 0;
+
+    /**
+     * Returns the time spent waiting on the driver, i.e. on the server and the network.
+     */
+    std::chrono::nanoseconds server_time() const {
+        return total_time - encode_time - decode_time;
+    }
+};
+
+/**
+ * A snapshot of model_metrics, with an entry for each kind of operation.
+ */
+struct metrics_snapshot {
+    std::array<operation_snapshot, k_operation_count> operations;
+
+    const operation_snapshot& operator[](operation op) const {
+        return operations[static_cast<std::size_t>(op)];
+    }
+};
+
+namespace details {
+class operation_timer;
+}  // namespace details
+
+/**
+ * Counters and latency histograms of the operations of a model, or of a collection_wrapper.
+ * Recording is lock-free, so a single instance is shared by all threads. Nothing is measured
+ * until enable() is called.
+ */
+class model_metrics {
+   public:
+    model_metrics() = default;
+    model_metrics(const model_metrics&) = delete;
+    model_metrics& operator=(const model_metrics&) = delete;
+
+    void enable() {
+        _enabled.store(true, std::memory_order_relaxed);
+    }
+
+    void disable() {
+        _enabled.store(false, std::memory_order_relaxed);
+    }
+
+    bool enabled() const {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Sets every counter and histogram back to zero.
+     */
+    void reset() {
+        for (auto& counters : _operations) {
+            counters.calls.store(0, std::memory_order_relaxed);
+            counters.latency.reset();
+            counters.total_ns.store(0, std::memory_order_relaxed);
+            counters.encode_ns.store(0, std::memory_order_relaxed);
+            counters.decode_ns.store(0, std::memory_order_relaxed);
+            counters.bytes_encoded.store(0, std::memory_order_relaxed);
+            counters.bytes_decoded.store(0, std::memory_order_relaxed);
+            counters.documents_decoded.store(0, std::memory_order_relaxed);
+            counters.documents_skipped.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Returns a copy of the counters. Operations that are in progress are not included.
+     */
+    metrics_snapshot snapshot() const {
+        metrics_snapshot result;
+        for (std::size_t i = 0; i < k_operation_count; ++i) {
+            const auto& counters = _operations[i];
+            auto& op = result.operations[i];
+            op.calls = counters.calls.load(std::memory_order_relaxed);
+            op.latency = counters.latency.snapshot();
+            op.total_time = std::chrono::nanoseconds(counters.total_ns.load());
+            op.encode_time = std::chrono::nanoseconds(counters.encode_ns.load());
+            op.decode_time = std::chrono::nanoseconds(counters.decode_ns.load());
+            op.bytes_encoded = counters.bytes_encoded.load(std::memory_order_relaxed);
+            op.bytes_decoded = counters.bytes_decoded.load(std::memory_order_relaxed);
+            op.documents_decoded = counters.documents_decoded.load(std::memory_order_relaxed);
+            op.documents_skipped = counters.documents_skipped.load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+   private:
+    friend class details::operation_timer;
+
+    struct operation_counters {
+        std::atomic<std::uint64_t> calls{0};
+        latency_histogram latency;
+        std::atomic<std::uint64_t> total_ns{0};
+        std::atomic<std::uint64_t> encode_ns{0};
+        std::atomic<std::uint64_t> decode_ns{0};
+        std::atomic<std::uint64_t> bytes_encoded{0};
+        std::atomic<std::uint64_t> bytes_decoded{0};
+        std::atomic<std::uint64_t> documents_decoded{0};
+        std::atomic<std::uint64_t> documents_skipped{0};
+    };
+
+    std::atomic<bool> _enabled{false};
+    std::array<operation_counters, k_operation_count> _operations;
+};
+
+namespace details {
+
+/**
+ * Measures a single operation, and adds it to a model_metrics when it is destroyed. The
+ * measurements are kept locally until then, so that a cursor does not touch the shared counters
+ * for every document.
+ *
+ * A timer runs from its creation, and can be paused and resumed so that a cursor only counts the
+ * time spent inside it. A default-constructed timer, or one created while the metrics are
+ * disabled, is inactive and measures nothing.
+ */
+class operation_timer {
+    using clock = std::chrono::steady_clock;
+
+   public:
+    /**
+     * Resumes a paused timer for the lifetime of this object.
+     */
+    class section {
+       public:
+        explicit section(operation_timer& timer) : _timer(timer.active() ? &timer : nullptr) {
+            if (_timer) {
+                _timer->resume();
+            }
+        }
+
+        section(const section&) = delete;
+        section& operator=(const section&) = delete;
+
+        ~section() {
+            if (_timer) {
+                _timer->pause();
+            }
+        }
+
+       private:
+        operation_timer* _timer;
+    };
+
+    operation_timer() = default;
+
+    operation_timer(model_metrics* metrics, operation op)
+        : _metrics(metrics && metrics->enabled() ? metrics : nullptr), _op(op) {
+        if (_metrics) {
+            _started = clock::now();
+            _running = true;
+        }
+    }
+
+    operation_timer(operation_timer&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    operation_timer& operator=(operation_timer&& other) noexcept {
+        if (this != &other) {
+            finish();
+            _metrics = other._metrics;
+            _op = other._op;
+            _started = other._started;
+            _running = other._running;
+            _total = other._total;
+            _encode = other._encode;
+            _decode = other._decode;
+            _bytes_encoded = other._bytes_encoded;
+            _bytes_decoded = other._bytes_decoded;
+            _documents_decoded = other._documents_decoded;
+            _documents_skipped = other._documents_skipped;
+            other._metrics = nullptr;
+        }
+        return *this;
+    }
+
+    ~operation_timer() {
+        finish();
+    }
+
+    bool active() const {
+        return _metrics != nullptr;
+    }
+
+    void pause() {
+        if (_metrics && _running) {
+            _total += clock::now() - _started;
+            _running = false;
+        }
+    }
+
+    void resume() {
+        if (_metrics && !_running) {
+            _started = clock::now();
+            _running = true;
+        }
+    }
+
+    /**
+     * Calls a function that returns a BSON document, and counts its time and the document's
+     * size as encoding.
+     */
+    template <typename F>
+    auto encode(F&& f) -> decltype(f()) {
+        if (!_metrics) {
+            return f();
+        }
+        auto start = clock::now();
+        auto doc = f();
+        _encode += clock::now() - start;
+        _bytes_encoded += doc.view().length();
+        return doc;
+    }
+
+    /**
+     * Calls a function that deserializes a document of the given size, and counts its time as
+     * decoding.
+     */
+    template <typename F>
+    auto decode(std::size_t bytes, F&& f) -> decltype(f()) {
+        if (!_metrics) {
+            return f();
+        }
+        auto start = clock::now();
+        // The document is counted even if it cannot be deserialized.
+        _bytes_decoded += bytes;
+        struct stopwatch {
+            operation_timer& timer;
+            clock::time_point start;
+            ~stopwatch() {
+                timer._decode += clock::now() - start;
+            }
+        } stop{*this, start};
+        auto obj = f();
+        ++_documents_decoded;
+        return obj;
+    }
+
+    /**
+     * Counts a document that a cursor skipped because it could not be deserialized.
+     */
+    void skipped() {
+        if (_metrics) {
+            ++_documents_skipped;
+        }
+    }
+
+   private:
+    void finish() {
+        if (!_metrics) {
+            return;
+        }
+        pause();
+        auto& counters = _metrics->_operations[static_cast<std::size_t>(_op)];
+        counters.calls.fetch_add(1, std::memory_order_relaxed);
+        counters.latency.record(_total);
+        add(counters.total_ns, _total);
+        add(counters.encode_ns, _encode);
+        add(counters.decode_ns, _decode);
+        counters.bytes_encoded.fetch_add(_bytes_encoded, std::memory_order_relaxed);
+        counters.bytes_decoded.fetch_add(_bytes_decoded, std::memory_order_relaxed);
+        counters.documents_decoded.fetch_add(_documents_decoded, std::memory_order_relaxed);
+        counters.documents_skipped.fetch_add(_documents_skipped, std::memory_order_relaxed);
+        _metrics = nullptr;
+    }
+
+    static void add(std::atomic<std::uint64_t>& counter, std::chrono::nanoseconds duration) {
+        counter.fetch_add(static_cast<std::uint64_t>(std::max<std::int64_t>(duration.count(), 0)),
+                          std::memory_order_relaxed);
+    }
+
+    model_metrics* _metrics = nullptr;
+    operation _op = operation::find;
+    clock::time_point _started;
+    bool _running = false;
+    std::chrono::nanoseconds _total{0};
+    std::chrono::nanoseconds _encode{0};
+    std::chrono::nanoseconds _decode{0};
+    std::uint64_t _bytes_encoded = 0;
+    std::uint64_t _bytes_decoded = 0;
+    std::uint64_t _documents_decoded = 0;
+    std::uint64_t _documents_skipped = 0;
+};
+
+inline void write_prometheus_seconds(std::ostream& os, std::chrono::nanoseconds duration) {
+    os << static_cast<double>(duration.count()) / 1e9;
+}
+
+}  // namespace details
+
+/**
+ * Writes the metrics of several models in the Prometheus text exposition format. Each model is
+ * labelled with its name, and only the operations that were called are included.
+ *
+ * @param os        The stream to write to.
+ * @param models    Pairs of a model name and a snapshot of its metrics.
+ *
+ * @see https://prometheus.io/docs/instrumenting/exposition_formats/
+ */
+inline void write_prometheus(std::ostream& os,
+                             const std::vector<std::pair<std::string, metrics_snapshot>>& models) {
+    // Writes one sample of each called operation of each model.
+    auto write_family = [&](const char* name, const char* type, const char* help,
+                            std::ostream& (*sample)(std::ostream&, const operation_snapshot&)) {
+        os << "# HELP " << name << ' ' << help << '\n';
+        os << "# TYPE " << name << ' ' << type << '\n';
+        for (const auto& model : models) {
+            for (std::size_t i = 0; i < k_operation_count; ++i) {
+                const auto& op = model.second.operations[i];
+                if (op.calls == 0) {
+                    continue;
+                }
+                os << name << "{model=\"" << model.first << "\",operation=\""
+                   << operation_name(static_cast<operation>(i)) << "\"} ";
+                sample(os, op) << '\n';
+            }
+        }
+    };
+
+    write_family("mangrove_operations_total", "counter", "Operations performed.",
+                 [](std::ostream& os, const operation_snapshot& op) -> std::ostream& {
+                     return os << op.calls;
+                 });
+    write_family("mangrove_operation_server_seconds_total", "counter",
+                 "Time spent waiting on the server and the network.",
+                 [](std::ostream& os, const operation_snapshot& op) -> std::ostream& {
+                     details::write_prometheus_seconds(os, op.server_time());
+                     return os;
+                 });
+    write_family("mangrove_operation_encode_seconds_total", "counter",
+                 "Time spent serializing objects to BSON.",
+                 [](std::ostream& os, const operation_snapshot& op) -> std::ostream& {
+                     details::write_prometheus_seconds(os, op.encode_time);
+                     return os;
+                 });
+    write_family("mangrove_operation_decode_seconds_total", "counter",
+                 "Time spent deserializing objects from BSON.",
+                 [](std::ostream& os, const operation_snapshot& op) -> std::ostream& {
+                     details::write_prometheus_seconds(os, op.decode_time);
+                     return os;
+                 });
+    write_family("mangrove_operation_encoded_bytes_total", "counter",
+                 "Bytes of BSON serialized from objects.",
+                 [](std::ostream& os, const operation_snapshot& op) -> std::ostream& {
+                     return os << op.bytes_encoded;
+                 });
+    write_family("mangrove_operation_decoded_bytes_total", "counter",
+                 "Bytes of BSON deserialized into objects.",
+                 [](std::ostream& os, const operation_snapshot& op) -> std::ostream& {
+                     return os << op.bytes_decoded;
+                 });
+    write_family("mangrove_operation_decoded_documents_total", "counter",
+                 "Documents deserialized into objects.",
+                 [](std::ostream& os, const operation_snapshot& op) -> std::ostream& {
+                     return os << op.documents_decoded;
+                 });
+    write_family("mangrove_operation_skipped_documents_total", "counter",
+                 "Documents skipped by cursors because they could not be deserialized.",
+                 [](std::ostream& os, const operation_snapshot& op) -> std::ostream& {
+                     return os << op.documents_skipped;
+                 });
+
+    // The histogram is exported with a bucket for each power of two from 1us to about 1min,
+    // which the log-linear buckets of latency_histogram align with.
+    const char* name = "mangrove_operation_duration_seconds";
+    os << "# HELP " << name << " Latency of operations.\n";
+    os << "# TYPE " << name << " histogram\n";
+    for (const auto& model : models) {
+        for (std::size_t i = 0; i < k_operation_count; ++i) {
+            const auto& op = model.second.operations[i];
+            if (op.calls == 0) {
+                continue;
+            }
+            std::string labels = "model=\"" + model.first + "\",operation=\"" +
+                                 operation_name(static_cast<operation>(i)) + "\"";
+            std::uint64_t cumulative = 0;
+            std::size_t bucket = 0;
+            for (std::size_t exponent = 10; exponent <= 36; ++exponent) {
+                auto bound = std::int64_t{1} << exponent;
+                while (latency_histogram::bucket_upper_bound(bucket) <=
+                       static_cast<std::uint64_t>(bound)) {
+                    cumulative += op.latency.counts[bucket++];
+                }
+                os << name << "_bucket{" << labels << ",le=\"";
+                details::write_prometheus_seconds(os, std::chrono::nanoseconds(bound));
+                os << "\"} " << cumulative << '\n';
+            }
+            os << name << "_bucket{" << labels << ",le=\"+Inf\"} " << op.latency.count << '\n';
+            os << name << "_sum{" << labels << "} ";
+            details::write_prometheus_seconds(os, op.latency.sum);
+            os << '\n' << name << "_count{" << labels << "} " << op.latency.count << '\n';
+        }
+    }
+}
+
+/**
+ * Writes the metrics of several models to a file in the Prometheus text format, e.g. for the
+ * textfile collector of the node exporter. The file is written under a temporary name and then
+ * renamed, so that readers never see a partial file.
+ *
+ * @throws std::runtime_error if the file cannot be written.
+ */
+inline void dump_prometheus(const std::string& path,
+                            const std::vector<std::pair<std::string, metrics_snapshot>>& models) {
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::out | std::ios::trunc);
+        write_prometheus(file, models);
+        file.flush();
+        if (!file) {
+            throw std::runtime_error("mangrove: could not write metrics to " + temporary + ".");
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("mangrove: could not write metrics to " + path + ".");
+    }
+}
+
+MANGROVE_INLINE_NAMESPACE_END
+}  // namespace mangrove
+
+#include <mangrove/config/postlude.hpp>
@@ -14,13 +14,29 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
 #include <cereal/cereal.hpp>
 
+#include <bsoncxx/builder/core.hpp>
 #include <bsoncxx/oid.hpp>
+#include <mangrove/batch_size_tuner.hpp>
 #include <mangrove/collection_wrapper.hpp>
 #include <mangrove/config/prelude.hpp>
+#include <mangrove/id_cache.hpp>
+#include <mangrove/metrics.hpp>
+#include <mangrove/parallel_scan.hpp>
 #include <mangrove/util.hpp>
 #include <mongocxx/collection.hpp>
+#include <mongocxx/pool.hpp>
 
 namespace mangrove {
 MANGROVE_INLINE_NAMESPACE_BEGIN
@@ -36,6 +52,16 @@ class model {
     static thread_local collection_wrapper<T> _coll;
 #endif
 
+    // Unlike the collection, the identity cache is shared by all threads so that a write made
+    // through the model on any thread invalidates the cached copy everywhere.
+    static id_cache<IdType, T> _id_cache;
+
+    // Like the identity cache, the batch size tuner is shared so that it learns from the cursors
+    // of all threads.
+    static batch_size_tuner _batch_size_tuner;
+
+    static model_metrics _metrics;
+
    public:
     /**
      * Forward the arguments to the constructor of IdType.
@@ -71,6 +97,7 @@ class model {
     static std::int64_t count(
         bsoncxx::document::view_or_value filter = bsoncxx::document::view_or_value{},
         const mongocxx::options::count& options = mongocxx::options::count()) {
+        details::operation_timer timer(&_metrics, operation::count);
         return _coll.collection().count(filter, options);
     }
 
@@ -100,7 +127,10 @@ class model {
     static mongocxx::stdx::optional<mongocxx::result::delete_result> delete_many(
         bsoncxx::document::view_or_value filter,
         const mongocxx::options::delete_options& options = mongocxx::options::delete_options()) {
-        return _coll.collection().delete_many(filter, options);
+        details::operation_timer timer(&_metrics, operation::remove);
+        auto result = _coll.collection().delete_many(filter, options);
+        _id_cache.clear();
+        return result;
     }
 
     /**
@@ -119,7 +149,10 @@ class model {
     static mongocxx::stdx::optional<mongocxx::result::delete_result> delete_one(
         bsoncxx::document::view_or_value filter,
         const mongocxx::options::delete_options& options = mongocxx::options::delete_options()) {
-        return _coll.collection().delete_one(filter, options);
+        details::operation_timer timer(&_metrics, operation::remove);
+        auto result = _coll.collection().delete_one(filter, options);
+        _id_cache.clear();
+        return result;
     }
 
     /**
@@ -131,6 +164,171 @@ class model {
      */
     static void drop() {
         _coll.collection().drop();
+        _id_cache.clear();
+    }
+
+    /**
+     * Enables the read-through identity cache used by find_by_id(). Objects fetched by _id are
+     * kept in memory, up to the limits given in the options, and served from there on subsequent
+     * lookups. The cache is shared by all threads and starts out empty.
+     *
+     * Writes made through this class invalidate the affected objects: save() and remove() evict
+     * the object's _id, while the filter-based update and delete methods empty the whole cache.
+     * Changes made by other means are only picked up once the cached object expires, so a TTL
+     * should be set if the collection is also modified elsewhere.
+     *
+     * @param options
+     *   The size budget and expiry of the cache, see mangrove::id_cache_options.
+     */
+    static void enable_id_cache(const id_cache_options& options = id_cache_options()) {
+        _id_cache.configure(options);
+    }
+
+    /**
+     * Disables the identity cache and releases all of the objects it holds. find_by_id() will
+     * query the database on every call.
+     */
+    static void disable_id_cache() {
+        _id_cache.configure({});
+    }
+
+    /**
+     * Finds the object with the given _id. If the identity cache is enabled, a cached copy is
+     * returned when available, and otherwise the object fetched from the database is added to
+     * the cache.
+     *
+     * @param id
+     *   The _id of the object to find.
+     *
+     * @return An optional object with the given _id.
+     * @throws mongocxx::exception::query if the operation fails.
+     *
+     * @see enable_id_cache()
+     */
+    static mongocxx::stdx::optional<T> find_by_id(const IdType& id) {
+        if (auto cached = _id_cache.get(id)) {
+            return cached;
+        }
+
+        // Read the generation before the query, so that an invalidation racing with it prevents
+        // the possibly stale result from being cached.
+        auto generation = _id_cache.generation();
+
+        auto id_match_filter = bsoncxx::builder::stream::document{}
+                               << "_id" << id << bsoncxx::builder::stream::finalize;
+
+        details::operation_timer timer(&_metrics, operation::find_one);
+        auto doc = _coll.collection().find_one(id_match_filter.view());
+        if (!doc) {
+            return {};
+        }
+
+        auto view = doc->view();
+        T obj = timer.decode(view.length(), [&view]() { return boson::to_obj<T>(view); });
+        _id_cache.put(id, obj, doc->view().length(), generation);
+        return {std::move(obj)};
+    }
+
+    /**
+     * Finds the objects with the given _ids, in as few queries as possible. Duplicate ids are
+     * looked up once, objects in the identity cache are not fetched again, and the remaining ids
+     * are fetched with {_id: {$in: [...]}} queries of at most max_chunk_size ids, each kept well
+     * within the maximum BSON document size.
+     *
+     * @param ids
+     *   A container of the _ids of the objects to find.
+     * @param max_chunk_size
+     *   The maximum number of ids to send in a single query.
+     *
+     * @return A vector with an optional object for each element of ids, in the same order.
+     * @throws mongocxx::exception::query if one of the queries fails.
+     *
+     * @see find_map_by_ids()
+     */
+    template <typename Container>
+    static std::vector<mongocxx::stdx::optional<T>> find_by_ids(
+        const Container& ids, std::size_t max_chunk_size = k_default_ids_chunk_size) {
+        auto found = find_map_by_ids(ids, max_chunk_size);
+
+        std::vector<mongocxx::stdx::optional<T>> results;
+        results.reserve(std::distance(std::begin(ids), std::end(ids)));
+        for (const IdType& id : ids) {
+            auto it = found.find(id);
+            if (it == found.end()) {
+                results.emplace_back();
+            } else {
+                results.emplace_back(it->second);
+            }
+        }
+        return results;
+    }
+
+    /**
+     * Finds the objects with the given _ids, as find_by_ids() does, and returns them keyed by
+     * their _id. Ids that do not match an object are not present in the result.
+     *
+     * @param ids
+     *   A container of the _ids of the objects to find.
+     * @param max_chunk_size
+     *   The maximum number of ids to send in a single query.
+     *
+     * @return A map from _id to the object with that _id.
+     * @throws mongocxx::exception::query if one of the queries fails.
+     */
+    template <typename Container>
+    static std::map<IdType, T> find_map_by_ids(
+        const Container& ids, std::size_t max_chunk_size = k_default_ids_chunk_size) {
+        std::map<IdType, T> found;
+        auto filters = ids_chunk_filters(ids, max_chunk_size, found);
+
+        // As in find_by_id(), read the generation before querying so that racing writes prevent
+        // the possibly stale results from being cached.
+        auto generation = _id_cache.generation();
+        for (const auto& filter : filters) {
+            fetch_ids_chunk(_coll.collection(), filter.view(), generation, found);
+        }
+        return found;
+    }
+
+    /**
+     * Finds the objects with the given _ids, as find_map_by_ids() does, but runs the queries of
+     * the chunks of ids concurrently, each on a thread of its own with a client from a pool.
+     *
+     * @param pool
+     *   The pool that the queries acquire their clients from. Its size bounds the number of
+     *   queries that run at the same time.
+     * @param database
+     *   The name of the database that holds this model's collection.
+     * @param ids
+     *   A container of the _ids of the objects to find.
+     * @param max_chunk_size
+     *   The maximum number of ids to send in a single query.
+     *
+     * @return A map from _id to the object with that _id.
+     * @throws mongocxx::exception::query if one of the queries fails.
+     */
+    template <typename Container>
+    static std::map<IdType, T> find_map_by_ids(
+        mongocxx::pool& pool, const std::string& database, const Container& ids,
+        std::size_t max_chunk_size = k_default_ids_chunk_size) {
+        std::map<IdType, T> found;
+        auto filters = ids_chunk_filters(ids, max_chunk_size, found);
+
+        auto generation = _id_cache.generation();
+        auto collection = _coll.collection().name().to_string();
+        std::vector<std::map<IdType, T>> chunks(filters.size());
+        details::run_workers(filters.size(), [&](std::size_t i, const std::atomic<bool>&) {
+            auto client = pool.acquire();
+            fetch_ids_chunk((*client)[database][collection], filters[i].view(), generation,
+                            chunks[i]);
+        });
+
+        // The chunks hold distinct ids, so merging them never replaces an object.
+        for (auto& chunk : chunks) {
+            found.insert(std::make_move_iterator(chunk.begin()),
+                         std::make_move_iterator(chunk.end()));
+        }
+        return found;
     }
 
     /**
@@ -139,7 +337,8 @@ class model {
      * @param filter
      *   Document view representing a document that should match the query.
      * @param options
-     *   Optional arguments, see mongocxx::options::find
+     *   Optional arguments, see mongocxx::options::find. If adaptive batch sizing is enabled
+     *   and no batch size is set, the batch size is chosen by the tuner.
      *
      * @return Cursor with deserialized objects from the collection.
      * @throws
@@ -147,11 +346,150 @@ class model {
      *   is iterated.
      *
      * @see https://docs.mongodb.com/manual/tutorial/query-documents/
+     * @see enable_adaptive_batch_size()
      */
     static deserializing_cursor<T> find(
         bsoncxx::document::view_or_value filter,
         const mongocxx::options::find& options = mongocxx::options::find()) {
-        return _coll.find(std::move(filter), options);
+        std::size_t batch_size = options.batch_size() ? 0 : _batch_size_tuner.next_batch_size();
+        if (batch_size == 0) {
+            return _coll.find(std::move(filter), options);
+        }
+
+        auto tuned = options;
+        tuned.batch_size(static_cast<std::int32_t>(batch_size));
+        auto cursor = _coll.find(std::move(filter), tuned);
+        cursor.adapt_batch_size(_batch_size_tuner, batch_size);
+        return cursor;
+    }
+
+    /**
+     * Enables adaptive batch sizing for find(). The batch size of each query that does not set
+     * one in its options is chosen from the size of the documents, and the time spent on each
+     * object by the consumers of the previous cursors, so that a batch stays within the memory
+     * and latency budgets given in the options.
+     *
+     * @param options
+     *   The budgets and bounds of the batch size, see mangrove::batch_size_options.
+     *
+     * @see adaptive_batch_size_stats()
+     */
+    static void enable_adaptive_batch_size(
+        const batch_size_options& options = batch_size_options()) {
+        _batch_size_tuner.configure(options);
+    }
+
+    /**
+     * Disables adaptive batch sizing, so that find() uses the server's default batch size.
+     */
+    static void disable_adaptive_batch_size() {
+        _batch_size_tuner.configure({});
+    }
+
+    /**
+     * Returns the counters and estimates of adaptive batch sizing, including the batch size that
+     * the next query will use.
+     */
+    static batch_size_stats adaptive_batch_size_stats() {
+        return _batch_size_tuner.stats();
+    }
+
+    /**
+     * Returns the operation metrics of this model, which are shared by all threads. They record
+     * the number, latency, encoding and decoding time and bytes of each kind of operation once
+     * they are enabled, e.g. with T::metrics().enable().
+     *
+     * @see write_prometheus()
+     */
+    static model_metrics& metrics() {
+        return _metrics;
+    }
+
+    /**
+     * Scans the objects that match a filter with several cursors at once. The _id range of the
+     * matching documents is split into partitions of about the same size, from a random sample
+     * of their _ids, and each partition is read by its own thread on a client acquired from the
+     * pool. This returns once every partition has been read.
+     *
+     * Since this model's collection is set per thread, the workers look the collection up by name
+     * in the given database rather than using it.
+     *
+     * @param pool
+     *   The pool that the workers acquire their clients from. It should allow at least
+     *   partitions connections, or the workers will wait for each other.
+     * @param database
+     *   The name of the database that holds this model's collection.
+     * @param filter
+     *   Document view representing the objects to scan.
+     * @param partitions
+     *   The number of partitions and of worker threads. There may be fewer partitions if the
+     *   sample has too few distinct _ids.
+     * @param callback
+     *   Called as callback(partition, obj) for each object, on the worker thread of the
+     *   partition, so calls for different partitions are concurrent. The objects of a partition
+     *   are passed in _id order only if the query plan scans the _id index.
+     *
+     * @throws mongocxx::exception::query if a query fails, or the first exception thrown by the
+     *   callback. The other workers stop after their current object.
+     *
+     * @see https://docs.mongodb.com/manual/reference/operator/aggregation/sample/
+     */
+    template <typename F>
+    static void parallel_scan(mongocxx::pool& pool, const std::string& database,
+                              bsoncxx::document::view_or_value filter, std::size_t partitions,
+                              F callback) {
+        if (partitions == 0) {
+            throw std::logic_error("mangrove: a parallel scan requires at least one partition.");
+        }
+        auto collection = _coll.collection().name().to_string();
+        details::parallel_scan<T, IdType>(pool, database, collection, filter.view(), partitions,
+                                          callback);
+    }
+
+    /**
+     * Finds the distinct values of a field among the documents that match a filter.
+     *
+     * @param field
+     *   The name-value pair of the field, from MANGROVE_KEY or MANGROVE_CHILD.
+     * @param filter
+     *   A query expression, or a document representing the documents to consider. By default,
+     *   all of them.
+     * @param options
+     *   Optional arguments, see mongocxx::options::distinct.
+     *
+     * @return The distinct values, or the distinct elements if the field is an array.
+     * @throws mongocxx::exception::query if the operation fails.
+     *
+     * @see https://docs.mongodb.com/manual/reference/command/distinct/
+     */
+    template <typename NvpT>
+    static std::vector<iterable_value_t<typename NvpT::no_opt_type>> distinct(
+        const NvpT& field,
+        bsoncxx::document::view_or_value filter = bsoncxx::document::view_or_value{},
+        const mongocxx::options::distinct& options = mongocxx::options::distinct()) {
+        return _coll.distinct(field, std::move(filter), options);
+    }
+
+    /**
+     * Runs a typed aggregation pipeline against this collection.
+     *
+     * @param pipeline
+     *   A typed_pipeline that starts from objects of this model.
+     * @param options
+     *   Optional arguments, see mongocxx::options::aggregate.
+     *
+     * @return Cursor with the deserialized results of the pipeline.
+     * @throws
+     *   If the operation failed, the returned cursor will throw mongocxx::exception::query when
+     *   it is iterated.
+     *
+     * @see https://docs.mongodb.com/manual/aggregation/
+     */
+    template <typename Result>
+    static deserializing_cursor<Result> aggregate(
+        const typed_pipeline<T, Result>& pipeline,
+        const mongocxx::options::aggregate& options = mongocxx::options::aggregate()) {
+        return _coll.aggregate(pipeline, options);
     }
 
     /**
@@ -173,6 +511,34 @@ class model {
         return _coll.find_one(std::move(filter), options);
     }
 
+    /**
+     * Atomically finds a single document matching the provided filter, updates it, and returns
+     * either the original or the updated object. Only the mapped fields of the model are
+     * requested from the server unless the options set a projection.
+     *
+     * @param filter
+     *   A query expression, or a document representing the match criteria.
+     * @param update
+     *   An update expression, or a document representing the update to apply.
+     * @param options
+     *   Optional arguments, see mongocxx::options::find_one_and_update. Use return_document() to
+     *   choose between the original and the updated object.
+     *
+     * @return An optional object that matched the filter.
+     * @throws mongocxx::exception::write if the operation fails.
+     *
+     * @see https://docs.mongodb.com/manual/reference/command/findAndModify/
+     */
+    template <typename Query, typename Update>
+    static mongocxx::stdx::optional<T> find_one_and_update(
+        const Query& filter, const Update& update,
+        const mongocxx::options::find_one_and_update& options =
+            mongocxx::options::find_one_and_update()) {
+        auto result = _coll.find_one_and_update(filter, update, options);
+        _id_cache.clear();
+        return result;
+    }
+
     /**
      *  Inserts multiple object of the model into the collection.
      *
@@ -270,7 +636,10 @@ class model {
         auto id_match_filter = bsoncxx::builder::stream::document{}
                                << "_id" << this->_id << bsoncxx::builder::stream::finalize;
 
-        return _coll.collection().delete_one(id_match_filter.view(), options);
+        details::operation_timer timer(&_metrics, operation::remove);
+        auto result = _coll.collection().delete_one(id_match_filter.view(), options);
+        _id_cache.erase(this->_id);
+        return result;
     }
 
     /**
@@ -287,9 +656,13 @@ class model {
      */
     static void setCollection(const mongocxx::collection& coll) {
         _coll = collection_wrapper<T>(coll);
+        _coll.set_metrics(&_metrics);
+        _id_cache.clear();
     }
     static void setCollection(mongocxx::collection&& coll) {
         _coll = collection_wrapper<T>(std::move(coll));
+        _coll.set_metrics(&_metrics);
+        _id_cache.clear();
     }
 
     /**
@@ -313,16 +686,21 @@ class model {
      */
     mongocxx::stdx::optional<mongocxx::result::update> save(
         mongocxx::options::update options = mongocxx::options::update()) {
+        details::operation_timer timer(&_metrics, operation::update);
         auto id_match_filter = bsoncxx::builder::stream::document{}
                                << "_id" << this->_id << bsoncxx::builder::stream::finalize;
 
-        auto update = bsoncxx::builder::stream::document{}
-                      << "$set" << boson::to_dotted_notation_document(*static_cast<T*>(this))
-                      << bsoncxx::builder::stream::finalize;
+        auto fields = timer.encode(
+            [this]() { return boson::to_dotted_notation_document(*static_cast<T*>(this)); });
+        auto update = bsoncxx::builder::stream::document{} << "$set" << std::move(fields)
+                                                             << bsoncxx::builder::stream::finalize;
 
         options.upsert(true);
 
-        return _coll.collection().update_one(id_match_filter.view(), update.view(), options);
+        auto result =
+            _coll.collection().update_one(id_match_filter.view(), update.view(), options);
+        _id_cache.erase(this->_id);
+        return result;
     }
 
     /**
@@ -343,7 +721,10 @@ class model {
     static mongocxx::stdx::optional<mongocxx::result::update> update_many(
         bsoncxx::document::view_or_value filter, bsoncxx::document::view_or_value update,
         const mongocxx::options::update& options = mongocxx::options::update()) {
-        return _coll.collection().update_many(filter, update, options);
+        details::operation_timer timer(&_metrics, operation::update);
+        auto result = _coll.collection().update_many(filter, update, options);
+        _id_cache.clear();
+        return result;
     }
 
     /**
@@ -364,11 +745,96 @@ class model {
     static mongocxx::stdx::optional<mongocxx::result::update> update_one(
         bsoncxx::document::view_or_value filter, bsoncxx::document::view_or_value update,
         const mongocxx::options::update& options = mongocxx::options::update()) {
-        return _coll.collection().update_many(filter, update, options);
+        details::operation_timer timer(&_metrics, operation::update);
+        auto result = _coll.collection().update_many(filter, update, options);
+        _id_cache.clear();
+        return result;
     }
 
    protected:
     IdType _id;
+
+   private:
+    static constexpr std::size_t k_default_ids_chunk_size = 1000;
+
+    // The size of the $in array in one query, which leaves room for the rest of the command
+    // within the 16MB limit on BSON documents.
+    static constexpr std::size_t k_max_ids_chunk_bytes = 15 * 1024 * 1024;
+
+    /**
+     * Moves the objects of the given ids that are in the identity cache into found, and returns
+     * the {_id: {$in: [...]}} filters that fetch the others. Each filter holds at most
+     * max_chunk_size distinct ids, and stays well within the maximum BSON document size.
+     */
+    template <typename Container>
+    static std::vector<bsoncxx::document::value> ids_chunk_filters(const Container& ids,
+                                                                   std::size_t max_chunk_size,
+                                                                   std::map<IdType, T>& found) {
+        static_assert(container_of_v<Container, IdType>,
+                      "find_by_ids requires a container of the model's id type.");
+        if (max_chunk_size == 0) {
+            throw std::logic_error("mangrove: the chunk size of find_by_ids must be positive.");
+        }
+
+        std::vector<IdType> missing;
+        for (const IdType& id : ids) {
+            if (auto cached = _id_cache.get(id)) {
+                found.emplace(id, std::move(*cached));
+            } else {
+                missing.push_back(id);
+            }
+        }
+        std::sort(missing.begin(), missing.end());
+        missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+
+        std::vector<bsoncxx::document::value> filters;
+        auto begin = missing.begin();
+        while (begin != missing.end()) {
+            auto filter = bsoncxx::builder::core(false);
+            filter.key_view("_id").open_document().key_view("$in").open_array();
+
+            std::size_t count = 0;
+            std::size_t bytes = 0;
+            auto end = begin;
+            for (; end != missing.end() && count < max_chunk_size; ++end, ++count) {
+                // Each array element is a type byte, its index as a key, and the value.
+                auto element_size = 2 + std::to_string(count).size() + id_value_size(*end);
+                if (count > 0 && bytes + element_size > k_max_ids_chunk_bytes) {
+                    break;
+                }
+                bytes += element_size;
+                filter.append(*end);
+            }
+            filter.close_array().close_document();
+            filters.push_back(filter.extract_document());
+            begin = end;
+        }
+        return filters;
+    }
+
+    // Runs one of the queries of find_map_by_ids(), and caches and adds the objects it finds.
+    static void fetch_ids_chunk(mongocxx::collection coll, bsoncxx::document::view filter,
+                                std::uint64_t generation, std::map<IdType, T>& found) {
+        details::operation_timer timer(&_metrics, operation::find);
+        for (auto&& doc : coll.find(filter)) {
+            T obj = timer.decode(doc.length(), [&doc]() { return boson::to_obj<T>(doc); });
+            _id_cache.put(obj._id, obj, doc.length(), generation);
+            found.emplace(obj._id, std::move(obj));
+        }
+    }
+
+    // Returns the number of bytes that an _id occupies as a BSON value.
+    static std::size_t id_value_size(const bsoncxx::oid&) {
+        return 12;
+    }
+
+    template <typename Id>
+    static std::size_t id_value_size(const Id& id) {
+        auto builder = bsoncxx::builder::core(false);
+        builder.key_view("").append(id);
+        // Subtract the length prefix, type byte, empty key and terminator of the document.
+        return builder.view_document().length() - 7;
+    }
 };
 
 #ifdef __APPLE__
@@ -379,5 +845,14 @@ template <typename T, typename IdType>
 thread_local collection_wrapper<T> model<T, IdType>::_coll;
 #endif
 
+template <typename T, typename IdType>
+id_cache<IdType, T> model<T, IdType>::_id_cache;
+
+template <typename T, typename IdType>
+batch_size_tuner model<T, IdType>::_batch_size_tuner;
+
+template <typename T, typename IdType>
+model_metrics model<T, IdType>::_metrics;
+
 MANGROVE_INLINE_NAMESPACE_END
 }  // namespace mangrove
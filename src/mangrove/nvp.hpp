@@ -17,10 +17,16 @@
 #include <mangrove/config/prelude.hpp>
 
 #include <cstddef>
+#include <initializer_list>
+#include <iterator>
 #include <stdexcept>
+#include <string>
 #include <tuple>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
+#include <bsoncxx/stdx/string_view.hpp>
 #include <bsoncxx/types.hpp>
 
 #include <mangrove/expression_syntax.hpp>
@@ -33,6 +39,207 @@ MANGROVE_INLINE_NAMESPACE_BEGIN
 template <typename NvpT, typename T>
 class nvp_base;
 
+namespace details {
+
+/**
+ * A fixed-capacity buffer holding the dotted path of a field, such as "a.b.0.c".
+ * Name-value pairs of nested fields and array elements build their path once, when they are
+ * formed, so that expressions can pass it to a BSON builder as a key without allocating. Paths
+ * that do not fit are marked as truncated, and their names are then built on demand instead.
+ *
+ * The buffer is 128 bytes, and it is held by value: every nvp_child, array_element_nvp and
+ * dollar_operator_nvp has one, and so does every expression on one of them, since expressions
+ * store their name-value pair by value. An update list of n nested fields thus carries at least
+ * 128 * n bytes of paths. The static_asserts at the end of this file keep this from growing.
+ */
+class field_path {
+   public:
+    static constexpr std::size_t capacity = 127;
+
+    constexpr field_path() : _data{}, _size(0) {
+    }
+
+    constexpr explicit field_path(const char* name) : field_path() {
+        append(name);
+    }
+
+    /**
+     * Creates the path "parent.name".
+     */
+    constexpr field_path(const field_path& parent, const char* name) : field_path(parent) {
+        append('.');
+        append(name);
+    }
+
+    /**
+     * Creates the path "parent.index", for an element of an array.
+     */
+    constexpr field_path(const field_path& parent, std::size_t index) : field_path(parent) {
+        char digits[20]{};
+        std::size_t n = 0;
+        do {
+            digits[n++] = static_cast<char>('0' + index % 10);
+            index /= 10;
+        } while (index > 0);
+        append('.');
+        while (n > 0) {
+            append(digits[--n]);
+        }
+    }
+
+    /**
+     * Returns whether the path was too long for this buffer.
+     */
+    constexpr bool truncated() const {
+        return _size > capacity;
+    }
+
+    /**
+     * Returns the path, or an empty view if it was truncated.
+     */
+    bsoncxx::stdx::string_view view() const {
+        if (truncated()) {
+            return {};
+        }
+        return {_data, _size};
+    }
+
+   private:
+    // A path that did not fit has a size past the capacity, so that the size and the truncation
+    // flag share a byte.
+    constexpr void append(char c) {
+        if (_size < capacity) {
+            _data[_size++] = c;
+        } else {
+            _size = capacity + 1;
+        }
+    }
+
+    constexpr void append(const char* s) {
+        while (*s) {
+            append(*s++);
+        }
+    }
+
+    char _data[capacity];
+    unsigned char _size;
+};
+
+/**
+ * Helpers for the visit_values() member functions of name-value pairs, which resolve the values of
+ * a sub-field given a value of its parent field. An empty optional has no values, and an array
+ * has the values of all of its elements, as in MongoDB's dot notation.
+ */
+template <typename Base, typename T, typename V, typename F>
+std::enable_if_t<std::is_base_of<Base, std::decay_t<V>>::value, bool> visit_member(V& v,
+                                                                                   T Base::*t,
+                                                                                   F&& f);
+
+template <typename Base, typename T, typename V, typename F>
+std::enable_if_t<is_optional_v<std::decay_t<V>>, bool> visit_member(V& v, T Base::*t, F&& f);
+
+template <typename Base, typename T, typename V, typename F>
+std::enable_if_t<is_iterable_v<std::decay_t<V>> && !std::is_base_of<Base, std::decay_t<V>>::value,
+                 bool>
+visit_member(V& v, T Base::*t, F&& f);
+
+template <typename Base, typename T, typename V, typename F>
+std::enable_if_t<std::is_base_of<Base, std::decay_t<V>>::value, bool> visit_member(V& v,
+                                                                                   T Base::*t,
+                                                                                   F&& f) {
+    return f(v.*t);
+}
+
+template <typename Base, typename T, typename V, typename F>
+std::enable_if_t<is_optional_v<std::decay_t<V>>, bool> visit_member(V& v, T Base::*t, F&& f) {
+    return v && visit_member(*v, t, f);
+}
+
+template <typename Base, typename T, typename V, typename F>
+std::enable_if_t<is_iterable_v<std::decay_t<V>> && !std::is_base_of<Base, std::decay_t<V>>::value,
+                 bool>
+visit_member(V& v, T Base::*t, F&& f) {
+    for (auto& elem : v) {
+        if (visit_member(elem, t, f)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename V, typename F>
+std::enable_if_t<is_iterable_v<std::decay_t<V>>, bool> visit_element(V& v, std::size_t i, F&& f) {
+    if (i >= static_cast<std::size_t>(std::distance(std::begin(v), std::end(v)))) {
+        return false;
+    }
+    return f(*std::next(std::begin(v), i));
+}
+
+template <typename V, typename F>
+std::enable_if_t<is_optional_v<std::decay_t<V>>, bool> visit_element(V& v, std::size_t i, F&& f) {
+    return v && visit_element(*v, i, f);
+}
+
+/**
+ * Helpers for the resolve() member functions of name-value pairs, which find the single value of a
+ * sub-field that an update modifies. If `create` is true, missing embedded documents and array
+ * elements along the way are created, as MongoDB does when setting a field.
+ */
+template <typename V>
+V* resolve_optional(V& v, bool) {
+    return &v;
+}
+
+template <typename V>
+V* resolve_optional(bsoncxx::stdx::optional<V>& v, bool create) {
+    if (!v) {
+        if (!create) {
+            return nullptr;
+        }
+        v.emplace();
+    }
+    return &*v;
+}
+
+template <typename Base, typename T, typename V>
+std::enable_if_t<std::is_base_of<Base, V>::value, T*> resolve_member(V& v, T Base::*t, bool) {
+    return &(v.*t);
+}
+
+template <typename Base, typename T, typename V>
+std::enable_if_t<!std::is_base_of<Base, V>::value, T*> resolve_member(V&, T Base::*, bool) {
+    throw std::logic_error(
+        "mangrove: an update to a field in an array of documents requires an array index");
+}
+
+template <typename C>
+auto resize_array(C& c, std::size_t n, int) -> decltype(c.resize(n), bool()) {
+    c.resize(n);
+    return true;
+}
+
+template <typename C>
+bool resize_array(C&, std::size_t, long) {
+    return false;
+}
+
+template <typename C>
+iterable_value_t<C>* resolve_element(C& c, std::size_t i, bool create) {
+    auto size = static_cast<std::size_t>(std::distance(std::begin(c), std::end(c)));
+    if (i >= size) {
+        if (!create) {
+            return nullptr;
+        }
+        // MongoDB pads the array with nulls, the closest equivalent of which is the default value.
+        if (!resize_array(c, i + 1, 0)) {
+            throw std::logic_error("mangrove: cannot grow a fixed-size array in an update");
+        }
+    }
+    return &*std::next(std::begin(c), i);
+}
+
+}  // namespace details
+
 struct current_date_t {
     constexpr current_date_t() {
     }
@@ -98,6 +305,41 @@ class nvp : public nvp_base<nvp<Base, T>, T> {
         return s.append(name);
     }
 
+    /**
+     * Returns the name of this field, for use as a BSON key.
+     */
+    bsoncxx::stdx::string_view key() const {
+        return name;
+    }
+
+    /**
+     * Returns the name of this field as a field_path, so that children can extend it.
+     */
+    constexpr details::field_path path() const {
+        return details::field_path{name};
+    }
+
+    /**
+     * Invokes `f` on the value of this field in the given object.
+     * This is used to evaluate expressions directly against C++ objects.
+     * @param  obj  An object of type Base, which may be const.
+     * @param  f    A callable that takes the field's value, and returns a bool.
+     * @return      The result of `f`.
+     */
+    template <typename Root, typename F>
+    bool visit_values(Root& obj, F&& f) const {
+        return f(obj.*t);
+    }
+
+    /**
+     * Returns a pointer to the value of this field in the given object. This is used to apply
+     * update expressions directly to C++ objects.
+     */
+    template <typename Root>
+    T* resolve(Root& obj, bool) const {
+        return &(obj.*t);
+    }
+
     T Base::*t;
     const char* name;
 };
@@ -119,7 +361,7 @@ class nvp_child : public nvp_base<nvp_child<Base, T, Parent>, T> {
     using no_opt_type = remove_optional_t<T>;
 
     constexpr nvp_child(T Base::*t, const char* name, const Parent& parent)
-        : t(t), name(name), parent(parent) {
+        : t(t), name(name), parent(parent), _path(parent.path(), name) {
     }
 
     /**
@@ -164,12 +406,67 @@ class nvp_child : public nvp_base<nvp_child<Base, T, Parent>, T> {
      * @return A string containing the name of this field in dot notation.
      */
     std::string& append_name(std::string& s) const {
-        return parent.append_name(s).append(1, '.').append(name);
+        if (_path.truncated()) {
+            return parent.append_name(s).append(1, '.').append(name);
+        }
+        auto path = _path.view();
+        return s.append(path.data(), path.size());
+    }
+
+    /**
+     * Returns the qualified name of this field for use as a BSON key, without building a string.
+     * This is empty if the name is too long to be stored inline, in which case callers fall back
+     * to append_name().
+     */
+    bsoncxx::stdx::string_view key() const {
+        return _path.view();
+    }
+
+    /**
+     * Returns the qualified name of this field, as built when this name-value pair was formed.
+     */
+    constexpr const details::field_path& path() const {
+        return _path;
+    }
+
+    /**
+     * Invokes `f` on each value of this field in the given root object, until a call returns true.
+     * A field nested in an array of documents has one value per document, and a field nested in an
+     * empty optional has none.
+     * @param  obj  An object of the root type of this field's chain of parents, which may be const.
+     * @param  f    A callable that takes the field's value, and returns a bool.
+     * @return      True if any call to `f` returned true, false otherwise.
+     */
+    template <typename Root, typename F>
+    bool visit_values(Root& obj, F&& f) const {
+        return parent.visit_values(
+            obj, [&](auto& parent_value) { return details::visit_member(parent_value, t, f); });
+    }
+
+    /**
+     * Returns a pointer to the value of this field in the given root object, or nullptr if one of
+     * its parents is an empty optional.
+     * @param  obj      An object of the root type of this field's chain of parents.
+     * @param  create   Whether to fill in empty optional parents instead of returning nullptr.
+     * @throws std::logic_error if one of the parents is an array of documents, in which case
+     *         the path does not refer to a single value.
+     */
+    template <typename Root>
+    T* resolve(Root& obj, bool create) const {
+        auto parent_value = parent.resolve(obj, create);
+        if (!parent_value) {
+            return nullptr;
+        }
+        auto base = details::resolve_optional(*parent_value, create);
+        return base ? details::resolve_member(*base, t, create) : nullptr;
     }
 
     T Base::*t;
     const char* name;
     const Parent& parent;
+
+   private:
+    details::field_path _path;
 };
 
 template <typename NvpT>
@@ -180,7 +477,8 @@ class array_element_nvp
     // In case this field is wrapped in an optional, store the underlying type.
     using no_opt_type = remove_optional_t<type>;
 
-    constexpr array_element_nvp(const NvpT& nvp, std::size_t i) : _nvp(nvp), _i(i) {
+    constexpr array_element_nvp(const NvpT& nvp, std::size_t i)
+        : _nvp(nvp), _i(i), _path(nvp.path(), i) {
     }
 
     /**
@@ -206,12 +504,61 @@ class array_element_nvp
      * @return A string containing the name of this field in dot notation.
      */
     std::string& append_name(std::string& s) const {
-        return _nvp.append_name(s).append(1, '.').append(std::to_string(_i));
+        if (_path.truncated()) {
+            return _nvp.append_name(s).append(1, '.').append(std::to_string(_i));
+        }
+        auto path = _path.view();
+        return s.append(path.data(), path.size());
+    }
+
+    /**
+     * Returns the qualified name of this field for use as a BSON key, or an empty view if it is
+     * too long to be stored inline.
+     */
+    bsoncxx::stdx::string_view key() const {
+        return _path.view();
+    }
+
+    /**
+     * Returns the qualified name of this field, as built when this name-value pair was formed.
+     */
+    constexpr const details::field_path& path() const {
+        return _path;
+    }
+
+    /**
+     * Invokes `f` on the array element at this index in the given root object, if it exists.
+     * @param  obj  An object of the root type of this field's chain of parents, which may be const.
+     * @param  f    A callable that takes the element's value, and returns a bool.
+     * @return      True if a call to `f` returned true, false otherwise.
+     */
+    template <typename Root, typename F>
+    bool visit_values(Root& obj, F&& f) const {
+        return _nvp.visit_values(
+            obj, [&](auto& array) { return details::visit_element(array, _i, f); });
+    }
+
+    /**
+     * Returns a pointer to the array element at this index in the given root object, or nullptr
+     * if it does not exist.
+     * @param  obj      An object of the root type of this field's chain of parents.
+     * @param  create   Whether to create the element, growing the array if necessary, instead of
+     *                  returning nullptr.
+     */
+    template <typename Root>
+    type* resolve(Root& obj, bool create) const {
+        auto array_value = _nvp.resolve(obj, create);
+        if (!array_value) {
+            return nullptr;
+        }
+        auto array = details::resolve_optional(*array_value, create);
+        return array ? details::resolve_element(*array, _i, create) : nullptr;
     }
 
    private:
     const NvpT& _nvp;
     const std::size_t _i;
+    details::field_path _path;
 };
 
 /**
@@ -231,6 +578,22 @@ class free_nvp : public nvp_base<free_nvp<T>, T> {
     std::string& append_name(std::string& s) const {
         return s;
     }
+
+    bsoncxx::stdx::string_view key() const {
+        return {};
+    }
+
+    constexpr details::field_path path() const {
+        return {};
+    }
+
+    /**
+     * Invokes `f` on the given array element itself, since this field has no name.
+     */
+    template <typename Root, typename F>
+    bool visit_values(Root& obj, F&& f) const {
+        return f(obj);
+    }
 };
 
 template <typename NvpT>
@@ -252,7 +615,7 @@ class dollar_operator_nvp : public nvp_base<dollar_operator_nvp<NvpT>, typename
     // In case this field is wrapped in an optional, store the underlying type.
     using no_opt_type = remove_optional_t<type>;
 
-    constexpr dollar_operator_nvp(const NvpT& nvp) : _nvp(nvp) {
+    constexpr dollar_operator_nvp(const NvpT& nvp) : _nvp(nvp), _path(nvp.path(), "$") {
     }
 
     /**
@@ -277,11 +640,38 @@ class dollar_operator_nvp : public nvp_base<dollar_operator_nvp<NvpT>, typename
      * @return A string containing the name of this field in dot notation.
      */
     std::string& append_name(std::string& s) const {
-        return _nvp.append_name(s).append(1, '.').append(1, '$');
+        if (_path.truncated()) {
+            return _nvp.append_name(s).append(1, '.').append(1, '$');
+        }
+        auto path = _path.view();
+        return s.append(path.data(), path.size());
+    }
+
+    /**
+     * Returns the name of this field for use as a BSON key, or an empty view if it is too long to
+     * be stored inline.
+     */
+    bsoncxx::stdx::string_view key() const {
+        return _path.view();
+    }
+
+    constexpr const details::field_path& path() const {
+        return _path;
+    }
+
+    /**
+     * The element that the $ operator refers to depends on the query of the update, so updates
+     * that use it cannot be applied to an object on their own.
+     */
+    template <typename Root>
+    type* resolve(Root&, bool) const {
+        throw std::logic_error(
+            "mangrove: updates with the $ operator cannot be applied without their query");
     }
 
    private:
     const NvpT& _nvp;
+    details::field_path _path;
 };
 
 /**
@@ -792,12 +1182,124 @@ struct is_nvp<array_element_nvp<NvpT>> : public std::true_type {};
 template <typename T>
 constexpr bool is_nvp_v = is_nvp<T>::value;
 
+namespace details {
+
+// Type trait that determines whether a class registers its fields with MANGROVE_MAKE_KEYS.
+template <typename T, typename = void>
+struct has_mapped_fields : public std::false_type {};
+
+template <typename T>
+struct has_mapped_fields<T, decltype((void)T::mangrove_mapped_fields())> : public std::true_type {};
+
+template <typename T>
+constexpr bool has_mapped_fields_v = has_mapped_fields<T>::value;
+
+/**
+ * Whether a field may be null or missing in a document, because it or one of its parents is
+ * optional, or because it is an element of an array.
+ */
+template <typename NvpT>
+struct may_be_null : public std::integral_constant<bool, is_optional_v<typename NvpT::type>> {};
+
+template <typename Base, typename T, typename Parent>
+struct may_be_null<nvp_child<Base, T, Parent>>
+    : public std::integral_constant<bool, is_optional_v<T> || may_be_null<Parent>::value> {};
+
+template <typename NvpT>
+struct may_be_null<array_element_nvp<NvpT>> : public std::true_type {};
+
+}  // namespace details
+
 /* Create a name-value pair from a object member and its name */
 template <typename Base, typename T>
 nvp<Base, T> constexpr make_nvp(T Base::*t, const char* name) {
     return nvp<Base, T>(t, name);
 }
 
+namespace details {
+
+/**
+ * The stored names assigned by MANGROVE_MAKE_SHORT_KEYS, in declaration order: "a" to "z", then
+ * "aa" to "zz".
+ */
+struct short_name_table {
+    static constexpr std::size_t size = 26 + 26 * 26;
+
+    constexpr short_name_table() : names{} {
+        for (std::size_t i = 0; i < size; ++i) {
+            if (i < 26) {
+                names[i][0] = static_cast<char>('a' + i);
+            } else {
+                names[i][0] = static_cast<char>('a' + (i - 26) / 26);
+                names[i][1] = static_cast<char>('a' + (i - 26) % 26);
+            }
+        }
+    }
+
+    char names[size][3];
+};
+
+// The table is a static member of a template so that it can be defined in this header.
+template <typename = void>
+struct short_names {
+    static constexpr short_name_table table{};
+};
+
+template <typename V>
+constexpr short_name_table short_names<V>::table;
+
+template <typename Fields, std::size_t... I>
+constexpr auto with_short_names(const Fields& fields, std::index_sequence<I...>) {
+    return std::make_tuple(make_nvp(std::get<I>(fields).t, short_names<>::table.names[I])...);
+}
+
+/**
+ * Renames a tuple of name-value pairs to the short names of their positions in the tuple.
+ */
+template <typename... Fields>
+constexpr auto with_short_names(const std::tuple<Fields...>& fields) {
+    static_assert(sizeof...(Fields) <= short_name_table::size,
+                  "mangrove: too many fields for MANGROVE_MAKE_SHORT_KEYS");
+    return with_short_names(fields, std::index_sequence_for<Fields...>{});
+}
+
+// The fields of a class as declared, before MANGROVE_MAKE_SHORT_KEYS renames them.
+template <typename Base>
+constexpr auto declared_fields(decltype((void)Base::mangrove_declared_fields(), 0)) {
+    return Base::mangrove_declared_fields();
+}
+
+template <typename Base>
+constexpr auto declared_fields(...) {
+    return Base::mangrove_mapped_fields();
+}
+
+template <typename Base, std::size_t... I>
+std::vector<std::pair<std::string, std::string>> stored_field_names(std::index_sequence<I...>) {
+    constexpr auto declared = declared_fields<Base>(0);
+    constexpr auto mapped = Base::mangrove_mapped_fields();
+    std::vector<std::pair<std::string, std::string>> names;
+    (void)std::initializer_list<int>{
+        (names.emplace_back(std::get<I>(declared).name, std::get<I>(mapped).name), 0)...};
+    return names;
+}
+
+}  // namespace details
+
+/**
+ * Returns the name under which each mapped field of a class is stored, in declaration order.
+ * This is useful to read the documents of classes that use MANGROVE_MAKE_SHORT_KEYS outside of
+ * mangrove, e.g. in the shell.
+ * @tparam Base A class whose fields are mapped with one of the MANGROVE_MAKE_KEYS macros.
+ * @return      Pairs of the declared name and the stored name of each field.
+ */
+template <typename Base>
+std::vector<std::pair<std::string, std::string>> stored_field_names() {
+    using fields = decltype(Base::mangrove_mapped_fields());
+    return details::stored_field_names<Base>(
+        std::make_index_sequence<std::tuple_size<fields>::value>{});
+}
+
 /**
  * Constructs a name-value pair that is a subfield of a `parent` object.
  * The resulting name-value pair will have the name "rootfield.subfield".
@@ -924,6 +1426,36 @@ struct hasCallIfFieldIsPresent<
     }
 };
 
+namespace details {
+
+// Classes whose fields are only used to check the sizes of name-value pairs below.
+struct nvp_size_leaf {
+    int value;
+    std::vector<int> values;
+};
+
+struct nvp_size_root {
+    nvp_size_leaf leaf;
+};
+
+using nvp_size_child =
+    nvp_child<nvp_size_leaf, std::vector<int>, nvp<nvp_size_root, nvp_size_leaf>>;
+
+}  // namespace details
+
+// The paths of nested fields are stored inline, as described at details::field_path. Apart from
+// the path, each of these holds no more than a member pointer, a name and a reference or index.
+static_assert(sizeof(details::field_path) == details::field_path::capacity + 1,
+              "field_path should only hold its characters and their count.");
+static_assert(sizeof(details::nvp_size_child) <= sizeof(details::field_path) + 4 * sizeof(void*),
+              "nvp_child should hold little besides its path.");
+static_assert(sizeof(array_element_nvp<details::nvp_size_child>) <=
+                  sizeof(details::field_path) + 2 * sizeof(void*),
+              "array_element_nvp should hold little besides its path.");
+static_assert(sizeof(dollar_operator_nvp<details::nvp_size_child>) <=
+                  sizeof(details::field_path) + 2 * sizeof(void*),
+              "dollar_operator_nvp should hold little besides its path.");
+
 MANGROVE_INLINE_NAMESPACE_END
 }  // namespace mangrove
 
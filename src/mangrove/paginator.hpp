@@ -0,0 +1,378 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <mangrove/config/prelude.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <bsoncxx/builder/core.hpp>
+#include <bsoncxx/document/element.hpp>
+#include <bsoncxx/document/value.hpp>
+#include <bsoncxx/document/view.hpp>
+#include <bsoncxx/types.hpp>
+#include <bsoncxx/types/value.hpp>
+#include <mongocxx/collection.hpp>
+#include <mongocxx/options/find.hpp>
+#include <mongocxx/stdx.hpp>
+
+#include <boson/mapping_functions.hpp>
+#include <mangrove/aggregation.hpp>
+#include <mangrove/nvp.hpp>
+#include <mangrove/query_builder.hpp>
+
+namespace mangrove {
+MANGROVE_INLINE_NAMESPACE_BEGIN
+
+namespace details {
+
+inline std::string hex_encode(const std::uint8_t *data, std::size_t length) {
+    static const char digits[] = "0123456789abcdef";
+    std::string result;
+    result.reserve(2 * length);
+    for (std::size_t i = 0; i < length; ++i) {
+        result.push_back(digits[data[i] >> 4]);
+        result.push_back(digits[data[i] & 0xf]);
+    }
+    return result;
+}
+
+inline int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/**
+ * Returns the element at a dotted path in a document, or an invalid element if the path is
+ * missing or goes through a value that is not an embedded document.
+ */
+inline bsoncxx::document::element find_path(bsoncxx::document::view doc,
+                                            const std::string &path) {
+    std::size_t start = 0;
+    for (auto dot = path.find('.'); dot != std::string::npos; dot = path.find('.', start)) {
+        auto parent = doc[bsoncxx::stdx::string_view(path.data() + start, dot - start)];
+        if (!parent || parent.type() != bsoncxx::type::k_document) {
+            return {};
+        }
+        doc = parent.get_document().value;
+        start = dot + 1;
+    }
+    return doc[bsoncxx::stdx::string_view(path.data() + start, path.size() - start)];
+}
+
+/**
+ * Whether a field is an array or is reached through one. The server sorts such a field by the
+ * least or greatest of its values, and a range query on it matches if any of its values does.
+ */
+template <typename NvpT>
+struct is_array_path
+    : public std::integral_constant<bool, is_iterable_v<typename NvpT::no_opt_type>> {};
+
+template <typename Base, typename T, typename Parent>
+struct is_array_path<nvp_child<Base, T, Parent>>
+    : public std::integral_constant<bool, is_iterable_v<remove_optional_t<T>> ||
+                                              is_array_path<Parent>::value> {};
+
+template <typename NvpT>
+struct is_array_path<array_element_nvp<NvpT>> : public std::true_type {};
+
+}  // namespace details
+
+/**
+ * Pages through the objects in a collection that match a filter, in a fixed sort order, without
+ * skipping. Each page after the first is fetched with a filter that continues after the sort key
+ * of the last object of the previous page, so every page costs an index seek no matter how deep
+ * it is, as long as an index supports the sort order.
+ *
+ * The sort order includes _id, which is appended in ascending order if it is not one of the
+ * sort keys given, so that the continuation filter neither skips nor repeats objects with equal
+ * keys. Array fields, and fields inside arrays, cannot be sort keys, since the server orders them
+ * by the least or greatest of their values, which a continuation filter cannot follow.
+ *
+ * Optional sort fields are supported. The server sorts null and missing values before all other
+ * values, and the continuation filter follows that order.
+ *
+ * The position of a paginator can be exported as an opaque resume token and imported into
+ * another paginator with the same collection, filter and sort order, so that a stateless server
+ * can continue a scan across requests.
+ *
+ * @tparam T    The class of the objects, which must map an _id field.
+ */
+template <typename T>
+class paginator {
+   public:
+    /**
+     * Creates a paginator that starts at the first page.
+     * @param collection    The collection to page through.
+     * @param page_size     The maximum number of objects in a page.
+     * @param sorts         Sort expressions on fields of T, from MANGROVE_KEY(T::field).sort().
+     */
+    template <typename... Sorts>
+    paginator(mongocxx::collection collection, std::size_t page_size, const Sorts &... sorts)
+        : _collection(std::move(collection)), _page_size(page_size) {
+        static_assert(details::has_mapped_id<T>(), "A paginator requires a class with an _id.");
+        static_assert(all_true<details::is_sort_expression_v<Sorts>...>::value,
+                      "A paginator is ordered by sort expressions.");
+        if (page_size == 0) {
+            throw std::logic_error("mangrove: the page size of a paginator must be positive.");
+        }
+
+        (void)std::initializer_list<int>{(add_key(sorts), 0)...};
+        if (std::none_of(_keys.begin(), _keys.end(),
+                         [](const sort_key &key) { return key.name == "_id"; })) {
+            add_key(std::get<details::mapped_field_index<T>("_id")>(T::mangrove_mapped_fields())
+                        .sort(true));
+        }
+
+        auto sort = bsoncxx::builder::core(false);
+        for (const auto &key : _keys) {
+            sort.key_view(key.name).append(key.ascending ? 1 : -1);
+        }
+        _sort.emplace(sort.extract_document());
+    }
+
+    /**
+     * Restricts the pages to the objects that match a filter.
+     * @param filter    A query expression, or a document.
+     */
+    paginator &filter(bsoncxx::document::view_or_value filter) {
+        _filter.emplace(bsoncxx::document::value(filter.view()));
+        return *this;
+    }
+
+    /**
+     * Fetches the next page, and moves past it.
+     * @return  The objects in the page. This is empty once all the objects have been returned.
+     *          Documents that cannot be deserialized are skipped, so a page may have fewer
+     *          objects than the page size even if there are more pages.
+     * @throws  mongocxx::exception::query if the query fails.
+     */
+    std::vector<T> next_page() {
+        std::vector<T> page;
+        if (_done) {
+            return page;
+        }
+
+        mongocxx::options::find options;
+        options.sort(_sort->view());
+        options.limit(static_cast<std::int32_t>(_page_size));
+
+        // The end of the scan and the position are taken from the documents that the server
+        // returns, so that documents that cannot be deserialized do not cut the scan short.
+        page.reserve(_page_size);
+        std::size_t returned = 0;
+        auto position = bsoncxx::builder::core(false);
+        for (auto &&doc : _collection.find(page_filter(), options)) {
+            ++returned;
+            position.clear();
+            for (std::size_t i = 0; i < _keys.size(); ++i) {
+                position.key_owned(std::to_string(i));
+                auto value = details::find_path(doc, _keys[i].name);
+                if (value) {
+                    position.append(value.get_value());
+                } else {
+                    position.append(bsoncxx::types::b_null{});
+                }
+            }
+            try {
+                page.push_back(boson::to_obj<T>(doc));
+            } catch (const boson::Exception &) {
+                // Like a deserializing_cursor, skip documents that cannot be deserialized.
+            }
+        }
+
+        if (returned < _page_size) {
+            _done = true;
+        }
+        if (returned > 0) {
+            _position.emplace(position.extract_document());
+        }
+        return page;
+    }
+
+    /**
+     * Returns false once next_page() has returned the last objects.
+     */
+    bool has_next() const {
+        return !_done;
+    }
+
+    /**
+     * Returns an opaque token for the current position, i.e. the sort key of the last object
+     * returned. It is empty before the first page.
+     */
+    std::string resume_token() const {
+        if (!_position) {
+            return {};
+        }
+        return details::hex_encode(_position->view().data(), _position->view().length());
+    }
+
+    /**
+     * Moves this paginator to a position exported by resume_token().
+     * @throws std::invalid_argument if the token was not created by a paginator with the same
+     *         sort order.
+     */
+    paginator &resume(const std::string &token) {
+        _done = false;
+        if (token.empty()) {
+            _position = mongocxx::stdx::nullopt;
+            return *this;
+        }
+
+        std::vector<std::uint8_t> bytes(token.size() / 2);
+        bool valid = token.size() % 2 == 0 && bytes.size() >= 5;
+        for (std::size_t i = 0; valid && i < bytes.size(); ++i) {
+            int high = details::hex_digit(token[2 * i]);
+            int low = details::hex_digit(token[2 * i + 1]);
+            valid = high >= 0 && low >= 0;
+            bytes[i] = static_cast<std::uint8_t>(high << 4 | low);
+        }
+
+        std::int32_t length = 0;
+        if (valid) {
+            std::memcpy(&length, bytes.data(), sizeof(length));
+            valid = length >= 0 && static_cast<std::size_t>(length) == bytes.size();
+        }
+        if (valid) {
+            auto position = bsoncxx::document::value(
+                bsoncxx::document::view(bytes.data(), bytes.size()));
+            std::size_t count = 0;
+            for (auto &&element : position.view()) {
+                valid = valid && element.key() == std::to_string(count);
+                ++count;
+            }
+            if (valid && count == _keys.size()) {
+                _position.emplace(std::move(position));
+                return *this;
+            }
+        }
+        throw std::invalid_argument("mangrove: invalid paginator resume token.");
+    }
+
+   private:
+    struct sort_key {
+        std::string name;
+        bool ascending;
+        // Whether the key can be null or missing, so that a descending scan must continue with
+        // the objects in which it is null after those in which it has a value.
+        bool nullable;
+    };
+
+    template <typename NvpT>
+    void add_key(const sort_expr<NvpT> &sort) {
+        static_assert(std::is_base_of<details::nvp_root_t<NvpT>, T>::value,
+                      "A paginator must be ordered by fields of its objects.");
+        static_assert(!details::is_array_path<NvpT>::value,
+                      "A paginator cannot be ordered by an array field.");
+        std::string name;
+        sort.field().append_name(name);
+        _keys.push_back({std::move(name), sort.ascending(), details::may_be_null<NvpT>::value});
+    }
+
+    /**
+     * Builds the filter of the next page. After the position (v1, ..., vn), this is
+     * {$or: [{k1: {$gt: v1}}, {k1: v1, k2: {$gt: v2}}, ...]}, with $lt for descending keys, and
+     * combined with the user's filter.
+     *
+     * Null and missing values sort before all others, so after a null vi the condition on ki is
+     * {$ne: null} in ascending order, and there is no condition in descending order, where
+     * nothing follows null. In descending order, a ki that can be null also continues with
+     * {..., ki: null} after a value. The _id key is never null, so the $or is never empty.
+     */
+    bsoncxx::document::value page_filter() const {
+        auto builder = bsoncxx::builder::core(false);
+        if (!_position) {
+            if (_filter) {
+                return *_filter;
+            }
+            return builder.extract_document();
+        }
+
+        std::vector<bsoncxx::types::value> values;
+        for (auto &&element : _position->view()) {
+            values.push_back(element.get_value());
+        }
+
+        if (_filter) {
+            builder.key_view("$and").open_array();
+            builder.append(bsoncxx::types::b_document{_filter->view()});
+            builder.open_document();
+        }
+        auto open_clause = [&](std::size_t i) {
+            builder.open_document();
+            for (std::size_t j = 0; j < i; ++j) {
+                builder.key_view(_keys[j].name).append(values[j]);
+            }
+        };
+
+        builder.key_view("$or").open_array();
+        for (std::size_t i = 0; i < _keys.size(); ++i) {
+            bool is_null = values[i].type() == bsoncxx::type::k_null;
+            if (is_null && !_keys[i].ascending) {
+                continue;
+            }
+            open_clause(i);
+            builder.key_view(_keys[i].name).open_document();
+            if (is_null) {
+                builder.key_view("$ne").append(bsoncxx::types::b_null{});
+            } else {
+                builder.key_view(_keys[i].ascending ? "$gt" : "$lt").append(values[i]);
+            }
+            builder.close_document();
+            builder.close_document();
+
+            if (!is_null && !_keys[i].ascending && _keys[i].nullable) {
+                open_clause(i);
+                builder.key_view(_keys[i].name).append(bsoncxx::types::b_null{});
+                builder.close_document();
+            }
+        }
+        builder.close_array();
+        if (_filter) {
+            builder.close_document();
+            builder.close_array();
+        }
+        return builder.extract_document();
+    }
+
+    mongocxx::collection _collection;
+    std::size_t _page_size;
+    std::vector<sort_key> _keys;
+    mongocxx::stdx::optional<bsoncxx::document::value> _sort;
+    mongocxx::stdx::optional<bsoncxx::document::value> _filter;
+    // The sort key of the last object returned, as a document {"0": v1, "1": v2, ...}.
+    mongocxx::stdx::optional<bsoncxx::document::value> _position;
+    bool _done = false;
+};
+
+MANGROVE_INLINE_NAMESPACE_END
+}  // namespace mangrove
+
+#include <mangrove/config/postlude.hpp>
@@ -0,0 +1,193 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <mangrove/config/prelude.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <cereal/cereal.hpp>
+
+#include <bsoncxx/builder/core.hpp>
+#include <bsoncxx/document/value.hpp>
+#include <bsoncxx/document/view.hpp>
+#include <bsoncxx/types.hpp>
+#include <mongocxx/collection.hpp>
+#include <mongocxx/pipeline.hpp>
+#include <mongocxx/pool.hpp>
+
+#include <boson/mapping_functions.hpp>
+#include <mangrove/deserializing_cursor.hpp>
+
+namespace mangrove {
+MANGROVE_INLINE_NAMESPACE_BEGIN
+
+namespace details {
+
+// The number of _ids sampled for each partition of a scan. More samples give partitions of more
+// even sizes, at the cost of a slower $sample stage.
+constexpr std::size_t k_samples_per_partition = 20;
+
+// A document of the form {_id: ...}, as returned by the sampling pipeline.
+template <typename IdType>
+struct sampled_id {
+    IdType _id;
+
+    template <class Archive>
+    void serialize(Archive& ar) {
+        ar(cereal::make_nvp("_id", _id));
+    }
+};
+
+/**
+ * Chooses the _ids that split the documents matching a filter into partitions of about the same
+ * size, from a random sample of their _ids.
+ * @return  At most partitions - 1 increasing _ids. Partition i holds the _ids from bound i - 1
+ *          inclusive to bound i exclusive, and the first and last partitions are unbounded below
+ *          and above respectively. There are fewer bounds if the sample has too few distinct
+ *          _ids.
+ */
+template <typename IdType>
+std::vector<IdType> partition_bounds(mongocxx::collection& collection,
+                                     bsoncxx::document::view filter, std::size_t partitions) {
+    std::vector<IdType> bounds;
+    if (partitions < 2) {
+        return bounds;
+    }
+
+    auto projection = bsoncxx::builder::core(false);
+    projection.key_view("_id").append(1);
+
+    mongocxx::pipeline pipeline;
+    pipeline.match(filter);
+    pipeline.sample(static_cast<std::int32_t>(partitions * k_samples_per_partition));
+    pipeline.project(projection.view_document());
+
+    std::vector<IdType> ids;
+    for (auto&& doc : collection.aggregate(pipeline)) {
+        ids.push_back(boson::to_obj<sampled_id<IdType>>(doc)._id);
+    }
+    std::sort(ids.begin(), ids.end());
+
+    for (std::size_t i = 1; i < partitions && !ids.empty(); ++i) {
+        const IdType& id = ids[i * ids.size() / partitions];
+        if (bounds.empty() || bounds.back() < id) {
+            bounds.push_back(id);
+        }
+    }
+    return bounds;
+}
+
+/**
+ * Restricts a filter to the _ids of partition i, as returned by partition_bounds().
+ */
+template <typename IdType>
+bsoncxx::document::value partition_filter(bsoncxx::document::view filter,
+                                          const std::vector<IdType>& bounds, std::size_t i) {
+    auto builder = bsoncxx::builder::core(false);
+    builder.key_view("$and").open_array();
+    builder.append(bsoncxx::types::b_document{filter});
+    builder.open_document().key_view("_id").open_document();
+    if (i > 0) {
+        builder.key_view("$gte").append(bounds[i - 1]);
+    }
+    if (i < bounds.size()) {
+        builder.key_view("$lt").append(bounds[i]);
+    }
+    builder.close_document().close_document();
+    builder.close_array();
+    return builder.extract_document();
+}
+
+/**
+ * Runs work(i, failed) on a thread of its own for each i in [0, count), and waits for all of them.
+ * The first exception thrown by a worker sets failed, so that the other workers can stop early,
+ * and is rethrown once they have all finished.
+ */
+template <typename F>
+void run_workers(std::size_t count, F work) {
+    std::atomic<bool> failed{false};
+    std::exception_ptr failure;
+    std::mutex failure_mutex;
+
+    std::vector<std::thread> workers;
+    workers.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        workers.emplace_back([&, i]() {
+            try {
+                work(i, failed);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(failure_mutex);
+                if (!failure) {
+                    failure = std::current_exception();
+                }
+                failed.store(true);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+/**
+ * Scans the documents of a collection that match a filter, partitioned by _id, with a thread and
+ * a pooled client for each partition. See model::parallel_scan().
+ */
+template <typename T, typename IdType, typename F>
+void parallel_scan(mongocxx::pool& pool, const std::string& database,
+                   const std::string& collection, bsoncxx::document::view filter,
+                   std::size_t partitions, F& callback) {
+    std::vector<IdType> bounds;
+    {
+        auto client = pool.acquire();
+        auto coll = (*client)[database][collection];
+        bounds = partition_bounds<IdType>(coll, filter, partitions);
+    }
+
+    // The first failure stops the other workers after their current object, and is rethrown.
+    run_workers(bounds.size() + 1, [&](std::size_t i, const std::atomic<bool>& failed) {
+        auto client = pool.acquire();
+        auto coll = (*client)[database][collection];
+        auto cursor = deserializing_cursor<T>(
+            coll.find(bounds.empty() ? bsoncxx::document::value(filter)
+                                     : partition_filter(filter, bounds, i)));
+        for (auto&& obj : cursor) {
+            if (failed.load()) {
+                return;
+            }
+            callback(i, std::move(obj));
+        }
+    });
+}
+
+}  // namespace details
+
+MANGROVE_INLINE_NAMESPACE_END
+}  // namespace mangrove
+
+#include <mangrove/config/postlude.hpp>
@@ -0,0 +1,387 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <mangrove/config/prelude.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <bsoncxx/builder/core.hpp>
+#include <bsoncxx/document/value.hpp>
+#include <bsoncxx/document/view.hpp>
+#include <bsoncxx/stdx/string_view.hpp>
+#include <mongocxx/stdx.hpp>
+
+#include <boson/mapping_functions.hpp>
+#include <mangrove/expression_syntax.hpp>
+#include <mangrove/query_builder.hpp>
+#include <mangrove/util.hpp>
+
+namespace mangrove {
+MANGROVE_INLINE_NAMESPACE_BEGIN
+
+namespace details {
+
+// BSON type bytes used when encoding parameters and walking the skeleton.
+constexpr std::uint8_t bson_double = 0x01;
+constexpr std::uint8_t bson_utf8 = 0x02;
+constexpr std::uint8_t bson_document = 0x03;
+constexpr std::uint8_t bson_array = 0x04;
+constexpr std::uint8_t bson_bool = 0x08;
+constexpr std::uint8_t bson_date = 0x09;
+constexpr std::uint8_t bson_int32 = 0x10;
+constexpr std::uint8_t bson_int64 = 0x12;
+
+inline void append_little_endian(std::vector<std::uint8_t> &buffer, std::uint64_t bits,
+                                 std::size_t size) {
+    for (std::size_t i = 0; i < size; ++i) {
+        buffer.push_back(static_cast<std::uint8_t>(bits >> (8 * i)));
+    }
+}
+
+inline void write_int32(std::uint8_t *data, std::int32_t value) {
+    auto bits = static_cast<std::uint32_t>(value);
+    for (std::size_t i = 0; i < 4; ++i) {
+        data[i] = static_cast<std::uint8_t>(bits >> (8 * i));
+    }
+}
+
+inline std::int32_t read_int32(const std::uint8_t *data) {
+    std::uint32_t bits = 0;
+    for (std::size_t i = 0; i < 4; ++i) {
+        bits |= static_cast<std::uint32_t>(data[i]) << (8 * i);
+    }
+    return static_cast<std::int32_t>(bits);
+}
+
+/**
+ * Returns the size of a BSON value of the given type, whose encoding starts at `data`.
+ * @throws std::logic_error for types that cannot appear in a query, such as deprecated ones.
+ */
+inline std::size_t bson_value_size(std::uint8_t type, const std::uint8_t *data) {
+    switch (type) {
+        case 0x06:  // undefined
+        case 0x0A:  // null
+        case 0x7F:  // maxkey
+        case 0xFF:  // minkey
+            return 0;
+        case bson_bool:
+            return 1;
+        case bson_int32:
+            return 4;
+        case bson_double:
+        case bson_date:
+        case 0x11:  // timestamp
+        case bson_int64:
+            return 8;
+        case 0x07:  // oid
+            return 12;
+        case 0x13:  // decimal128
+            return 16;
+        case bson_utf8:
+        case 0x0D:  // code
+        case 0x0E:  // symbol
+            return 4 + read_int32(data);
+        case 0x05:  // binary
+            return 5 + read_int32(data);
+        case bson_document:
+        case bson_array:
+        case 0x0F:  // code with scope
+            return read_int32(data);
+        case 0x0B: {  // regex
+            auto pattern = std::strlen(reinterpret_cast<const char *>(data)) + 1;
+            return pattern + std::strlen(reinterpret_cast<const char *>(data + pattern)) + 1;
+        }
+        default:
+            throw std::logic_error("mangrove: unsupported BSON type in prepared query");
+    }
+}
+
+/**
+ * Appends the BSON encoding of a value to `buffer`, and returns its BSON type. Fixed-size
+ * values and strings are written directly, while other values go through a BSON builder so
+ * that they are encoded exactly as append_value_to_bson() encodes them.
+ */
+template <typename T>
+std::enable_if_t<!std::is_same<T, bool>::value && !std::is_same<T, std::int32_t>::value &&
+                     !std::is_same<T, std::int64_t>::value && !std::is_same<T, double>::value &&
+                     !std::is_convertible<const T &, bsoncxx::stdx::string_view>::value,
+                 std::uint8_t>
+encode_value(const T &value, std::vector<std::uint8_t> &buffer) {
+    auto builder = bsoncxx::builder::core(false);
+    builder.key_view("");
+    append_value_to_bson(value, builder);
+    auto doc = builder.extract_document();
+    // The document holds a length prefix, a type byte, an empty key, the value and a terminator.
+    auto data = doc.view().data();
+    buffer.insert(buffer.end(), data + 6, data + doc.view().length() - 1);
+    return data[4];
+}
+
+inline std::uint8_t encode_value(bool value, std::vector<std::uint8_t> &buffer) {
+    buffer.push_back(value ? 1 : 0);
+    return bson_bool;
+}
+
+inline std::uint8_t encode_value(std::int32_t value, std::vector<std::uint8_t> &buffer) {
+    append_little_endian(buffer, static_cast<std::uint32_t>(value), 4);
+    return bson_int32;
+}
+
+inline std::uint8_t encode_value(std::int64_t value, std::vector<std::uint8_t> &buffer) {
+    append_little_endian(buffer, static_cast<std::uint64_t>(value), 8);
+    return bson_int64;
+}
+
+inline std::uint8_t encode_value(double value, std::vector<std::uint8_t> &buffer) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    append_little_endian(buffer, bits, 8);
+    return bson_double;
+}
+
+template <typename T>
+std::enable_if_t<std::is_convertible<const T &, bsoncxx::stdx::string_view>::value,
+                 std::uint8_t>
+encode_value(const T &value, std::vector<std::uint8_t> &buffer) {
+    bsoncxx::stdx::string_view s{value};
+    append_little_endian(buffer, static_cast<std::uint32_t>(s.size() + 1), 4);
+    buffer.insert(buffer.end(), s.begin(), s.end());
+    buffer.push_back(0);
+    return bson_utf8;
+}
+
+template <typename Clock, typename Duration>
+std::uint8_t encode_value(const std::chrono::time_point<Clock, Duration> &tp,
+                          std::vector<std::uint8_t> &buffer) {
+    auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch());
+    append_little_endian(buffer, static_cast<std::uint64_t>(millis.count()), 8);
+    return bson_date;
+}
+
+}  // namespace details
+
+/**
+ * A query whose BSON is serialized once, and then re-used with different operand values.
+ *
+ * When prepared, the query is serialized into a skeleton, and the position of each operand in
+ * it is recorded. Binding new values copies the skeleton and writes the new values in place,
+ * updating the lengths of the enclosing documents if a value changes size, so that issuing the
+ * same query shape repeatedly does not walk the expression tree or allocate builder stacks.
+ *
+ * Operands are bound positionally, in the order in which they appear in the expression. For
+ * instance, the operands of (age > 21 && name == "Bob") are 21 and "Bob". The values used to
+ * prepare the query are only read by the constructor, so temporaries are fine.
+ */
+class prepared_query {
+   public:
+    /**
+     * Prepares the given query expression.
+     * @param expr  A query expression, whose operands serve as placeholders.
+     * @throws std::logic_error if the operands cannot be located in the serialized query.
+     */
+    template <typename Expr>
+    explicit prepared_query(const Expr &expr) {
+        static_assert(
+            !details::is_update_expression_v<Expr> && !details::is_sort_expression_v<Expr>,
+            "prepared_query requires a query expression.");
+        auto builder = bsoncxx::builder::core(false);
+        expr.append_to_bson(builder);
+        auto doc = builder.extract_document();
+        _skeleton.assign(doc.view().data(), doc.view().data() + doc.view().length());
+
+        std::vector<placeholder> placeholders;
+        expr.for_each_operand([&](const char *op, const auto &value) {
+            placeholder p{op, 0, {}};
+            p.type = details::encode_value(value, p.value);
+            placeholders.push_back(std::move(p));
+        });
+
+        std::size_t next = 0;
+        locate(0, placeholders, next);
+        if (next != placeholders.size()) {
+            throw std::logic_error("mangrove: could not locate the operands of a prepared query");
+        }
+    }
+
+    /**
+     * Returns the number of operands that must be bound to this query.
+     */
+    std::size_t parameter_count() const {
+        return _parameters.size();
+    }
+
+    /**
+     * Returns the query as it was serialized when it was prepared.
+     */
+    bsoncxx::document::view skeleton() const {
+        return {_skeleton.data(), _skeleton.size()};
+    }
+
+    /**
+     * Binds new operand values into a caller-owned buffer, and returns a view of the result.
+     * Re-using the same buffer for every call avoids allocating once it is large enough.
+     * @param buffer    The buffer to write the query into. Its contents are replaced.
+     * @param args      The new operand values, in the order in which they appear in the query.
+     * @return          A view of the query, valid until the buffer is modified.
+     * @throws std::invalid_argument if the number of values does not match parameter_count().
+     */
+    template <typename... Args>
+    bsoncxx::document::view bind(std::vector<std::uint8_t> &buffer, const Args &... args) const {
+        if (sizeof...(Args) != _parameters.size()) {
+            throw std::invalid_argument("mangrove: wrong number of prepared query parameters");
+        }
+
+        // The difference in size between each new value and the value in the skeleton.
+        std::array<std::ptrdiff_t, sizeof...(Args)> growth{};
+        std::size_t i = 0;
+        std::size_t copied = 0;
+        buffer.clear();
+        tuple_for_each(std::forward_as_tuple(args...), [&](const auto &arg) {
+            const auto &p = _parameters[i];
+            buffer.insert(buffer.end(), _skeleton.begin() + copied,
+                          _skeleton.begin() + p.value_offset);
+            auto start = buffer.size();
+            auto type = details::encode_value(arg, buffer);
+            buffer[start - (p.value_offset - p.type_offset)] = type;
+            growth[i] = static_cast<std::ptrdiff_t>(buffer.size() - start) -
+                        static_cast<std::ptrdiff_t>(p.value_size);
+            copied = p.value_offset + p.value_size;
+            ++i;
+        });
+        buffer.insert(buffer.end(), _skeleton.begin() + copied, _skeleton.end());
+
+        for (const auto &c : _containers) {
+            std::ptrdiff_t before = 0;
+            std::ptrdiff_t inside = 0;
+            for (std::size_t j = 0; j < growth.size(); ++j) {
+                if (_parameters[j].value_offset < c.offset) {
+                    before += growth[j];
+                } else if (_parameters[j].value_offset < c.offset + c.size) {
+                    inside += growth[j];
+                }
+            }
+            if (inside != 0) {
+                details::write_int32(buffer.data() + c.offset + before,
+                                     static_cast<std::int32_t>(c.size + inside));
+            }
+        }
+        return {buffer.data(), buffer.size()};
+    }
+
+    /**
+     * Binds new operand values, and returns the resulting query as an owning BSON document.
+     * @throws std::invalid_argument if the number of values does not match parameter_count().
+     */
+    template <typename... Args>
+    bsoncxx::document::value operator()(const Args &... args) const {
+        std::vector<std::uint8_t> buffer;
+        buffer.reserve(_skeleton.size());
+        return bsoncxx::document::value{bind(buffer, args...)};
+    }
+
+   private:
+    // An operand of the prepared expression, and its encoding, as found when preparing it.
+    struct placeholder {
+        const char *op;
+        std::uint8_t type;
+        std::vector<std::uint8_t> value;
+    };
+
+    // The location of an operand's element in the skeleton.
+    struct parameter {
+        std::size_t type_offset;
+        std::size_t value_offset;
+        std::size_t value_size;
+    };
+
+    // The location of a document or array that encloses at least one operand.
+    struct container {
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    /**
+     * Walks the document or array that starts at the given offset, and records the position of
+     * each operand. Operands are written in order as the values of their operator keys, so the
+     * next operand is the first element that has its operator as key and its encoding as value.
+     */
+    void locate(std::size_t offset, const std::vector<placeholder> &placeholders,
+                std::size_t &next) {
+        auto size = static_cast<std::size_t>(details::read_int32(&_skeleton[offset]));
+        auto first = next;
+        auto index = _containers.size();
+        _containers.push_back({offset, size});
+
+        auto pos = offset + 4;
+        while (pos < offset + size - 1) {
+            auto type = _skeleton[pos];
+            auto key = reinterpret_cast<const char *>(&_skeleton[pos + 1]);
+            auto value_offset = pos + 2 + std::strlen(key);
+            auto value = &_skeleton[value_offset];
+            auto value_size = details::bson_value_size(type, value);
+
+            if (next < placeholders.size() && std::strcmp(key, placeholders[next].op) == 0 &&
+                type == placeholders[next].type &&
+                value_size == placeholders[next].value.size() &&
+                std::equal(value, value + value_size, placeholders[next].value.begin())) {
+                _parameters.push_back({pos, value_offset, value_size});
+                ++next;
+            } else if (type == details::bson_document || type == details::bson_array) {
+                locate(value_offset, placeholders, next);
+            }
+            pos = value_offset + value_size;
+        }
+
+        // Only documents that enclose an operand need their length updated when binding.
+        if (next == first) {
+            _containers.erase(_containers.begin() + index, _containers.end());
+        }
+    }
+
+    std::vector<std::uint8_t> _skeleton;
+    std::vector<parameter> _parameters;
+    std::vector<container> _containers;
+};
+
+/**
+ * Prepares a query expression, so that it can be issued repeatedly with different operand
+ * values without being serialized again. For example:
+ *
+ *     auto by_age = mangrove::prepare(MANGROVE_KEY(User::age) > 0);
+ *     auto cursor = User::find(by_age(21));
+ *
+ * @param expr  A query expression, whose operands serve as placeholders.
+ * @return      A prepared_query whose operands can be bound with new values.
+ */
+template <typename Expr>
+prepared_query prepare(const Expr &expr) {
+    return prepared_query(expr);
+}
+
+MANGROVE_INLINE_NAMESPACE_END
+}  // namespace mangrove
+
+#include <mangrove/config/postlude.hpp>
@@ -16,15 +16,24 @@
 
 #include <mangrove/config/prelude.hpp>
 
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <cstddef>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <regex>
 #include <stdexcept>
+#include <string>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
 
 #include <bsoncxx/builder/core.hpp>
 #include <bsoncxx/view_or_value.hpp>
 
+#include <boson/interned_string.hpp>
 #include <mangrove/expression_syntax.hpp>
 #include <mangrove/nvp.hpp>
 #include <mangrove/util.hpp>
@@ -98,6 +107,403 @@ void append_value_to_bson(const std::chrono::time_point<Clock, Duration> &tp,
     builder.append(bsoncxx::types::b_date(tp));
 }
 
+// Interned strings are appended as the strings they point to.
+inline void append_value_to_bson(const boson::interned_string &str,
+                                 bsoncxx::builder::core &builder) {
+    builder.append(bsoncxx::stdx::string_view{str->data(), str->size()});
+}
+
+namespace details {
+
+/**
+ * The operators of query expressions, as used when evaluating expressions against C++ objects.
+ * Expressions keep their operator as a string for serialization, and look up the corresponding
+ * value once on construction so that matching an object does not involve string comparisons.
+ */
+enum class query_operator {
+    eq,
+    ne,
+    gt,
+    gte,
+    lt,
+    lte,
+    in,
+    nin,
+    exists,
+    mod,
+    regex,
+    not_regex,
+    all,
+    elem_match,
+    size,
+    bits_all_set,
+    bits_any_set,
+    bits_all_clear,
+    bits_any_clear,
+    logical_and,
+    logical_or,
+    logical_nor,
+    unknown
+};
+
+constexpr bool operator_name_equals(const char *a, const char *b) {
+    return *a == *b && (*a == '\0' || operator_name_equals(a + 1, b + 1));
+}
+
+constexpr query_operator to_query_operator(const char *op) {
+    // clang-format off
+    return operator_name_equals(op, "$eq") ? query_operator::eq
+         : operator_name_equals(op, "$ne") ? query_operator::ne
+         : operator_name_equals(op, "$gt") ? query_operator::gt
+         : operator_name_equals(op, "$gte") ? query_operator::gte
+         : operator_name_equals(op, "$lt") ? query_operator::lt
+         : operator_name_equals(op, "$lte") ? query_operator::lte
+         : operator_name_equals(op, "$in") ? query_operator::in
+         : operator_name_equals(op, "$nin") ? query_operator::nin
+         : operator_name_equals(op, "$exists") ? query_operator::exists
+         : operator_name_equals(op, "$mod") ? query_operator::mod
+         : operator_name_equals(op, "$regex") ? query_operator::regex
+         : operator_name_equals(op, "$not") ? query_operator::not_regex
+         : operator_name_equals(op, "$all") ? query_operator::all
+         : operator_name_equals(op, "$elemMatch") ? query_operator::elem_match
+         : operator_name_equals(op, "$size") ? query_operator::size
+         : operator_name_equals(op, "$bitsAllSet") ? query_operator::bits_all_set
+         : operator_name_equals(op, "$bitsAnySet") ? query_operator::bits_any_set
+         : operator_name_equals(op, "$bitsAllClear") ? query_operator::bits_all_clear
+         : operator_name_equals(op, "$bitsAnyClear") ? query_operator::bits_any_clear
+         : operator_name_equals(op, "$and") ? query_operator::logical_and
+         : operator_name_equals(op, "$or") ? query_operator::logical_or
+         : operator_name_equals(op, "$nor") ? query_operator::logical_nor
+         : query_operator::unknown;
+    // clang-format on
+}
+
+[[noreturn]] inline void throw_not_evaluable() {
+    throw std::logic_error("mangrove: this expression cannot be evaluated against C++ objects");
+}
+
+/**
+ * Invokes `f` on the given field value, unwrapping it if it is an optional.
+ * An empty optional represents a missing field, which matches nothing.
+ */
+template <typename V, typename F>
+std::enable_if_t<!is_optional_v<V>, bool> visit_present(const V &v, F &&f) {
+    return f(v);
+}
+
+template <typename V, typename F>
+std::enable_if_t<is_optional_v<V>, bool> visit_present(const V &v, F &&f) {
+    return v && f(v.value());
+}
+
+/**
+ * Type trait that checks whether `cmp(a, b)` is a valid expression for a comparator type Cmp.
+ */
+template <typename Cmp, typename A, typename B, typename = void>
+struct is_comparable : public std::false_type {};
+
+template <typename Cmp, typename A, typename B>
+struct is_comparable<Cmp, A, B, decltype(void(std::declval<const Cmp &>()(
+                                    std::declval<const A &>(), std::declval<const B &>())))>
+    : public std::true_type {};
+
+template <typename Cmp, typename V, typename U>
+constexpr bool is_element_comparable_v =
+    is_iterable_v<V> && is_comparable<Cmp, iterable_value_t<V>, U>::value;
+
+/**
+ * Compares a single field value against an operand. As in MongoDB, a comparison against an array
+ * matches if either the whole array or any one of its elements satisfies the comparator.
+ */
+template <typename Cmp, typename V, typename U>
+std::enable_if_t<is_comparable<Cmp, V, U>::value && !is_element_comparable_v<Cmp, V, U>, bool>
+compare_value(const V &v, const U &u, const Cmp &cmp) {
+    return cmp(v, u);
+}
+
+template <typename Cmp, typename V, typename U>
+std::enable_if_t<!is_comparable<Cmp, V, U>::value && is_element_comparable_v<Cmp, V, U>, bool>
+compare_value(const V &v, const U &u, const Cmp &cmp) {
+    for (const auto &elem : v) {
+        if (cmp(elem, u)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename Cmp, typename V, typename U>
+std::enable_if_t<is_comparable<Cmp, V, U>::value && is_element_comparable_v<Cmp, V, U>, bool>
+compare_value(const V &v, const U &u, const Cmp &cmp) {
+    if (cmp(v, u)) {
+        return true;
+    }
+    for (const auto &elem : v) {
+        if (cmp(elem, u)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename Cmp, typename V, typename U>
+std::enable_if_t<!is_comparable<Cmp, V, U>::value && !is_element_comparable_v<Cmp, V, U>, bool>
+compare_value(const V &, const U &, const Cmp &) {
+    throw_not_evaluable();
+}
+
+/**
+ * Comparators for the operators that are not plain relational operators. Each of them only
+ * accepts the operand type that the corresponding nvp member function creates, so that
+ * compare_value() can reject other combinations.
+ */
+struct mod_comparator {
+    template <typename V, typename N, typename = std::enable_if_t<std::is_arithmetic<V>::value>>
+    bool operator()(const V &v, const std::array<N, 2> &divisor_remainder) const {
+        // The server rejects a divisor of 0 too, rather than matching nothing.
+        if (divisor_remainder[0] == 0) {
+            throw std::logic_error("mangrove: the divisor of $mod cannot be 0");
+        }
+        return static_cast<std::int64_t>(v) % divisor_remainder[0] == divisor_remainder[1];
+    }
+};
+
+/**
+ * Returns a compiled std::regex for a BSON regex. Compiled expressions are cached per thread,
+ * since the same expression is usually matched against many objects.
+ * Only the 'i' option is honored; the ECMAScript grammar of std::regex is close to, but not the
+ * same as, the PCRE grammar used by MongoDB.
+ */
+inline const std::regex &compiled_regex(const bsoncxx::types::b_regex &r) {
+// TODO: As in model, this can always be thread_local once XCode 8 is released. Until then,
+//       matching regular expressions will not be thread-safe on OS X.
+#ifdef __APPLE__
+    static std::unordered_map<std::string, std::regex> cache;
+#else
+    thread_local std::unordered_map<std::string, std::regex> cache;
+#endif
+
+    std::string options(r.options.data(), r.options.size());
+    std::string pattern(r.regex.data(), r.regex.size());
+    auto it = cache.find(options + '/' + pattern);
+    if (it != cache.end()) {
+        return it->second;
+    }
+
+    auto flags = std::regex::ECMAScript;
+    if (options.find('i') != std::string::npos) {
+        flags |= std::regex::icase;
+    }
+    // Bound the cache in case expressions are built from arbitrary user input.
+    if (cache.size() >= 64) {
+        cache.clear();
+    }
+    return cache.emplace(options + '/' + pattern, std::regex(pattern, flags)).first->second;
+}
+
+struct regex_comparator {
+    template <typename V, typename = std::enable_if_t<is_string_v<V>>>
+    bool operator()(const V &v, const bsoncxx::types::b_regex &r) const {
+        return std::regex_search(v, compiled_regex(r));
+    }
+};
+
+template <typename Mask, typename Compare>
+struct bits_comparator {
+    template <typename V, typename = std::enable_if_t<std::is_integral<V>::value &&
+                                                      std::is_integral<Mask>::value>>
+    bool operator()(const V &v, const Mask &mask) const {
+        auto m = static_cast<std::int64_t>(mask);
+        return Compare{}(static_cast<std::int64_t>(v) & m, m);
+    }
+};
+
+// Predicates over (value & mask, mask) for each of the bit test operators.
+struct all_bits_set {
+    bool operator()(std::int64_t masked, std::int64_t mask) const {
+        return masked == mask;
+    }
+};
+
+struct any_bit_set {
+    bool operator()(std::int64_t masked, std::int64_t) const {
+        return masked != 0;
+    }
+};
+
+struct all_bits_clear {
+    bool operator()(std::int64_t masked, std::int64_t) const {
+        return masked == 0;
+    }
+};
+
+struct any_bit_clear {
+    bool operator()(std::int64_t masked, std::int64_t mask) const {
+        return masked != mask;
+    }
+};
+
+/**
+ * Implementations of the operators whose operand is a list of values, or an expression.
+ */
+template <typename V, typename Iterable>
+std::enable_if_t<is_iterable_v<Iterable>, bool> match_in(const V &v, const Iterable &values) {
+    for (const auto &x : values) {
+        if (compare_value(v, x, std::equal_to<>{})) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename V, typename U>
+std::enable_if_t<!is_iterable_v<U>, bool> match_in(const V &, const U &) {
+    throw_not_evaluable();
+}
+
+template <typename V, typename Iterable>
+std::enable_if_t<is_iterable_v<V> && is_iterable_v<Iterable>, bool> match_all(
+    const V &v, const Iterable &values) {
+    for (const auto &x : values) {
+        if (!compare_value(v, x, std::equal_to<>{})) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename V, typename U>
+std::enable_if_t<!is_iterable_v<V> || !is_iterable_v<U>, bool> match_all(const V &, const U &) {
+    throw_not_evaluable();
+}
+
+template <typename V, typename N>
+std::enable_if_t<is_iterable_v<V> && std::is_integral<N>::value, bool> match_size(const V &v,
+                                                                                   const N &n) {
+    return std::distance(std::begin(v), std::end(v)) == n;
+}
+
+template <typename V, typename U>
+std::enable_if_t<!is_iterable_v<V> || !std::is_integral<U>::value, bool> match_size(const V &,
+                                                                                    const U &) {
+    throw_not_evaluable();
+}
+
+template <typename V, typename Expr>
+std::enable_if_t<is_iterable_v<V> && !isnt_expression_v<Expr>, bool> match_elem(
+    const V &v, const Expr &expr) {
+    for (const auto &elem : v) {
+        if (expr.matches(elem)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename V, typename U>
+std::enable_if_t<!is_iterable_v<V> || isnt_expression_v<U>, bool> match_elem(const V &,
+                                                                             const U &) {
+    throw_not_evaluable();
+}
+
+inline bool match_exists(bool found, bool exists) {
+    return found == exists;
+}
+
+template <typename U>
+bool match_exists(bool, const U &) {
+    throw_not_evaluable();
+}
+
+/**
+ * Used to rank overloads, so that the first one that applies to a type is chosen.
+ */
+template <int N>
+struct rank : public rank<N - 1> {};
+
+template <>
+struct rank<0> {};
+
+/**
+ * Orders two values in ascending (direction 1) or descending (direction -1) order.
+ */
+template <typename T>
+auto sort_less(int direction, const T &a, const T &b, rank<1>) -> decltype(bool(a < b)) {
+    return direction < 0 ? b < a : a < b;
+}
+
+template <typename T>
+bool sort_less(int, const T &, const T &, rank<0>) {
+    throw_not_evaluable();
+}
+
+template <typename T>
+const T *present_or_null(const T *v) {
+    return v;
+}
+
+template <typename T>
+const T *present_or_null(const bsoncxx::stdx::optional<T> *v) {
+    return v && *v ? &v->value() : nullptr;
+}
+
+/**
+ * Orders two possibly missing field values. As in MongoDB, missing values are smaller than any
+ * other value.
+ */
+template <typename T>
+bool sort_before(int direction, const T *a, const T *b) {
+    auto x = present_or_null(a);
+    auto y = present_or_null(b);
+    if (!x || !y) {
+        return direction < 0 ? x && !y : !x && y;
+    }
+    return sort_less(direction, *x, *y, rank<1>{});
+}
+
+/**
+ * Appends the name of a field as the next key of a BSON builder. Names are passed by reference
+ * to the path stored in the name-value pair, and only built into a string if the path was too
+ * long to be stored inline.
+ */
+template <typename NvpT>
+void append_key(bsoncxx::builder::core &builder, const NvpT &nvp) {
+    auto key = nvp.key();
+    if (!key.empty()) {
+        builder.key_view(key);
+        return;
+    }
+    std::string s;
+    builder.key_owned(nvp.append_name(s));
+}
+
+/**
+ * Passes the operand of a comparison to `f`, along with its operator. Operands that are
+ * themselves expressions, as in $elemMatch, pass on their own operands instead.
+ */
+template <typename U, typename F>
+std::enable_if_t<isnt_expression_v<U>> for_each_operand(const char *op, const U &value, F &&f) {
+    f(op, value);
+}
+
+template <typename U, typename F>
+std::enable_if_t<!isnt_expression_v<U>> for_each_operand(const char *, const U &expr, F &&f) {
+    expr.for_each_operand(f);
+}
+
+// Defined along with the other update helpers, below.
+template <typename... Args>
+void check_update_paths(const std::tuple<Args...> &updates);
+
+template <typename... Args>
+void check_first_update_path(const std::tuple<Args...> &updates);
+
+// Selects the constructor of an expression list that prepends an expression to the elements of
+// another list.
+struct prepend_t {};
+
+}  // namespace details
+
 /**
  * An expression that represents a sorting order.
  * This consists of a name-value pair and a boolean specifying ascending or descending sort
@@ -126,8 +532,7 @@ class sort_expr {
             builder.open_document();
         }
 
-        std::string s;
-        builder.key_view(_nvp.append_name(s));
+        details::append_key(builder, _nvp);
         builder.append(_ascending ? 1 : -1);
 
         if (wrap) {
@@ -145,6 +550,34 @@ class sort_expr {
         return builder.extract_document();
     }
 
+    /**
+     * Returns whether the object `a` comes before the object `b` in this sort order.
+     * Objects in which the field is missing come first in ascending order.
+     */
+    template <typename Base>
+    bool less(const Base &a, const Base &b) const {
+        const typename NvpT::type *va = nullptr;
+        const typename NvpT::type *vb = nullptr;
+        // If the field is in an array of documents, sort by the first value.
+        _nvp.visit_values(a, [&](const auto &v) {
+            va = &v;
+            return true;
+        });
+        _nvp.visit_values(b, [&](const auto &v) {
+            vb = &v;
+            return true;
+        });
+        return details::sort_before(_ascending ? 1 : -1, va, vb);
+    }
+
+    constexpr const NvpT &field() const {
+        return _nvp;
+    }
+
+    constexpr bool ascending() const {
+        return _ascending;
+    }
+
    private:
     const NvpT _nvp;
     const bool _ascending;
@@ -172,7 +605,7 @@ class comparison_expr {
      * @param  op            The type of comparison operator, such at gt (>) or ne (!=).
      */
     constexpr comparison_expr(const NvpT &nvp, const U &field, const char *op)
-        : _nvp(nvp), _field(field), _operator(op) {
+        : _nvp(nvp), _field(field), _operator(op), _op_code(details::to_query_operator(op)) {
     }
 
     /**
@@ -184,7 +617,10 @@ class comparison_expr {
      * @param  op            The new operator to use.
      */
     constexpr comparison_expr(const comparison_expr &expr, const char *op)
-        : _nvp(expr._nvp), _field(expr._field), _operator(op) {
+        : _nvp(expr._nvp),
+          _field(expr._field),
+          _operator(op),
+          _op_code(details::to_query_operator(op)) {
     }
 
     /**
@@ -208,8 +644,7 @@ class comparison_expr {
             builder.open_document();
         }
         if (!omit_name && !is_free_nvp_v<field_type>) {
-            std::string s;
-            builder.key_view(_nvp.append_name(s));
+            details::append_key(builder, _nvp);
             builder.open_document();
         }
 
@@ -234,10 +669,123 @@ class comparison_expr {
         return builder.extract_document();
     }
 
+    /**
+     * Evaluates this expression against a C++ object, following the semantics that MongoDB
+     * applies to the object's BSON representation: a missing field matches only negated
+     * operators, and comparing an array field to a single value matches any of its elements.
+     * @param obj   An object of the type that contains this expression's field.
+     * @return      Whether the object would match this expression as a query filter.
+     * @throws      std::logic_error if the field type and operator cannot be evaluated, such as
+     *              bit tests with a binary mask.
+     */
+    template <typename Base>
+    bool matches(const Base &obj) const {
+        using details::query_operator;
+        switch (_op_code) {
+            case query_operator::eq:
+                return any_value(obj, std::equal_to<>{});
+            case query_operator::ne:
+                return !any_value(obj, std::equal_to<>{});
+            case query_operator::gt:
+                return any_value(obj, std::greater<>{});
+            case query_operator::gte:
+                return any_value(obj, std::greater_equal<>{});
+            case query_operator::lt:
+                return any_value(obj, std::less<>{});
+            case query_operator::lte:
+                return any_value(obj, std::less_equal<>{});
+            case query_operator::mod:
+                return any_value(obj, details::mod_comparator{});
+            case query_operator::regex:
+                return any_value(obj, details::regex_comparator{});
+            case query_operator::not_regex:
+                return !any_value(obj, details::regex_comparator{});
+            case query_operator::bits_all_set:
+                return any_value(obj, details::bits_comparator<U, details::all_bits_set>{});
+            case query_operator::bits_any_set:
+                return any_value(obj, details::bits_comparator<U, details::any_bit_set>{});
+            case query_operator::bits_all_clear:
+                return any_value(obj, details::bits_comparator<U, details::all_bits_clear>{});
+            case query_operator::bits_any_clear:
+                return any_value(obj, details::bits_comparator<U, details::any_bit_clear>{});
+            case query_operator::in:
+                return any_present(obj, [this](const auto &v) {
+                    return details::match_in(v, _field);
+                });
+            case query_operator::nin:
+                return !any_present(obj, [this](const auto &v) {
+                    return details::match_in(v, _field);
+                });
+            case query_operator::all:
+                return any_present(obj, [this](const auto &v) {
+                    return details::match_all(v, _field);
+                });
+            case query_operator::size:
+                return any_present(obj, [this](const auto &v) {
+                    return details::match_size(v, _field);
+                });
+            case query_operator::elem_match:
+                return any_present(obj, [this](const auto &v) {
+                    return details::match_elem(v, _field);
+                });
+            case query_operator::exists:
+                return details::match_exists(any_present(obj, [](const auto &) { return true; }),
+                                             _field);
+            default:
+                details::throw_not_evaluable();
+        }
+    }
+
+    /**
+     * Returns the field that this expression compares.
+     */
+    constexpr const NvpT &field() const {
+        return _nvp;
+    }
+
+    /**
+     * Returns the value that this expression compares the field against.
+     */
+    constexpr const U &operand() const {
+        return _field;
+    }
+
+    /**
+     * Returns the operator of this expression. Along with field() and operand(), this lets
+     * in-process containers such as indexed_set answer the expression from an index.
+     */
+    constexpr details::query_operator op_code() const {
+        return _op_code;
+    }
+
+    /**
+     * Calls `f(op, value)` with this expression's operator and operand. Operands are visited in
+     * the order in which append_to_bson() writes them, which lets prepared queries find them.
+     */
+    template <typename F>
+    void for_each_operand(F &&f) const {
+        details::for_each_operand(_operator, _field, f);
+    }
+
    private:
+    // Returns whether `f` returns true for any present value of this expression's field.
+    template <typename Base, typename F>
+    bool any_present(const Base &obj, F &&f) const {
+        return _nvp.visit_values(obj,
+                                 [&](const auto &v) { return details::visit_present(v, f); });
+    }
+
+    // Returns whether any present value of this expression's field compares true to the operand.
+    template <typename Base, typename Cmp>
+    bool any_value(const Base &obj, const Cmp &cmp) const {
+        return any_present(obj,
+                           [&](const auto &v) { return details::compare_value(v, _field, cmp); });
+    }
+
     const NvpT _nvp;
     const U &_field;
     const char *_operator;
+    const details::query_operator _op_code;
 };
 
 /**
@@ -355,6 +903,14 @@ class text_search_expr {
         return builder.extract_document();
     }
 
+    /**
+     * Calls `f("$search", search)`. The language and sensitivity options are not operands.
+     */
+    template <typename F>
+    void for_each_operand(F &&f) const {
+        f("$search", _search);
+    }
+
    private:
     const char *_search;
     mongocxx::stdx::optional<const char *> _language;
@@ -400,6 +956,13 @@ class where_expr {
         return builder.extract_document();
     }
 
+    /**
+     * $where expressions have no operands, since their code is fixed.
+     */
+    template <typename F>
+    void for_each_operand(F &&) const {
+    }
+
    private:
     const CodeT &_code;
 };
@@ -428,6 +991,13 @@ class not_expr {
         return _expr.append_name(s);
     }
 
+    /**
+     * Returns the field of the negated expression.
+     */
+    constexpr const field_type &field() const {
+        return _expr.field();
+    }
+
     /**
      * Appends this expression to a BSON core builder,
      * as a key-value pair of the form "key: {$not: {$cmp: val}}".
@@ -443,8 +1013,7 @@ class not_expr {
             builder.open_document();
         }
         if (!omit_name && !is_free_nvp_v<field_type>) {
-            std::string s;
-            builder.key_view(_expr.append_name(s));
+            details::append_key(builder, _expr.field());
             builder.open_document();
         }
 
@@ -470,6 +1039,23 @@ class not_expr {
         return builder.extract_document();
     }
 
+    /**
+     * Evaluates this expression against a C++ object. As in MongoDB, this also matches objects
+     * in which the field is missing.
+     */
+    template <typename Base>
+    bool matches(const Base &obj) const {
+        return !_expr.matches(obj);
+    }
+
+    /**
+     * Calls `f(op, value)` for the operand of the negated expression.
+     */
+    template <typename F>
+    void for_each_operand(F &&f) const {
+        _expr.for_each_operand(f);
+    }
+
    private:
     const Expr _expr;
 };
@@ -485,18 +1071,30 @@ class expression_list {
     /**
      * Constructs an expression list of the given arguments.
      * @tparam args  The individual elements of the list.
+     * @throws std::logic_error if this is a list of updates that modify conflicting paths.
      */
     expression_list(const Args &... args) : storage(std::make_tuple(args...)) {
+        check_paths(expression_category_t<list_type>{});
+    }
+
+    /**
+     * Constructs an expression list from an expression followed by the elements of a list that
+     * was already checked, so that only the new expression needs to be checked against them.
+     */
+    expression_list(details::prepend_t, const Args &... args) : storage(std::make_tuple(args...)) {
+        check_first_path(expression_category_t<list_type>{});
     }
 
     /**
      * Appends each element to a BSON code builder.
+     * Update expressions are grouped by operator, so that a list such as (x = 1, y = 2, z += 3)
+     * produces {$set: {x: 1, y: 2}, $inc: {z: 3}} rather than repeating the $set key.
      * @param builder A code BSON builder
      * @param wrap    Whether to wrap individual elements inside a BSON document, e.g.
-     *                "{elt1...}, {elt2, ...}, ..."
+     *                "{elt1...}, {elt2, ...}, ...". An update list is wrapped as a whole.
      */
     void append_to_bson(bsoncxx::builder::core &builder, bool wrap = false) const {
-        tuple_for_each(storage, [&](const auto &v) { v.append_to_bson(builder, wrap); });
+        append_elements(builder, wrap, expression_category_t<list_type>{});
     }
 
     /**
@@ -508,7 +1106,102 @@ class expression_list {
         return builder.extract_document();
     }
 
+    /**
+     * Evaluates this list of query expressions against a C++ object. Like a query document with
+     * several fields, the object matches if it matches every expression.
+     */
+    template <typename Base>
+    bool matches(const Base &obj) const {
+        bool result = true;
+        tuple_for_each(storage, [&](const auto &v) { result = result && v.matches(obj); });
+        return result;
+    }
+
+    /**
+     * Returns whether the given C++ object matches at least one expression in this list.
+     */
+    template <typename Base>
+    bool matches_any(const Base &obj) const {
+        bool result = false;
+        tuple_for_each(storage, [&](const auto &v) { result = result || v.matches(obj); });
+        return result;
+    }
+
+    /**
+     * Applies this list of update expressions to a C++ object, in order.
+     */
+    template <typename Base>
+    void apply(Base &obj) const {
+        tuple_for_each(storage, [&](const auto &v) { v.apply(obj); });
+    }
+
+    /**
+     * Calls `f(op, value)` for the operands of each query expression in this list, in order.
+     */
+    template <typename F>
+    void for_each_operand(F &&f) const {
+        tuple_for_each(storage, [&](const auto &v) { v.for_each_operand(f); });
+    }
+
     std::tuple<Args...> storage;
+
+   private:
+    // MongoDB rejects updates that modify conflicting paths. They are checked when the list is
+    // built, rather than every time it is serialized.
+    template <typename Category>
+    void check_paths(Category) const {
+    }
+
+    void check_paths(details::expression_update_t) const {
+        details::check_update_paths(storage);
+    }
+
+    template <typename Category>
+    void check_first_path(Category) const {
+    }
+
+    void check_first_path(details::expression_update_t) const {
+        details::check_first_update_path(storage);
+    }
+
+    template <typename Category>
+    void append_elements(bsoncxx::builder::core &builder, bool wrap, Category) const {
+        tuple_for_each(storage, [&](const auto &v) { v.append_to_bson(builder, wrap); });
+    }
+
+    // Writes each update operator once, with the fields of all of its expressions, in the order
+    // in which the operators first appear in the list.
+    void append_elements(bsoncxx::builder::core &builder, bool wrap,
+                         details::expression_update_t) const {
+        std::array<const char *, sizeof...(Args)> ops{};
+        std::size_t count = 0;
+        tuple_for_each(storage, [&](const auto &v) {
+            auto op = v.operator_name();
+            auto end = ops.begin() + count;
+            if (std::find_if(ops.begin(), end, [&](const char *o) {
+                    return std::strcmp(o, op) == 0;
+                }) == end) {
+                ops[count++] = op;
+            }
+        });
+
+        if (wrap) {
+            builder.open_document();
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            builder.key_view(ops[i]);
+            builder.open_document();
+            tuple_for_each(storage, [&](const auto &v) {
+                if (std::strcmp(v.operator_name(), ops[i]) == 0) {
+                    v.append_field_to_bson(builder);
+                }
+            });
+            builder.close_document();
+        }
+        if (wrap) {
+            builder.close_document();
+        }
+    }
 };
 
 /**
@@ -525,7 +1218,7 @@ class boolean_expr {
      * @param  op  The operator of the expression, e.g. AND or OR.
      */
     constexpr boolean_expr(const Expr1 &lhs, const Expr2 &rhs, const char *op)
-        : _lhs(lhs), _rhs(rhs), _op(op) {
+        : _lhs(lhs), _rhs(rhs), _op(op), _op_code(details::to_query_operator(op)) {
     }
 
     /**
@@ -568,9 +1261,37 @@ class boolean_expr {
         return builder.extract_document();
     }
 
+    /**
+     * Evaluates this expression against a C++ object, short-circuiting like the corresponding
+     * C++ operator.
+     */
+    template <typename Base>
+    bool matches(const Base &obj) const {
+        switch (_op_code) {
+            case details::query_operator::logical_and:
+                return _lhs.matches(obj) && _rhs.matches(obj);
+            case details::query_operator::logical_or:
+                return _lhs.matches(obj) || _rhs.matches(obj);
+            default:
+                details::throw_not_evaluable();
+        }
+    }
+
+    /**
+     * Calls `f(op, value)` for the operands of the left-hand side, then the right-hand side.
+     */
+    template <typename F>
+    void for_each_operand(F &&f) const {
+        _lhs.for_each_operand(f);
+        _rhs.for_each_operand(f);
+    }
+
     const Expr1 _lhs;
     const Expr2 _rhs;
     const char *_op;
+
+   private:
+    const details::query_operator _op_code;
 };
 
 /**
@@ -586,7 +1307,8 @@ class boolean_list_expr {
      * @param args An expression list of boolean conditions.
      * @param op   The operator of the expression, e.g. AND or OR.
      */
-    constexpr boolean_list_expr(const List args, const char *op) : _args(args), _op(op) {
+    constexpr boolean_list_expr(const List args, const char *op)
+        : _args(args), _op(op), _op_code(details::to_query_operator(op)) {
     }
 
     /**
@@ -617,11 +1339,39 @@ class boolean_list_expr {
         return builder.extract_document();
     }
 
-    const List _args;
-    const char *_op;
-};
-
-/**
+    /**
+     * Evaluates this expression against a C++ object.
+     */
+    template <typename Base>
+    bool matches(const Base &obj) const {
+        switch (_op_code) {
+            case details::query_operator::logical_and:
+                return _args.matches(obj);
+            case details::query_operator::logical_or:
+                return _args.matches_any(obj);
+            case details::query_operator::logical_nor:
+                return !_args.matches_any(obj);
+            default:
+                details::throw_not_evaluable();
+        }
+    }
+
+    /**
+     * Calls `f(op, value)` for the operands of each argument, in order.
+     */
+    template <typename F>
+    void for_each_operand(F &&f) const {
+        _args.for_each_operand(f);
+    }
+
+    const List _args;
+    const char *_op;
+
+   private:
+    const details::query_operator _op_code;
+};
+
+/**
  * An expression that wraps another expression and adds an $isolated operator.
  */
 template <typename Expr>
@@ -659,10 +1409,520 @@ class isolated_expr {
         return {builder.extract_document()};
     }
 
+    /**
+     * Evaluates the underlying expression against a C++ object. $isolated has no effect here.
+     */
+    template <typename Base>
+    bool matches(const Base &obj) const {
+        return _expr.matches(obj);
+    }
+
+    /**
+     * Calls `f(op, value)` for the operands of the underlying expression.
+     */
+    template <typename F>
+    void for_each_operand(F &&f) const {
+        _expr.for_each_operand(f);
+    }
+
    private:
     const Expr _expr;
 };
 
+namespace details {
+
+/**
+ * The operators of update expressions, as used when applying expressions to C++ objects.
+ * This also includes the "and", "or" and "xor" operations of the $bit operator.
+ */
+enum class update_operator {
+    set,
+    set_on_insert,
+    inc,
+    mul,
+    min,
+    max,
+    pull,
+    pull_all,
+    pop,
+    bit_and,
+    bit_or,
+    bit_xor,
+    unknown
+};
+
+constexpr update_operator to_update_operator(const char *op) {
+    // clang-format off
+    return operator_name_equals(op, "$set") ? update_operator::set
+         : operator_name_equals(op, "$setOnInsert") ? update_operator::set_on_insert
+         : operator_name_equals(op, "$inc") ? update_operator::inc
+         : operator_name_equals(op, "$mul") ? update_operator::mul
+         : operator_name_equals(op, "$min") ? update_operator::min
+         : operator_name_equals(op, "$max") ? update_operator::max
+         : operator_name_equals(op, "$pull") ? update_operator::pull
+         : operator_name_equals(op, "$pullAll") ? update_operator::pull_all
+         : operator_name_equals(op, "$pop") ? update_operator::pop
+         : operator_name_equals(op, "and") ? update_operator::bit_and
+         : operator_name_equals(op, "or") ? update_operator::bit_or
+         : operator_name_equals(op, "xor") ? update_operator::bit_xor
+         : update_operator::unknown;
+    // clang-format on
+}
+
+[[noreturn]] inline void throw_not_applicable() {
+    throw std::logic_error("mangrove: this update cannot be applied to C++ objects");
+}
+
+/**
+ * Returns the value of a field, creating it if it is an empty optional. A created numeric value
+ * starts out as zero, which is how MongoDB treats missing fields in $inc, $mul and $bit.
+ * @param missing   Set to true if the value had to be created.
+ */
+template <typename V>
+V &present_value(V &v, bool &missing) {
+    missing = false;
+    return v;
+}
+
+template <typename V>
+V &present_value(bsoncxx::stdx::optional<V> &v, bool &missing) {
+    missing = !v;
+    if (missing) {
+        v.emplace();
+    }
+    return *v;
+}
+
+/**
+ * Implementations of the field update operators. Each has a fallback that throws, for operand
+ * types that the corresponding operator does not accept.
+ */
+template <typename V, typename U>
+std::enable_if_t<std::is_assignable<V &, const U &>::value> assign_value(V &v, const U &u) {
+    v = u;
+}
+
+template <typename V, typename U>
+std::enable_if_t<!std::is_assignable<V &, const U &>::value> assign_value(V &, const U &) {
+    throw_not_applicable();
+}
+
+template <typename V, typename U, typename Op>
+std::enable_if_t<std::is_arithmetic<remove_optional_t<V>>::value && std::is_arithmetic<U>::value>
+apply_arithmetic(V &v, const U &u, const Op &op) {
+    bool missing;
+    auto &x = present_value(v, missing);
+    x = static_cast<remove_optional_t<V>>(op(x, u));
+}
+
+template <typename V, typename U, typename Op>
+std::enable_if_t<!std::is_arithmetic<remove_optional_t<V>>::value || !std::is_arithmetic<U>::value>
+apply_arithmetic(V &, const U &, const Op &) {
+    throw_not_applicable();
+}
+
+template <typename V, typename U, typename Cmp>
+std::enable_if_t<is_comparable<Cmp, U, remove_optional_t<V>>::value &&
+                 std::is_assignable<remove_optional_t<V> &, const U &>::value>
+apply_if(V &v, const U &u, const Cmp &cmp) {
+    bool missing;
+    auto &x = present_value(v, missing);
+    if (missing || cmp(u, x)) {
+        x = u;
+    }
+}
+
+template <typename V, typename U, typename Cmp>
+std::enable_if_t<!is_comparable<Cmp, U, remove_optional_t<V>>::value ||
+                 !std::is_assignable<remove_optional_t<V> &, const U &>::value>
+apply_if(V &, const U &, const Cmp &) {
+    throw_not_applicable();
+}
+
+template <typename V>
+void reset_value(bsoncxx::stdx::optional<V> &v) {
+    v = bsoncxx::stdx::nullopt;
+}
+
+template <typename V>
+void reset_value(V &) {
+    throw_not_applicable();
+}
+
+/**
+ * Sets a date or timestamp field to the current time, as done by $currentDate.
+ */
+template <typename Clock, typename Duration>
+void set_current_date(std::chrono::time_point<Clock, Duration> &v) {
+    v = std::chrono::time_point_cast<Duration>(Clock::now());
+}
+
+template <typename Rep, typename Period>
+void set_current_date(std::chrono::duration<Rep, Period> &v) {
+    v = std::chrono::duration_cast<std::chrono::duration<Rep, Period>>(
+        std::chrono::system_clock::now().time_since_epoch());
+}
+
+inline void set_current_date(bsoncxx::types::b_date &v) {
+    v = bsoncxx::types::b_date(std::chrono::time_point_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now()));
+}
+
+// The server fills in the increment to order writes within the same second, which has no
+// equivalent here.
+inline void set_current_date(bsoncxx::types::b_timestamp &v) {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    v.timestamp =
+        static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(now).count());
+    v.increment = 1;
+}
+
+template <typename V>
+void set_current_date(bsoncxx::stdx::optional<V> &v) {
+    bool missing;
+    set_current_date(present_value(v, missing));
+}
+
+/**
+ * Helpers that modify the various containers supported as array fields. Overloads are ranked, so
+ * that the first implementation that a container supports is chosen; containers that support
+ * none of them (e.g. std::array) cannot be modified by array update operators.
+ */
+template <typename C, typename Pred>
+auto erase_elements(C &c, const Pred &pred, rank<3>) -> decltype(c.remove_if(pred), void()) {
+    c.remove_if(pred);
+}
+
+template <typename C, typename Pred, typename = typename C::key_type>
+void erase_elements(C &c, const Pred &pred, rank<2>) {
+    for (auto it = c.begin(); it != c.end();) {
+        it = pred(*it) ? c.erase(it) : std::next(it);
+    }
+}
+
+template <typename C, typename Pred>
+auto erase_elements(C &c, const Pred &pred, rank<1>)
+    -> decltype(c.erase(c.begin(), c.end()), void()) {
+    c.erase(std::remove_if(c.begin(), c.end(), pred), c.end());
+}
+
+template <typename C, typename Pred>
+void erase_elements(C &, const Pred &, rank<0>) {
+    throw_not_applicable();
+}
+
+template <typename C, typename It>
+auto insert_elements(C &c, std::size_t pos, It first, It last, rank<2>)
+    -> decltype(c.insert(c.begin(), first, last), void()) {
+    auto size = static_cast<std::size_t>(std::distance(c.begin(), c.end()));
+    c.insert(std::next(c.begin(), std::min(pos, size)), first, last);
+}
+
+template <typename C, typename It>
+auto insert_elements(C &c, std::size_t, It first, It last, rank<1>)
+    -> decltype(c.insert(first, last), void()) {
+    c.insert(first, last);
+}
+
+template <typename C, typename It>
+void insert_elements(C &, std::size_t, It, It, rank<0>) {
+    throw_not_applicable();
+}
+
+template <typename C, typename Cmp>
+auto sort_elements(C &c, const Cmp &cmp, rank<2>) -> decltype(c.sort(cmp), void()) {
+    c.sort(cmp);
+}
+
+template <typename C, typename Cmp>
+auto sort_elements(C &c, const Cmp &cmp, rank<1>)
+    -> std::enable_if_t<std::is_base_of<std::random_access_iterator_tag,
+                                        typename std::iterator_traits<decltype(
+                                            c.begin())>::iterator_category>::value> {
+    std::stable_sort(c.begin(), c.end(), cmp);
+}
+
+template <typename C, typename Cmp>
+void sort_elements(C &, const Cmp &, rank<0>) {
+    throw_not_applicable();
+}
+
+template <typename C>
+auto erase_range(C &c, std::size_t first, std::size_t last, rank<1>)
+    -> decltype(c.erase(c.begin(), c.end()), void()) {
+    c.erase(std::next(c.begin(), first), std::next(c.begin(), last));
+}
+
+template <typename C>
+void erase_range(C &, std::size_t, std::size_t, rank<0>) {
+    throw_not_applicable();
+}
+
+/**
+ * Returns the array value of a field, or nullptr if it is missing and `create` is false.
+ */
+template <typename V>
+V *array_value(V &v, bool) {
+    return &v;
+}
+
+template <typename V>
+V *array_value(bsoncxx::stdx::optional<V> &v, bool create) {
+    return resolve_optional(v, create);
+}
+
+/**
+ * Implementations of the array update operators.
+ */
+// $pop removes the last element if the direction is 1, and the first one if it is -1.
+template <typename V, typename N>
+std::enable_if_t<is_iterable_v<remove_optional_t<V>> && std::is_integral<N>::value> pop_element(
+    V &v, const N &direction) {
+    auto c = array_value(v, false);
+    if (c && c->begin() != c->end()) {
+        auto size = static_cast<std::size_t>(std::distance(c->begin(), c->end()));
+        auto last = direction > 0;
+        erase_range(*c, last ? size - 1 : 0, last ? size : 1, rank<1>{});
+    }
+}
+
+template <typename V, typename U>
+std::enable_if_t<!is_iterable_v<remove_optional_t<V>> || !std::is_integral<U>::value> pop_element(
+    V &, const U &) {
+    throw_not_applicable();
+}
+
+// $pull with a value removes the elements equal to it.
+template <typename V, typename U>
+std::enable_if_t<is_iterable_v<remove_optional_t<V>> && isnt_expression_v<U> &&
+                 is_comparable<std::equal_to<>, iterable_value_t<remove_optional_t<V>>, U>::value>
+pull_elements(V &v, const U &u) {
+    if (auto c = array_value(v, false)) {
+        erase_elements(*c, [&](const auto &elem) { return elem == u; }, rank<3>{});
+    }
+}
+
+// $pull with a query removes the elements that match it.
+template <typename V, typename Expr>
+std::enable_if_t<is_iterable_v<remove_optional_t<V>> && !isnt_expression_v<Expr>> pull_elements(
+    V &v, const Expr &expr) {
+    if (auto c = array_value(v, false)) {
+        erase_elements(*c, [&](const auto &elem) { return expr.matches(elem); }, rank<3>{});
+    }
+}
+
+template <typename V, typename U>
+std::enable_if_t<!is_iterable_v<remove_optional_t<V>> ||
+                 (isnt_expression_v<U> &&
+                  !is_comparable<std::equal_to<>, iterable_value_t<remove_optional_t<V>>,
+                                 U>::value)>
+pull_elements(V &, const U &) {
+    throw_not_applicable();
+}
+
+template <typename V, typename U>
+constexpr bool is_pull_all_applicable_v =
+    is_iterable_v<remove_optional_t<V>> && is_iterable_v<U> &&
+    is_comparable<std::equal_to<>, iterable_value_t<U>,
+                  iterable_value_t<remove_optional_t<V>>>::value;
+
+template <typename V, typename Iterable>
+std::enable_if_t<is_pull_all_applicable_v<V, Iterable>> pull_all_elements(V &v,
+                                                                         const Iterable &values) {
+    if (auto c = array_value(v, false)) {
+        erase_elements(*c,
+                       [&](const auto &elem) {
+                           return std::find(std::begin(values), std::end(values), elem) !=
+                                  std::end(values);
+                       },
+                       rank<3>{});
+    }
+}
+
+template <typename V, typename U>
+std::enable_if_t<!is_pull_all_applicable_v<V, U>> pull_all_elements(V &, const U &) {
+    throw_not_applicable();
+}
+
+/**
+ * Calls `f` with a range over the values given to $push or $addToSet, which are either a single
+ * element or, with the $each modifier, an iterable of elements.
+ */
+template <typename C, typename U, typename F>
+std::enable_if_t<std::is_same<iterable_value_t<C>, U>::value> for_each_range(const U &u, F &&f) {
+    f(&u, &u + 1);
+}
+
+template <typename C, typename U, typename F>
+std::enable_if_t<!std::is_same<iterable_value_t<C>, U>::value> for_each_range(const U &u, F &&f) {
+    f(std::begin(u), std::end(u));
+}
+
+template <typename C, typename U>
+using enable_if_insertable_t = std::enable_if_t<
+    is_iterable_v<C> && (std::is_same<iterable_value_t<C>, std::decay_t<U>>::value ||
+                         std::is_same<iterable_value_t<C>, iterable_value_t<U>>::value)>;
+
+template <typename V, typename U, typename = enable_if_insertable_t<remove_optional_t<V>, U>,
+          typename = std::enable_if_t<
+              is_comparable<std::equal_to<>, iterable_value_t<remove_optional_t<V>>,
+                            iterable_value_t<remove_optional_t<V>>>::value>>
+void add_to_set_elements(V &v, const U &u, rank<1>) {
+    auto c = array_value(v, true);
+    for_each_range<remove_optional_t<V>>(u, [&](auto first, auto last) {
+        for (; first != last; ++first) {
+            if (std::find(c->begin(), c->end(), *first) == c->end()) {
+                insert_elements(*c, static_cast<std::size_t>(-1), first, std::next(first),
+                                rank<2>{});
+            }
+        }
+    });
+}
+
+template <typename V, typename U>
+void add_to_set_elements(V &, const U &, rank<0>) {
+    throw_not_applicable();
+}
+
+/**
+ * Returns a comparator for the $sort modifier of $push, which is either +/-1 to sort by the
+ * elements themselves, or a sort expression on a field of the elements.
+ */
+template <typename T>
+auto make_sort_comparator(int direction) {
+    return [direction](const T &a, const T &b) { return sort_less(direction, a, b, rank<1>{}); };
+}
+
+template <typename T, typename SortExpr,
+          typename = std::enable_if_t<!std::is_same<int, SortExpr>::value>>
+auto make_sort_comparator(const SortExpr &sort) {
+    return [&sort](const T &a, const T &b) { return sort.less(a, b); };
+}
+
+/**
+ * Implements $push. As on the server, the new elements are inserted first, then the array is
+ * sorted, and then sliced.
+ */
+template <typename V, typename U, typename Sort,
+          typename = enable_if_insertable_t<remove_optional_t<V>, U>>
+void push_elements(V &v, const U &u, const bsoncxx::stdx::optional<std::int32_t> &slice,
+                   const bsoncxx::stdx::optional<Sort> &sort,
+                   const bsoncxx::stdx::optional<std::uint32_t> &position, rank<1>) {
+    auto c = array_value(v, true);
+    for_each_range<remove_optional_t<V>>(u, [&](auto first, auto last) {
+        auto pos = position ? static_cast<std::size_t>(*position) : static_cast<std::size_t>(-1);
+        insert_elements(*c, pos, first, last, rank<2>{});
+    });
+
+    if (sort) {
+        using element_type = iterable_value_t<remove_optional_t<V>>;
+        sort_elements(*c, make_sort_comparator<element_type>(*sort), rank<2>{});
+    }
+
+    if (slice) {
+        // A positive $slice keeps the first elements, and a negative one keeps the last ones.
+        auto size = static_cast<std::size_t>(std::distance(c->begin(), c->end()));
+        auto n = static_cast<std::size_t>(*slice < 0 ? -std::int64_t{*slice} : *slice);
+        if (n < size) {
+            *slice < 0 ? erase_range(*c, 0, size - n, rank<1>{})
+                       : erase_range(*c, n, size, rank<1>{});
+        }
+    }
+}
+
+template <typename V, typename U, typename Sort>
+void push_elements(V &, const U &, const bsoncxx::stdx::optional<std::int32_t> &,
+                   const bsoncxx::stdx::optional<Sort> &,
+                   const bsoncxx::stdx::optional<std::uint32_t> &, rank<0>) {
+    throw_not_applicable();
+}
+
+/**
+ * Appends a single update expression to a BSON core builder as "$op: {field: value}".
+ */
+template <typename Expr>
+void append_update_to_bson(const Expr &expr, bsoncxx::builder::core &builder, bool wrap) {
+    if (wrap) {
+        builder.open_document();
+    }
+    builder.key_view(expr.operator_name());
+    builder.open_document();
+    expr.append_field_to_bson(builder);
+    builder.close_document();
+    if (wrap) {
+        builder.close_document();
+    }
+}
+
+/**
+ * Returns the dotted name of a field. The name is only built into `storage`, replacing its
+ * contents, if it is not stored inline in the name-value pair.
+ */
+template <typename NvpT>
+bsoncxx::stdx::string_view field_key(const NvpT &nvp, std::string &storage) {
+    auto key = nvp.key();
+    if (!key.empty()) {
+        return key;
+    }
+    storage.clear();
+    return bsoncxx::stdx::string_view{nvp.append_name(storage)};
+}
+
+/**
+ * Returns whether two update paths conflict, i.e. whether they are the same path or one is a
+ * prefix of the other, such as "a" and "a.b". MongoDB rejects updates with conflicting paths.
+ */
+inline bool paths_conflict(bsoncxx::stdx::string_view a, bsoncxx::stdx::string_view b) {
+    if (a.size() > b.size()) {
+        std::swap(a, b);
+    }
+    return std::equal(a.begin(), a.end(), b.begin()) &&
+           (a.size() == b.size() || b[a.size()] == '.');
+}
+
+/**
+ * Checks that the update expressions in a tuple do not modify conflicting paths.
+ * @throws std::logic_error if two of the expressions modify conflicting paths.
+ */
+template <typename... Args>
+void check_update_paths(const std::tuple<Args...> &updates) {
+    std::array<std::string, sizeof...(Args)> storage;
+    std::array<bsoncxx::stdx::string_view, sizeof...(Args)> keys;
+    std::size_t n = 0;
+    tuple_for_each(updates, [&](const auto &v) {
+        keys[n] = field_key(v.field(), storage[n]);
+        ++n;
+    });
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = i + 1; j < n; ++j) {
+            if (paths_conflict(keys[i], keys[j])) {
+                throw std::logic_error("mangrove: update expressions modify conflicting paths");
+            }
+        }
+    }
+}
+
+/**
+ * Checks that the first update expression in a tuple does not modify a path that conflicts with
+ * those of the others, which are known not to conflict with each other.
+ * @throws std::logic_error if the first expression conflicts with another one.
+ */
+template <typename... Args>
+void check_first_update_path(const std::tuple<Args...> &updates) {
+    std::string first_storage;
+    std::string storage;
+    auto first = field_key(std::get<0>(updates).field(), first_storage);
+    bool is_first = true;
+    tuple_for_each(updates, [&](const auto &v) {
+        if (!is_first && paths_conflict(first, field_key(v.field(), storage))) {
+            throw std::logic_error("mangrove: update expressions modify conflicting paths");
+        }
+        is_first = false;
+    });
+}
+
+}  // namespace details
+
 /**
  * Represents an update operator that modifies a certain elements.
  * This creates BSON expressions of the form "$op: {field: value}",
@@ -679,7 +1939,7 @@ class update_expr {
    public:
     using field_type = NvpT;
     constexpr update_expr(const NvpT &nvp, const U &val, const char *op)
-        : _nvp(nvp), _val(val), _op(op) {
+        : _nvp(nvp), _val(val), _op(op), _op_code(details::to_update_operator(op)) {
     }
 
     /**
@@ -688,18 +1948,30 @@ class update_expr {
      * @param Whether to wrap this expression inside a document.
      */
     void append_to_bson(bsoncxx::builder::core &builder, bool wrap = false) const {
-        if (wrap) {
-            builder.open_document();
-        }
-        builder.key_view(_op);
-        builder.open_document();
-        std::string s;
-        builder.key_view(_nvp.append_name(s));
+        details::append_update_to_bson(*this, builder, wrap);
+    }
+
+    /**
+     * Returns the update operator of this expression, such as "$set" or "$inc".
+     */
+    constexpr const char *operator_name() const {
+        return _op;
+    }
+
+    /**
+     * Appends the "field: value" pair of this expression, which goes inside the document of its
+     * update operator.
+     */
+    void append_field_to_bson(bsoncxx::builder::core &builder) const {
+        details::append_key(builder, _nvp);
         append_value_to_bson(_val, builder);
-        builder.close_document();
-        if (wrap) {
-            builder.close_document();
-        }
+    }
+
+    /**
+     * Returns the field that this expression updates.
+     */
+    constexpr const NvpT &field() const {
+        return _nvp;
     }
 
     /**
@@ -711,10 +1983,54 @@ class update_expr {
         return {builder.extract_document()};
     }
 
+    /**
+     * Applies this update to a C++ object, modifying it the way the server would modify the
+     * corresponding document. Missing optional fields are created, except by the operators
+     * that remove values. $setOnInsert has no effect, since the object already exists.
+     * @throws std::logic_error if this update cannot be applied to C++ objects, such as an
+     *         update that uses the $ operator.
+     */
+    template <typename Base>
+    void apply(Base &obj) const {
+        using details::update_operator;
+        if (_op_code == update_operator::set_on_insert) {
+            return;
+        }
+
+        bool create = _op_code != update_operator::pull &&
+                      _op_code != update_operator::pull_all && _op_code != update_operator::pop;
+        auto v = _nvp.resolve(obj, create);
+        if (!v) {
+            return;
+        }
+
+        switch (_op_code) {
+            case update_operator::set:
+                return details::assign_value(*v, _val);
+            case update_operator::inc:
+                return details::apply_arithmetic(*v, _val, std::plus<>{});
+            case update_operator::mul:
+                return details::apply_arithmetic(*v, _val, std::multiplies<>{});
+            case update_operator::min:
+                return details::apply_if(*v, _val, std::less<>{});
+            case update_operator::max:
+                return details::apply_if(*v, _val, std::greater<>{});
+            case update_operator::pull:
+                return details::pull_elements(*v, _val);
+            case update_operator::pull_all:
+                return details::pull_all_elements(*v, _val);
+            case update_operator::pop:
+                return details::pop_element(*v, _val);
+            default:
+                details::throw_not_applicable();
+        }
+    }
+
    private:
     const NvpT _nvp;
     const U &_val;
     const char *_op;
+    const details::update_operator _op_code;
 };
 
 template <typename NvpT, typename U>
@@ -744,18 +2060,26 @@ class unset_expr {
      * @param Whether to wrap this expression inside a document.
      */
     void append_to_bson(bsoncxx::builder::core &builder, bool wrap = false) const {
-        if (wrap) {
-            builder.open_document();
-        }
-        builder.key_view("$unset");
-        builder.open_document();
-        std::string s;
-        builder.key_view(_nvp.append_name(s));
+        details::append_update_to_bson(*this, builder, wrap);
+    }
+
+    constexpr const char *operator_name() const {
+        return "$unset";
+    }
+
+    /**
+     * Appends the "field: ''" pair of this expression.
+     */
+    void append_field_to_bson(bsoncxx::builder::core &builder) const {
+        details::append_key(builder, _nvp);
         builder.append("");
-        builder.close_document();
-        if (wrap) {
-            builder.close_document();
-        }
+    }
+
+    /**
+     * Returns the field that this expression updates.
+     */
+    constexpr const NvpT &field() const {
+        return _nvp;
     }
 
     operator bsoncxx::document::view_or_value() const {
@@ -764,6 +2088,16 @@ class unset_expr {
         return {builder.extract_document()};
     }
 
+    /**
+     * Applies this update to a C++ object by resetting the optional field.
+     */
+    template <typename Base>
+    void apply(Base &obj) const {
+        if (auto v = _nvp.resolve(obj, false)) {
+            details::reset_value(*v);
+        }
+    }
+
    private:
     const NvpT _nvp;
 };
@@ -790,24 +2124,31 @@ class current_date_expr {
      * @param Whether to wrap this expression inside a document.
      */
     void append_to_bson(bsoncxx::builder::core &builder, bool wrap = false) const {
-        if (wrap) {
-            builder.open_document();
-        }
-        builder.key_view("$currentDate");
-        builder.open_document();
-        std::string s;
-        builder.key_view(_nvp.append_name(s));
+        details::append_update_to_bson(*this, builder, wrap);
+    }
+
+    constexpr const char *operator_name() const {
+        return "$currentDate";
+    }
+
+    /**
+     * Appends the "field: {$type: 'timestamp|date'}" pair of this expression.
+     */
+    void append_field_to_bson(bsoncxx::builder::core &builder) const {
+        details::append_key(builder, _nvp);
 
         // type specification
         builder.open_document();
         builder.key_view("$type");
         builder.append(_is_date ? "date" : "timestamp");
         builder.close_document();
+    }
 
-        builder.close_document();
-        if (wrap) {
-            builder.close_document();
-        }
+    /**
+     * Returns the field that this expression updates.
+     */
+    constexpr const NvpT &field() const {
+        return _nvp;
     }
 
     operator bsoncxx::document::view_or_value() const {
@@ -816,6 +2157,14 @@ class current_date_expr {
         return {builder.extract_document()};
     }
 
+    /**
+     * Applies this update to a C++ object by setting the field to the current time.
+     */
+    template <typename Base>
+    void apply(Base &obj) const {
+        details::set_current_date(*_nvp.resolve(obj, true));
+    }
+
    private:
     const NvpT _nvp;
     const bool _is_date;
@@ -847,13 +2196,18 @@ class add_to_set_update_expr {
      * @param wrap    Whether to wrap this expression inside a document.
      */
     void append_to_bson(bsoncxx::builder::core &builder, bool wrap = false) const {
-        if (wrap) {
-            builder.open_document();
-        }
-        builder.key_view("$addToSet");
-        builder.open_document();
-        std::string s;
-        builder.key_view(_nvp.append_name(s));
+        details::append_update_to_bson(*this, builder, wrap);
+    }
+
+    constexpr const char *operator_name() const {
+        return "$addToSet";
+    }
+
+    /**
+     * Appends the "field: value | {$each: value}" pair of this expression.
+     */
+    void append_field_to_bson(bsoncxx::builder::core &builder) const {
+        details::append_key(builder, _nvp);
 
         // wrap value in $each: {} if necessary.
         if (_each) {
@@ -864,11 +2218,13 @@ class add_to_set_update_expr {
         if (_each) {
             builder.close_document();
         }
+    }
 
-        builder.close_document();
-        if (wrap) {
-            builder.close_document();
-        }
+    /**
+     * Returns the field that this expression updates.
+     */
+    constexpr const NvpT &field() const {
+        return _nvp;
     }
 
     operator bsoncxx::document::view_or_value() const {
@@ -877,6 +2233,14 @@ class add_to_set_update_expr {
         return {builder.extract_document()};
     }
 
+    /**
+     * Applies this update to a C++ object, appending the values that are not already in the array.
+     */
+    template <typename Base>
+    void apply(Base &obj) const {
+        details::add_to_set_elements(*_nvp.resolve(obj, true), _val, details::rank<1>{});
+    }
+
    private:
     const NvpT _nvp;
     const U &_val;
@@ -997,13 +2361,18 @@ class push_update_expr {
      * @param Whether to wrap this expression inside a document.
      */
     void append_to_bson(bsoncxx::builder::core &builder, bool wrap = false) const {
-        if (wrap) {
-            builder.open_document();
-        }
-        builder.key_view("$push");
-        builder.open_document();
-        std::string s;
-        builder.key_view(_nvp.append_name(s));
+        details::append_update_to_bson(*this, builder, wrap);
+    }
+
+    constexpr const char *operator_name() const {
+        return "$push";
+    }
+
+    /**
+     * Appends the "field: value | {$each: value, $modifiers: params...}" pair of this expression.
+     */
+    void append_field_to_bson(bsoncxx::builder::core &builder) const {
+        details::append_key(builder, _nvp);
 
         // wrap value in "$each: {}" if necessary.
         if (_each) {
@@ -1026,11 +2395,13 @@ class push_update_expr {
             }
             builder.close_document();
         }
+    }
 
-        builder.close_document();
-        if (wrap) {
-            builder.close_document();
-        }
+    /**
+     * Returns the field that this expression updates.
+     */
+    constexpr const NvpT &field() const {
+        return _nvp;
     }
 
     operator bsoncxx::document::view_or_value() const {
@@ -1039,6 +2410,15 @@ class push_update_expr {
         return {builder.extract_document()};
     }
 
+    /**
+     * Applies this update to a C++ object, including the $position, $sort and $slice modifiers.
+     */
+    template <typename Base>
+    void apply(Base &obj) const {
+        details::push_elements(*_nvp.resolve(obj, true), _val, _slice, _sort, _position,
+                               details::rank<1>{});
+    }
+
    private:
     const NvpT _nvp;
     const U &_val;
@@ -1059,7 +2439,7 @@ class bit_update_expr {
    public:
     using field_type = NvpT;
     constexpr bit_update_expr(const NvpT &nvp, Integer mask, const char *op)
-        : _nvp(nvp), _mask(mask), _operation(op){};
+        : _nvp(nvp), _mask(mask), _operation(op), _op_code(details::to_update_operator(op)){};
 
     /**
      * Appends this query to a BSON core builder as an expression
@@ -1068,24 +2448,31 @@ class bit_update_expr {
      * @param Whether to wrap this expression inside a document.
      */
     void append_to_bson(bsoncxx::builder::core &builder, bool wrap = false) const {
-        if (wrap) {
-            builder.open_document();
-        }
-        builder.key_view("$bit");
-        builder.open_document();
-        std::string s;
-        builder.key_view(_nvp.append_name(s));
+        details::append_update_to_bson(*this, builder, wrap);
+    }
+
+    constexpr const char *operator_name() const {
+        return "$bit";
+    }
+
+    /**
+     * Appends the "field: {<and|or|xor>: <int>}" pair of this expression.
+     */
+    void append_field_to_bson(bsoncxx::builder::core &builder) const {
+        details::append_key(builder, _nvp);
 
         // bit operation
         builder.open_document();
         builder.key_view(_operation);
         builder.append(_mask);
         builder.close_document();
+    }
 
-        builder.close_document();
-        if (wrap) {
-            builder.close_document();
-        }
+    /**
+     * Returns the field that this expression updates.
+     */
+    constexpr const NvpT &field() const {
+        return _nvp;
     }
 
     operator bsoncxx::document::view_or_value() const {
@@ -1094,10 +2481,29 @@ class bit_update_expr {
         return {builder.extract_document()};
     }
 
+    /**
+     * Applies this update to a C++ object. A missing field is treated as zero.
+     */
+    template <typename Base>
+    void apply(Base &obj) const {
+        auto v = _nvp.resolve(obj, true);
+        switch (_op_code) {
+            case details::update_operator::bit_and:
+                return details::apply_arithmetic(*v, _mask, std::bit_and<>{});
+            case details::update_operator::bit_or:
+                return details::apply_arithmetic(*v, _mask, std::bit_or<>{});
+            case details::update_operator::bit_xor:
+                return details::apply_arithmetic(*v, _mask, std::bit_xor<>{});
+            default:
+                details::throw_not_applicable();
+        }
+    }
+
    private:
     const NvpT _nvp;
     const Integer _mask;
     const char *_operation;
+    const details::update_operator _op_code;
 };
 
 /* Query comparison operators */
@@ -1285,7 +2691,7 @@ constexpr comparison_expr<NvpT, bsoncxx::types::b_regex> operator!(
 template <typename Expr, expression_category list_type, typename... Args, size_t... idxs>
 constexpr expression_list<list_type, Expr, Args...> append_impl(
     expression_list<list_type, Args...> list, Expr expr, std::index_sequence<idxs...>) {
-    return {expr, std::get<idxs>(list.storage)...};
+    return {details::prepend_t{}, expr, std::get<idxs>(list.storage)...};
 }
 
 /**
@@ -0,0 +1,158 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <mangrove/config/prelude.hpp>
+
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include <bsoncxx/builder/core.hpp>
+#include <bsoncxx/oid.hpp>
+
+#include <boson/bson_archiver.hpp>
+
+namespace mangrove {
+MANGROVE_INLINE_NAMESPACE_BEGIN
+
+/**
+ * A field that refers to an object of the model U by its _id. The reference is stored in BSON as
+ * the bare _id, and the object it refers to is loaded the first time it is accessed, through
+ * U::find_by_id().
+ *
+ * Resolving the references of many objects one by one costs a query each, so a
+ * deserializing_cursor can instead be asked to prefetch() a reference field, which resolves the
+ * references of a whole batch of results at once.
+ *
+ * @tparam U        The model class that is referred to.
+ * @tparam IdType   The type of U's _id.
+ */
+template <typename U, typename IdType = bsoncxx::oid>
+class ref {
+   public:
+    using id_type = IdType;
+    using referenced_type = U;
+
+    ref() = default;
+
+    ref(IdType id) : _id(std::move(id)) {
+    }
+
+    /**
+     * Returns the _id of the referenced object.
+     */
+    const IdType& id() const {
+        return _id;
+    }
+
+    /**
+     * Returns whether the referenced object has already been looked up, whether or not it exists.
+     */
+    bool resolved() const {
+        return _resolved;
+    }
+
+    /**
+     * Returns the referenced object, looking it up first if it has not been resolved yet.
+     * @throws std::logic_error if no object of type U has this _id.
+     */
+    const U& get() const {
+        if (!_resolved) {
+            auto obj = U::find_by_id(_id);
+            resolve(obj ? std::make_shared<const U>(std::move(*obj)) : nullptr);
+        }
+        if (!_target) {
+            throw std::logic_error("mangrove: the referenced object does not exist.");
+        }
+        return *_target;
+    }
+
+    const U& operator*() const {
+        return get();
+    }
+
+    const U* operator->() const {
+        return &get();
+    }
+
+    /**
+     * Sets the object that this refers to without querying for it. A null target records that
+     * the object does not exist. This is used by deserializing_cursor::prefetch(), so that
+     * references to the same object share a single copy of it.
+     */
+    void resolve(std::shared_ptr<const U> target) const {
+        _target = std::move(target);
+        _resolved = true;
+    }
+
+    template <class Archive>
+    void save(Archive& ar) const {
+        ar(_id);
+    }
+
+    template <class Archive>
+    void load(Archive& ar) {
+        ar(_id);
+        _target.reset();
+        _resolved = false;
+    }
+
+    friend bool operator==(const ref& lhs, const ref& rhs) {
+        return lhs._id == rhs._id;
+    }
+
+    friend bool operator!=(const ref& lhs, const ref& rhs) {
+        return !(lhs == rhs);
+    }
+
+    friend bool operator<(const ref& lhs, const ref& rhs) {
+        return lhs._id < rhs._id;
+    }
+
+   private:
+    IdType _id;
+    mutable bool _resolved = false;
+    mutable std::shared_ptr<const U> _target;
+};
+
+// A ref is archived as the _id it holds, so like stdx::optional it does not start or finish a
+// BSON node of its own.
+template <typename U, typename IdType>
+inline void prologue(boson::BSONOutputArchive&, const ref<U, IdType>&) {
+}
+
+template <typename U, typename IdType>
+inline void prologue(boson::BSONInputArchive&, const ref<U, IdType>&) {
+}
+
+template <typename U, typename IdType>
+inline void epilogue(boson::BSONOutputArchive&, const ref<U, IdType>&) {
+}
+
+template <typename U, typename IdType>
+inline void epilogue(boson::BSONInputArchive&, const ref<U, IdType>&) {
+}
+
+// Appends a ref to a query as the _id it holds, rather than as a sub-document.
+template <typename U, typename IdType>
+void append_value_to_bson(const ref<U, IdType>& r, bsoncxx::builder::core& builder) {
+    builder.append(r.id());
+}
+
+MANGROVE_INLINE_NAMESPACE_END
+}  // namespace mangrove
+
+#include <mangrove/config/postlude.hpp>
@@ -0,0 +1,127 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <mangrove/config/prelude.hpp>
+
+#include <bsoncxx/builder/core.hpp>
+#include <bsoncxx/document/view.hpp>
+#include <mongocxx/stdx.hpp>
+
+#include <boson/mapping_functions.hpp>
+#include <mangrove/expression_syntax.hpp>
+#include <mangrove/query_builder.hpp>
+
+namespace mangrove {
+MANGROVE_INLINE_NAMESPACE_BEGIN
+
+/**
+ * A BSON builder that serializes query builder expressions, and is reset rather than reallocated
+ * between uses. Converting an expression to a bsoncxx::document::view_or_value creates a new
+ * builder and extracts an owning document every time, whereas a scratch_builder keeps its buffer,
+ * so that serializing expressions of a similar size does not allocate once it has grown.
+ *
+ * The views returned by serialize() remain valid until the next call to serialize() or clear(),
+ * or until the scratch_builder is destroyed.
+ */
+class scratch_builder {
+   public:
+    scratch_builder() : _builder(false) {
+    }
+
+    scratch_builder(const scratch_builder &) = delete;
+    scratch_builder &operator=(const scratch_builder &) = delete;
+
+    /**
+     * Serializes an expression into this builder, replacing its previous contents.
+     * @param expr  A query, update or sort expression, or a list of them.
+     * @return      A view of the serialized expression, owned by this builder.
+     */
+    template <typename Expr>
+    bsoncxx::document::view serialize(const Expr &expr) {
+        _builder.clear();
+        expr.append_to_bson(_builder);
+        return _builder.view_document();
+    }
+
+    /**
+     * Empties this builder, keeping its buffer for later use.
+     */
+    void clear() {
+        _builder.clear();
+    }
+
+   private:
+    bsoncxx::builder::core _builder;
+};
+
+/**
+ * The roles of the thread-local scratch builders, so that the filter, update and sort of a single
+ * request can all be serialized at once.
+ */
+enum class scratch_slot { filter, update, sort };
+
+/**
+ * Returns the scratch builder used by the current thread for the given role.
+ */
+template <scratch_slot slot>
+scratch_builder &thread_scratch_builder() {
+// TODO: As in model, this can always be thread_local once XCode 8 is released. Until then, the
+//       scratch builders are shared by all threads, and so are not thread-safe, on OS X.
+#ifdef __APPLE__
+    static scratch_builder builder;
+#else
+    thread_local scratch_builder builder;
+#endif
+    return builder;
+}
+
+/**
+ * Serializes a query expression into the current thread's filter builder.
+ * @return A view that remains valid until the next call to serialize_filter() on this thread.
+ */
+template <typename Expr>
+bsoncxx::document::view serialize_filter(const Expr &expr) {
+    static_assert(!details::is_update_expression_v<Expr> && !details::is_sort_expression_v<Expr>,
+                  "serialize_filter requires a query expression.");
+    return thread_scratch_builder<scratch_slot::filter>().serialize(expr);
+}
+
+/**
+ * Serializes an update expression into the current thread's update builder.
+ * @return A view that remains valid until the next call to serialize_update() on this thread.
+ */
+template <typename Expr>
+bsoncxx::document::view serialize_update(const Expr &expr) {
+    static_assert(details::is_update_expression_v<Expr>,
+                  "serialize_update requires an update expression.");
+    return thread_scratch_builder<scratch_slot::update>().serialize(expr);
+}
+
+/**
+ * Serializes a sort expression into the current thread's sort builder.
+ * @return A view that remains valid until the next call to serialize_sort() on this thread.
+ */
+template <typename Expr>
+bsoncxx::document::view serialize_sort(const Expr &expr) {
+    static_assert(details::is_sort_expression_v<Expr>,
+                  "serialize_sort requires a sort expression.");
+    return thread_scratch_builder<scratch_slot::sort>().serialize(expr);
+}
+
+MANGROVE_INLINE_NAMESPACE_END
+}  // namespace mangrove
+
+#include <mangrove/config/postlude.hpp>
@@ -0,0 +1,142 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+
+#include <string>
+#include <vector>
+
+#include <mongocxx/client.hpp>
+#include <mongocxx/instance.hpp>
+#include <mongocxx/stdx.hpp>
+
+#include <boson/mapping_functions.hpp>
+#include <mangrove/aggregation.hpp>
+#include <mangrove/collection_wrapper.hpp>
+#include <mangrove/query_builder.hpp>
+
+using namespace mangrove;
+
+class Sale {
+   public:
+    std::string customer;
+    double total;
+    bool paid;
+    std::vector<std::string> items;
+
+    MANGROVE_MAKE_KEYS(Sale, MANGROVE_NVP(customer), MANGROVE_NVP(total), MANGROVE_NVP(paid),
+                       MANGROVE_NVP(items))
+};
+
+class Revenue {
+   public:
+    std::string _id;
+    double total;
+    int sales;
+    double largest;
+
+    MANGROVE_MAKE_KEYS(Revenue, MANGROVE_NVP(_id), MANGROVE_NVP(total), MANGROVE_NVP(sales),
+                       MANGROVE_NVP(largest))
+};
+
+class ItemCount {
+   public:
+    std::string _id;
+    int count;
+
+    MANGROVE_MAKE_KEYS(ItemCount, MANGROVE_NVP(_id), MANGROVE_NVP(count))
+};
+
+class Receipt {
+   public:
+    std::string who;
+    double amount;
+
+    MANGROVE_MAKE_KEYS(Receipt, MANGROVE_NVP(who), MANGROVE_NVP(amount))
+};
+
+TEST_CASE("typed_pipeline runs aggregations built from name-value pairs on the server.",
+          "[mangrove::typed_pipeline]") {
+    mongocxx::instance::current();
+    mongocxx::client conn{mongocxx::uri{}};
+    auto coll = conn["testdb"]["sales"];
+    collection_wrapper<Sale> sales(coll);
+
+    coll.delete_many({});
+    sales.insert_one(Sale{"ann", 10.0, true, {"pen", "ink"}});
+    sales.insert_one(Sale{"ann", 30.0, true, {"pen"}});
+    sales.insert_one(Sale{"bob", 25.0, true, {"paper"}});
+    sales.insert_one(Sale{"bob", 100.0, false, {"pen"}});
+
+    SECTION("Test $match, $group and $sort.") {
+        auto pipeline = typed_pipeline<Sale>{}
+                            .match(MANGROVE_KEY(Sale::paid) == true)
+                            .group<Revenue>(MANGROVE_KEY(Sale::customer),
+                                            sum(MANGROVE_KEY(Sale::total))
+                                                .as(MANGROVE_KEY(Revenue::total)),
+                                            sum(1).as(MANGROVE_KEY(Revenue::sales)),
+                                            max(MANGROVE_KEY(Sale::total))
+                                                .as(MANGROVE_KEY(Revenue::largest)))
+                            .sort(MANGROVE_KEY(Revenue::total).sort(false));
+
+        std::vector<Revenue> results;
+        for (Revenue r : sales.aggregate(pipeline)) {
+            results.push_back(r);
+        }
+        REQUIRE(results.size() == 2);
+        REQUIRE(results[0]._id == "ann");
+        REQUIRE(results[0].total == 40.0);
+        REQUIRE(results[0].sales == 2);
+        REQUIRE(results[0].largest == 30.0);
+        REQUIRE(results[1]._id == "bob");
+        REQUIRE(results[1].sales == 1);
+    }
+
+    SECTION("Test $unwind and $limit.") {
+        auto pipeline = typed_pipeline<Sale>{}
+                            .unwind(MANGROVE_KEY(Sale::items))
+                            .group<ItemCount>(MANGROVE_KEY(Sale::items),
+                                              sum(1).as(MANGROVE_KEY(ItemCount::count)))
+                            .sort(MANGROVE_KEY(ItemCount::count).sort(false))
+                            .limit(1);
+
+        std::vector<ItemCount> results;
+        for (ItemCount c : sales.aggregate(pipeline)) {
+            results.push_back(c);
+        }
+        REQUIRE(results.size() == 1);
+        REQUIRE(results[0]._id == "pen");
+        REQUIRE(results[0].count == 3);
+    }
+
+    SECTION("Test $project.") {
+        auto pipeline = typed_pipeline<Sale>{}
+                            .match(MANGROVE_KEY(Sale::total) > 50.0)
+                            .project<Receipt>(
+                                value_of(MANGROVE_KEY(Sale::customer))
+                                    .as(MANGROVE_KEY(Receipt::who)),
+                                value_of(MANGROVE_KEY(Sale::total))
+                                    .as(MANGROVE_KEY(Receipt::amount)));
+
+        int count = 0;
+        for (Receipt r : sales.aggregate(pipeline)) {
+            REQUIRE(r.who == "bob");
+            REQUIRE(r.amount == 100.0);
+            count++;
+        }
+        REQUIRE(count == 1);
+    }
+
+    coll.delete_many({});
+}
@@ -0,0 +1,112 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+
+#include <mangrove/batch_size_tuner.hpp>
+
+using namespace mangrove;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+
+TEST_CASE("batch_size_tuner only picks batch sizes while it is enabled.",
+          "[mangrove::batch_size_tuner]") {
+    batch_size_tuner tuner;
+    REQUIRE(!tuner.enabled());
+    REQUIRE(tuner.next_batch_size() == 0);
+
+    tuner.configure(batch_size_options{}.initial_batch_size(50));
+    REQUIRE(tuner.enabled());
+    REQUIRE(tuner.next_batch_size() == 50);
+    REQUIRE(tuner.stats().queries == 1);
+
+    tuner.configure({});
+    REQUIRE(!tuner.enabled());
+    REQUIRE(tuner.next_batch_size() == 0);
+    REQUIRE(tuner.stats().queries == 0);
+
+    REQUIRE_THROWS_AS(tuner.configure(batch_size_options{}.min_batch_size(0)), std::logic_error);
+    REQUIRE_THROWS_AS(tuner.configure(batch_size_options{}.min_batch_size(10).max_batch_size(5)),
+                      std::logic_error);
+}
+
+TEST_CASE("batch_size_tuner keeps batches within their memory and latency budgets.",
+          "[mangrove::batch_size_tuner]") {
+    batch_size_tuner tuner;
+    auto options = batch_size_options{}
+                       .target_bytes(1024 * 1024)
+                       .target_latency(milliseconds(10))
+                       .min_batch_size(10)
+                       .max_batch_size(5000);
+
+    SECTION("Large documents get small batches.") {
+        tuner.configure(options);
+        tuner.record(10, 10 * 64 * 1024, nanoseconds(0));
+        REQUIRE(tuner.stats().average_document_bytes == 64 * 1024);
+        REQUIRE(tuner.next_batch_size() == 16);
+    }
+
+    SECTION("Small documents and a fast consumer get the largest batches.") {
+        tuner.configure(options);
+        tuner.record(100, 100 * 16, microseconds(100));
+        REQUIRE(tuner.next_batch_size() == 5000);
+    }
+
+    SECTION("A slow consumer gets small batches, down to the minimum.") {
+        tuner.configure(options);
+        tuner.record(10, 10 * 16, microseconds(10 * 100));
+        REQUIRE(tuner.stats().average_processing_time == microseconds(100));
+        REQUIRE(tuner.next_batch_size() == 100);
+
+        tuner.configure(options);
+        tuner.record(10, 10 * 16, milliseconds(10 * 5));
+        REQUIRE(tuner.next_batch_size() == 10);
+    }
+
+    SECTION("Observations are smoothed.") {
+        tuner.configure(options);
+        tuner.record(10, 10 * 1000, nanoseconds(0));
+        tuner.record(10, 10 * 2000, nanoseconds(0));
+        auto stats = tuner.stats();
+        REQUIRE(stats.documents == 20);
+        REQUIRE(stats.bytes == 30000);
+        REQUIRE(stats.average_document_bytes == 1250);
+    }
+}
+
+TEST_CASE("batch_size_sampler reports to its tuner once per batch and when it is destroyed.",
+          "[mangrove::batch_size_tuner]") {
+    batch_size_tuner tuner;
+    tuner.configure(batch_size_options{});
+
+    {
+        details::batch_size_sampler sampler(&tuner, 2);
+        sampler.document(100);
+        REQUIRE(tuner.stats().documents == 0);
+        sampler.document(100);
+        REQUIRE(tuner.stats().documents == 2);
+        sampler.document(100);
+
+        // A moved-from sampler does not report again.
+        details::batch_size_sampler moved(std::move(sampler));
+        REQUIRE(tuner.stats().documents == 2);
+    }
+    REQUIRE(tuner.stats().documents == 3);
+    REQUIRE(tuner.stats().bytes == 300);
+}
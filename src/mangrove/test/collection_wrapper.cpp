@@ -24,6 +24,7 @@
 
 #include <boson/bson_streambuf.hpp>
 #include <mangrove/collection_wrapper.hpp>
+#include <mangrove/query_builder.hpp>
 
 using namespace bsoncxx;
 using namespace mongocxx;
@@ -43,6 +44,14 @@ class Foo {
     }
 };
 
+class Job {
+   public:
+    std::string name;
+    int attempts;
+
+    MANGROVE_MAKE_KEYS(Job, MANGROVE_NVP(name), MANGROVE_CUSTOM_NVP(attempts, "n"))
+};
+
 // Represents an aggregation result
 class FooResult {
    public:
@@ -175,6 +184,20 @@ TEST_CASE(
         }
     }
 
+    SECTION("Test find_one_and_update()", "[mangrove::collection_wrapper]") {
+        coll.delete_many({});
+        coll.insert_one(doc_view);
+
+        mongocxx::stdx::optional<Foo> res =
+            foo_coll.find_one_and_update(doc_view, from_json(R"({"$set": {"c": 900}})"));
+        REQUIRE(res);
+        if (res) {
+            Foo obj_test = res.value();
+            REQUIRE(obj_test == obj);
+        }
+        REQUIRE(coll.count(doc_2_view) == 1);
+    }
+
     SECTION("Test insert_one().", "[mangrove::collection_wrapper]") {
         coll.delete_many({});
         auto res = foo_coll.insert_one(obj);
@@ -224,3 +247,74 @@ TEST_CASE(
 
     coll.delete_many({});
 }
+
+TEST_CASE("mapped_fields_projection includes the stored names of mapped fields.",
+          "[mangrove::collection_wrapper]") {
+    auto expected = from_json(R"({"name": 1, "n": 1})");
+    REQUIRE(mapped_fields_projection<Job>().view() == expected.view());
+}
+
+TEST_CASE("collection_wrapper claims documents with typed find_one_and_update.",
+          "[mangrove::collection_wrapper]") {
+    instance::current();
+    client conn{uri{}};
+    collection coll = conn["testdb"]["testcollection"];
+    collection_wrapper<Job> job_coll(coll);
+
+    coll.delete_many({});
+    coll.insert_one(from_json(R"({"name": "a", "n": 0, "payload": "x"})"));
+
+    options::find_one_and_update opts;
+    opts.return_document(options::return_document::k_after);
+    auto job = job_coll.find_one_and_update(MANGROVE_KEY(Job::attempts) == 0,
+                                            MANGROVE_KEY(Job::attempts) += 1, opts);
+    REQUIRE(job);
+    REQUIRE(job->name == "a");
+    REQUIRE(job->attempts == 1);
+
+    REQUIRE(!job_coll.find_one_and_update(MANGROVE_KEY(Job::attempts) == 0,
+                                          MANGROVE_KEY(Job::attempts) += 1));
+
+    coll.delete_many({});
+}
+
+TEST_CASE("collection_wrapper exports documents as Extended JSON.",
+          "[mangrove::collection_wrapper]") {
+    instance::current();
+    client conn{uri{}};
+    collection coll = conn["testdb"]["testcollection"];
+    collection_wrapper<Job> job_coll(coll);
+
+    coll.delete_many({});
+    coll.insert_one(from_json(R"({"_id": 1, "name": "a", "n": 0, "payload": "x"})"));
+    coll.insert_one(from_json(R"({"_id": 2, "name": "b", "n": 3, "payload": "y"})"));
+
+    options::find opts;
+    opts.sort(from_json(R"({"_id": 1})"));
+    std::string out;
+
+    SECTION("All fields are exported by default.") {
+        boson::json_writer writer(out);
+        REQUIRE(job_coll.export_json(MANGROVE_KEY(Job::attempts) > 0, writer) == 1);
+        REQUIRE(out == R"({"_id":2,"name":"b","n":3,"payload":"y"})" "\n");
+    }
+
+    SECTION("Only the given fields are exported.") {
+        boson::json_writer writer(out, boson::json_mode::k_canonical, boson::json_framing::k_array);
+        REQUIRE(job_coll.export_json({}, opts, writer, MANGROVE_KEY(Job::attempts)) == 2);
+        writer.finish();
+        REQUIRE(out == R"([{"n":{"$numberInt":"0"}},{"n":{"$numberInt":"3"}}])");
+    }
+
+    SECTION("The fields are added to the projection, and do not restrict the writer.") {
+        boson::json_writer writer(out);
+        opts.projection(from_json(R"({"name": 1})"));
+        REQUIRE(job_coll.export_json(MANGROVE_KEY(Job::attempts) > 0, opts, writer,
+                                     MANGROVE_KEY(Job::attempts)) == 1);
+        auto other = from_json(R"({"a": 1, "b": 2})");
+        writer.write(other.view());
+        REQUIRE(out == R"({"name":"b","n":3})" "\n" R"({"a":1,"b":2})" "\n");
+    }
+
+    coll.delete_many({});
+}
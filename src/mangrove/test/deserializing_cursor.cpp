@@ -14,7 +14,10 @@
 
 #include "catch.hpp"
 
+#include <cstdint>
 #include <iostream>
+#include <type_traits>
+#include <vector>
 
 #include <bsoncxx/builder/stream/document.hpp>
 #include <mongocxx/client.hpp>
@@ -24,6 +27,7 @@
 
 #include <boson/bson_streambuf.hpp>
 #include <mangrove/collection_wrapper.hpp>
+#include <mangrove/query_builder.hpp>
 
 using namespace bsoncxx;
 using namespace mongocxx;
@@ -108,3 +112,98 @@ TEST_CASE("Test deserializing cursor", "[mangrove::deserializing_cursor]") {
 
     coll.delete_many({});
 }
+
+class Position {
+   public:
+    double x, y;
+    MANGROVE_MAKE_KEYS(Position, MANGROVE_NVP(x), MANGROVE_NVP(y));
+};
+
+class Reading {
+   public:
+    std::int32_t sensor;
+    double value;
+    mongocxx::stdx::optional<std::string> label;
+    Position pos;
+    mongocxx::stdx::optional<bool> calibrated;
+    mongocxx::stdx::optional<Position> origin;
+    MANGROVE_MAKE_KEYS(Reading, MANGROVE_NVP(sensor), MANGROVE_NVP(value), MANGROVE_NVP(label),
+                       MANGROVE_NVP(pos), MANGROVE_NVP(calibrated), MANGROVE_NVP(origin));
+};
+
+TEST_CASE("Deserializing cursor collects fields into columns.",
+          "[mangrove::deserializing_cursor]") {
+    instance::current();
+    client conn{uri{}};
+    collection coll = conn["testdb"]["testcollection"];
+    collection_wrapper<Reading> reading_coll(coll);
+    coll.delete_many({});
+
+    coll.insert_one(from_json(R"({"_id": 1, "sensor": 1, "value": 0.5, "label": "a",
+                                  "pos": {"x": 1.0, "y": 2.0}, "calibrated": true,
+                                  "origin": {"x": 0.5, "y": 0.0}})"));
+    coll.insert_one(from_json(R"({"_id": 2, "sensor": 2, "value": 1.5, "pos": {"x": 3.0}})"));
+    // The sensor has the wrong type, so this document is skipped.
+    coll.insert_one(from_json(R"({"_id": 3, "sensor": "3", "value": 2.5, "label": "c"})"));
+    coll.insert_one(from_json(
+        R"({"_id": 4, "sensor": 4, "value": 3.5, "label": null, "calibrated": false})"));
+
+    mongocxx::options::find opts;
+    opts.sort(from_json(R"({"_id": 1})"));
+
+    SECTION("Columns hold the values of each field in order.") {
+        auto cur = reading_coll.find({}, opts);
+        auto columns = cur.collect_columns(MANGROVE_KEY(Reading::sensor),
+                                           MANGROVE_KEY(Reading::value),
+                                           MANGROVE_KEY(Reading::label));
+
+        const column<std::int32_t>& sensor = std::get<0>(columns);
+        const column<double>& value = std::get<1>(columns);
+        const column<std::string>& label = std::get<2>(columns);
+
+        REQUIRE(sensor.values == (std::vector<std::int32_t>{1, 2, 4}));
+        REQUIRE(!sensor.nullable);
+        REQUIRE(sensor.nulls.empty());
+        REQUIRE(value.values == (std::vector<double>{0.5, 1.5, 3.5}));
+
+        REQUIRE(label.nullable);
+        REQUIRE(label.size() == 3);
+        REQUIRE(label.values[0] == "a");
+        REQUIRE(!label.is_null(0));
+        REQUIRE(label.is_null(1));
+        REQUIRE(label.is_null(2));
+    }
+
+    SECTION("Documents that miss a required field are skipped.") {
+        auto cur = reading_coll.find({}, opts);
+        auto columns = cur.collect_columns(MANGROVE_KEY(Reading::sensor),
+                                           MANGROVE_CHILD(Reading, pos, y));
+
+        REQUIRE(std::get<0>(columns).values == (std::vector<std::int32_t>{1}));
+        REQUIRE(std::get<1>(columns).values == (std::vector<double>{2.0}));
+    }
+
+    SECTION("Bools are stored as bytes, and the fields of an optional parent are nullable.") {
+        auto cur = reading_coll.find({}, opts);
+        auto columns = cur.collect_columns(MANGROVE_KEY(Reading::sensor),
+                                           MANGROVE_KEY(Reading::calibrated),
+                                           MANGROVE_CHILD(Reading, origin, x));
+
+        const column<bool>& calibrated = std::get<1>(columns);
+        static_assert(
+            std::is_same<decltype(calibrated.values), std::vector<std::uint8_t>>::value,
+            "bool columns store bytes");
+        REQUIRE(calibrated.values == (std::vector<std::uint8_t>{1, 0, 0}));
+        REQUIRE(calibrated.is_null(1));
+
+        const column<double>& origin_x = std::get<2>(columns);
+        REQUIRE(origin_x.nullable);
+        REQUIRE(origin_x.size() == 3);
+        REQUIRE(!origin_x.is_null(0));
+        REQUIRE(origin_x.values[0] == 0.5);
+        REQUIRE(origin_x.is_null(1));
+        REQUIRE(origin_x.is_null(2));
+    }
+
+    coll.delete_many({});
+}
@@ -0,0 +1,115 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <mangrove/id_cache.hpp>
+
+using namespace mangrove;
+
+TEST_CASE("id_cache only stores objects while it is enabled.", "[mangrove::id_cache]") {
+    id_cache<int, std::string> cache;
+
+    cache.put(1, "one", 10, cache.generation());
+    REQUIRE(!cache.get(1));
+
+    cache.configure(id_cache_options{});
+    cache.put(1, "one", 10, cache.generation());
+    REQUIRE(cache.get(1).value_or("") == "one");
+    REQUIRE(cache.size() == 1);
+    REQUIRE(cache.bytes() == 10);
+
+    cache.configure({});
+    REQUIRE(!cache.enabled());
+    REQUIRE(cache.size() == 0);
+    REQUIRE(!cache.get(1));
+}
+
+TEST_CASE("id_cache evicts the least recently used objects to stay within its budgets.",
+          "[mangrove::id_cache]") {
+    id_cache<int, std::string> cache;
+
+    SECTION("Entry budget") {
+        cache.configure(id_cache_options{}.max_entries(2));
+        cache.put(1, "one", 10, cache.generation());
+        cache.put(2, "two", 10, cache.generation());
+
+        // Touch 1 so that 2 becomes the least recently used.
+        REQUIRE(cache.get(1));
+        cache.put(3, "three", 10, cache.generation());
+
+        REQUIRE(cache.size() == 2);
+        REQUIRE(cache.get(1));
+        REQUIRE(!cache.get(2));
+        REQUIRE(cache.get(3));
+    }
+
+    SECTION("Byte budget") {
+        cache.configure(id_cache_options{}.max_entries(0).max_bytes(25));
+        cache.put(1, "one", 10, cache.generation());
+        cache.put(2, "two", 10, cache.generation());
+        cache.put(3, "three", 10, cache.generation());
+
+        REQUIRE(cache.size() == 2);
+        REQUIRE(cache.bytes() == 20);
+        REQUIRE(!cache.get(1));
+
+        // An object larger than the whole budget is never cached.
+        cache.put(4, "four", 30, cache.generation());
+        REQUIRE(!cache.get(4));
+        REQUIRE(cache.size() == 2);
+    }
+}
+
+TEST_CASE("id_cache expires objects after their TTL.", "[mangrove::id_cache]") {
+    id_cache<int, std::string> cache;
+    cache.configure(id_cache_options{}.ttl(std::chrono::milliseconds{10}));
+
+    cache.put(1, "one", 10, cache.generation());
+    REQUIRE(cache.get(1));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    REQUIRE(!cache.get(1));
+    REQUIRE(cache.size() == 0);
+}
+
+TEST_CASE("id_cache does not store objects fetched before an invalidation.",
+          "[mangrove::id_cache]") {
+    id_cache<int, std::string> cache;
+    cache.configure(id_cache_options{});
+
+    cache.put(1, "one", 10, cache.generation());
+    cache.put(2, "two", 10, cache.generation());
+
+    auto generation = cache.generation();
+    cache.erase(1);
+    REQUIRE(!cache.get(1));
+    REQUIRE(cache.get(2));
+
+    cache.put(1, "stale", 10, generation);
+    REQUIRE(!cache.get(1));
+
+    generation = cache.generation();
+    cache.clear();
+    REQUIRE(cache.size() == 0);
+    cache.put(2, "stale", 10, generation);
+    REQUIRE(!cache.get(2));
+
+    cache.put(2, "fresh", 10, cache.generation());
+    REQUIRE(cache.get(2).value_or("") == "fresh");
+}
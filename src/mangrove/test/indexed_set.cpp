@@ -0,0 +1,164 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <mangrove/indexed_set.hpp>
+
+using namespace mangrove;
+
+using bsoncxx::stdx::nullopt;
+using bsoncxx::stdx::optional;
+
+class User {
+   public:
+    int age;
+    std::string name;
+    std::vector<std::string> tags;
+    optional<int> score;
+
+    MANGROVE_MAKE_KEYS(User, MANGROVE_NVP(age), MANGROVE_NVP(name), MANGROVE_NVP(tags),
+                       MANGROVE_NVP(score));
+};
+
+// A value that cannot be overwritten once it is sealed, so that an update of it throws for some
+// objects only.
+class Seal {
+   public:
+    int value;
+    bool sealed;
+
+    Seal(int value, bool sealed) : value(value), sealed(sealed) {
+    }
+
+    Seal(const Seal&) = default;
+    Seal(Seal&&) = default;
+    Seal& operator=(Seal&&) = default;
+
+    Seal& operator=(const Seal& other) {
+        if (sealed) {
+            throw std::logic_error("sealed");
+        }
+        value = other.value;
+        sealed = other.sealed;
+        return *this;
+    }
+};
+
+class Box {
+   public:
+    int id;
+    Seal seal;
+
+    MANGROVE_MAKE_KEYS(Box, MANGROVE_NVP(id), MANGROVE_NVP(seal));
+};
+
+TEST_CASE("indexed_set answers queries from secondary indexes.", "[mangrove::indexed_set]") {
+    indexed_set<User> users;
+    users.insert({30, "ann", {"admin"}, 5});
+    users.insert({25, "bob", {"dev", "ops"}, nullopt});
+    users.add_hash_index(MANGROVE_KEY(User::name));
+    users.add_ordered_index(MANGROVE_KEY(User::age));
+    users.add_hash_index(MANGROVE_KEY(User::tags));
+    users.add_ordered_index(MANGROVE_KEY(User::score));
+    users.insert({40, "cat", {"dev"}, 7});
+    users.insert({35, "dan", {}, 1});
+    REQUIRE(users.size() == 4);
+
+    SECTION("Test choosing an index.") {
+        auto plan = users.explain(MANGROVE_KEY(User::name) == "bob");
+        REQUIRE(plan.stage == "IXSCAN");
+        REQUIRE(plan.index_field == "name");
+        REQUIRE(plan.index_type == "hash");
+        REQUIRE(plan.examined == 1);
+
+        plan = users.explain(MANGROVE_KEY(User::age) >= 35);
+        REQUIRE(plan.index_field == "age");
+        REQUIRE(plan.examined == 2);
+
+        // A hash index cannot answer range queries.
+        plan = users.explain(MANGROVE_KEY(User::name) > "b");
+        REQUIRE(plan.stage == "COLLSCAN");
+        REQUIRE(plan.examined == 4);
+
+        // The index that yields the fewest candidates is chosen among the clauses of a
+        // conjunction, but a disjunction is always answered by a scan.
+        plan = users.explain(MANGROVE_KEY(User::age) > 20 && MANGROVE_KEY(User::name) == "cat");
+        REQUIRE(plan.index_field == "name");
+        plan = users.explain((MANGROVE_KEY(User::age) < 28, MANGROVE_KEY(User::tags) == "dev"));
+        REQUIRE(plan.index_field == "age");
+        plan = users.explain(MANGROVE_KEY(User::age) > 20 || MANGROVE_KEY(User::name) == "cat");
+        REQUIRE(plan.stage == "COLLSCAN");
+    }
+
+    SECTION("Test queries.") {
+        REQUIRE(users.find_one(MANGROVE_KEY(User::name) == "cat")->age == 40);
+        REQUIRE(users.count(MANGROVE_KEY(User::age) < 35) == 2);
+        REQUIRE(users.count(MANGROVE_KEY(User::age) <= 35) == 3);
+        REQUIRE(users.count(MANGROVE_KEY(User::age) > 35) == 1);
+        REQUIRE(users.count(MANGROVE_KEY(User::tags) == "dev") == 2);
+        REQUIRE(users.count(MANGROVE_KEY(User::score) > 2) == 2);
+        REQUIRE(users.count(MANGROVE_KEY(User::name).in(std::vector<std::string>{"ann", "dan"})) ==
+                2);
+        REQUIRE(users.count(MANGROVE_KEY(User::age) > 20 && MANGROVE_KEY(User::name) == "ann") ==
+                1);
+        REQUIRE(users.count(MANGROVE_KEY(User::age) > 30 && MANGROVE_KEY(User::name) == "ann") ==
+                0);
+        REQUIRE(users.find(MANGROVE_KEY(User::name) != "ann").size() == 3);
+    }
+
+    SECTION("Test keeping indexes up to date.") {
+        REQUIRE(users.update(MANGROVE_KEY(User::name) == "bob", MANGROVE_KEY(User::age) = 50) == 1);
+        REQUIRE(users.count(MANGROVE_KEY(User::age) == 25) == 0);
+        REQUIRE(users.find_one(MANGROVE_KEY(User::age) == 50)->name == "bob");
+
+        REQUIRE(users.update(MANGROVE_KEY(User::tags) == "dev",
+                             MANGROVE_KEY(User::tags).pull("dev")) == 2);
+        REQUIRE(users.count(MANGROVE_KEY(User::tags) == "dev") == 0);
+        REQUIRE(users.count(MANGROVE_KEY(User::tags) == "ops") == 1);
+
+        REQUIRE(users.erase(MANGROVE_KEY(User::age) > 45) == 1);
+        REQUIRE(users.size() == 3);
+        REQUIRE(!users.find_one(MANGROVE_KEY(User::name) == "bob"));
+
+        users.insert({20, "eve", {"ops"}, nullopt});
+        REQUIRE(users.find_one(MANGROVE_KEY(User::tags) == "ops")->name == "eve");
+
+        users.clear();
+        REQUIRE(users.size() == 0);
+        REQUIRE(users.count(MANGROVE_KEY(User::age) > 0) == 0);
+    }
+}
+
+TEST_CASE("indexed_set leaves objects and indexes unchanged if an update throws.",
+          "[mangrove::indexed_set]") {
+    indexed_set<Box> boxes;
+    boxes.add_ordered_index(MANGROVE_KEY(Box::id));
+    boxes.insert({1, {0, false}});
+    boxes.insert({2, {0, true}});
+    boxes.insert({3, {0, false}});
+
+    // The update applies to the first box, then throws for the sealed one.
+    REQUIRE_THROWS_AS(
+        (boxes.update(MANGROVE_KEY(Box::id) > 0,
+                      (MANGROVE_KEY(Box::id) += 10, MANGROVE_KEY(Box::seal) = Seal{5, false}))),
+        std::logic_error);
+    REQUIRE(boxes.count(MANGROVE_KEY(Box::id) > 10) == 0);
+    REQUIRE(boxes.count(MANGROVE_KEY(Box::id) < 10) == 3);
+    REQUIRE(boxes.find_one(MANGROVE_KEY(Box::id) == 1)->seal.value == 0);
+}
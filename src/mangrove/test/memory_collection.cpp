@@ -0,0 +1,202 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <mongocxx/options/find.hpp>
+#include <mongocxx/options/find_one_and_replace.hpp>
+#include <mongocxx/options/find_one_and_update.hpp>
+#include <mongocxx/options/update.hpp>
+#include <mongocxx/stdx.hpp>
+
+#include <boson/mapping_functions.hpp>
+#include <mangrove/memory_collection.hpp>
+#include <mangrove/query_builder.hpp>
+
+using namespace mangrove;
+
+class Item {
+   public:
+    int a;
+    std::string name;
+    std::vector<int> tags;
+
+    MANGROVE_MAKE_KEYS(Item, MANGROVE_NVP(a), MANGROVE_NVP(name), MANGROVE_NVP(tags));
+
+    bool operator==(const Item& rhs) const {
+        return (a == rhs.a) && (name == rhs.name) && (tags == rhs.tags);
+    }
+};
+
+class Entry {
+   public:
+    int _id;
+    std::string name;
+
+    MANGROVE_MAKE_KEYS_MODEL(Entry, MANGROVE_NVP(name));
+};
+
+// Reads the results of a find() in order.
+template <typename T>
+std::vector<T> read_all(memory_cursor<T> cursor) {
+    return std::vector<T>(cursor.begin(), cursor.end());
+}
+
+TEST_CASE("memory_collection evaluates queries and updates in process.",
+          "[mangrove::memory_collection]") {
+    memory_collection<Item> items;
+    auto res = items.insert_many(std::vector<Item>{
+        {3, "c", {1}}, {1, "a", {1, 2}}, {2, "b", {}}, {4, "d", {2, 3}}, {5, "a", {}}});
+    REQUIRE(res);
+    REQUIRE(res->inserted_count() == 5);
+    REQUIRE(items.count() == 5);
+
+    SECTION("Test finding objects.") {
+        auto found = read_all(items.find(MANGROVE_KEY(Item::a) > 2));
+        REQUIRE(found.size() == 3);
+        REQUIRE(found[0].a == 3);
+        REQUIRE(read_all(items.find({})).size() == 5);
+
+        int count = 0;
+        for (Item item : items.find(MANGROVE_KEY(Item::name) == "a")) {
+            REQUIRE(item.name == "a");
+            count++;
+        }
+        REQUIRE(count == 2);
+
+        mongocxx::options::find options;
+        options.skip(1).limit(2);
+        auto sorted = read_all(
+            items.find(MANGROVE_KEY(Item::a) > 1, MANGROVE_KEY(Item::a).sort(false), options));
+        REQUIRE(sorted.size() == 2);
+        REQUIRE(sorted[0].a == 4);
+        REQUIRE(sorted[1].a == 3);
+
+        auto one = items.find_one(MANGROVE_KEY(Item::name) == "a");
+        REQUIRE(one);
+        REQUIRE(one->a == 1);
+        REQUIRE(items.find_one(MANGROVE_KEY(Item::name) == "a", options)->a == 5);
+        REQUIRE(!items.find_one(MANGROVE_KEY(Item::name) == "z"));
+
+        // Without a server, results can only be ordered by sort expressions.
+        mongocxx::options::find sort_options;
+        sort_options.sort(bsoncxx::document::view{});
+        REQUIRE_THROWS_AS(items.find(sort_options), std::logic_error);
+
+        REQUIRE(items.count(MANGROVE_KEY(Item::tags) == 2) == 2);
+    }
+
+    SECTION("Test updating and replacing objects.") {
+        auto update =
+            items.update_many(MANGROVE_KEY(Item::name) == "a", MANGROVE_KEY(Item::a) += 10);
+        REQUIRE(update->matched_count() == 2);
+        REQUIRE(update->modified_count() == 2);
+        REQUIRE(items.count(MANGROVE_KEY(Item::a) > 10) == 2);
+
+        // An update that leaves the object unchanged does not count as a modification.
+        update = items.update_one(MANGROVE_KEY(Item::a) == 2, MANGROVE_KEY(Item::name) = "b");
+        REQUIRE(update->matched_count() == 1);
+        REQUIRE(update->modified_count() == 0);
+
+        auto original = items.find_one_and_update(MANGROVE_KEY(Item::a) == 2,
+                                                  MANGROVE_KEY(Item::tags).push(7));
+        REQUIRE(original);
+        REQUIRE(original->tags.empty());
+        REQUIRE((items.find_one(MANGROVE_KEY(Item::a) == 2)->tags == std::vector<int>{7}));
+
+        mongocxx::options::find_one_and_update update_options;
+        update_options.return_document(mongocxx::options::return_document::k_after);
+        auto updated = items.find_one_and_update(MANGROVE_KEY(Item::a) == 2,
+                                                 MANGROVE_KEY(Item::tags).push(8), update_options);
+        REQUIRE(updated);
+        REQUIRE((updated->tags == std::vector<int>{7, 8}));
+
+        mongocxx::options::find_one_and_replace replace_options;
+        replace_options.return_document(mongocxx::options::return_document::k_after);
+        auto replaced =
+            items.find_one_and_replace(MANGROVE_KEY(Item::a) == 3, {6, "f", {}}, replace_options);
+        REQUIRE(replaced);
+        REQUIRE(replaced->a == 6);
+        REQUIRE(!items.find_one(MANGROVE_KEY(Item::a) == 3));
+
+        auto replace = items.replace_one(MANGROVE_KEY(Item::a) == 100, {7, "g", {}});
+        REQUIRE(replace->matched_count() == 0);
+        mongocxx::options::update upsert;
+        upsert.upsert(true);
+        replace = items.replace_one(MANGROVE_KEY(Item::a) == 100, {7, "g", {}}, upsert);
+        REQUIRE(replace->inserted_count() == 1);
+        REQUIRE(items.count() == 6);
+    }
+
+    SECTION("An update that throws leaves the objects unchanged.") {
+        auto before = read_all(items.find());
+        // In each update, the first expression applies, but the one that depends on the query
+        // throws. The expressions refer to their fields, so they are built inline.
+        REQUIRE_THROWS_AS((items.update_many(MANGROVE_KEY(Item::name) == "a",
+                                             (MANGROVE_KEY(Item::a) += 10,
+                                              MANGROVE_KEY(Item::tags).first_match() = 9))),
+                          std::logic_error);
+        REQUIRE_THROWS_AS((items.update_one(MANGROVE_KEY(Item::a) == 1,
+                                            (MANGROVE_KEY(Item::a) += 10,
+                                             MANGROVE_KEY(Item::tags).first_match() = 9))),
+                          std::logic_error);
+        REQUIRE_THROWS_AS((items.find_one_and_update(MANGROVE_KEY(Item::a) == 1,
+                                                     (MANGROVE_KEY(Item::a) += 10,
+                                                      MANGROVE_KEY(Item::tags).first_match() = 9))),
+                          std::logic_error);
+        REQUIRE((read_all(items.find()) == before));
+    }
+
+    SECTION("Test deleting objects.") {
+        auto deleted = items.find_one_and_delete(MANGROVE_KEY(Item::a) == 4);
+        REQUIRE(deleted);
+        REQUIRE(deleted->name == "d");
+        REQUIRE(items.count() == 4);
+
+        REQUIRE(items.delete_one(MANGROVE_KEY(Item::name) == "a")->deleted_count() == 1);
+        REQUIRE(items.delete_many(MANGROVE_KEY(Item::a) < 4)->deleted_count() == 2);
+        REQUIRE((read_all(items.find()) == std::vector<Item>{{5, "a", {}}}));
+
+        items.drop();
+        REQUIRE(items.count() == 0);
+    }
+}
+
+TEST_CASE("memory_collection rejects objects with a duplicate _id.",
+          "[mangrove::memory_collection]") {
+    memory_collection<Entry> entries;
+    entries.insert_one({1, "a"});
+
+    REQUIRE_THROWS_AS(entries.insert_one({1, "b"}), std::logic_error);
+    REQUIRE(entries.count() == 1);
+
+    // A duplicate within the inserted objects, or with a stored one, inserts none of them.
+    REQUIRE_THROWS_AS(entries.insert_many(std::vector<Entry>{{2, "b"}, {2, "c"}}),
+                      std::logic_error);
+    REQUIRE_THROWS_AS(entries.insert_many(std::vector<Entry>{{3, "c"}, {1, "d"}}),
+                      std::logic_error);
+    REQUIRE(entries.count() == 1);
+
+    mongocxx::options::update upsert;
+    upsert.upsert(true);
+    REQUIRE_THROWS_AS(entries.replace_one(MANGROVE_KEY(Entry::name) == "z", {1, "z"}, upsert),
+                      std::logic_error);
+
+    REQUIRE(entries.insert_many(std::vector<Entry>{{2, "b"}, {3, "c"}})->inserted_count() == 2);
+    REQUIRE(entries.count() == 3);
+}
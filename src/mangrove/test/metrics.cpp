@@ -0,0 +1,124 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include <bsoncxx/builder/core.hpp>
+
+#include <mangrove/metrics.hpp>
+
+using namespace mangrove;
+using std::chrono::microseconds;
+using std::chrono::nanoseconds;
+
+TEST_CASE("latency_histogram buckets durations with a bounded relative error.",
+          "[mangrove::metrics]") {
+    std::uint64_t durations[] = {0, 1, 7, 8, 15, 16, 1000, 123456789, std::uint64_t{1} << 40};
+    for (std::uint64_t ns : durations) {
+        auto index = latency_histogram::bucket_index(ns);
+        REQUIRE(latency_histogram::bucket_lower_bound(index) <= ns);
+        REQUIRE(ns < latency_histogram::bucket_upper_bound(index));
+        // Each bucket is at most an eighth as wide as the durations in it.
+        auto width = latency_histogram::bucket_upper_bound(index) -
+                     latency_histogram::bucket_lower_bound(index);
+        REQUIRE(width <= std::max<std::uint64_t>(ns / 8, 1));
+    }
+    std::size_t bucket_count = latency_histogram::k_bucket_count;
+    REQUIRE(latency_histogram::bucket_index(~std::uint64_t{0}) < bucket_count);
+
+    latency_histogram histogram;
+    for (int i = 1; i <= 100; ++i) {
+        histogram.record(microseconds(i));
+    }
+    auto snapshot = histogram.snapshot();
+    REQUIRE(snapshot.count == 100);
+    REQUIRE(snapshot.sum == microseconds(5050));
+    REQUIRE(snapshot.mean() == nanoseconds(50500));
+
+    auto p50 = snapshot.percentile(0.5);
+    REQUIRE(p50 >= microseconds(50));
+    REQUIRE(p50 < microseconds(57));
+    auto p99 = snapshot.percentile(0.99);
+    REQUIRE(p99 >= microseconds(99));
+    REQUIRE(p99 < microseconds(112));
+    REQUIRE(snapshot.percentile(1) >= microseconds(100));
+}
+
+TEST_CASE("operation_timer records an operation once, and only while metrics are enabled.",
+          "[mangrove::metrics]") {
+    model_metrics metrics;
+
+    { details::operation_timer timer(&metrics, operation::find_one); }
+    REQUIRE(metrics.snapshot()[operation::find_one].calls == 0);
+
+    metrics.enable();
+    {
+        details::operation_timer timer(&metrics, operation::insert);
+        auto doc = timer.encode([]() {
+            auto builder = bsoncxx::builder::core(false);
+            builder.key_view("x").append(std::int32_t{1});
+            return builder.extract_document();
+        });
+        REQUIRE(doc.view().length() == 12);
+        REQUIRE(timer.decode(40, []() { return 5; }) == 5);
+        timer.skipped();
+
+        // Moving the timer, as a cursor does, does not record the operation twice.
+        details::operation_timer moved(std::move(timer));
+    }
+
+    auto snapshot = metrics.snapshot();
+    const auto& insert = snapshot[operation::insert];
+    REQUIRE(insert.calls == 1);
+    REQUIRE(insert.latency.count == 1);
+    REQUIRE(insert.bytes_encoded == 12);
+    REQUIRE(insert.bytes_decoded == 40);
+    REQUIRE(insert.documents_decoded == 1);
+    REQUIRE(insert.documents_skipped == 1);
+    REQUIRE(insert.total_time >= insert.encode_time + insert.decode_time);
+    REQUIRE(insert.server_time() >= nanoseconds(0));
+    REQUIRE(snapshot[operation::find].calls == 0);
+
+    metrics.reset();
+    REQUIRE(metrics.snapshot()[operation::insert].calls == 0);
+}
+
+TEST_CASE("write_prometheus writes the operations that were called.", "[mangrove::metrics]") {
+    model_metrics metrics;
+    metrics.enable();
+    { details::operation_timer timer(&metrics, operation::remove); }
+
+    std::ostringstream os;
+    write_prometheus(os, {{"users", metrics.snapshot()}});
+    auto text = os.str();
+
+    REQUIRE(text.find("# TYPE mangrove_operations_total counter\n") != std::string::npos);
+    REQUIRE(text.find("mangrove_operations_total{model=\"users\",operation=\"delete\"} 1\n") !=
+            std::string::npos);
+    REQUIRE(text.find("operation=\"find\"") == std::string::npos);
+    REQUIRE(text.find("# TYPE mangrove_operation_duration_seconds histogram\n") !=
+            std::string::npos);
+    REQUIRE(text.find("mangrove_operation_duration_seconds_bucket{model=\"users\","
+                      "operation=\"delete\",le=\"+Inf\"} 1\n") != std::string::npos);
+    REQUIRE(text.find("mangrove_operation_duration_seconds_count{model=\"users\","
+                      "operation=\"delete\"} 1\n") != std::string::npos);
+}
@@ -14,12 +14,19 @@
 
 #include "catch.hpp"
 
+#include <algorithm>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
 #include <bsoncxx/builder/stream/document.hpp>
 
 #include <boson/stdx/optional.hpp>
 
 #include <mongocxx/client.hpp>
 #include <mongocxx/instance.hpp>
+#include <mongocxx/pool.hpp>
 
 #include <mangrove/macros.hpp>
 #include <mangrove/model.hpp>
@@ -467,3 +474,246 @@ TEST_CASE(
 
     REQUIRE(DataA::count(MANGROVE_KEY(DataA::y) == 229) == 2);
 }
+
+TEST_CASE("the model base class allows atomically updating and reading a single document.",
+          "[mangrove::model]") {
+    mongocxx::instance{};
+    mongocxx::client conn{mongocxx::uri{}};
+
+    auto db = conn["mangrove_model_test"];
+
+    DataA::setCollection(db["data_a"]);
+    DataA::drop();
+
+    DataA single;
+    single.x = 1;
+    single.y = 2;
+    single.z = 3.0;
+    single.save();
+
+    auto before = DataA::find_one_and_update(MANGROVE_KEY(DataA::x) == 1,
+                                             MANGROVE_KEY(DataA::y) += 1);
+    REQUIRE(before);
+    REQUIRE(before->y == 2);
+    REQUIRE(before->getID() == single.getID());
+
+    mongocxx::options::find_one_and_update opts;
+    opts.return_document(mongocxx::options::return_document::k_after);
+    auto after = DataA::find_one_and_update(MANGROVE_KEY(DataA::x) == 1,
+                                            MANGROVE_KEY(DataA::y) += 1, opts);
+    REQUIRE(after);
+    REQUIRE(after->y == 4);
+
+    REQUIRE(!DataA::find_one_and_update(MANGROVE_KEY(DataA::x) == 2,
+                                        MANGROVE_KEY(DataA::y) += 1));
+}
+
+TEST_CASE("the model base class allows finding documents by _id through the identity cache.",
+          "[mangrove::model]") {
+    mongocxx::instance{};
+    mongocxx::client conn{mongocxx::uri{}};
+
+    auto db = conn["mangrove_model_test"];
+
+    DataA::setCollection(db["data_a"]);
+    DataA::drop();
+    DataA::enable_id_cache(mangrove::id_cache_options{}.max_entries(16));
+
+    DataA a;
+    a.x = 1;
+    a.y = 2;
+    a.z = 3.0;
+    a.save();
+
+    auto id_filter = bsoncxx::builder::stream::document{} << "_id" << a.getID()
+                                                          << bsoncxx::builder::stream::finalize;
+
+    auto result = DataA::find_by_id(a.getID());
+    REQUIRE(result);
+    REQUIRE(a == *result);
+
+    // Changes made directly through the collection are not seen while the object is cached.
+    db["data_a"].update_one(id_filter.view(), (MANGROVE_KEY(DataA::x) = 5));
+    result = DataA::find_by_id(a.getID());
+    REQUIRE(result);
+    REQUIRE(result->x == 1);
+
+    // Writes made through the model invalidate the cached object.
+    DataA::update_many({}, MANGROVE_KEY(DataA::y) = 7);
+    result = DataA::find_by_id(a.getID());
+    REQUIRE(result);
+    REQUIRE(result->x == 5);
+    REQUIRE(result->y == 7);
+
+    a.x = 8;
+    a.save();
+    result = DataA::find_by_id(a.getID());
+    REQUIRE(result);
+    REQUIRE(result->x == 8);
+
+    a.remove();
+    REQUIRE(!DataA::find_by_id(a.getID()));
+
+    DataA::disable_id_cache();
+}
+
+TEST_CASE("the model base class allows finding many documents by _id in batches.",
+          "[mangrove::model]") {
+    mongocxx::instance{};
+    mongocxx::client conn{mongocxx::uri{}};
+
+    auto db = conn["mangrove_model_test"];
+
+    DataA::setCollection(db["data_a"]);
+    DataA::drop();
+
+    std::vector<bsoncxx::oid> ids;
+    for (int i = 0; i < 5; i++) {
+        DataA a;
+        a.x = i;
+        a.y = 0;
+        a.z = 0.0;
+        a.save();
+        ids.push_back(a.getID());
+    }
+
+    // Ask for the objects out of order, with a duplicate and an id that does not exist, in
+    // chunks of two ids.
+    std::vector<bsoncxx::oid> wanted{ids[3], bsoncxx::oid{}, ids[0], ids[4], ids[3], ids[1]};
+    auto results = DataA::find_by_ids(wanted, 2);
+    REQUIRE(results.size() == wanted.size());
+    REQUIRE(results[0]->x == 3);
+    REQUIRE(!results[1]);
+    REQUIRE(results[2]->x == 0);
+    REQUIRE(results[3]->x == 4);
+    REQUIRE(results[4]->x == 3);
+    REQUIRE(results[5]->x == 1);
+
+    auto by_id = DataA::find_map_by_ids(wanted);
+    REQUIRE(by_id.size() == 4);
+    REQUIRE(by_id.at(ids[4]).x == 4);
+    REQUIRE(by_id.count(ids[2]) == 0);
+
+    // With a pool, the chunks are fetched concurrently.
+    mongocxx::pool pool{mongocxx::uri{}};
+    auto pooled = DataA::find_map_by_ids(pool, "mangrove_model_test", wanted, 1);
+    REQUIRE(pooled.size() == 4);
+    for (const auto& entry : by_id) {
+        REQUIRE(pooled.at(entry.first).x == entry.second.x);
+    }
+    REQUIRE(pooled.count(ids[2]) == 0);
+}
+
+TEST_CASE("the model base class allows finding the distinct values of a field.",
+          "[mangrove::model]") {
+    mongocxx::instance{};
+    mongocxx::client conn{mongocxx::uri{}};
+
+    auto db = conn["mangrove_model_test"];
+
+    DataA::setCollection(db["data_a"]);
+    DataA::drop();
+
+    for (int i = 0; i < 6; i++) {
+        DataA a;
+        a.x = i % 3;
+        a.y = i;
+        a.z = 0.5;
+        a.save();
+    }
+
+    auto xs = DataA::distinct(MANGROVE_KEY(DataA::x));
+    std::sort(xs.begin(), xs.end());
+    REQUIRE(xs == (std::vector<int32_t>{0, 1, 2}));
+
+    xs = DataA::distinct(MANGROVE_KEY(DataA::x), MANGROVE_KEY(DataA::y) >= 4);
+    std::sort(xs.begin(), xs.end());
+    REQUIRE(xs == (std::vector<int32_t>{0, 1}));
+
+    REQUIRE(DataA::distinct(MANGROVE_KEY(DataA::z)) == std::vector<double>{0.5});
+    REQUIRE(DataA::distinct(MANGROVE_KEY(DataA::x), MANGROVE_KEY(DataA::y) > 10).empty());
+}
+
+TEST_CASE("the model base class allows scanning a collection with concurrent cursors.",
+          "[mangrove::model]") {
+    mongocxx::instance::current();
+    mongocxx::pool pool{mongocxx::uri{}};
+    mongocxx::client conn{mongocxx::uri{}};
+
+    auto db = conn["mangrove_model_test"];
+
+    DataA::setCollection(db["data_a"]);
+    DataA::drop();
+
+    for (int i = 0; i < 200; i++) {
+        DataA a;
+        a.x = i;
+        a.y = i % 2;
+        a.z = 0.0;
+        a.save();
+    }
+
+    std::mutex mutex;
+    std::set<std::size_t> partitions;
+    std::vector<int32_t> xs;
+    DataA::parallel_scan(pool, "mangrove_model_test", MANGROVE_KEY(DataA::y) == 1, 4,
+                         [&](std::size_t partition, DataA a) {
+                             std::lock_guard<std::mutex> lock(mutex);
+                             partitions.insert(partition);
+                             xs.push_back(a.x);
+                         });
+
+    // Every matching object is passed exactly once, whichever partition it falls in.
+    std::sort(xs.begin(), xs.end());
+    REQUIRE(xs.size() == 100);
+    REQUIRE(std::adjacent_find(xs.begin(), xs.end()) == xs.end());
+    REQUIRE(std::all_of(xs.begin(), xs.end(), [](int32_t x) { return x % 2 == 1; }));
+    REQUIRE(partitions.size() > 1);
+    REQUIRE(*partitions.rbegin() < 4);
+
+    REQUIRE_THROWS_AS(DataA::parallel_scan(pool, "mangrove_model_test", {}, 2,
+                                           [](std::size_t, DataA) {
+                                               throw std::runtime_error("stop");
+                                           }),
+                      std::runtime_error);
+}
+
+TEST_CASE("the model base class records metrics of its operations once they are enabled.",
+          "[mangrove::model]") {
+    mongocxx::instance::current();
+    mongocxx::client conn{mongocxx::uri{}};
+
+    auto db = conn["mangrove_model_test"];
+
+    DataA::setCollection(db["data_a"]);
+    DataA::drop();
+    DataA::metrics().reset();
+    DataA::metrics().enable();
+
+    for (int i = 0; i < 3; i++) {
+        DataA a;
+        a.x = i;
+        a.y = 0;
+        a.z = 0.0;
+        a.save();
+    }
+    std::size_t found = 0;
+    for (DataA a : DataA::find({})) {
+        (void)a;
+        ++found;
+    }
+    REQUIRE(found == 3);
+    REQUIRE(DataA::count() == 3);
+
+    DataA::metrics().disable();
+    REQUIRE(DataA::count() == 3);
+
+    auto snapshot = DataA::metrics().snapshot();
+    REQUIRE(snapshot[mangrove::operation::update].calls == 3);
+    REQUIRE(snapshot[mangrove::operation::update].bytes_encoded > 0);
+    REQUIRE(snapshot[mangrove::operation::find].calls == 1);
+    REQUIRE(snapshot[mangrove::operation::find].documents_decoded == 3);
+    REQUIRE(snapshot[mangrove::operation::find].bytes_decoded > 0);
+    REQUIRE(snapshot[mangrove::operation::count].calls == 1);
+    REQUIRE(snapshot[mangrove::operation::insert].calls == 0);
+}
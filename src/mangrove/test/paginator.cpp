@@ -0,0 +1,197 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/oid.hpp>
+#include <mongocxx/client.hpp>
+#include <mongocxx/instance.hpp>
+
+#include <boson/stdx/optional.hpp>
+#include <mangrove/model.hpp>
+#include <mangrove/paginator.hpp>
+#include <mangrove/query_builder.hpp>
+
+using namespace mangrove;
+
+class Entry : public model<Entry> {
+   public:
+    std::string author;
+    int score;
+
+    MANGROVE_MAKE_KEYS_MODEL(Entry, MANGROVE_NVP(author), MANGROVE_NVP(score))
+
+    bsoncxx::oid getID() const {
+        return _id;
+    }
+};
+
+TEST_CASE("a paginator returns every object exactly once, in sort order.",
+          "[mangrove::paginator]") {
+    mongocxx::instance::current();
+    mongocxx::client conn{mongocxx::uri{}};
+    auto coll = conn["mangrove_paginator_test"]["entries"];
+    coll.drop();
+
+    Entry::setCollection(coll);
+    // Several entries share a score, so that pages can only be split by the _id tiebreaker.
+    for (int i = 0; i < 10; ++i) {
+        Entry e;
+        e.author = i % 2 ? "ann" : "bob";
+        e.score = i / 3;
+        e.save();
+    }
+
+    auto by_score = [&coll]() {
+        return paginator<Entry>(coll, 3, MANGROVE_KEY(Entry::score).sort(false));
+    };
+
+    SECTION("Pages follow the sort keys and the _id tiebreaker.") {
+        auto pages = by_score();
+        std::vector<Entry> seen;
+        std::size_t page_count = 0;
+        while (pages.has_next()) {
+            auto page = pages.next_page();
+            REQUIRE(page.size() <= 3);
+            seen.insert(seen.end(), page.begin(), page.end());
+            ++page_count;
+        }
+        REQUIRE(page_count == 4);
+        REQUIRE(seen.size() == 10);
+        for (std::size_t i = 1; i < seen.size(); ++i) {
+            REQUIRE(seen[i - 1].score >= seen[i].score);
+            if (seen[i - 1].score == seen[i].score) {
+                REQUIRE(seen[i - 1].getID() < seen[i].getID());
+            }
+        }
+        REQUIRE(pages.next_page().empty());
+    }
+
+    SECTION("A filter restricts the pages.") {
+        auto pages = by_score();
+        pages.filter(MANGROVE_KEY(Entry::author) == "ann");
+        std::size_t count = 0;
+        while (pages.has_next()) {
+            for (const auto &e : pages.next_page()) {
+                REQUIRE(e.author == "ann");
+                ++count;
+            }
+        }
+        REQUIRE(count == 5);
+    }
+
+    SECTION("A document that cannot be deserialized does not end the scan.") {
+        // A string sorts before numbers in descending order, so it lands in the first page.
+        using bsoncxx::builder::basic::kvp;
+        coll.insert_one(bsoncxx::builder::basic::make_document(kvp("author", "eve"),
+                                                               kvp("score", "high")));
+        auto pages = by_score();
+        std::size_t count = 0;
+        while (pages.has_next()) {
+            count += pages.next_page().size();
+        }
+        REQUIRE(count == 10);
+    }
+
+    SECTION("A resume token continues a scan in another paginator.") {
+        auto first = by_score();
+        REQUIRE(first.resume_token().empty());
+        auto page = first.next_page();
+        auto token = first.resume_token();
+        REQUIRE(!token.empty());
+
+        auto second = by_score();
+        second.resume(token);
+        auto expected = first.next_page();
+        auto resumed = second.next_page();
+        REQUIRE(resumed.size() == expected.size());
+        for (std::size_t i = 0; i < resumed.size(); ++i) {
+            REQUIRE(resumed[i].getID() == expected[i].getID());
+        }
+    }
+}
+
+class Rated : public model<Rated> {
+   public:
+    boson::stdx::optional<int> rating;
+
+    MANGROVE_MAKE_KEYS_MODEL(Rated, MANGROVE_NVP(rating))
+
+    bsoncxx::oid getID() const {
+        return _id;
+    }
+};
+
+TEST_CASE("a paginator pages through objects in which a sort field is missing.",
+          "[mangrove::paginator]") {
+    mongocxx::instance::current();
+    mongocxx::client conn{mongocxx::uri{}};
+    auto coll = conn["mangrove_paginator_test"]["rated"];
+    coll.drop();
+
+    // Missing ratings sort before all others, and pages must not stop at them.
+    Rated::setCollection(coll);
+    for (int i = 0; i < 9; ++i) {
+        Rated r;
+        if (i % 3 != 0) {
+            r.rating = i % 4;
+        }
+        r.save();
+    }
+
+    for (bool ascending : {true, false}) {
+        paginator<Rated> pages(coll, 2, MANGROVE_KEY(Rated::rating).sort(ascending));
+        std::vector<Rated> seen;
+        while (pages.has_next()) {
+            auto page = pages.next_page();
+            seen.insert(seen.end(), page.begin(), page.end());
+        }
+
+        REQUIRE(seen.size() == 9);
+        for (std::size_t i = 1; i < seen.size(); ++i) {
+            const auto &lower = ascending ? seen[i - 1] : seen[i];
+            const auto &higher = ascending ? seen[i] : seen[i - 1];
+            // An empty optional compares less than any value, as a missing field sorts first.
+            bool ordered = lower.rating <= higher.rating;
+            REQUIRE(ordered);
+            if (lower.rating == higher.rating) {
+                REQUIRE(seen[i - 1].getID() < seen[i].getID());
+            }
+        }
+    }
+}
+
+TEST_CASE("a paginator rejects invalid arguments and resume tokens.", "[mangrove::paginator]") {
+    mongocxx::instance::current();
+    mongocxx::client conn{mongocxx::uri{}};
+    auto coll = conn["mangrove_paginator_test"]["entries"];
+
+    REQUIRE_THROWS_AS(paginator<Entry>(coll, 0), std::logic_error);
+
+    paginator<Entry> pages(coll, 5, MANGROVE_KEY(Entry::score).sort(true));
+    REQUIRE_THROWS_AS(pages.resume("not a token"), std::invalid_argument);
+    // An empty document is valid BSON, but does not hold a value for each sort key.
+    REQUIRE_THROWS_AS(pages.resume("0500000000"), std::invalid_argument);
+
+    REQUIRE_NOTHROW(pages.resume(""));
+    REQUIRE(pages.resume_token().empty());
+    REQUIRE(pages.has_next());
+}
@@ -0,0 +1,87 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <bsoncxx/builder/core.hpp>
+#include <mongocxx/stdx.hpp>
+
+#include <boson/mapping_functions.hpp>
+#include <mangrove/prepared_query.hpp>
+#include <mangrove/query_builder.hpp>
+
+using namespace mangrove;
+
+class Account {
+   public:
+    int age;
+    std::string name;
+    std::vector<int> tags;
+
+    MANGROVE_MAKE_KEYS(Account, MANGROVE_NVP(age), MANGROVE_NVP(name), MANGROVE_NVP(tags));
+};
+
+// Serializes an expression the way it would be sent to the server without preparing it.
+template <typename Expr>
+bsoncxx::document::value serialize(const Expr& expr) {
+    auto builder = bsoncxx::builder::core(false);
+    expr.append_to_bson(builder);
+    return builder.extract_document();
+}
+
+TEST_CASE("Prepared queries patch operands into a cached skeleton.",
+          "[mangrove::prepared_query]") {
+    SECTION("Test fixed-size operands.") {
+        auto query = prepare(MANGROVE_KEY(Account::age) > 0 && MANGROVE_KEY(Account::age) <= 0);
+        REQUIRE(query.parameter_count() == 2);
+        REQUIRE(query.skeleton() ==
+                serialize(MANGROVE_KEY(Account::age) > 0 && MANGROVE_KEY(Account::age) <= 0));
+
+        std::vector<std::uint8_t> buffer;
+        REQUIRE(query.bind(buffer, 21, 65) ==
+                serialize(MANGROVE_KEY(Account::age) > 21 && MANGROVE_KEY(Account::age) <= 65));
+        REQUIRE(query(30, 40).view() ==
+                serialize(MANGROVE_KEY(Account::age) > 30 && MANGROVE_KEY(Account::age) <= 40));
+    }
+
+    SECTION("Test operands that change size.") {
+        auto query = prepare((MANGROVE_KEY(Account::name) == "" ||
+                              MANGROVE_KEY(Account::tags).in(std::vector<int>{})) &&
+                             MANGROVE_KEY(Account::age) != 0);
+        REQUIRE(query.parameter_count() == 3);
+
+        std::vector<std::uint8_t> buffer;
+        auto tags = std::vector<int>{1, 2, 3};
+        REQUIRE(query.bind(buffer, "Bartholomew", tags, 7) ==
+                serialize((MANGROVE_KEY(Account::name) == "Bartholomew" ||
+                           MANGROVE_KEY(Account::tags).in(tags)) &&
+                          MANGROVE_KEY(Account::age) != 7));
+
+        // The buffer can be re-used with smaller values.
+        REQUIRE(query.bind(buffer, std::string("Al"), std::vector<int>{}, 8) ==
+                serialize((MANGROVE_KEY(Account::name) == "Al" ||
+                           MANGROVE_KEY(Account::tags).in(std::vector<int>{})) &&
+                          MANGROVE_KEY(Account::age) != 8));
+    }
+
+    SECTION("Test binding the wrong number of operands.") {
+        auto query = prepare(MANGROVE_KEY(Account::age) == 0);
+        REQUIRE_THROWS_AS(query(1, 2), std::invalid_argument);
+    }
+}
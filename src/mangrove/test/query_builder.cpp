@@ -15,6 +15,7 @@
 #include "catch.hpp"
 
 #include <iostream>
+#include <stdexcept>
 
 #include <bsoncxx/builder/stream/document.hpp>
 #include <mongocxx/client.hpp>
@@ -43,6 +44,25 @@ class Point {
     }
 };
 
+// ODM classes whose nested field paths are too long to be stored inline in a name-value pair.
+class LongLeaf {
+   public:
+    int first_field_of_a_class_with_names_long_enough_to_overflow_the_inline_path;
+    int second_field_of_a_class_with_names_long_enough_to_overflow_the_inline_path;
+    MANGROVE_MAKE_KEYS(
+        LongLeaf,
+        MANGROVE_NVP(first_field_of_a_class_with_names_long_enough_to_overflow_the_inline_path),
+        MANGROVE_NVP(second_field_of_a_class_with_names_long_enough_to_overflow_the_inline_path));
+};
+
+class LongRoot {
+   public:
+    LongLeaf embedded_document_with_a_name_long_enough_to_overflow_the_inline_path;
+    MANGROVE_MAKE_KEYS(
+        LongRoot,
+        MANGROVE_NVP(embedded_document_with_a_name_long_enough_to_overflow_the_inline_path));
+};
+
 // An ODM class that inherits from model
 class Bar : public mangrove::model<Bar> {
    public:
@@ -163,6 +183,18 @@ TEST_CASE("Test nested member access.", "[mangrove::nvp_child]") {
         test_lambda(MANGROVE_CHILD(BarParent, b, p, x));
     }
 
+    SECTION("Nested field paths are built when the nvp is formed") {
+        // The path is stored in the child, so it remains valid after its parents are destroyed.
+        auto nvp_child = MANGROVE_CHILD(BarParent, b, p, x);
+        REQUIRE(nvp_child.get_name() == "b.p.x");
+        REQUIRE(nvp_child.key().size() == 5);
+
+        auto element = MANGROVE_KEY(Bar::arr)[12];
+        REQUIRE(element.get_name() == "arr.12");
+        REQUIRE(((MANGROVE_KEY(Bar::pts)[0]->*MANGROVE_KEY(Point::x)).get_name() == "pts.0.x"));
+        REQUIRE((MANGROVE_KEY(Bar::arr).first_match().get_name() == "arr.$"));
+    }
+
     SECTION("Test accessing nested members within optional") {
         REQUIRE((MANGROVE_KEY(OptionalWithChildren::pt)->*MANGROVE_KEY(Point::x)).get_name() ==
                 "pt.x");
@@ -264,6 +296,76 @@ TEST_CASE("Test keys with custom names") {
     REQUIRE(obj.x == 4);
 }
 
+// ODM classes whose fields are stored under short names.
+class ShortNamePoint {
+   public:
+    int x;
+    int y;
+    MANGROVE_MAKE_SHORT_KEYS(ShortNamePoint, MANGROVE_NVP(x), MANGROVE_NVP(y));
+};
+
+class ShortNameModel : public mangrove::model<ShortNameModel> {
+   public:
+    std::string name;
+    std::vector<ShortNamePoint> points;
+    MANGROVE_MAKE_SHORT_KEYS_MODEL(ShortNameModel, MANGROVE_NVP(name), MANGROVE_NVP(points));
+};
+
+TEST_CASE("Test keys with automatic short names", "[mangrove::nvp]") {
+    REQUIRE((MANGROVE_KEY(ShortNamePoint::x).get_name() == "a"));
+    REQUIRE((MANGROVE_KEY(ShortNamePoint::y).get_name() == "b"));
+    REQUIRE((MANGROVE_KEY(ShortNameModel::name).get_name() == "a"));
+    REQUIRE((MANGROVE_KEY(ShortNameModel::points).get_name() == "b"));
+    REQUIRE((MANGROVE_CHILD(ShortNameModel, points, x).get_name() == "b.a"));
+    REQUIRE((MANGROVE_KEY(ShortNameModel::points)[2]->*MANGROVE_KEY(ShortNamePoint::y))
+                .get_name() == "b.2.b");
+
+    auto names = mangrove::stored_field_names<ShortNameModel>();
+    REQUIRE(names == (std::vector<std::pair<std::string, std::string>>{
+                         {"_id", "_id"}, {"name", "a"}, {"points", "b"}}));
+    REQUIRE((mangrove::stored_field_names<Point>().front() ==
+             std::make_pair(std::string("x"), std::string("x"))));
+
+    ShortNameModel obj;
+    obj.name = "n";
+    obj.points = {{1, 2}};
+    auto doc = boson::to_document(obj);
+    REQUIRE(doc.view()["a"].get_utf8().value.to_string() == "n");
+    REQUIRE(doc.view()["b"][0]["b"].get_int32().value == 2);
+    REQUIRE(!doc.view()["name"]);
+
+    auto round_trip = boson::to_obj<ShortNameModel>(doc.view());
+    REQUIRE(round_trip.name == "n");
+    REQUIRE(round_trip.points[0].y == 2);
+
+    bsoncxx::document::view_or_value query = MANGROVE_KEY(ShortNameModel::name) == "n";
+    REQUIRE(query.view() == bsoncxx::from_json(R"({"a": {"$eq": "n"}})").view());
+    bsoncxx::document::view_or_value update = MANGROVE_CHILD(ShortNameModel, points, x) += 1;
+    REQUIRE(update.view() == bsoncxx::from_json(R"({"$inc": {"b.a": 1}})").view());
+    bsoncxx::document::view_or_value sort = MANGROVE_KEY(ShortNameModel::name).sort(false);
+    REQUIRE(sort.view() == bsoncxx::from_json(R"({"a": -1})").view());
+}
+
+class Shipment {
+   public:
+    int id;
+    boson::interned_string status;
+    MANGROVE_MAKE_KEYS(Shipment, MANGROVE_NVP(id), MANGROVE_NVP(status));
+};
+
+TEST_CASE("Test queries on interned string fields", "[mangrove::query_builder]") {
+    bsoncxx::document::view_or_value query = MANGROVE_KEY(Shipment::status) == "shipped";
+    REQUIRE(query.view() == bsoncxx::from_json(R"({"status": {"$eq": "shipped"}})").view());
+    bsoncxx::document::view_or_value in = MANGROVE_KEY(Shipment::status).in(
+        std::vector<boson::interned_string>{"shipped", "delivered"});
+    REQUIRE(in.view() ==
+            bsoncxx::from_json(R"({"status": {"$in": ["shipped", "delivered"]}})").view());
+
+    Shipment shipment{1, "shipped"};
+    REQUIRE(((MANGROVE_KEY(Shipment::status) == "shipped").matches(shipment)));
+    REQUIRE((!(MANGROVE_KEY(Shipment::status) == "delivered").matches(shipment)));
+}
+
 TEST_CASE("Test member array access") {
     // Nvp's must be used as temporary objects.
     REQUIRE((MANGROVE_KEY(Bar::arr)[1].get_name() == "arr.1"));
@@ -800,6 +902,118 @@ TEST_CASE("Query Builder", "[mangrove::query_builder]") {
     }
 }
 
+TEST_CASE("Query expressions can be evaluated against C++ objects.",
+          "[mangrove::query_builder::matches]") {
+    Bar b(444, 10, 2, false, "hello", {0, 1}, {4, 5, 6}, {{1, 2}, {3, 4}}, system_clock::now());
+    Bar no_x2(555, 1, stdx::nullopt, true, "goodbye", {1, 0}, {}, {}, system_clock::now());
+
+    SECTION("Test comparison operators.", "[mangrove::comparison_expr]") {
+        REQUIRE(((MANGROVE_KEY(Bar::x1) == 10).matches(b)));
+        REQUIRE((!(MANGROVE_KEY(Bar::x1) == 1).matches(b)));
+        REQUIRE(((MANGROVE_KEY(Bar::x1) > 9).matches(b)));
+        REQUIRE((!(MANGROVE_KEY(Bar::x1) > 10).matches(b)));
+        REQUIRE(((MANGROVE_KEY(Bar::x1) >= 10).matches(b)));
+        REQUIRE(((MANGROVE_KEY(Bar::x1) < 11).matches(b)));
+        REQUIRE(((MANGROVE_KEY(Bar::x1) <= 10).matches(b)));
+        REQUIRE(((MANGROVE_KEY(Bar::x1) != 1).matches(b)));
+        REQUIRE(((MANGROVE_KEY(Bar::z) == "hello").matches(b)));
+        REQUIRE(((MANGROVE_KEY(Bar::p) == Point{0, 1}).matches(b)));
+
+        // nested members, and members of documents in arrays
+        REQUIRE(((MANGROVE_KEY(Bar::p)->*MANGROVE_KEY(Point::y) == 1).matches(b)));
+        REQUIRE(((MANGROVE_KEY(Bar::pts)->*MANGROVE_KEY(Point::x) == 3).matches(b)));
+        REQUIRE((!(MANGROVE_KEY(Bar::pts)->*MANGROVE_KEY(Point::x) == 2).matches(b)));
+        REQUIRE(((MANGROVE_KEY(Bar::pts)[1]->*MANGROVE_KEY(Point::y) == 4).matches(b)));
+
+        // whole arrays, array elements, and elements by index
+        REQUIRE(((MANGROVE_KEY(Bar::arr) == std::vector<int>{4, 5, 6}).matches(b)));
+        REQUIRE(((MANGROVE_KEY(Bar::arr) == 5).matches(b)));
+        REQUIRE(((MANGROVE_KEY(Bar::arr) > 5).matches(b)));
+        REQUIRE((!(MANGROVE_KEY(Bar::arr) > 6).matches(b)));
+        REQUIRE(((MANGROVE_KEY(Bar::arr)[2] == 6).matches(b)));
+        REQUIRE((!(MANGROVE_KEY(Bar::arr)[3] == 6).matches(b)));
+        REQUIRE((!(MANGROVE_KEY(Bar::arr) != 5).matches(b)));
+
+        // Missing fields only match negated comparisons.
+        REQUIRE(((MANGROVE_KEY(Bar::x2) == 2).matches(b)));
+        REQUIRE((!(MANGROVE_KEY(Bar::x2) == 2).matches(no_x2)));
+        REQUIRE((!(MANGROVE_KEY(Bar::x2) < 2).matches(no_x2)));
+        REQUIRE(((MANGROVE_KEY(Bar::x2) != 2).matches(no_x2)));
+    }
+
+    SECTION("Test $exists, $in and $nin operators.") {
+        REQUIRE((MANGROVE_KEY(Bar::x2).exists(true).matches(b)));
+        REQUIRE((!MANGROVE_KEY(Bar::x2).exists(true).matches(no_x2)));
+        REQUIRE((MANGROVE_KEY(Bar::x2).exists(false).matches(no_x2)));
+
+        std::vector<int> values{1, 2, 3};
+        REQUIRE((MANGROVE_KEY(Bar::x2).in(values).matches(b)));
+        REQUIRE((!MANGROVE_KEY(Bar::x2).in(values).matches(no_x2)));
+        REQUIRE((!MANGROVE_KEY(Bar::x1).in(values).matches(b)));
+        REQUIRE((MANGROVE_KEY(Bar::x1).nin(values).matches(b)));
+        REQUIRE((MANGROVE_KEY(Bar::arr).in(std::vector<int>{6, 7}).matches(b)));
+        REQUIRE((!MANGROVE_KEY(Bar::arr).nin(std::vector<int>{6, 7}).matches(b)));
+    }
+
+    SECTION("Test $not and boolean expressions.") {
+        REQUIRE(((!(MANGROVE_KEY(Bar::x1) > 10)).matches(b)));
+        REQUIRE(((!(MANGROVE_KEY(Bar::x2) > 10)).matches(no_x2)));
+        REQUIRE(((MANGROVE_KEY(Bar::x1) == 10 && MANGROVE_KEY(Bar::y) == false).matches(b)));
+        REQUIRE((!(MANGROVE_KEY(Bar::x1) == 10 && MANGROVE_KEY(Bar::y) == true).matches(b)));
+        REQUIRE(((MANGROVE_KEY(Bar::x1) == 1 || MANGROVE_KEY(Bar::y) == false).matches(b)));
+        REQUIRE((!(MANGROVE_KEY(Bar::x1) == 1 || MANGROVE_KEY(Bar::y) == true).matches(b)));
+        REQUIRE((nor(MANGROVE_KEY(Bar::x1) == 1, MANGROVE_KEY(Bar::y) == true).matches(b)));
+        REQUIRE((!nor(MANGROVE_KEY(Bar::x1) == 10, MANGROVE_KEY(Bar::y) == true).matches(b)));
+        REQUIRE(((MANGROVE_KEY(Bar::x1) == 10, MANGROVE_KEY(Bar::w) == 444).matches(b)));
+        REQUIRE((!(MANGROVE_KEY(Bar::x1) == 10, MANGROVE_KEY(Bar::w) == 555).matches(b)));
+        REQUIRE((isolated(MANGROVE_KEY(Bar::x1) == 10).matches(b)));
+    }
+
+    SECTION("Test $mod and $regex operators.") {
+        REQUIRE((MANGROVE_KEY(Bar::w).mod(10, 4).matches(b)));
+        REQUIRE((!MANGROVE_KEY(Bar::w).mod(10, 5).matches(b)));
+        REQUIRE_THROWS_AS((MANGROVE_KEY(Bar::w).mod(0, 0).matches(b)), std::logic_error);
+        REQUIRE((MANGROVE_KEY(Bar::z).regex("^hel", "").matches(b)));
+        REQUIRE((MANGROVE_KEY(Bar::z).regex("^HEL", "i").matches(b)));
+        REQUIRE((!MANGROVE_KEY(Bar::z).regex("^HEL", "").matches(b)));
+        REQUIRE(((!MANGROVE_KEY(Bar::z).regex("^hel", "")).matches(no_x2)));
+    }
+
+    SECTION("Test array query operators.") {
+        REQUIRE((MANGROVE_KEY(Bar::arr).size(3).matches(b)));
+        REQUIRE((!MANGROVE_KEY(Bar::arr).size(3).matches(no_x2)));
+        REQUIRE((MANGROVE_KEY(Bar::arr).all(std::vector<int>{6, 4}).matches(b)));
+        REQUIRE((!MANGROVE_KEY(Bar::arr).all(std::vector<int>{4, 5, 6, 7}).matches(b)));
+        REQUIRE((MANGROVE_KEY(Bar::arr)
+                    .elem_match((MANGROVE_ELEM(Bar::arr) > 5, MANGROVE_ELEM(Bar::arr) < 7))
+                    .matches(b)));
+        REQUIRE((!MANGROVE_KEY(Bar::arr).elem_match(MANGROVE_ELEM(Bar::arr) > 6).matches(b)));
+        REQUIRE((MANGROVE_KEY(Bar::pts)
+                    .elem_match((MANGROVE_KEY(Point::x) > 2, MANGROVE_KEY(Point::y) > 3))
+                    .matches(b)));
+        // With elem_match, a single element must satisfy every condition. Without it, the
+        // conditions may be satisfied by different elements.
+        REQUIRE((!MANGROVE_KEY(Bar::pts)
+                     .elem_match((MANGROVE_KEY(Point::x) == 1, MANGROVE_KEY(Point::y) == 4))
+                     .matches(b)));
+        REQUIRE(((MANGROVE_KEY(Bar::pts)->*MANGROVE_KEY(Point::x) == 1,
+                 MANGROVE_KEY(Bar::pts)->*MANGROVE_KEY(Point::y) == 4)
+                    .matches(b)));
+    }
+
+    SECTION("Test bitwise query operators.") {
+        REQUIRE((MANGROVE_KEY(Bar::x1).bits_all_set(10).matches(b)));
+        REQUIRE((MANGROVE_KEY(Bar::x1).bits_all_set(1, 3).matches(b)));
+        REQUIRE((!MANGROVE_KEY(Bar::x1).bits_all_set(1, 2).matches(b)));
+        REQUIRE((MANGROVE_KEY(Bar::x1).bits_any_set(1, 2).matches(b)));
+        REQUIRE((!MANGROVE_KEY(Bar::x1).bits_any_set(12, 13).matches(b)));
+        REQUIRE((MANGROVE_KEY(Bar::x1).bits_all_clear(0, 2).matches(b)));
+        REQUIRE((!MANGROVE_KEY(Bar::x1).bits_all_clear(1, 2).matches(b)));
+        REQUIRE((MANGROVE_KEY(Bar::x1).bits_any_clear(21).matches(b)));
+        REQUIRE((!MANGROVE_KEY(Bar::x1).bits_any_clear(1, 3).matches(b)));
+    }
+}
+
 TEST_CASE("Query builder works with non-ODM class") {
     instance::current();
     client conn{uri{}};
@@ -1290,3 +1504,172 @@ TEST_CASE("Update Builder", "mangrove::update_expr") {
         REQUIRE((bar->arr == std::vector<int>{7, 1, 2, 3, 6, 5, 4}));
     }
 }
+
+TEST_CASE("Update expressions can be applied to C++ objects.",
+          "[mangrove::query_builder::apply]") {
+    Bar b(444, 10, 2, false, "hello", {0, 1}, {4, 5, 6}, {{9, 10}, {11, 12}}, system_clock::now());
+
+    SECTION("Test field update operators.", "[mangrove::update_expr]") {
+        (MANGROVE_KEY(Bar::z) = "goodbye").apply(b);
+        REQUIRE(b.z == "goodbye");
+
+        (MANGROVE_KEY(Bar::p)->*MANGROVE_KEY(Point::y) = 5).apply(b);
+        REQUIRE(b.p.y == 5);
+
+        (MANGROVE_KEY(Bar::pts)[1]->*MANGROVE_KEY(Point::x) = 1).apply(b);
+        REQUIRE((b.pts[1] == Point{1, 12}));
+
+        (MANGROVE_KEY(Bar::arr)[4] = 8).apply(b);
+        REQUIRE((b.arr == std::vector<int>{4, 5, 6, 0, 8}));
+
+        (MANGROVE_KEY(Bar::x1) += 5).apply(b);
+        REQUIRE(b.x1 == 15);
+        (MANGROVE_KEY(Bar::x1) -= 3).apply(b);
+        REQUIRE(b.x1 == 12);
+        (MANGROVE_KEY(Bar::x1)++).apply(b);
+        REQUIRE(b.x1 == 13);
+        (MANGROVE_KEY(Bar::x1) *= 2).apply(b);
+        REQUIRE(b.x1 == 26);
+        MANGROVE_KEY(Bar::x1).min(30).apply(b);
+        REQUIRE(b.x1 == 26);
+        MANGROVE_KEY(Bar::x1).min(20).apply(b);
+        REQUIRE(b.x1 == 20);
+        MANGROVE_KEY(Bar::x1).max(25).apply(b);
+        REQUIRE(b.x1 == 25);
+        MANGROVE_KEY(Bar::x1).set_on_insert(0).apply(b);
+        REQUIRE(b.x1 == 25);
+
+        (MANGROVE_KEY(Bar::x1) &= 12).apply(b);
+        REQUIRE(b.x1 == 8);
+        (MANGROVE_KEY(Bar::x1) |= 3).apply(b);
+        REQUIRE(b.x1 == 11);
+        (MANGROVE_KEY(Bar::x1) ^= 1).apply(b);
+        REQUIRE(b.x1 == 10);
+
+        // Several updates are applied in order.
+        (MANGROVE_KEY(Bar::y) = true, MANGROVE_KEY(Bar::x1) += 1).apply(b);
+        REQUIRE(b.y);
+        REQUIRE(b.x1 == 11);
+    }
+
+    SECTION("Test updates to optional fields.", "[mangrove::unset_expr]") {
+        MANGROVE_KEY(Bar::x2).unset().apply(b);
+        REQUIRE(!b.x2);
+        (MANGROVE_KEY(Bar::x2) += 5).apply(b);
+        REQUIRE(b.x2 == 5);
+        MANGROVE_KEY(Bar::x2).unset().apply(b);
+        (MANGROVE_KEY(Bar::x2) *= 5).apply(b);
+        REQUIRE(b.x2 == 0);
+        MANGROVE_KEY(Bar::x2).unset().apply(b);
+        MANGROVE_KEY(Bar::x2).max(-1).apply(b);
+        REQUIRE(b.x2 == -1);
+
+        OptionalWithChildren o;
+        (MANGROVE_KEY(OptionalWithChildren::pt)->*MANGROVE_KEY(Point::x) = 3).apply(o);
+        REQUIRE(o.pt);
+        REQUIRE(o.pt->x == 3);
+        MANGROVE_KEY(OptionalWithChildren::pts_vec).pull(Point{1, 2}).apply(o);
+        REQUIRE(!o.pts_vec);
+        MANGROVE_KEY(OptionalWithChildren::pts_vec).push(Point{1, 2}).apply(o);
+        REQUIRE((o.pts_vec == std::vector<Point>{{1, 2}}));
+    }
+
+    SECTION("Test $currentDate operator.", "[mangrove::current_date_expr]") {
+        b.t = system_clock::time_point{};
+        auto before = system_clock::now();
+        (MANGROVE_KEY(Bar::t) = mangrove::current_date).apply(b);
+        REQUIRE(b.t >= time_point_cast<milliseconds>(before));
+    }
+
+    SECTION("Test $pop, $pull and $pullAll operators.", "[mangrove::update_expr]") {
+        MANGROVE_KEY(Bar::arr).pop(true).apply(b);
+        REQUIRE((b.arr == std::vector<int>{4, 5}));
+        MANGROVE_KEY(Bar::arr).pop(false).apply(b);
+        REQUIRE((b.arr == std::vector<int>{5}));
+
+        b.arr = {4, 5, 6, 5};
+        MANGROVE_KEY(Bar::arr).pull(5).apply(b);
+        REQUIRE((b.arr == std::vector<int>{4, 6}));
+        MANGROVE_KEY(Bar::arr).pull(MANGROVE_KEY(Bar::arr).element() > 4).apply(b);
+        REQUIRE((b.arr == std::vector<int>{4}));
+        MANGROVE_KEY(Bar::pts).pull(MANGROVE_KEY(Point::x) > 10).apply(b);
+        REQUIRE((b.pts == std::vector<Point>{{9, 10}}));
+
+        std::vector<int> values{4, 7};
+        b.arr = {4, 5, 7, 4};
+        MANGROVE_KEY(Bar::arr).pull_all(values).apply(b);
+        REQUIRE((b.arr == std::vector<int>{5}));
+    }
+
+    SECTION("Test $addToSet and $push operators.", "[mangrove::push_update_expr]") {
+        MANGROVE_KEY(Bar::arr).add_to_set(4).apply(b);
+        REQUIRE((b.arr == std::vector<int>{4, 5, 6}));
+        std::vector<int> values{7, 4, 7};
+        MANGROVE_KEY(Bar::arr).add_to_set(values).apply(b);
+        REQUIRE((b.arr == std::vector<int>{4, 5, 6, 7}));
+
+        MANGROVE_KEY(Bar::arr).push(4).apply(b);
+        REQUIRE((b.arr == std::vector<int>{4, 5, 6, 7, 4}));
+
+        std::vector<int> more{1, 2};
+        MANGROVE_KEY(Bar::arr).push(more).position(1).apply(b);
+        REQUIRE((b.arr == std::vector<int>{4, 1, 2, 5, 6, 7, 4}));
+        MANGROVE_KEY(Bar::arr).push(more).sort(-1).slice(4).apply(b);
+        REQUIRE((b.arr == std::vector<int>{7, 6, 5, 4}));
+        MANGROVE_KEY(Bar::arr).push(more).slice(-3).apply(b);
+        REQUIRE((b.arr == std::vector<int>{4, 1, 2}));
+
+        std::vector<Point> pts{{10, 0}};
+        MANGROVE_KEY(Bar::pts).push(pts).sort(MANGROVE_KEY(Point::x).sort(false)).apply(b);
+        REQUIRE((b.pts == std::vector<Point>{{11, 12}, {10, 0}, {9, 10}}));
+    }
+
+    SECTION("Updates that depend on the query cannot be applied.") {
+        REQUIRE_THROWS((MANGROVE_KEY(Bar::arr).first_match() = 1).apply(b));
+    }
+}
+
+TEST_CASE("Update expression lists are grouped by operator.", "[mangrove::expression_list]") {
+    auto to_bson = [](const auto& expr) {
+        auto builder = bsoncxx::builder::core(false);
+        expr.append_to_bson(builder);
+        return builder.extract_document();
+    };
+
+    SECTION("Each operator appears once.") {
+        // The comma operator adds each expression to the front of the list.
+        auto doc = to_bson((MANGROVE_KEY(Bar::x1) = 1, MANGROVE_KEY(Bar::w) += 3,
+                            MANGROVE_KEY(Bar::z) = std::string("a")));
+
+        auto expected = bsoncxx::builder::core(false);
+        expected.key_view("$set");
+        expected.open_document();
+        expected.key_view("z");
+        expected.append(std::string("a"));
+        expected.key_view("x1");
+        expected.append(1);
+        expected.close_document();
+        expected.key_view("$inc");
+        expected.open_document();
+        expected.key_view("w");
+        expected.append(std::int64_t{3});
+        expected.close_document();
+        REQUIRE(doc.view() == expected.extract_document().view());
+    }
+
+    SECTION("Conflicting paths are rejected.") {
+        REQUIRE_THROWS(to_bson((MANGROVE_KEY(Bar::x1) = 1, MANGROVE_KEY(Bar::x1) += 2)));
+        REQUIRE_THROWS(
+            to_bson((MANGROVE_KEY(Bar::p) = Point{1, 2}, MANGROVE_CHILD(Bar, p, x) = 3)));
+        REQUIRE_NOTHROW(to_bson((MANGROVE_KEY(Bar::x1) = 1, MANGROVE_KEY(Bar::x2) = 2)));
+
+#define LONG_FIELD(name)                                                                  \
+    MANGROVE_CHILD(LongRoot,                                                              \
+                   embedded_document_with_a_name_long_enough_to_overflow_the_inline_path, \
+                   name##_field_of_a_class_with_names_long_enough_to_overflow_the_inline_path)
+        // Paths that are not stored inline are each compared in full.
+        REQUIRE_THROWS((LONG_FIELD(first) = 1, LONG_FIELD(second) = 2, LONG_FIELD(second) = 3));
+        REQUIRE_NOTHROW((LONG_FIELD(first) = 1, LONG_FIELD(second) = 2));
+#undef LONG_FIELD
+    }
+}
@@ -0,0 +1,141 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+
+#include <stdexcept>
+#include <string>
+
+#include <bsoncxx/builder/core.hpp>
+#include <bsoncxx/oid.hpp>
+#include <mongocxx/client.hpp>
+#include <mongocxx/instance.hpp>
+#include <mongocxx/stdx.hpp>
+
+#include <boson/mapping_functions.hpp>
+#include <mangrove/model.hpp>
+#include <mangrove/query_builder.hpp>
+#include <mangrove/ref.hpp>
+
+using namespace mangrove;
+
+class Owner : public model<Owner> {
+   public:
+    std::string name;
+
+    MANGROVE_MAKE_KEYS_MODEL(Owner, MANGROVE_NVP(name))
+
+    bsoncxx::oid getID() const {
+        return _id;
+    }
+};
+
+class Order : public model<Order> {
+   public:
+    ref<Owner> owner;
+    int total;
+
+    MANGROVE_MAKE_KEYS_MODEL(Order, MANGROVE_NVP(owner), MANGROVE_NVP(total))
+};
+
+TEST_CASE("ref fields are stored as the _id they refer to.", "[mangrove::ref]") {
+    bsoncxx::oid owner_id;
+
+    Order order;
+    order.owner = owner_id;
+    order.total = 5;
+
+    auto doc = boson::to_document(order);
+    REQUIRE(doc.view()["owner"].get_oid().value == owner_id);
+
+    auto loaded = boson::to_obj<Order>(doc.view());
+    REQUIRE(loaded.owner.id() == owner_id);
+    REQUIRE(!loaded.owner.resolved());
+    REQUIRE(loaded.total == 5);
+
+    auto builder = bsoncxx::builder::core(false);
+    (MANGROVE_KEY(Order::owner) == order.owner).append_to_bson(builder);
+    auto expected = bsoncxx::builder::core(false);
+    expected.key_view("owner").append(owner_id);
+    REQUIRE(builder.extract_document().view() == expected.extract_document().view());
+}
+
+TEST_CASE("ref fields are resolved lazily, or in batches by a prefetching cursor.",
+          "[mangrove::ref]") {
+    mongocxx::instance::current();
+    mongocxx::client conn{mongocxx::uri{}};
+    auto db = conn["mangrove_ref_test"];
+
+    Owner::setCollection(db["owners"]);
+    Order::setCollection(db["orders"]);
+    Owner::drop();
+    Order::drop();
+
+    Owner alice;
+    alice.name = "alice";
+    alice.save();
+    Owner bob;
+    bob.name = "bob";
+    bob.save();
+
+    for (int i = 0; i < 6; i++) {
+        Order order;
+        order.owner = i % 2 == 0 ? alice.getID() : bob.getID();
+        order.total = i;
+        order.save();
+    }
+    Order orphan;
+    orphan.owner = bsoncxx::oid{};
+    orphan.total = 6;
+    orphan.save();
+
+    SECTION("A ref looks up its object when it is first accessed.") {
+        auto order = Order::find_one(MANGROVE_KEY(Order::total) == 1);
+        REQUIRE(order);
+        REQUIRE(!order->owner.resolved());
+        REQUIRE(order->owner->name == "bob");
+        REQUIRE(order->owner.resolved());
+
+        auto orphaned = Order::find_one(MANGROVE_KEY(Order::total) == 6);
+        REQUIRE(orphaned);
+        REQUIRE_THROWS_AS(orphaned->owner.get(), std::logic_error);
+    }
+
+    SECTION("A prefetching cursor resolves the refs of each batch before yielding it.") {
+        auto cursor = Order::find({});
+        cursor.prefetch(MANGROVE_KEY(Order::owner)).prefetch_batch_size(4);
+
+        int count = 0;
+        for (Order order : cursor) {
+            REQUIRE(order.owner.resolved());
+            if (order.total == 6) {
+                REQUIRE_THROWS_AS(order.owner.get(), std::logic_error);
+            } else {
+                REQUIRE(order.owner->name == (order.total % 2 == 0 ? "alice" : "bob"));
+            }
+            count++;
+        }
+        REQUIRE(count == 7);
+    }
+
+    SECTION("prefetch() can be chained on the temporary cursor of a range-based for loop.") {
+        int count = 0;
+        for (Order order :
+             Order::find({}).prefetch(MANGROVE_KEY(Order::owner)).prefetch_batch_size(4)) {
+            REQUIRE(order.owner.resolved());
+            count++;
+        }
+        REQUIRE(count == 7);
+    }
+}
@@ -0,0 +1,62 @@
+// Copyright 2016 MongoDB Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+
+#include <string>
+
+#include <bsoncxx/builder/core.hpp>
+#include <mongocxx/stdx.hpp>
+
+#include <boson/mapping_functions.hpp>
+#include <mangrove/query_builder.hpp>
+#include <mangrove/scratch_builder.hpp>
+
+using namespace mangrove;
+
+class Task {
+   public:
+    int priority;
+    std::string owner;
+
+    MANGROVE_MAKE_KEYS(Task, MANGROVE_NVP(priority), MANGROVE_NVP(owner));
+};
+
+// Serializes an expression into a new builder, as its conversion to view_or_value does.
+template <typename Expr>
+bsoncxx::document::value serialize(const Expr& expr) {
+    auto builder = bsoncxx::builder::core(false);
+    expr.append_to_bson(builder);
+    return builder.extract_document();
+}
+
+TEST_CASE("Expressions can be serialized into reusable builders.", "[mangrove::scratch_builder]") {
+    SECTION("Test reusing a scratch builder.") {
+        scratch_builder builder;
+        REQUIRE(builder.serialize(MANGROVE_KEY(Task::priority) > 3) ==
+                serialize(MANGROVE_KEY(Task::priority) > 3));
+        REQUIRE(builder.serialize(MANGROVE_KEY(Task::owner) == "someone") ==
+                serialize(MANGROVE_KEY(Task::owner) == "someone"));
+    }
+
+    SECTION("Test the thread-local builders of a single request.") {
+        auto filter = serialize_filter(MANGROVE_KEY(Task::owner) == "");
+        auto update = serialize_update(MANGROVE_KEY(Task::owner) = std::string("worker"));
+        auto sort = serialize_sort(MANGROVE_KEY(Task::priority).sort(false));
+
+        REQUIRE(filter == serialize(MANGROVE_KEY(Task::owner) == ""));
+        REQUIRE(update == serialize(MANGROVE_KEY(Task::owner) = std::string("worker")));
+        REQUIRE(sort == serialize(MANGROVE_KEY(Task::priority).sort(false)));
+    }
+}